@@ -0,0 +1,106 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef ASYNCAUTODETECT_HPP
+#define ASYNCAUTODETECT_HPP
+
+#include <chrono>
+#include <optional>
+
+#include <async/asyncsocket.hpp>
+#include <proxy/sslautodetect.hpp>
+
+// Waits in worker's event loop for the first flight of accepted connection: tells TLS from plaintext and,
+// if asked, collects whole ClientHello so bypass and policy can be decided before any TLS work is done.
+class AsyncSslAutodetect : public AsyncSocket<SslAutodetect::result_t> {
+public:
+    using clock_t = SslAutodetect::Probe::clock_t;
+
+    // @tls_known: connection is TLS already (by port), only ClientHello is awaited
+    // @detect_timeout: wait for first bytes, then connection is plaintext
+    // @hello_timeout: wait for complete ClientHello once connection is TLS
+    AsyncSslAutodetect(baseHostCX* accepted, clock_t::duration detect_timeout, clock_t::duration hello_timeout,
+                       bool tls_known, bool want_hello):
+            AsyncSocket(accepted),
+            probe_(clock_t::now() + detect_timeout, clock_t::now() + hello_timeout, tls_known, want_hello)
+            {}
+
+    void start() {
+        // socket stays with accepted cx, we only watch it
+        tap(owner()->socket(), false);
+    }
+
+    task_state_t update() override {
+
+        switch(probe_.update(socket())) {
+            case SslAutodetect::Probe::watch_t::READ:
+                owner()->com()->set_monitor(socket());
+                return task_state_t::RUNNING;
+
+            case SslAutodetect::Probe::watch_t::IDLE:
+                // partial first flight: don't get woken up for the same bytes again, done() re-checks them
+                owner()->com()->unset_monitor(socket());
+                return task_state_t::RUNNING;
+
+            case SslAutodetect::Probe::watch_t::DONE:
+                break;
+        }
+
+        return task_state_t::FINISHED;
+    }
+
+    SslAutodetect::result_t const& yield() const override {
+        return probe_.result();
+    }
+
+    std::optional<sx::tls::HelloInfo>& hello() { return probe_.hello(); }
+
+    // decision is made, either by data, or by deadline. Called from every round of the acceptor.
+    bool done(clock_t::time_point now) {
+        if(not probe_.round(socket(), now)) return false;
+
+        untap();
+        return true;
+    }
+
+private:
+    SslAutodetect::Probe probe_;
+};
+
+#endif //ASYNCAUTODETECT_HPP
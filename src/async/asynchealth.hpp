@@ -0,0 +1,118 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef ASYNCHEALTH_HPP
+#define ASYNCHEALTH_HPP
+
+#include <async/asyncsocket.hpp>
+#include <policy/healthcheck.hpp>
+
+// one health probe of a routing backend, running in worker's event loop
+class AsyncHealthProbe : public AsyncSocket<HealthProbeIO::result_t> {
+public:
+    AsyncHealthProbe(baseHostCX* owner, std::shared_ptr<BackendHealth::Target> target):
+            AsyncSocket(owner),
+            target_(std::move(target)),
+            deadline_(time(nullptr) + BackendHealth::timeout)
+            {}
+
+    // returns false if probe could not be started (already reported as failed)
+    bool start() {
+        int fd = io_.start(target_->host, target_->port, target_->check == BackendHealth::mode_t::TLS);
+        if(fd < 0) {
+            finish(HealthProbeIO::result_t::FAILED);
+            return false;
+        }
+
+        // socket is closed by AsyncSocket
+        io_.release();
+        tap(fd);
+        owner()->com()->set_write_monitor(fd);
+        return true;
+    }
+
+    task_state_t update() override {
+        result_ = io_.step();
+
+        if(result_ == HealthProbeIO::result_t::RUNNING) {
+            if(io_.want_write())
+                owner()->com()->set_write_monitor(socket());
+            else
+                owner()->com()->set_monitor(socket());
+
+            return task_state_t::RUNNING;
+        }
+
+        finish(result_);
+        return task_state_t::FINISHED;
+    }
+
+    HealthProbeIO::result_t const& yield() const override {
+        return result_;
+    }
+
+    // called periodically by the owner; returns true when probe is done and can be deleted
+    bool expired(time_t now) {
+        if(reported_) return true;
+
+        if(now > deadline_ or state() == task_state_t::TIMEOUT or state() == task_state_t::ERROR) {
+            untap();
+            finish(HealthProbeIO::result_t::FAILED, "timeout");
+            return true;
+        }
+        return false;
+    }
+
+private:
+    void finish(HealthProbeIO::result_t r, const char* why = nullptr) {
+        if(reported_) return;
+        reported_ = true;
+
+        bool ok = r == HealthProbeIO::result_t::OK;
+        BackendHealth::get().report(*target_, ok, io_.elapsed_us(), why ? why : io_.error());
+    }
+
+    std::shared_ptr<BackendHealth::Target> target_;
+    time_t deadline_;
+    HealthProbeIO io_;
+    HealthProbeIO::result_t result_ = HealthProbeIO::result_t::RUNNING;
+    bool reported_ = false;
+};
+
+#endif //ASYNCHEALTH_HPP
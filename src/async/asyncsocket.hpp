@@ -99,8 +99,9 @@ public:
         untap();
     }
 
-    void tap(int fd) {
-        socket_.set(fd, this, owner_->com(), true);
+    // @owned: socket is closed on untap(); pass false to only watch a socket which belongs to someone else
+    void tap(int fd, bool owned = true) {
+        socket_.set(fd, this, owner_->com(), owned);
         socket_.opening();
 
         this->state(task_state_t::RUNNING);
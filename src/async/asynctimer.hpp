@@ -0,0 +1,100 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef ASYNCTIMER_HPP
+#define ASYNCTIMER_HPP
+
+#include <chrono>
+#include <cstdint>
+
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include <async/asyncsocket.hpp>
+
+// one-shot timer in owner's event loop, backed by timerfd: callback is called once armed time elapses.
+// Can be armed again after it fired.
+class AsyncTimer : public AsyncSocket<bool> {
+public:
+    explicit AsyncTimer(baseHostCX* owner, callback_t callback) : AsyncSocket(owner, std::move(callback)) {}
+
+    bool armed() const { return state() == task_state_t::RUNNING; }
+
+    // (re)arm timer to fire @after from now; false if timerfd can't be created
+    bool arm(std::chrono::milliseconds after) {
+
+        if(not armed()) {
+            int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if(fd < 0) return false;
+
+            // timer fd is ours, it's closed when timer fires
+            tap(fd);
+            fired_ = false;
+        }
+
+        itimerspec spec {};
+        spec.it_value.tv_sec = after.count() / 1000;
+        spec.it_value.tv_nsec = (after.count() % 1000) * 1'000'000L;
+        // zero would disarm it
+        if(spec.it_value.tv_sec == 0 and spec.it_value.tv_nsec == 0) spec.it_value.tv_nsec = 1;
+
+        ::timerfd_settime(socket(), 0, &spec, nullptr);
+        owner()->com()->set_monitor(socket());
+
+        return true;
+    }
+
+    task_state_t update() override {
+        uint64_t expirations = 0;
+        if(::read(socket(), &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            owner()->com()->set_monitor(socket());
+            return task_state_t::RUNNING;
+        }
+
+        fired_ = true;
+        return task_state_t::FINISHED;
+    }
+
+    bool const& yield() const override { return fired_; }
+
+private:
+    bool fired_ = false;
+};
+
+#endif //ASYNCTIMER_HPP
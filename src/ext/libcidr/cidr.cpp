@@ -9,6 +9,7 @@
 #include <cctype>
 
 #include <strings.h>
+#include <endian.h>
 #include <arpa/inet.h>
 
 #include <ext/libcidr/cidr.hpp>
@@ -2419,4 +2420,200 @@ namespace cidr {
         return (toret);
     }
 
-}
\ No newline at end of file
+
+/*
+ * Value-type prefix API
+ */
+
+    namespace {
+
+        Prefix::uint128_t load128 (uint8_t const* b) {
+            uint64_t hi, lo;
+            memcpy(&hi, b, 8);
+            memcpy(&lo, b + 8, 8);
+            return (Prefix::uint128_t(be64toh(hi)) << 64) | be64toh(lo);
+        }
+
+        void store128 (Prefix::uint128_t v, uint8_t* b) {
+            uint64_t hi = htobe64(static_cast<uint64_t>(v >> 64));
+            uint64_t lo = htobe64(static_cast<uint64_t>(v));
+            memcpy(b, &hi, 8);
+            memcpy(b + 8, &lo, 8);
+        }
+
+        /* count of leading one bits */
+        unsigned int clo128 (Prefix::uint128_t v) {
+            auto inv = ~v;
+            auto hi = static_cast<uint64_t>(inv >> 64);
+            auto lo = static_cast<uint64_t>(inv);
+
+            if (hi != 0) return static_cast<unsigned int>(__builtin_clzll(hi));
+            if (lo != 0) return 64 + static_cast<unsigned int>(__builtin_clzll(lo));
+            return 128;
+        }
+
+        constexpr Prefix::uint128_t v4_mapped = Prefix::uint128_t(0xffff) << 32;
+
+        char* format_u8 (char* p, unsigned int v) {
+            if (v >= 100) { *p++ = static_cast<char>('0' + v / 100); v %= 100; *p++ = static_cast<char>('0' + v / 10); v %= 10; }
+            else if (v >= 10) { *p++ = static_cast<char>('0' + v / 10); v %= 10; }
+            *p++ = static_cast<char>('0' + v);
+            return p;
+        }
+    }
+
+    Prefix
+    Prefix::from_bytes (int proto, uint8_t const* bytes, int len) {
+        Prefix ret;
+
+        if (bytes == nullptr)
+            return ret;
+
+        if (proto == CIDR_IPV4) {
+            if (len > 32) return ret;
+
+            uint32_t a = (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+            ret.addr = v4_mapped | a;
+            ret.pflen = static_cast<uint8_t>(96 + (len < 0 ? 32 : len));
+            ret.proto = CIDR_IPV4;
+        }
+        else if (proto == CIDR_IPV6) {
+            if (len > 128) return ret;
+
+            ret.addr = load128(bytes);
+            ret.pflen = static_cast<uint8_t>(len < 0 ? 128 : len);
+            ret.proto = CIDR_IPV6;
+        }
+
+        return ret;
+    }
+
+    Prefix
+    Prefix::from_sockaddr (sockaddr const* sa) {
+        if (sa == nullptr)
+            return {};
+
+        if (sa->sa_family == AF_INET) {
+            auto const* sin = reinterpret_cast<sockaddr_in const*>(sa);
+            return from_bytes(CIDR_IPV4, reinterpret_cast<uint8_t const*>(&sin->sin_addr));
+        }
+        else if (sa->sa_family == AF_INET6) {
+            auto const* sin6 = reinterpret_cast<sockaddr_in6 const*>(sa);
+            return from_bytes(CIDR_IPV6, sin6->sin6_addr.s6_addr);
+        }
+
+        return {};
+    }
+
+    Prefix
+    Prefix::from_cidr (CIDR const* c) {
+        Prefix ret;
+
+        if (c == nullptr)
+            return ret;
+
+        if (c->proto == CIDR_IPV4) {
+            /* only last 4 octets are significant, normalize the rest */
+            ret.addr = v4_mapped | (load128(c->addr) & 0xffffffff);
+            ret.pflen = static_cast<uint8_t>(clo128(load128(c->mask) | ~uint128_t(0xffffffff)));
+            ret.proto = CIDR_IPV4;
+        }
+        else if (c->proto == CIDR_IPV6) {
+            ret.addr = load128(c->addr);
+            ret.pflen = static_cast<uint8_t>(clo128(load128(c->mask)));
+            ret.proto = CIDR_IPV6;
+        }
+
+        return ret;
+    }
+
+    Prefix
+    Prefix::parse (std::string_view str) {
+
+        auto slash = str.find('/');
+        auto addr_part = str.substr(0, slash);
+
+        /* inet_pton wants zero-terminated string */
+        char buf[INET6_ADDRSTRLEN];
+        if (addr_part.empty() || addr_part.size() >= sizeof(buf))
+            return {};
+        memcpy(buf, addr_part.data(), addr_part.size());
+        buf[addr_part.size()] = '\0';
+
+        int len = -1;
+        if (slash != std::string_view::npos) {
+            auto len_part = str.substr(slash + 1);
+            if (len_part.empty() || len_part.size() > 3)
+                return {};
+
+            len = 0;
+            for (auto ch: len_part) {
+                if (ch < '0' || ch > '9')
+                    return {};
+                len = len * 10 + (ch - '0');
+            }
+        }
+
+        uint8_t bytes[16];
+        if (inet_pton(AF_INET, buf, bytes) == 1)
+            return from_bytes(CIDR_IPV4, bytes, len);
+        if (inet_pton(AF_INET6, buf, bytes) == 1)
+            return from_bytes(CIDR_IPV6, bytes, len);
+
+        return {};
+    }
+
+    void
+    Prefix::to_bytes (uint8_t out[16]) const {
+        store128(addr, out);
+    }
+
+    void
+    Prefix::to_cidr (CIDR& out) const {
+        memset(&out, 0, sizeof(CIDR));
+
+        if (!valid())
+            return;
+
+        store128(addr, out.addr);
+        store128(mask(), out.mask);
+        out.proto = proto;
+    }
+
+    std::size_t
+    Prefix::format (char* buf, std::size_t buf_len, int flags) const {
+
+        if (!valid() || buf == nullptr || buf_len < str_size)
+            return 0;
+
+        char* p = buf;
+
+        if (!(flags & CIDR_ONLYPFLEN)) {
+            if (proto == CIDR_IPV4) {
+                auto a = static_cast<uint32_t>(addr);
+                p = format_u8(p, (a >> 24) & 0xff); *p++ = '.';
+                p = format_u8(p, (a >> 16) & 0xff); *p++ = '.';
+                p = format_u8(p, (a >> 8) & 0xff);  *p++ = '.';
+                p = format_u8(p, a & 0xff);
+            }
+            else {
+                uint8_t bytes[16];
+                store128(addr, bytes);
+                if (inet_ntop(AF_INET6, bytes, p, INET6_ADDRSTRLEN) == nullptr)
+                    return 0;
+                p += strlen(p);
+            }
+        }
+
+        if (!(flags & CIDR_ONLYADDR)) {
+            if (!(flags & CIDR_ONLYPFLEN))
+                *p++ = '/';
+            p = format_u8(p, static_cast<unsigned int>(prefix_len()));
+        }
+
+        *p = '\0';
+        return static_cast<std::size_t>(p - buf);
+    }
+
+}
+
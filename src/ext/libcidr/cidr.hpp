@@ -125,5 +125,71 @@ namespace cidr {
 #ifdef __cplusplus
 }
 #endif 
-        
+
+
+#ifdef __cplusplus
+
+#include <cstddef>
+#include <string_view>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+/*
+ * Value-type prefix API (smithproxy extension).
+ *
+ * cidr::Prefix is trivially copyable and never touches heap - use it in per-connection code
+ * instead of cidr_from_str()/cidr_dup()/cidr_to_str(). Address is kept as 128-bit host-order
+ * integer in the same form as CIDR uses: IPv4 is v4-mapped (::ffff:a.b.c.d) and its prefix
+ * length is counted in 128-bit space (IPv4 /24 is stored as 120).
+ */
+namespace cidr {
+
+    struct Prefix {
+        using uint128_t = unsigned __int128;
+
+        uint128_t addr = 0;
+        uint8_t pflen = 0;
+        int proto = CIDR_NOPROTO;
+
+        /* longest string produced by format(), including terminating zero */
+        constexpr static std::size_t str_size = INET6_ADDRSTRLEN + 5;
+
+        bool valid() const { return proto == CIDR_IPV4 || proto == CIDR_IPV6; }
+        int prefix_len() const { return proto == CIDR_IPV4 ? pflen - 96 : pflen; }
+
+        static uint128_t mask_of(unsigned int len) {
+            uint128_t const full = ~uint128_t(0);
+            return len == 0 ? 0 : full << (128 - len);
+        }
+        uint128_t mask() const { return mask_of(pflen); }
+
+        /* true if @little is the same or more specific prefix inside of this one */
+        bool contains(Prefix const& little) const {
+            return (proto == little.proto) & valid() & (little.pflen >= pflen) & (((addr ^ little.addr) & mask()) == 0);
+        }
+
+        bool operator==(Prefix const& r) const { return proto == r.proto && pflen == r.pflen && addr == r.addr; }
+        bool operator!=(Prefix const& r) const { return !(*this == r); }
+
+        /* @bytes are in network order: 4 for CIDR_IPV4, 16 for CIDR_IPV6. Negative @len means host prefix. */
+        static Prefix from_bytes(int proto, uint8_t const* bytes, int len = -1);
+        static Prefix from_sockaddr(sockaddr const* sa);
+        static Prefix from_cidr(CIDR const* c);
+
+        /* "192.168.1.0/24", "10.0.0.1", "2001:db8::/32" - invalid prefix is returned on error */
+        static Prefix parse(std::string_view str);
+
+        void to_bytes(uint8_t out[16]) const;
+        void to_cidr(CIDR& out) const;
+
+        /*
+         * Write textual form into @buf, honoring CIDR_ONLYADDR and CIDR_ONLYPFLEN.
+         * Returns length of the string, or 0 if prefix is invalid or @buf is too short.
+         */
+        std::size_t format(char* buf, std::size_t buf_len, int flags = CIDR_NOFLAGS) const;
+    };
+}
+
+#endif
+
 #endif /* __LIBCIDR_H */
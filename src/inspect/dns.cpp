@@ -40,6 +40,7 @@
 #include <arpa/inet.h>
 #include <openssl/rand.h>
 #include <unistd.h>
+#include <algorithm>
 
 #include <epoll.hpp>
 #include <socketinfo.hpp>
@@ -712,10 +713,165 @@ std::vector<std::unique_ptr<CidrAddress>> DNS_Packet::get_a_anwsers() const {
 
     for(auto const& x: answers_list_) {
         if(x.type_ == A || x.type_ == AAAA) {
-            ret.emplace_back(std::make_unique<CidrAddress>(x.cidr()));
+            ret.emplace_back(std::make_unique<CidrAddress>(x.prefix()));
         }
     }
 
     return ret;
 }
 
+
+
+std::optional<DNS_ReverseIndex::Key> DNS_ReverseIndex::Key::from_answer(DNS_Answer const& a) {
+    Key k;
+    if(a.type_ == A && a.data_.size() == 4) {
+        k.family = CIDR_IPV4;
+        memcpy(k.addr.data(), a.data_.data(), 4);
+        return k;
+    }
+    else if(a.type_ == AAAA && a.data_.size() == 16) {
+        k.family = CIDR_IPV6;
+        memcpy(k.addr.data(), a.data_.data(), 16);
+        return k;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<DNS_ReverseIndex::Key> DNS_ReverseIndex::Key::from_cidr(cidr::CIDR const* c) {
+    if(not c) return std::nullopt;
+
+    Key k;
+    if(c->proto == CIDR_IPV4) {
+        // libcidr keeps IPv4 address in the last 4 bytes
+        k.family = CIDR_IPV4;
+        memcpy(k.addr.data(), &c->addr[12], 4);
+        return k;
+    }
+    else if(c->proto == CIDR_IPV6) {
+        k.family = CIDR_IPV6;
+        memcpy(k.addr.data(), c->addr, 16);
+        return k;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<DNS_ReverseIndex::Key> DNS_ReverseIndex::Key::from_str(std::string const& ip) {
+    Key k;
+    if(inet_pton(AF_INET, ip.c_str(), k.addr.data()) == 1) {
+        k.family = CIDR_IPV4;
+        return k;
+    }
+    else if(inet_pton(AF_INET6, ip.c_str(), k.addr.data()) == 1) {
+        k.family = CIDR_IPV6;
+        return k;
+    }
+
+    return std::nullopt;
+}
+
+void DNS_ReverseIndex::unlink(std::string const& question) {
+
+    auto it = by_question_.find(question);
+    if(it == by_question_.end()) return;
+
+    auto name = std::string_view(it->first).substr(it->first.find(':') + 1);
+    auto id = fqdn_id(name);
+
+    for(auto const& key: it->second) {
+        if(auto ip = by_ip_.find(key); ip != by_ip_.end()) {
+            auto& refs = ip->second;
+            refs.erase(std::remove_if(refs.begin(), refs.end(), [&](auto const& r) { return r.id == id and r.name == name; }), refs.end());
+
+            if(refs.empty()) by_ip_.erase(ip);
+        }
+    }
+    by_question_.erase(it);
+}
+
+void DNS_ReverseIndex::update(std::string const& question, DNS_Response const& response) {
+
+    auto colon = question.find(':');
+    if(colon == std::string::npos) return;
+
+    auto id = fqdn_id(std::string_view(question).substr(colon + 1));
+
+    // expire together with the cache entry - cleanup uses the first answer TTL too
+    time_t expires_at = response.answers().empty() ? response.loaded_at
+                                                   : response.loaded_at + response.answers().front().ttl_;
+
+    std::vector<Key> keys;
+    for(auto const& a: response.answers()) {
+        if(auto k = Key::from_answer(a); k) keys.push_back(k.value());
+    }
+
+    auto l_ = std::unique_lock(lock_);
+
+    unlink(question);
+
+    if(not keys.empty()) {
+        auto qit = by_question_.emplace(question, std::move(keys)).first;
+        auto name = std::string_view(qit->first).substr(colon + 1);
+
+        for(auto const& key: qit->second) {
+            auto& refs = by_ip_[key];
+            if(auto r = std::find_if(refs.begin(), refs.end(), [&](auto const& x) { return x.id == id and x.name == name; }); r != refs.end()) {
+                r->expires_at = expires_at;
+            }
+            else {
+                refs.push_back({ id, expires_at, std::string(name) });
+            }
+        }
+    }
+}
+
+void DNS_ReverseIndex::remove(std::string const& question) {
+
+    auto l_ = std::unique_lock(lock_);
+    unlink(question);
+}
+
+void DNS_ReverseIndex::clear() {
+    auto l_ = std::unique_lock(lock_);
+    by_ip_.clear();
+    by_question_.clear();
+}
+
+bool DNS_ReverseIndex::contains(Key const& ip, fqdn_id_t id, std::string_view fqdn) const {
+
+    auto l_ = std::shared_lock(lock_);
+
+    auto it = by_ip_.find(ip);
+    if(it == by_ip_.end()) return false;
+
+    auto now = ::time(nullptr);
+    return std::any_of(it->second.begin(), it->second.end(), [&](auto const& r) {
+        return r.id == id and r.expires_at >= now and r.name == fqdn;
+    });
+}
+
+bool DNS_ReverseIndex::contains(cidr::CIDR const* ip, fqdn_id_t id, std::string_view fqdn) const {
+    auto k = Key::from_cidr(ip);
+    return k and contains(k.value(), id, fqdn);
+}
+
+std::size_t DNS_ReverseIndex::size() const {
+    auto l_ = std::shared_lock(lock_);
+    return by_ip_.size();
+}
+
+std::string DNS_ReverseIndex::to_string(int verbosity) const {
+    auto l_ = std::shared_lock(lock_);
+
+    std::stringstream ss;
+    ss << "DNS reverse index: " << by_ip_.size() << " addresses, " << by_question_.size() << " questions";
+
+    if(verbosity > INF) {
+        for(auto const& [question, keys]: by_question_) {
+            ss << "\n    " << question << ": " << keys.size() << " addresses";
+        }
+    }
+
+    return ss.str();
+}
@@ -43,9 +43,14 @@
 #include <string>
 #include <vector>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <array>
 #include <unordered_map>
 #include <optional>
+#include <string_view>
 #include <ctime>
+#include <algorithm>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -176,6 +181,17 @@ struct DNS_Answer {
         return ret;
     }
     
+    cidr::Prefix prefix() const {
+        if(type_ == A && data_.size() == 4) {
+            return cidr::Prefix::from_bytes(CIDR_IPV4, data_.data());
+        }
+        else if (type_ == AAAA && data_.size() == 16) {
+            return cidr::Prefix::from_bytes(CIDR_IPV6, data_.data());
+        }
+
+        return {};
+    }
+
     cidr::CIDR* cidr() const {
         if(type_ == A && data_.size() == 4) {
             uint32_t ip = data_.get_at<uint32_t>(0);
@@ -271,6 +287,7 @@ public:
 
     inline std::vector<DNS_Question>& questions() { return questions_list_; };
     inline std::vector<DNS_Answer>& answers() { return answers_list_; };
+    inline std::vector<DNS_Answer> const& answers() const { return answers_list_; };
     inline std::vector<DNS_Answer>& authorities() { return authorities_list_; };
     inline std::vector<DNS_Answer>& additionals() { return additionals_list_; };
     
@@ -325,6 +342,97 @@ private:
 };
 
 
+/// @brief reverse index of cached A/AAAA answers: address -> set of FQDNs resolving to it.
+/// FqdnAddress matching is then a single hash probe, instead of cache lookup and answers walk.
+/// Index is kept in sync with DNS cache by its writers (DNS_Inspector::store incl. LRU evictions, cache cleanup, diag).
+class DNS_ReverseIndex {
+
+public:
+    using fqdn_id_t = uint64_t;
+
+    struct Key {
+        uint8_t family = 0;
+        std::array<uint8_t, 16> addr {};
+
+        bool operator==(Key const& r) const { return family == r.family and addr == r.addr; }
+
+        static std::optional<Key> from_answer(DNS_Answer const& a);
+        static std::optional<Key> from_cidr(cidr::CIDR const* c);
+        static std::optional<Key> from_str(std::string const& ip);
+    };
+
+    struct KeyHash {
+        std::size_t operator()(Key const& k) const noexcept {
+            uint64_t h = 14695981039346656037ULL ^ k.family;
+            for(auto b: k.addr) { h ^= b; h *= 1099511628211ULL; }
+            return h;
+        }
+    };
+
+    // FQDNs are not interned, they are identified by the hash of their name. Hash is used only to skip
+    // non-matching names quickly, hits are verified against the name itself.
+    static fqdn_id_t fqdn_id(std::string_view fqdn) {
+        uint64_t h = 14695981039346656037ULL;
+        for(auto c: fqdn) { h ^= static_cast<uint8_t>(c); h *= 1099511628211ULL; }
+        return h;
+    }
+
+    // index answers of the response cached under @question ("A:fqdn" or "AAAA:fqdn"),
+    // replacing addresses indexed for the same question before
+    void update(std::string const& question, DNS_Response const& response);
+    void remove(std::string const& question);
+    void clear();
+
+    // remove questions for which @keep(std::string const& question) returns false
+    template <typename Fn>
+    std::size_t prune(Fn&& keep) {
+        auto l_ = std::unique_lock(lock_);
+
+        std::vector<std::string> gone;
+        for(auto const& [ question, keys ]: by_question_) {
+            if(not keep(question)) gone.push_back(question);
+        }
+        for(auto const& question: gone) unlink(question);
+
+        return gone.size();
+    }
+
+    // true if non-expired @fqdn (with @id == fqdn_id(fqdn)) resolves to @ip
+    bool contains(Key const& ip, fqdn_id_t id, std::string_view fqdn) const;
+    bool contains(cidr::CIDR const* ip, fqdn_id_t id, std::string_view fqdn) const;
+
+    // call @fn(std::string_view fqdn) for each non-expired name resolving to @ip, until it returns true
+    template <typename Fn>
+    bool any_name(Key const& ip, Fn&& fn) const {
+        auto l_ = std::shared_lock(lock_);
+
+        auto it = by_ip_.find(ip);
+        if(it == by_ip_.end()) return false;
+
+        auto now = ::time(nullptr);
+        return std::any_of(it->second.begin(), it->second.end(), [&](auto const& r) {
+            return r.expires_at >= now and fn(r.name);
+        });
+    }
+
+    std::size_t size() const;
+    std::string to_string(int verbosity) const;
+
+private:
+    struct Ref {
+        fqdn_id_t id = 0;
+        time_t expires_at = 0;
+        std::string name;       // own copy, question keys are replaced by updates
+    };
+
+    void unlink(std::string const& question);
+
+    mutable std::shared_mutex lock_;
+    std::unordered_map<Key, std::vector<Ref>, KeyHash> by_ip_;
+    std::unordered_map<std::string, std::vector<Key>> by_question_;
+};
+
+
 class DNS {
 
 public:
@@ -339,6 +447,7 @@ private:
 
     dns_cache_t dns_cache_;
     domain_cache_t domain_cache_;
+    DNS_ReverseIndex reverse_index_;
 
 
     DNS() :
@@ -350,6 +459,7 @@ public:
 
     inline dns_cache_t& dns_cache() { return dns_cache_; };
     inline domain_cache_t& domain_cache() { return domain_cache_; };
+    inline DNS_ReverseIndex& reverse_index() { return reverse_index_; };
 
     inline auto& dns_lock() { return dns_cache().getlock(); };
     inline auto& domain_lock() { return domain_cache().getlock(); };
@@ -357,6 +467,7 @@ public:
 
     static dns_cache_t& get_dns_cache() { return get().dns_cache(); };
     static domain_cache_t& get_domain_cache() { return get().domain_cache(); };
+    static DNS_ReverseIndex& get_reverse_index() { return get().reverse_index(); };
 
     static auto& get_dns_lock() { return get().dns_lock(); };
     static auto& get_domain_lock() { return get().domain_lock(); };
@@ -297,7 +297,21 @@ bool DNS_Inspector::store(std::shared_ptr<DNS_Response> ptr) {
 
         {
             auto lc_ = std::scoped_lock(DNS::get_dns_lock());
-            DNS::get_dns_cache().set(question, ptr);
+            auto& cache = DNS::get_dns_cache();
+
+            // full cache drops least recently used response on insert - don't keep it in the index
+            bool evicts = cache.cache().size() >= static_cast<size_t>(cache.max_size())
+                          and cache.cache().find(question) == cache.cache().end();
+
+            cache.set(question, ptr);
+            DNS::get_reverse_index().update(question, *ptr);
+
+            if(evicts) {
+                auto pruned = DNS::get_reverse_index().prune([&cache](std::string const& q) {
+                    return cache.cache().find(q) != cache.cache().end();
+                });
+                _deb("DNS_Inspector::store: %d evicted questions removed from reverse index", pruned);
+            }
         }
         _dia("DNS_Inspector::update: %s added to cache (%d elements of max %d)", ptr->question_str_0().c_str(),
              DNS::get_dns_cache().cache().size(), DNS::get_dns_cache().max_size());
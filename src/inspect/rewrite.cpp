@@ -0,0 +1,807 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <optional>
+#include <stdexcept>
+
+#include <inspect/rewrite.hpp>
+
+namespace sx::rewrite {
+
+    namespace {
+
+        // pattern uses something DFA can't do, rule goes to std::regex
+        struct unsupported : public std::runtime_error {
+            using std::runtime_error::runtime_error;
+        };
+
+        using byteset = std::bitset<256>;
+
+        struct Node {
+            enum kind_t { SET, CAT, ALT, REP } kind = CAT;
+            byteset set;
+            std::vector<Node> sub;
+            int min = 0;
+            int max = 0;    // -1 is unbounded
+
+            static Node of(byteset const& s) { Node n; n.kind = SET; n.set = s; return n; }
+        };
+
+        byteset range(unsigned char from, unsigned char to) {
+            byteset ret;
+            for(unsigned int c = from; c <= to; ++c) ret.set(c);
+            return ret;
+        }
+
+        class Parser {
+        public:
+            explicit Parser(std::string_view re) : re_(re) {}
+
+            Node parse() {
+                auto n = alt();
+                if(pos_ != re_.size()) throw unsupported("unbalanced ')'");
+                return n;
+            }
+
+        private:
+            constexpr static int max_count = 1000;
+
+            bool at_end() const { return pos_ >= re_.size(); }
+            char peek() const { return re_[pos_]; }
+            bool eat(char c) {
+                if(not at_end() and re_[pos_] == c) { ++pos_; return true; }
+                return false;
+            }
+
+            Node alt() {
+                auto first = cat();
+                if(at_end() or peek() != '|') return first;
+
+                Node n;
+                n.kind = Node::ALT;
+                n.sub.emplace_back(std::move(first));
+                while(eat('|')) n.sub.emplace_back(cat());
+                return n;
+            }
+
+            Node cat() {
+                Node n;
+                while(not at_end() and peek() != '|' and peek() != ')') n.sub.emplace_back(repeat());
+                return n;
+            }
+
+            Node repeat() {
+                auto a = atom();
+                while(not at_end()) {
+                    int min = 0;
+                    int max = -1;
+                    switch(peek()) {
+                        case '*': ++pos_; break;
+                        case '+': ++pos_; min = 1; break;
+                        case '?': ++pos_; max = 1; break;
+                        case '{': braces(min, max); break;
+                        default:
+                            return a;
+                    }
+                    if(eat('?')) throw unsupported("lazy quantifier");
+
+                    Node r;
+                    r.kind = Node::REP;
+                    r.min = min;
+                    r.max = max;
+                    r.sub.emplace_back(std::move(a));
+                    a = std::move(r);
+                }
+                return a;
+            }
+
+            int number() {
+                int n = 0;
+                auto start = pos_;
+                while(not at_end() and peek() >= '0' and peek() <= '9') {
+                    n = n * 10 + (re_[pos_++] - '0');
+                    if(n > max_count) throw unsupported("repetition count too large");
+                }
+                if(start == pos_) throw unsupported("invalid repetition");
+                return n;
+            }
+
+            void braces(int& min, int& max) {
+                ++pos_;
+                min = number();
+                max = min;
+                if(eat(',')) {
+                    max = (not at_end() and peek() == '}') ? -1 : number();
+                }
+                if(not eat('}') or (max >= 0 and max < min)) throw unsupported("invalid repetition");
+            }
+
+            Node atom() {
+                auto c = static_cast<unsigned char>(re_[pos_++]);
+                switch(c) {
+                    case '(': {
+                        if(eat('?') and not eat(':')) throw unsupported("lookaround");
+                        auto n = alt();
+                        if(not eat(')')) throw unsupported("unbalanced '('");
+                        return n;
+                    }
+                    case '[':
+                        return Node::of(klass());
+                    case '.':
+                        return Node::of(~(byteset().set('\n').set('\r')));
+                    case '\\': {
+                        auto e = escape(false);
+                        return Node::of(e);
+                    }
+                    case '^':
+                    case '$':
+                        throw unsupported("anchor");
+                    case '*':
+                    case '+':
+                    case '?':
+                    case '{':
+                        throw unsupported("nothing to repeat");
+                    default:
+                        return Node::of(byteset().set(c));
+                }
+            }
+
+            byteset escape(bool in_class) {
+                if(at_end()) throw unsupported("trailing backslash");
+
+                auto c = static_cast<unsigned char>(re_[pos_++]);
+                auto const digit = range('0', '9');
+                auto const word = range('a', 'z') | range('A', 'Z') | digit | byteset().set('_');
+                auto const space = byteset().set(' ').set('\t').set('\n').set('\r').set('\f').set('\v');
+
+                switch(c) {
+                    case 'd': return digit;
+                    case 'D': return ~digit;
+                    case 'w': return word;
+                    case 'W': return ~word;
+                    case 's': return space;
+                    case 'S': return ~space;
+                    case 'n': return byteset().set('\n');
+                    case 'r': return byteset().set('\r');
+                    case 't': return byteset().set('\t');
+                    case 'f': return byteset().set('\f');
+                    case 'v': return byteset().set('\v');
+                    case '0': return byteset().set(0);
+                    case 'x': {
+                        if(pos_ + 2 > re_.size()) throw unsupported("invalid \\x escape");
+                        auto hex = std::string(re_.substr(pos_, 2));
+                        if(not std::isxdigit(hex[0]) or not std::isxdigit(hex[1])) throw unsupported("invalid \\x escape");
+                        pos_ += 2;
+                        return byteset().set(std::stoul(hex, nullptr, 16));
+                    }
+                    case 'b':
+                        if(in_class) return byteset().set('\b');
+                        throw unsupported("word boundary");
+                    case 'B':
+                    case 'c':
+                    case 'u':
+                    case 'k':
+                        throw unsupported("escape not supported");
+                    default:
+                        if(c >= '1' and c <= '9') throw unsupported("backreference");
+                        return byteset().set(c);
+                }
+            }
+
+            byteset klass() {
+                byteset ret;
+                bool const negate = eat('^');
+
+                // single character of the class, -1 if it was a class escape like \d
+                auto item = [this](byteset& set) -> int {
+                    if(at_end()) throw unsupported("unterminated class");
+                    auto c = static_cast<unsigned char>(re_[pos_++]);
+                    if(c != '\\') {
+                        set = byteset().set(c);
+                        return c;
+                    }
+                    set = escape(true);
+                    if(set.count() != 1) return -1;
+                    for(int b = 0; b < 256; ++b) {
+                        if(set.test(static_cast<std::size_t>(b))) return b;
+                    }
+                    return -1;
+                };
+
+                while(true) {
+                    if(at_end()) throw unsupported("unterminated class");
+                    if(eat(']')) break;
+
+                    byteset first;
+                    auto lo = item(first);
+
+                    if(lo >= 0 and pos_ + 1 < re_.size() and peek() == '-' and re_[pos_ + 1] != ']') {
+                        ++pos_;
+                        byteset second;
+                        auto hi = item(second);
+                        if(hi < 0 or hi < lo) throw unsupported("invalid class range");
+                        ret |= range(static_cast<unsigned char>(lo), static_cast<unsigned char>(hi));
+                    } else {
+                        ret |= first;
+                    }
+                }
+
+                return negate ? ~ret : ret;
+            }
+
+            std::string_view re_;
+            std::size_t pos_ = 0;
+        };
+
+
+        struct NState {
+            enum op_t : uint8_t { CHAR, SPLIT, EPS, MATCH } op = EPS;
+            int out = -1;
+            int out1 = -1;
+            int rule = -1;
+            byteset set;
+        };
+
+        struct Nfa {
+            std::vector<NState> states;
+            std::vector<int> start;     // per rule, -1 if rule is not compiled to DFA
+
+            struct Frag {
+                int start;
+                std::vector<std::pair<int, int>> outs;     // dangling (state, which out)
+            };
+
+            int add(NState s) {
+                if(states.size() >= limit) throw unsupported("pattern too large");
+                states.emplace_back(std::move(s));
+                return static_cast<int>(states.size() - 1);
+            }
+
+            void patch(std::vector<std::pair<int, int>> const& outs, int to) {
+                for(auto const& [s, which]: outs) {
+                    (which == 0 ? states[s].out : states[s].out1) = to;
+                }
+            }
+
+            Frag empty() {
+                auto s = add(NState{});
+                return { s, { { s, 0 } } };
+            }
+
+            Frag build(Node const& n) {
+                switch(n.kind) {
+                    case Node::SET: {
+                        NState st;
+                        st.op = NState::CHAR;
+                        st.set = n.set;
+                        auto s = add(std::move(st));
+                        return { s, { { s, 0 } } };
+                    }
+                    case Node::CAT: {
+                        if(n.sub.empty()) return empty();
+                        auto f = build(n.sub[0]);
+                        for(std::size_t i = 1; i < n.sub.size(); ++i) {
+                            auto next = build(n.sub[i]);
+                            patch(f.outs, next.start);
+                            f.outs = std::move(next.outs);
+                        }
+                        return f;
+                    }
+                    case Node::ALT: {
+                        auto f = build(n.sub[0]);
+                        for(std::size_t i = 1; i < n.sub.size(); ++i) {
+                            auto other = build(n.sub[i]);
+                            NState split;
+                            split.op = NState::SPLIT;
+                            split.out = f.start;
+                            split.out1 = other.start;
+                            auto s = add(split);
+                            f.start = s;
+                            f.outs.insert(f.outs.end(), other.outs.begin(), other.outs.end());
+                        }
+                        return f;
+                    }
+                    case Node::REP: {
+                        auto f = empty();
+                        auto append = [&](Frag next) {
+                            patch(f.outs, next.start);
+                            f.outs = std::move(next.outs);
+                        };
+                        for(int i = 0; i < n.min; ++i) append(build(n.sub[0]));
+
+                        if(n.max < 0) {
+                            auto body = build(n.sub[0]);
+                            NState split;
+                            split.op = NState::SPLIT;
+                            split.out = body.start;
+                            auto s = add(split);
+                            patch(body.outs, s);
+                            append({ s, { { s, 1 } } });
+                        } else {
+                            for(int i = n.min; i < n.max; ++i) {
+                                auto body = build(n.sub[0]);
+                                NState split;
+                                split.op = NState::SPLIT;
+                                split.out = body.start;
+                                auto s = add(split);
+                                body.outs.emplace_back(s, 1);
+                                append({ s, std::move(body.outs) });
+                            }
+                        }
+                        return f;
+                    }
+                }
+                return empty();
+            }
+
+            void add_rule(Node const& n, int rule) {
+                auto const rollback = states.size();
+                limit = states.size() + Ruleset::max_rule_states;
+                try {
+                    auto f = build(n);
+                    NState m;
+                    m.op = NState::MATCH;
+                    m.rule = rule;
+                    patch(f.outs, add(m));
+                    start.resize(std::max(start.size(), static_cast<std::size_t>(rule + 1)), -1);
+                    start[rule] = f.start;
+                }
+                catch(unsupported const&) {
+                    states.resize(rollback);
+                    throw;
+                }
+            }
+
+            // sorted CHAR and MATCH states reachable from @seeds without consuming input
+            std::vector<int> closure(std::vector<int> const& seeds) const {
+                std::vector<int> ret;
+                std::vector<int> stack(seeds.begin(), seeds.end());
+                seen.assign(states.size(), false);
+
+                while(not stack.empty()) {
+                    auto s = stack.back();
+                    stack.pop_back();
+                    if(s < 0 or seen[s]) continue;
+                    seen[s] = true;
+
+                    auto const& st = states[s];
+                    switch(st.op) {
+                        case NState::CHAR:
+                        case NState::MATCH:
+                            ret.push_back(s);
+                            break;
+                        case NState::SPLIT:
+                            stack.push_back(st.out1);
+                            stack.push_back(st.out);
+                            break;
+                        case NState::EPS:
+                            stack.push_back(st.out);
+                            break;
+                    }
+                }
+                std::sort(ret.begin(), ret.end());
+                return ret;
+            }
+
+            bool nullable(int rule) const {
+                auto c = closure({ start[rule] });
+                return std::any_of(c.begin(), c.end(), [this](int s) { return states[s].op == NState::MATCH; });
+            }
+
+            std::size_t limit = 0;
+            mutable std::vector<bool> seen;
+        };
+
+
+        std::optional<Ruleset::Dfa> build_dfa(Nfa const& nfa, std::vector<std::size_t> const& group) {
+
+            std::vector<int> seeds;
+            for(auto r: group) seeds.push_back(nfa.start[r]);
+
+            // byte classes: bytes which no CHAR state of the group tells apart share a class
+            Ruleset::Dfa dfa;
+            {
+                std::vector<bool> visited(nfa.states.size(), false);
+                std::vector<int> stack(seeds);
+                std::size_t classes = 1;
+
+                while(not stack.empty()) {
+                    auto s = stack.back();
+                    stack.pop_back();
+                    if(s < 0 or visited[s]) continue;
+                    visited[s] = true;
+
+                    auto const& st = nfa.states[s];
+                    stack.push_back(st.out);
+                    stack.push_back(st.out1);
+                    if(st.op != NState::CHAR) continue;
+
+                    std::map<std::pair<uint16_t, bool>, uint16_t> split;
+                    for(unsigned int b = 0; b < 256; ++b) {
+                        auto key = std::make_pair(dfa.byte_class[b], st.set.test(b));
+                        auto it = split.find(key);
+                        if(it == split.end()) it = split.emplace(key, static_cast<uint16_t>(split.size())).first;
+                        dfa.byte_class[b] = it->second;
+                    }
+                    classes = split.size();
+                }
+                dfa.classes = classes;
+            }
+
+            std::array<int, 256> representative {};
+            representative.fill(-1);
+            for(unsigned int b = 0; b < 256; ++b) {
+                if(representative[dfa.byte_class[b]] < 0) representative[dfa.byte_class[b]] = static_cast<int>(b);
+            }
+
+            std::map<std::vector<int>, int32_t> ids;
+            std::vector<std::vector<int>> sets;
+
+            auto state_of = [&](std::vector<int> set) -> int32_t {
+                auto it = ids.find(set);
+                if(it != ids.end()) return it->second;
+
+                auto id = static_cast<int32_t>(sets.size());
+                ids.emplace(set, id);
+
+                int32_t acc = -1;
+                for(auto s: set) {
+                    if(nfa.states[s].op == NState::MATCH and (acc < 0 or nfa.states[s].rule < acc)) acc = nfa.states[s].rule;
+                }
+                dfa.accept.push_back(acc);
+                dfa.next.resize(dfa.next.size() + dfa.classes, 0);
+                sets.emplace_back(std::move(set));
+                return id;
+            };
+
+            state_of({});                   // dead
+            dfa.start = state_of(nfa.closure(seeds));
+
+            for(std::size_t i = 1; i < sets.size(); ++i) {
+                for(std::size_t c = 0; c < dfa.classes; ++c) {
+                    auto const b = static_cast<std::size_t>(representative[c]);
+
+                    std::vector<int> moved;
+                    for(auto s: sets[i]) {
+                        auto const& st = nfa.states[s];
+                        if(st.op == NState::CHAR and st.set.test(b)) moved.push_back(st.out);
+                    }
+
+                    auto to = moved.empty() ? 0 : state_of(nfa.closure(moved));
+                    if(sets.size() > Ruleset::max_states) return std::nullopt;
+
+                    dfa.next[i * dfa.classes + c] = to;
+                }
+            }
+
+            return dfa;
+        }
+
+        // $1 and similar need capture groups
+        bool uses_groups(std::string const& replace) {
+            for(std::size_t i = 0; i + 1 < replace.size(); ++i) {
+                if(replace[i] != '$') continue;
+                auto n = replace[i + 1];
+                if((n >= '0' and n <= '9') or n == '`' or n == '\'') return true;
+                ++i;
+            }
+            return false;
+        }
+    }
+
+
+    Ruleset::Ruleset(std::vector<Rule> rules) : rules_(std::move(rules)) {
+
+        nth_slot_.assign(rules_.size(), -1);
+
+        Nfa nfa;
+        std::vector<std::size_t> dfa_rules;
+
+        auto add_fallback = [this](std::size_t i) {
+            try {
+                fallback_.push_back({ i, std::regex(rules_[i].match) });
+            }
+            catch(std::regex_error const& e) {
+                errors_.push_back("#" + std::to_string(i) + ": " + e.what());
+            }
+        };
+
+        for(std::size_t i = 0; i < rules_.size(); ++i) {
+            auto const& rule = rules_[i];
+
+            if(rule.replace_each_nth > 0) nth_slot_[i] = static_cast<int>(nth_slots_++);
+
+            if(rule.match.empty()) {
+                errors_.push_back("#" + std::to_string(i) + ": empty pattern");
+                continue;
+            }
+
+            if(uses_groups(rule.replace)) {
+                add_fallback(i);
+                continue;
+            }
+
+            try {
+                nfa.add_rule(Parser(rule.match).parse(), static_cast<int>(i));
+
+                if(nfa.nullable(static_cast<int>(i))) {
+                    errors_.push_back("#" + std::to_string(i) + ": pattern matches empty string");
+                    continue;
+                }
+                dfa_rules.push_back(i);
+            }
+            catch(unsupported const&) {
+                add_fallback(i);
+            }
+        }
+
+        // one DFA for all, unless it grows too big - then halves are tried
+        std::function<void(std::vector<std::size_t> const&)> add_group = [&](std::vector<std::size_t> const& group) {
+            if(group.empty()) return;
+
+            if(auto dfa = build_dfa(nfa, group); dfa) {
+                dfas_.emplace_back(std::move(dfa.value()));
+                return;
+            }
+            if(group.size() == 1) {
+                add_fallback(group[0]);
+                return;
+            }
+            auto half = group.begin() + static_cast<std::ptrdiff_t>(group.size() / 2);
+            add_group({ group.begin(), half });
+            add_group({ half, group.end() });
+        };
+        add_group(dfa_rules);
+
+        std::sort(fallback_.begin(), fallback_.end(), [](auto const& a, auto const& b) { return a.rule < b.rule; });
+
+        for(auto const& dfa: dfas_) {
+            for(unsigned int b = 0; b < 256; ++b) {
+                if(dfa.next[static_cast<std::size_t>(dfa.start) * dfa.classes + dfa.byte_class[b]] != 0) first_[b] = true;
+            }
+        }
+        if(std::count(first_.begin(), first_.end(), true) == 1) {
+            single_first_ = static_cast<int>(std::find(first_.begin(), first_.end(), true) - first_.begin());
+        }
+    }
+
+
+    Ruleset::match_t Ruleset::match_at(std::string_view data, std::size_t pos) const {
+        match_t best;
+
+        for(auto const& dfa: dfas_) {
+            auto const* next = dfa.next.data();
+            auto const* accept = dfa.accept.data();
+            auto const classes = dfa.classes;
+
+            int32_t s = dfa.start;
+            std::size_t i = pos;
+            for(; i < data.size(); ++i) {
+                s = next[static_cast<std::size_t>(s) * classes + dfa.byte_class[static_cast<uint8_t>(data[i])]];
+                if(s == 0) break;
+
+                if(auto r = accept[s]; r >= 0) {
+                    auto const len = i - pos + 1;
+                    if(len > best.len or (len == best.len and r < best.rule)) {
+                        best.len = len;
+                        best.rule = r;
+                    }
+                }
+            }
+            if(s != 0) best.more = true;
+        }
+
+        return best;
+    }
+
+    std::size_t Ruleset::next_candidate(std::string_view data, std::size_t pos) const {
+        if(pos >= data.size() or dfas_.empty()) return std::string_view::npos;
+
+        if(single_first_ >= 0) {
+            auto const* p = static_cast<char const*>(std::memchr(data.data() + pos, single_first_, data.size() - pos));
+            return p ? static_cast<std::size_t>(p - data.data()) : std::string_view::npos;
+        }
+
+        for(auto i = pos; i < data.size(); ++i) {
+            if(first_[static_cast<uint8_t>(data[i])]) return i;
+        }
+        return std::string_view::npos;
+    }
+
+
+    Session::Session(std::shared_ptr<Ruleset const> rules) : rules_(std::move(rules)),
+                                                             nth_counter_(rules_->nth_slots(), 0),
+                                                             nth_decided_(rules_->nth_slots(), 0) {}
+
+    void Session::apply(dir_t dir, std::string_view in, std::string& out, clock_t::time_point now) {
+        auto& stream = streams_[idx(dir)];
+        std::fill(nth_decided_.begin(), nth_decided_.end(), 0);
+
+        std::string chunk;
+        auto& target = rules_->fallback().empty() ? out : chunk;
+
+        if(stream.held.empty()) {
+            run(in, false, target, stream);
+        } else {
+            std::string work;
+            work.reserve(stream.held.size() + in.size());
+            work.append(stream.held).append(in);
+            run(work, false, target, stream);
+        }
+
+        // wait for more data since now
+        if(not stream.held.empty()) stream.held_since = now;
+
+        if(not rules_->fallback().empty()) {
+            apply_fallback(chunk);
+            out.append(chunk);
+        }
+    }
+
+    void Session::flush(dir_t dir, std::string& out) {
+        auto& stream = streams_[idx(dir)];
+        if(stream.held.empty()) return;
+
+        std::fill(nth_decided_.begin(), nth_decided_.end(), 0);
+
+        auto work = std::move(stream.held);
+        stream.held.clear();
+
+        std::string chunk;
+        auto& target = rules_->fallback().empty() ? out : chunk;
+        run(work, true, target, stream);
+
+        if(not rules_->fallback().empty()) {
+            apply_fallback(chunk);
+            out.append(chunk);
+        }
+    }
+
+    bool Session::hold_expired(dir_t dir, clock_t::time_point now) const {
+        auto const& stream = streams_[idx(dir)];
+        return not stream.held.empty() and now - stream.held_since >= Ruleset::hold_timeout;
+    }
+
+    void Session::run(std::string_view data, bool final, std::string& out, Stream& stream) {
+        auto const& rules = *rules_;
+
+        std::size_t emitted = 0;
+        std::size_t pos = 0;
+
+        while((pos = rules.next_candidate(data, pos)) != std::string_view::npos) {
+
+            auto m = rules.match_at(data, pos);
+
+            // match may continue in the next chunk
+            if(m.more and not final and data.size() - pos < Ruleset::max_hold) {
+                out.append(data.substr(emitted, pos - emitted));
+                stream.held.assign(data.substr(pos));
+                return;
+            }
+
+            if(m.len == 0) {
+                ++pos;
+                continue;
+            }
+
+            out.append(data.substr(emitted, pos - emitted));
+
+            auto const matched = data.substr(pos, m.len);
+            if(replace_now(static_cast<std::size_t>(m.rule))) {
+                append_replacement(rules.rules()[static_cast<std::size_t>(m.rule)], matched, out);
+            } else {
+                out.append(matched);
+            }
+
+            pos += m.len;
+            emitted = pos;
+        }
+
+        out.append(data.substr(emitted));
+        stream.held.clear();
+    }
+
+    bool Session::replace_now(std::size_t rule) {
+        auto const slot = rules_->nth_slot(rule);
+        if(slot < 0) return true;
+
+        // counter moves once per chunk where the rule matched, all matches of the nth chunk are replaced
+        auto& decided = nth_decided_[static_cast<std::size_t>(slot)];
+        if(decided == 0) {
+            auto& counter = nth_counter_[static_cast<std::size_t>(slot)];
+            if(++counter >= rules_->rules()[rule].replace_each_nth) {
+                counter = 0;
+                decided = 1;
+            } else {
+                decided = 2;
+            }
+        }
+        return decided == 1;
+    }
+
+    void Session::append_replacement(Rule const& rule, std::string_view matched, std::string& out) {
+        if(rule.fill_length) {
+            // empty replacement fills with spaces
+            std::string_view const fill = rule.replace.empty() ? std::string_view(" ") : std::string_view(rule.replace);
+            for(std::size_t i = 0; i < matched.size(); ++i) out.push_back(fill[i % fill.size()]);
+            return;
+        }
+
+        // ECMAScript format: $& is the whole match, $$ is '$'
+        auto const& r = rule.replace;
+        for(std::size_t i = 0; i < r.size(); ++i) {
+            if(r[i] == '$' and i + 1 < r.size()) {
+                if(r[i + 1] == '&') { out.append(matched); ++i; continue; }
+                if(r[i + 1] == '$') { out.push_back('$'); ++i; continue; }
+            }
+            out.push_back(r[i]);
+        }
+    }
+
+    void Session::apply_fallback(std::string& chunk) {
+        for(auto const& fb: rules_->fallback()) {
+            auto const& rule = rules_->rules()[fb.rule];
+
+            if(not std::regex_search(chunk, fb.re)) continue;
+            if(not replace_now(fb.rule)) continue;
+
+            if(not rule.fill_length) {
+                chunk = std::regex_replace(chunk, fb.re, rule.replace);
+                continue;
+            }
+
+            std::string result;
+            std::size_t last = 0;
+            for(auto it = std::sregex_iterator(chunk.begin(), chunk.end(), fb.re); it != std::sregex_iterator(); ++it) {
+                auto const pos = static_cast<std::size_t>(it->position(0));
+                result.append(chunk, last, pos - last);
+                append_replacement(rule, std::string_view(chunk).substr(pos, static_cast<std::size_t>(it->length(0))), result);
+                last = pos + static_cast<std::size_t>(it->length(0));
+            }
+            result.append(chunk, last, std::string::npos);
+            chunk = std::move(result);
+        }
+    }
+}
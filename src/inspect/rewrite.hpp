@@ -0,0 +1,182 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef REWRITE_HPP
+#define REWRITE_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Streaming multi-pattern content rewrite.
+//
+// Ruleset is compiled once, when content profile is loaded, and shared read-only by all sessions. Patterns are
+// compiled to anchored DFAs over byte classes; candidate positions are found by first-byte prefilter. All DFA
+// rules are matched in a single pass, leftmost-longest, lower rule index wins ties.
+//
+// Session keeps per-direction state: bytes which may be start of a match are held back until more data arrive,
+// so matches straddling two reads are found.
+//
+// Supported syntax: literals, escapes (\d \w \s and negations, \n \r \t \f \v \0 \xHH), '.', classes with ranges,
+// groups (also non-capturing), alternation, greedy * + ? {n} {n,} {n,m}. Anything else (anchors, lookarounds,
+// backreferences, lazy quantifiers, $1 in replacement) is compiled to std::regex and applied per chunk, after
+// DFA rules - such rules don't match across reads.
+
+namespace sx::rewrite {
+
+    struct Rule {
+        std::string match;
+        std::string replace;
+        // replacement is repeated/cut to the length of the matched text, so payload size doesn't change
+        bool fill_length = false;
+        // replace only in every nth chunk where the rule matches
+        int replace_each_nth = 0;
+    };
+
+    class Ruleset {
+    public:
+        // upper limit of bytes held back from output while waiting for a match to complete
+        constexpr static std::size_t max_hold = 4096;
+        // held bytes are released if no more data come in this time
+        constexpr static std::chrono::milliseconds hold_timeout { 50 };
+        // DFA size limit, larger rule groups are split
+        constexpr static std::size_t max_states = 8192;
+        // NFA size limit of single rule (counted repetitions are expanded)
+        constexpr static std::size_t max_rule_states = 16384;
+
+        explicit Ruleset(std::vector<Rule> rules);
+
+        std::vector<Rule> const& rules() const { return rules_; }
+        // rules which cannot be used at all, in "#<index>: <reason>" form
+        std::vector<std::string> const& errors() const { return errors_; }
+
+        std::size_t dfa_count() const { return dfas_.size(); }
+        std::size_t fallback_count() const { return fallback_.size(); }
+        bool empty() const { return dfas_.empty() and fallback_.empty(); }
+
+        struct match_t {
+            std::size_t len = 0;    // 0 means no match
+            int rule = -1;
+            bool more = false;      // end of data reached while a longer match was still possible
+        };
+        // anchored match of DFA rules at @pos
+        match_t match_at(std::string_view data, std::size_t pos) const;
+        // next position where any DFA rule can start, npos if none
+        std::size_t next_candidate(std::string_view data, std::size_t pos) const;
+
+        struct Dfa {
+            std::array<uint16_t, 256> byte_class {};
+            std::size_t classes = 0;
+            std::vector<int32_t> next;      // [state * classes + class], state 0 is dead
+            std::vector<int32_t> accept;    // lowest matching rule in state, -1 if none
+            int32_t start = 1;
+        };
+
+        struct Fallback {
+            std::size_t rule = 0;
+            std::regex re;
+        };
+
+        std::vector<Fallback> const& fallback() const { return fallback_; }
+        // index to per-session nth counters, -1 for rules replacing every time
+        int nth_slot(std::size_t rule) const { return nth_slot_[rule]; }
+        std::size_t nth_slots() const { return nth_slots_; }
+
+    private:
+        std::vector<Rule> rules_;
+        std::vector<std::string> errors_;
+        std::vector<Dfa> dfas_;
+        std::vector<Fallback> fallback_;
+        std::vector<int> nth_slot_;
+        std::size_t nth_slots_ = 0;
+
+        std::array<bool, 256> first_ {};
+        int single_first_ = -1;         // all rules start with this byte: memchr() is enough
+    };
+
+
+    // per-session rewrite state, both directions
+    class Session {
+    public:
+        enum class dir_t : std::size_t { UP = 0, DOWN = 1 };
+        using clock_t = std::chrono::steady_clock;
+
+        explicit Session(std::shared_ptr<Ruleset const> rules);
+
+        Ruleset const& ruleset() const { return *rules_; }
+
+        // rewrite next chunk, result is appended to @out. Tail which can be start of a match may be held back.
+        void apply(dir_t dir, std::string_view in, std::string& out, clock_t::time_point now = clock_t::now());
+        // release held bytes (rewritten if they match), ie. on end of stream or hold timeout
+        void flush(dir_t dir, std::string& out);
+
+        std::size_t held(dir_t dir) const { return streams_[idx(dir)].held.size(); }
+        bool hold_expired(dir_t dir, clock_t::time_point now = clock_t::now()) const;
+
+    private:
+        static std::size_t idx(dir_t d) { return static_cast<std::size_t>(d); }
+
+        struct Stream {
+            std::string held;
+            clock_t::time_point held_since;
+        };
+
+        void run(std::string_view data, bool final, std::string& out, Stream& stream);
+        void apply_fallback(std::string& chunk);
+        // nth logic: true if this match should be replaced
+        bool replace_now(std::size_t rule);
+        static void append_replacement(Rule const& rule, std::string_view matched, std::string& out);
+
+        std::shared_ptr<Ruleset const> rules_;
+        std::array<Stream, 2> streams_;
+
+        // shared by both directions, as rule counters always were
+        std::vector<int> nth_counter_;
+        // decision for the current chunk: 0 undecided, 1 replace, 2 keep
+        std::vector<uint8_t> nth_decided_;
+    };
+}
+
+#endif //REWRITE_HPP
@@ -127,6 +127,51 @@ TEST(DNS_Packet, load_response1) {
     }
 }
 
+TEST(DNS_ReverseIndex, update_remove) {
+
+    buffer b((void*)dns_response1, sizeof(dns_response1), sizeof(dns_response1), false);
+
+    auto dr = std::make_unique<DNS_Response>();
+    ASSERT_TRUE(dr->load(&b) == 0);
+    dr->loaded_at = time(nullptr);
+
+    DNS_ReverseIndex idx;
+    idx.update(dr->question_str_0(), *dr);
+
+    auto id = DNS_ReverseIndex::fqdn_id("pcdn.brave.com");
+    auto* hit = cidr::cidr_from_str("172.65.10.226");
+    auto* miss = cidr::cidr_from_str("172.65.10.227");
+
+    ASSERT_TRUE(idx.contains(hit, id, "pcdn.brave.com"));
+    ASSERT_FALSE(idx.contains(miss, id, "pcdn.brave.com"));
+    ASSERT_FALSE(idx.contains(hit, DNS_ReverseIndex::fqdn_id("brave.com"), "brave.com"));
+
+    std::string seen;
+    auto key = DNS_ReverseIndex::Key::from_cidr(hit);
+    ASSERT_TRUE(key);
+    ASSERT_TRUE(idx.any_name(key.value(), [&](std::string_view name) { seen = name; return true; }));
+    ASSERT_EQ(seen, "pcdn.brave.com");
+
+    // hash collision must not produce a match - name is verified on hit
+    ASSERT_FALSE(idx.contains(hit, id, "colliding.example.com"));
+
+    idx.remove(dr->question_str_0());
+    ASSERT_FALSE(idx.contains(hit, id, "pcdn.brave.com"));
+    ASSERT_TRUE(idx.size() == 0);
+
+    // evicted cache entries are pruned
+    idx.update(dr->question_str_0(), *dr);
+    ASSERT_TRUE(idx.contains(hit, id, "pcdn.brave.com"));
+    ASSERT_EQ(idx.prune([](std::string const&) { return true; }), 0U);
+    ASSERT_TRUE(idx.contains(hit, id, "pcdn.brave.com"));
+    ASSERT_EQ(idx.prune([](std::string const&) { return false; }), 1U);
+    ASSERT_FALSE(idx.contains(hit, id, "pcdn.brave.com"));
+    ASSERT_TRUE(idx.size() == 0);
+
+    cidr::cidr_free(hit);
+    cidr::cidr_free(miss);
+}
+
 TEST(DNS_Packet, qname_reconstuct1) {
 
 
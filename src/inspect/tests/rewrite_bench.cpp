@@ -0,0 +1,94 @@
+// Rewrite throughput vs. std::regex per chunk. Not part of sx_gtests: rates are only printed, rewrite
+// results are checked in rewrite_tests.cpp.
+
+#include <inspect/rewrite.hpp>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <regex>
+
+using namespace sx::rewrite;
+
+namespace {
+
+    using dir_t = Session::dir_t;
+
+    std::shared_ptr<Ruleset const> make(std::vector<Rule> rules) {
+        return std::make_shared<Ruleset const>(std::move(rules));
+    }
+}
+
+TEST(RewriteBench, Throughput) {
+
+    std::mt19937 rng(42);
+    auto const words = std::vector<std::string>{ "GET", "Host:", "Accept", "Cookie:", "session", "user", "example",
+                                                 "text/html", "keep-alive", "gzip", "Mozilla/5.0" };
+
+    std::string data;
+    data.reserve(32 << 20);
+    while(data.size() < (32 << 20)) {
+        data += words[rng() % words.size()];
+        data += (rng() % 8 == 0) ? "\r\n" : " ";
+        if(rng() % 64 == 0) data += "id=" + std::to_string(rng() % 100000) + ";";
+    }
+
+    auto rules_of = [](std::size_t count) {
+        std::vector<Rule> rules;
+        for(std::size_t i = 0; i < count; ++i) {
+            switch(i % 3) {
+                case 0:
+                    rules.push_back({ "token" + std::to_string(i), "T" });
+                    break;
+                case 1:
+                    rules.push_back({ "key" + std::to_string(i) + "=[a-z0-9]+", "K", true });
+                    break;
+                default:
+                    rules.push_back({ "(user|admin)" + std::to_string(i) + "@[a-z]+\\.com", "M" });
+                    break;
+            }
+        }
+        return rules;
+    };
+
+    constexpr std::size_t chunk = 16384;
+    using clk = std::chrono::steady_clock;
+
+    for(std::size_t count: { 1U, 50U, 500U }) {
+
+        auto t0 = clk::now();
+        auto rs = make(rules_of(count));
+        auto compile_ms = std::chrono::duration<double, std::milli>(clk::now() - t0).count();
+        ASSERT_TRUE(rs->errors().empty());
+        ASSERT_EQ(rs->fallback_count(), 0U);
+
+        Session s(rs);
+        std::string out;
+        out.reserve(data.size());
+
+        t0 = clk::now();
+        for(std::size_t off = 0; off < data.size(); off += chunk) {
+            s.apply(dir_t::UP, std::string_view(data).substr(off, chunk), out);
+        }
+        s.flush(dir_t::UP, out);
+        auto secs = std::chrono::duration<double>(clk::now() - t0).count();
+
+        EXPECT_EQ(out, data);
+
+        // previous implementation: std::regex compiled and run per rule, per chunk
+        std::size_t const old_bytes = count == 1 ? (4 << 20) : (count == 50 ? (256 << 10) : (32 << 10));
+        t0 = clk::now();
+        for(std::size_t off = 0; off < old_bytes; off += chunk) {
+            std::string result = data.substr(off, chunk);
+            for(auto const& r: rs->rules()) {
+                result = std::regex_replace(result, std::regex(r.match), r.replace);
+            }
+        }
+        auto old_secs = std::chrono::duration<double>(clk::now() - t0).count();
+
+        std::cout << "rewrite: " << count << " rules (" << rs->dfa_count() << " DFA, compiled in " << compile_ms
+                  << " ms): " << static_cast<double>(data.size()) / secs / (1 << 20) << " MB/s, std::regex per chunk: "
+                  << static_cast<double>(old_bytes) / old_secs / (1 << 20) << " MB/s\n";
+    }
+}
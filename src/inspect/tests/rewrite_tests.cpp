@@ -0,0 +1,148 @@
+#include <inspect/rewrite.hpp>
+#include <gtest/gtest.h>
+
+#include <random>
+
+using namespace sx::rewrite;
+
+namespace {
+
+    using dir_t = Session::dir_t;
+
+    std::shared_ptr<Ruleset const> make(std::vector<Rule> rules) {
+        return std::make_shared<Ruleset const>(std::move(rules));
+    }
+
+    // feed @chunks through session and flush at the end
+    std::string run(Session& s, std::vector<std::string> const& chunks, dir_t dir = dir_t::UP) {
+        std::string out;
+        for(auto const& c: chunks) s.apply(dir, c, out);
+        s.flush(dir, out);
+        return out;
+    }
+}
+
+TEST(Rewrite, Basic) {
+    auto rs = make({ { "hello", "HI" }, { "[0-9]{3}-[0-9]{4}", "XXX" } });
+    ASSERT_TRUE(rs->errors().empty());
+    ASSERT_EQ(rs->fallback_count(), 0U);
+
+    Session s(rs);
+    EXPECT_EQ(run(s, { "say hello, call 555-1234 or 555-12" }), "say HI, call XXX or 555-12");
+}
+
+TEST(Rewrite, AcrossChunks) {
+    auto rs = make({ { "hello", "HI" }, { "[0-9]{3}-[0-9]{4}", "XXX" } });
+    Session s(rs);
+
+    std::string out;
+    s.apply(dir_t::UP, "say hel", out);
+    EXPECT_EQ(out, "say ");
+    EXPECT_EQ(s.held(dir_t::UP), 3U);
+
+    s.apply(dir_t::UP, "lo 555-", out);
+    s.apply(dir_t::UP, "1234 abc", out);
+    s.flush(dir_t::UP, out);
+    EXPECT_EQ(out, "say HI XXX abc");
+
+    // directions don't mix
+    Session s2(rs);
+    std::string up, down;
+    s2.apply(dir_t::UP, "hel", up);
+    s2.apply(dir_t::DOWN, "lo", down);
+    s2.flush(dir_t::UP, up);
+    s2.flush(dir_t::DOWN, down);
+    EXPECT_EQ(up, "hel");
+    EXPECT_EQ(down, "lo");
+}
+
+TEST(Rewrite, HoldLimit) {
+    auto rs = make({ { "a+b", "X" } });
+    Session s(rs);
+
+    std::string out;
+    s.apply(dir_t::UP, std::string(Ruleset::max_hold * 2, 'a'), out);
+    EXPECT_LE(s.held(dir_t::UP), Ruleset::max_hold);
+    s.flush(dir_t::UP, out);
+    EXPECT_EQ(out, std::string(Ruleset::max_hold * 2, 'a'));
+}
+
+TEST(Rewrite, FillLength) {
+    auto rs = make({ { "secret[0-9]+", "*", true }, { "token", "", true }, { "pw", "abcdef", true } });
+    Session s(rs);
+    EXPECT_EQ(run(s, { "a secret12345 b token c pw" }), "a *********** b       c ab");
+}
+
+TEST(Rewrite, EachNth) {
+    // every 2nd chunk containing a match gets all of its matches replaced
+    auto rs = make({ { "cat", "dog", false, 2 } });
+    Session s(rs);
+
+    std::string out;
+    s.apply(dir_t::UP, "cat cat.", out);
+    s.apply(dir_t::UP, "none.", out);
+    s.apply(dir_t::UP, "cat cat.", out);
+    s.apply(dir_t::UP, "cat.", out);
+    s.flush(dir_t::UP, out);
+    EXPECT_EQ(out, "cat cat.none.dog dog.cat.");
+}
+
+TEST(Rewrite, FallbackAndErrors) {
+    auto rs = make({ { "^GET", "PUT" }, { "(a)(b)", "$2$1" }, { "", "x" }, { "x*", "y" }, { "[", "z" } });
+
+    EXPECT_EQ(rs->fallback_count(), 2U);
+    EXPECT_EQ(rs->errors().size(), 3U);
+
+    Session s(rs);
+    EXPECT_EQ(run(s, { "GET /ab GET" }), "PUT /ba GET");
+}
+
+TEST(Rewrite, LeftmostLongest) {
+    auto rs = make({ { "abc", "1" }, { "abcd", "2" }, { "b", "3" } });
+    Session s(rs);
+    EXPECT_EQ(run(s, { "abcd abce xb" }), "2 1e x3");
+}
+
+TEST(Rewrite, ManyRulesNoMatch) {
+
+    std::mt19937 rng(42);
+    auto const words = std::vector<std::string>{ "GET", "Host:", "Accept", "Cookie:", "session", "user", "example",
+                                                 "text/html", "keep-alive", "gzip", "Mozilla/5.0" };
+
+    std::string data;
+    while(data.size() < (1 << 20)) {
+        data += words[rng() % words.size()];
+        data += (rng() % 8 == 0) ? "\r\n" : " ";
+        if(rng() % 64 == 0) data += "id=" + std::to_string(rng() % 100000) + ";";
+    }
+
+    std::vector<Rule> rules;
+    for(std::size_t i = 0; i < 500; ++i) {
+        switch(i % 3) {
+            case 0:
+                rules.push_back({ "token" + std::to_string(i), "T" });
+                break;
+            case 1:
+                rules.push_back({ "key" + std::to_string(i) + "=[a-z0-9]+", "K", true });
+                break;
+            default:
+                rules.push_back({ "(user|admin)" + std::to_string(i) + "@[a-z]+\\.com", "M" });
+                break;
+        }
+    }
+
+    auto rs = make(std::move(rules));
+    ASSERT_TRUE(rs->errors().empty());
+    ASSERT_EQ(rs->fallback_count(), 0U);
+
+    // nothing matches, data pass through unchanged across chunk boundaries
+    Session s(rs);
+    std::string out;
+    constexpr std::size_t chunk = 16384;
+    for(std::size_t off = 0; off < data.size(); off += chunk) {
+        s.apply(dir_t::UP, std::string_view(data).substr(off, chunk), out);
+    }
+    s.flush(dir_t::UP, out);
+
+    EXPECT_EQ(out, data);
+}
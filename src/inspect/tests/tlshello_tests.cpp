@@ -0,0 +1,133 @@
+#include <inspect/tlshello.hpp>
+#include <gtest/gtest.h>
+
+#include <openssl/ssl.h>
+
+#include <algorithm>
+
+using namespace sx::tls;
+
+namespace {
+
+    // builds ClientHello record from its parts
+    struct HelloBuilder {
+        std::vector<uint8_t> ext;
+
+        static void put16(std::vector<uint8_t>& v, uint16_t x) { v.push_back(x >> 8); v.push_back(x & 0xff); }
+
+        void extension(uint16_t type, std::vector<uint8_t> const& data) {
+            put16(ext, type);
+            put16(ext, static_cast<uint16_t>(data.size()));
+            ext.insert(ext.end(), data.begin(), data.end());
+        }
+
+        std::vector<uint8_t> build(uint16_t version, std::vector<uint16_t> const& ciphers) const {
+            std::vector<uint8_t> body;
+            put16(body, version);
+            body.insert(body.end(), 32, 0x42);   // random
+            body.push_back(0);                   // session id
+            put16(body, static_cast<uint16_t>(ciphers.size() * 2));
+            for(auto c: ciphers) put16(body, c);
+            body.push_back(1); body.push_back(0); // compression: null
+            put16(body, static_cast<uint16_t>(ext.size()));
+            body.insert(body.end(), ext.begin(), ext.end());
+
+            std::vector<uint8_t> rec = { 0x16, 0x03, 0x01 };
+            put16(rec, static_cast<uint16_t>(body.size() + 4));
+            rec.push_back(0x01);
+            rec.push_back(0); put16(rec, static_cast<uint16_t>(body.size()));
+            rec.insert(rec.end(), body.begin(), body.end());
+            return rec;
+        }
+    };
+
+    std::vector<uint8_t> openssl_client_hello(const char* sni, std::vector<uint8_t> const& alpn) {
+        SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+        SSL* ssl = SSL_new(ctx);
+        BIO* rbio = BIO_new(BIO_s_mem());
+        BIO* wbio = BIO_new(BIO_s_mem());
+        SSL_set_bio(ssl, rbio, wbio);
+
+        SSL_set_tlsext_host_name(ssl, sni);
+        SSL_set_alpn_protos(ssl, alpn.data(), static_cast<unsigned int>(alpn.size()));
+        SSL_connect(ssl);
+
+        std::vector<uint8_t> out(BIO_ctrl_pending(wbio));
+        BIO_read(wbio, out.data(), static_cast<int>(out.size()));
+
+        SSL_free(ssl);
+        SSL_CTX_free(ctx);
+        return out;
+    }
+}
+
+TEST(TlsHello, OpenSSLHello) {
+    std::vector<uint8_t> alpn = { 2, 'h', '2', 8, 'h','t','t','p','/','1','.','1' };
+    auto rec = openssl_client_hello("www.smithproxy.org", alpn);
+    ASSERT_GT(rec.size(), ClientHello::header_size);
+
+    ClientHello ch;
+    // every prefix is just not enough data
+    for(std::size_t i = 0; i < rec.size(); ++i) {
+        ASSERT_EQ(ClientHello::parse(rec.data(), i, ch), ClientHello::status_t::INCOMPLETE) << "at " << i;
+    }
+
+    ASSERT_EQ(ClientHello::parse(rec.data(), rec.size(), ch), ClientHello::status_t::OK);
+    ASSERT_EQ(ch.sni, "www.smithproxy.org");
+    ASSERT_EQ(ch.alpn_protocols().size(), 2);
+    ASSERT_EQ(ch.alpn_protocols()[0], "h2");
+    ASSERT_EQ(ch.max_version(), 0x0304);
+
+    auto const ja3 = ch.ja3();
+    auto const ja4 = ch.ja4();
+
+    // fingerprints are computed later from info's own copy, peeked buffer is gone by then
+    auto info = ch.info();
+    std::fill(rec.begin(), rec.end(), 0);
+    ASSERT_EQ(info.sni, "www.smithproxy.org");
+    ASSERT_EQ(info.ja3(), ja3);
+    ASSERT_EQ(info.ja3().size(), 32);
+    ASSERT_EQ(info.ja4(), ja4);
+    ASSERT_EQ(info.ja4().substr(0, 4), "t13d");
+    ASSERT_EQ(info.ja4().substr(8, 2), "h2");
+    ASSERT_EQ(info.ja4().size(), 36);
+    std::cout << info.to_string() << "\n";
+}
+
+TEST(TlsHello, JA3Reference) {
+    // JA3 reference string: 769,47-53-5-10-49161-49162-49171-49172-50-56-19-4,0-10-11,23-24-25,0
+    HelloBuilder b;
+    b.extension(0, { 0, 6, 0, 0, 3, 'a', '.', 'b' });
+    b.extension(10, { 0, 6, 0, 23, 0, 24, 0, 25 });
+    b.extension(11, { 1, 0 });
+    auto rec = b.build(769, { 47, 53, 5, 10, 49161, 49162, 49171, 49172, 50, 56, 19, 4 });
+
+    ClientHello ch;
+    ASSERT_EQ(ClientHello::parse(rec.data(), rec.size(), ch), ClientHello::status_t::OK);
+    ASSERT_EQ(ch.sni, "a.b");
+    ASSERT_EQ(ch.ja3_string(), "769,47-53-5-10-49161-49162-49171-49172-50-56-19-4,0-10-11,23-24-25,0");
+    ASSERT_EQ(ch.ja3(), "ada70206e40642a3e4461f35503241d5");
+    ASSERT_EQ(ch.max_version(), 0x0301);
+    ASSERT_EQ(ch.ja4().substr(0, 10), "t10d120300");
+}
+
+TEST(TlsHello, GreaseAndInvalid) {
+    HelloBuilder b;
+    b.extension(0x1a1a, {});
+    b.extension(43, { 4, 0x2a, 0x2a, 0x03, 0x04 });
+    auto rec = b.build(0x0303, { 0x0a0a, 0x1301 });
+
+    ClientHello ch;
+    ASSERT_EQ(ClientHello::parse(rec.data(), rec.size(), ch), ClientHello::status_t::OK);
+    ASSERT_EQ(ch.max_version(), 0x0304);
+    ASSERT_EQ(ch.ja3_string(), "771,4865,43,,");
+    ASSERT_EQ(ch.ja4().substr(0, 10), "t13i010100");
+
+    // truncated extension inside complete record
+    auto broken = rec;
+    broken[broken.size() - 5] = 9;
+    ASSERT_EQ(ClientHello::parse(broken.data(), broken.size(), ch), ClientHello::status_t::INVALID);
+
+    const uint8_t http[] = "GET / HTTP/1.1\r\n";
+    ASSERT_EQ(ClientHello::parse(http, sizeof(http), ch), ClientHello::status_t::INVALID);
+}
@@ -0,0 +1,372 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+#include <openssl/evp.h>
+
+#include <inspect/tlshello.hpp>
+
+namespace sx::tls {
+
+    namespace {
+
+        // bounds-checked forward reader over the message, never copies
+        struct reader {
+            uint8_t const* data;
+            std::size_t size;
+            std::size_t pos = 0;
+            bool ok = true;
+
+            bool need(std::size_t n) {
+                if(not ok or size - pos < n) ok = false;
+                return ok;
+            }
+
+            uint8_t u8() { if(not need(1)) return 0; return data[pos++]; }
+            uint16_t u16() {
+                if(not need(2)) return 0;
+                auto r = static_cast<uint16_t>(data[pos] << 8 | data[pos+1]);
+                pos += 2;
+                return r;
+            }
+            bytes_view bytes(std::size_t n) {
+                if(not need(n)) return {};
+                bytes_view r { data + pos, n };
+                pos += n;
+                return r;
+            }
+            bool done() const { return pos == size; }
+        };
+
+        std::string digest_hex(EVP_MD const* md, std::string const& input, std::size_t hex_len) {
+            unsigned char out[EVP_MAX_MD_SIZE];
+            unsigned int out_len = 0;
+
+            if(EVP_Digest(input.data(), input.size(), out, &out_len, md, nullptr) != 1) return {};
+
+            std::string hex;
+            hex.reserve(out_len * 2);
+            char tmp[3];
+            for(unsigned int i = 0; i < out_len and hex.size() < hex_len; ++i) {
+                std::snprintf(tmp, sizeof(tmp), "%02x", out[i]);
+                hex += tmp;
+            }
+            hex.resize(std::min(hex.size(), hex_len));
+            return hex;
+        }
+
+        template <typename F>
+        void for_each_u16(bytes_view const& v, F f) {
+            for(std::size_t i = 0; i + 1 < v.size; i += 2) f(v.u16(i));
+        }
+
+        template <typename F>
+        void for_each_extension(bytes_view const& v, F f) {
+            reader r { v.data, v.size };
+            while(r.ok and not r.done()) {
+                auto type = r.u16();
+                auto len = r.u16();
+                auto data = r.bytes(len);
+                if(r.ok) f(type, data);
+            }
+        }
+
+        std::string hex4(uint16_t v) {
+            char tmp[5];
+            std::snprintf(tmp, sizeof(tmp), "%04x", v);
+            return tmp;
+        }
+
+        template <typename C>
+        std::string join(C const& items, char sep) {
+            std::string ret;
+            for(auto const& it: items) {
+                if(not ret.empty()) ret += sep;
+                ret += it;
+            }
+            return ret;
+        }
+    }
+
+    ClientHello::status_t ClientHello::parse(uint8_t const* buf, std::size_t len, ClientHello& out) {
+
+        if(len < 1) return status_t::INCOMPLETE;
+        if(buf[0] != 0x16) return status_t::INVALID;
+        if(len >= 2 and buf[1] != 0x03) return status_t::INVALID;
+        if(len < 5) return status_t::INCOMPLETE;
+
+        std::size_t const record_len = static_cast<std::size_t>(buf[3] << 8 | buf[4]);
+        if(record_len < 4 or record_len + 5 > max_size) return status_t::INVALID;
+
+        if(len >= 6 and buf[5] != 0x01) return status_t::INVALID;
+        if(len < header_size) return status_t::INCOMPLETE;
+
+        std::size_t const hs_len = static_cast<std::size_t>(buf[6] << 16 | buf[7] << 8 | buf[8]);
+        if(hs_len + 4 > record_len) return status_t::INVALID;
+
+        if(len < header_size + hs_len) return status_t::INCOMPLETE;
+
+        reader r { buf + header_size, hs_len };
+        ClientHello ch;
+
+        ch.record = { buf, header_size + hs_len };
+        ch.legacy_version = r.u16();
+        r.bytes(32);                      // random
+        r.bytes(r.u8());                  // session id
+
+        auto cipher_len = r.u16();
+        if(cipher_len % 2) return status_t::INVALID;
+        ch.ciphers = r.bytes(cipher_len);
+
+        r.bytes(r.u8());                  // compression methods
+
+        if(r.ok and not r.done()) {
+            ch.extensions = r.bytes(r.u16());
+        }
+        if(not r.ok) return status_t::INVALID;
+
+        bool ext_ok = true;
+        for_each_extension(ch.extensions, [&ch, &ext_ok](uint16_t type, bytes_view data) {
+            reader e { data.data, data.size };
+
+            switch(type) {
+                case 0: {
+                    // server_name: list of (type, name); only host_name type is defined
+                    reader list { data.data, data.size };
+                    auto list_len = list.u16();
+                    auto names = list.bytes(list_len);
+                    reader n { names.data, names.size };
+                    while(n.ok and not n.done()) {
+                        auto name_type = n.u8();
+                        auto name = n.bytes(n.u16());
+                        if(n.ok and name_type == 0 and ch.sni.empty()) {
+                            ch.sni = std::string_view(reinterpret_cast<char const*>(name.data), name.size);
+                        }
+                    }
+                    ext_ok &= list.ok;
+                    break;
+                }
+                case 10:
+                    ch.groups = e.bytes(e.u16());
+                    break;
+                case 11:
+                    ch.point_formats = e.bytes(e.u8());
+                    break;
+                case 13:
+                    ch.sig_algs = e.bytes(e.u16());
+                    break;
+                case 16:
+                    ch.alpn = e.bytes(e.u16());
+                    break;
+                case 43:
+                    ch.versions = e.bytes(e.u8());
+                    break;
+                default:
+                    break;
+            }
+            ext_ok &= e.ok;
+        });
+
+        if(not ext_ok) return status_t::INVALID;
+
+        out = ch;
+        return status_t::OK;
+    }
+
+    std::vector<std::string_view> ClientHello::alpn_protocols() const {
+        std::vector<std::string_view> ret;
+
+        reader r { alpn.data, alpn.size };
+        while(r.ok and not r.done()) {
+            auto name = r.bytes(r.u8());
+            if(r.ok) ret.emplace_back(reinterpret_cast<char const*>(name.data), name.size);
+        }
+        return ret;
+    }
+
+    uint16_t ClientHello::max_version() const {
+        uint16_t ret = 0;
+        for_each_u16(versions, [&ret](uint16_t v) { if(not is_grease(v)) ret = std::max(ret, v); });
+
+        return ret ? ret : legacy_version;
+    }
+
+    std::string ClientHello::ja3_string() const {
+
+        std::vector<std::string> cs;
+        for_each_u16(ciphers, [&cs](uint16_t v) { if(not is_grease(v)) cs.emplace_back(std::to_string(v)); });
+
+        std::vector<std::string> ext;
+        for_each_extension(extensions, [&ext](uint16_t type, bytes_view) { if(not is_grease(type)) ext.emplace_back(std::to_string(type)); });
+
+        std::vector<std::string> grp;
+        for_each_u16(groups, [&grp](uint16_t v) { if(not is_grease(v)) grp.emplace_back(std::to_string(v)); });
+
+        std::vector<std::string> pf;
+        for(std::size_t i = 0; i < point_formats.size; ++i) pf.emplace_back(std::to_string(point_formats.data[i]));
+
+        return std::to_string(legacy_version) + "," + join(cs, '-') + "," + join(ext, '-') + "," + join(grp, '-') + "," + join(pf, '-');
+    }
+
+    std::string ClientHello::ja3() const {
+        return digest_hex(EVP_md5(), ja3_string(), 32);
+    }
+
+    std::string ClientHello::ja4() const {
+
+        std::string a = "t";
+
+        switch(max_version()) {
+            case 0x0304: a += "13"; break;
+            case 0x0303: a += "12"; break;
+            case 0x0302: a += "11"; break;
+            case 0x0301: a += "10"; break;
+            case 0x0300: a += "s3"; break;
+            default:     a += "00"; break;
+        }
+
+        a += sni.empty() ? 'i' : 'd';
+
+        std::vector<std::string> cs;
+        for_each_u16(ciphers, [&cs](uint16_t v) { if(not is_grease(v)) cs.emplace_back(hex4(v)); });
+
+        std::vector<std::string> ext;
+        std::size_t ext_count = 0;
+        for_each_extension(extensions, [&ext, &ext_count](uint16_t type, bytes_view) {
+            if(is_grease(type)) return;
+            ++ext_count;
+            // SNI and ALPN are counted, but not hashed
+            if(type != 0x0000 and type != 0x0010) ext.emplace_back(hex4(type));
+        });
+
+        char counts[8];
+        std::snprintf(counts, sizeof(counts), "%02zu%02zu", std::min<std::size_t>(cs.size(), 99), std::min<std::size_t>(ext_count, 99));
+        a += counts;
+
+        auto protos = alpn_protocols();
+        if(protos.empty() or protos.front().empty()) {
+            a += "00";
+        }
+        else {
+            auto const& p = protos.front();
+            auto alnum = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) != 0; };
+
+            if(alnum(p.front()) and alnum(p.back())) {
+                a += p.front();
+                a += p.back();
+            }
+            else {
+                std::string hex;
+                char tmp[3];
+                for(auto c: p) {
+                    std::snprintf(tmp, sizeof(tmp), "%02x", static_cast<unsigned char>(c));
+                    hex += tmp;
+                }
+                a += hex.front();
+                a += hex.back();
+            }
+        }
+
+        std::sort(cs.begin(), cs.end());
+        std::string b = cs.empty() ? std::string(12, '0') : digest_hex(EVP_sha256(), join(cs, ','), 12);
+
+        std::sort(ext.begin(), ext.end());
+        std::string c_in = join(ext, ',');
+
+        std::vector<std::string> sig;
+        for_each_u16(sig_algs, [&sig](uint16_t v) { if(not is_grease(v)) sig.emplace_back(hex4(v)); });
+        if(not sig.empty()) c_in += "_" + join(sig, ',');
+
+        std::string c = ext.empty() ? std::string(12, '0') : digest_hex(EVP_sha256(), c_in, 12);
+
+        return a + "_" + b + "_" + c;
+    }
+
+    HelloInfo ClientHello::info() const {
+        HelloInfo ret;
+
+        ret.sni = sni;
+        for(auto const& p: alpn_protocols()) ret.alpn.emplace_back(p);
+        ret.version = max_version();
+        ret.record.assign(record.data, record.data + record.size);
+
+        return ret;
+    }
+
+    std::string const& HelloInfo::ja3() const {
+        if(not ja3_) {
+            ClientHello ch;
+            ja3_ = ClientHello::parse(record.data(), record.size(), ch) == ClientHello::status_t::OK ? ch.ja3() : std::string();
+        }
+        return *ja3_;
+    }
+
+    std::string const& HelloInfo::ja4() const {
+        if(not ja4_) {
+            ClientHello ch;
+            ja4_ = ClientHello::parse(record.data(), record.size(), ch) == ClientHello::status_t::OK ? ch.ja4() : std::string();
+        }
+        return *ja4_;
+    }
+
+    std::string HelloInfo::to_string() const {
+        std::string ret = "sni=" + (sni.empty() ? std::string("-") : sni);
+        ret += " alpn=" + (alpn.empty() ? std::string("-") : join(alpn, ','));
+        ret += " ver=";
+        ret += version_str(version);
+        ret += " ja3=" + ja3();
+        ret += " ja4=" + ja4();
+
+        return ret;
+    }
+
+    const char* version_str(uint16_t version) {
+        switch(version) {
+            case 0x0304: return "TLSv1.3";
+            case 0x0303: return "TLSv1.2";
+            case 0x0302: return "TLSv1.1";
+            case 0x0301: return "TLSv1.0";
+            case 0x0300: return "SSLv3";
+            default:     return "unknown";
+        }
+    }
+}
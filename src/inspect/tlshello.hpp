@@ -0,0 +1,124 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef TLSHELLO_HPP
+#define TLSHELLO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Zero-copy TLS ClientHello parser.
+//
+// parse() only validates lengths and remembers where the interesting parts of the message are - no field
+// is copied out of the buffer, so ClientHello views are valid only while the buffer is. Fingerprints
+// (JA3, JA4) and HelloInfo summary are built on request.
+
+namespace sx::tls {
+
+    struct bytes_view {
+        uint8_t const* data = nullptr;
+        std::size_t size = 0;
+
+        bool empty() const { return size == 0; }
+        uint16_t u16(std::size_t i) const { return static_cast<uint16_t>(data[i] << 8 | data[i+1]); }
+    };
+
+    // GREASE values (RFC 8701) are random and must be ignored in fingerprints
+    inline bool is_grease(uint16_t v) { return (v & 0x0f0f) == 0x0a0a and (v >> 8) == (v & 0xff); }
+
+    // owned summary of the ClientHello, kept with the connection. Only SNI, ALPN and version are extracted,
+    // fingerprints are hashed from the kept message copy when first asked for.
+    struct HelloInfo {
+        std::string sni;
+        std::vector<std::string> alpn;
+        uint16_t version = 0;           // highest offered version, supported_versions taken into account
+        std::vector<uint8_t> record;    // ClientHello record copy
+
+        std::string const& ja3() const; // MD5 hash hex
+        std::string const& ja4() const;
+
+        std::string to_string() const;
+
+    private:
+        mutable std::optional<std::string> ja3_;
+        mutable std::optional<std::string> ja4_;
+    };
+
+    struct ClientHello {
+
+        using status_t = enum class status { OK, INCOMPLETE, INVALID };
+
+        // TLS record header + handshake header
+        constexpr static std::size_t header_size = 9;
+        // single record limit, ClientHello spanning multiple records is not parsed
+        constexpr static std::size_t max_size = 16384 + 5;
+
+        bytes_view record;              // whole ClientHello record
+        uint16_t legacy_version = 0;
+        bytes_view ciphers;             // u16 list
+        bytes_view extensions;          // raw extension block
+
+        std::string_view sni;
+        bytes_view alpn;                // ALPN protocol_name_list (u8 length prefixed names)
+        bytes_view versions;            // supported_versions list, u16 items
+        bytes_view groups;              // supported_groups, u16 items
+        bytes_view point_formats;       // ec_point_formats, u8 items
+        bytes_view sig_algs;            // signature_algorithms, u16 items
+
+        // @buf starts with TLS record. INCOMPLETE means more bytes of the first record are needed.
+        static status_t parse(uint8_t const* buf, std::size_t len, ClientHello& out);
+
+        std::vector<std::string_view> alpn_protocols() const;
+        uint16_t max_version() const;
+
+        std::string ja3_string() const;
+        std::string ja3() const;
+        std::string ja4() const;
+
+        HelloInfo info() const;
+    };
+
+    const char* version_str(uint16_t version);
+}
+
+#endif //TLSHELLO_HPP
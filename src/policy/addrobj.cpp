@@ -41,12 +41,54 @@
 #include <policy/addrobj.hpp>
 #include <inspect/dns.hpp>
 #include <sstream>
+#include <sys/stat.h>
+
+CidrAddress::CidrAddress(cidr::CIDR* c) : AddressObject() {
+    if(c) {
+        c_ = *c;
+        prefix_ = cidr::Prefix::from_cidr(c);
+        cidr::cidr_free(c);
+    }
+}
+
+CidrAddress::CidrAddress(std::string const& v) : AddressObject(), prefix_(cidr::Prefix::parse(v)) {
+
+    if(prefix_.valid()) {
+        prefix_.to_cidr(c_);
+    }
+    else if(auto* c = cidr::cidr_from_str(v.c_str()); c) {
+        // legacy notations (ie. netmask instead of prefix length) are understood only by libcidr
+        c_ = *c;
+        prefix_ = cidr::Prefix::from_cidr(c);
+        cidr::cidr_free(c);
+    }
+}
+
+std::string CidrAddress::ip(int flags) const {
+
+    if((flags & ~(CIDR_ONLYADDR | CIDR_ONLYPFLEN)) == 0) {
+        char buf[cidr::Prefix::str_size];
+        if(auto len = prefix_.format(buf, sizeof(buf), flags); len > 0) {
+            return { buf, len };
+        }
+        return "?";
+    }
+
+    if(not prefix_.valid()) return "?";
+
+    auto temp = raw::allocated(cidr_to_str(&c_, flags));
+    return string_format("%s", temp.value);
+}
 
 int CidrAddress::contains(cidr::CIDR const* other) const{
-    return cidr_contains(c_.value,other);
+    return prefix_.contains(cidr::Prefix::from_cidr(other)) ? 0 : -1;
 }
 
 
+FqdnAddress::FqdnAddress(std::string s) : AddressObject(), fqdn_(std::move(s)) {
+    fqdn_id_ = DNS_ReverseIndex::fqdn_id(fqdn_);
+}
+
 std::string FqdnAddress::to_string(int verbosity) const {
 
     std::stringstream ret;
@@ -95,31 +137,93 @@ std::shared_ptr<DNS_Response> FqdnAddress::find_dns_response(int cidr_type) cons
 }
 
 bool FqdnAddress::match(cidr::CIDR* to_match) {
-    bool ret = false;
-
-    if(auto r = find_dns_response(to_match->proto); r != nullptr) {
-
-        _deb("FqdnAddress::match: found in cache: %s",fqdn_.c_str());
-        
-        auto ips = r->get_a_anwsers();
-        
-        int i = 0;
-        for(auto const& ip: ips) {
-            if(ip->match(to_match)) {
-                _deb("FqdnAddress::match: cached %s matches answer[%d] with %s",
-                                                fqdn_.c_str(),i,ip->str().c_str());
-                ret = true;
-                break;
-            } else {
-                _deb("FqdnAddress::match: cached %s DOESN'T match answer[%d] with %s",
-                                                fqdn_.c_str(),i,ip->str().c_str());
-            }
-            ++i;
+
+    // answers are indexed by DNS cache writers, no need to walk the cached response here
+    bool ret = DNS::get_reverse_index().contains(to_match, fqdn_id_, fqdn_);
+
+    _deb("FqdnAddress::match: %s %s", fqdn_.c_str(), ret ? "matched" : "not matched");
+
+    return ret;
+}
+
+
+namespace {
+    int64_t mtime_ns(struct stat const& st) {
+        return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    }
+}
+
+PrefixListAddress::PrefixListAddress(std::string path) : AddressObject(), path_(std::move(path)) {
+    reload();
+}
+
+bool PrefixListAddress::reload() {
+
+    auto l_ = std::scoped_lock(reload_lock_);
+
+    struct stat st{};
+    if(::stat(path_.c_str(), &st) != 0) {
+        _err("PrefixListAddress::reload: cannot stat %s", path_.c_str());
+        return false;
+    }
+
+    std::size_t bad = 0;
+    auto fresh = PrefixTable::load_file(path_, &bad);
+    if(not fresh) {
+        _err("PrefixListAddress::reload: cannot read %s", path_.c_str());
+        return false;
+    }
+
+    auto st_table = fresh->stats();
+    std::atomic_store(&table_, std::shared_ptr<PrefixTable const>(std::move(fresh)));
+
+    mtime_ns_ = mtime_ns(st);
+    bad_lines_ = bad;
+    loaded_at_ = ::time(nullptr);
+
+    _dia("PrefixListAddress::reload: %s: %d prefixes, %dB", path_.c_str(), st_table.prefixes, st_table.bytes);
+    if(bad > 0) {
+        _war("PrefixListAddress::reload: %s: %d lines ignored", path_.c_str(), bad);
+    }
+
+    return true;
+}
+
+bool PrefixListAddress::reload_if_changed() {
+
+    struct stat st{};
+    if(::stat(path_.c_str(), &st) != 0 or mtime_ns(st) == mtime_ns_) return false;
+
+    return reload();
+}
+
+bool PrefixListAddress::match(cidr::CIDR* c) {
+    auto t = table();
+    return t and t->contains(c);
+}
+
+std::string PrefixListAddress::to_string(int verbosity) const {
+
+    std::stringstream ret;
+    ret << "PrefixList: " + path_;
+
+    if(auto t = table(); t) {
+        auto st = t->stats();
+        ret << string_format(" (%d prefixes", st.prefixes);
+
+        if(verbosity > INF) {
+            ret << string_format(", %d chunks, %dkB, %d bad lines, loaded %ds ago",
+                                 st.chunks, st.bytes / 1024, bad_lines_.load(), ::time(nullptr) - loaded_at_.load());
         }
-        
-    } else {
-        _deb("FqdnAddress::match: NOT found in cache: %s",fqdn_.c_str());
+        ret << ")";
     }
-    
-    return ret;
+    else {
+        ret << " (not loaded)";
+    }
+
+    if(!element_name().empty() && verbosity > iINF) {
+        ret << string_format(" (name=%s)", element_name().c_str());
+    }
+
+    return ret.str();
 }
@@ -41,6 +41,8 @@
 #define ADDROBJ_HPP_
 
 #include <utility>
+#include <atomic>
+#include <mutex>
 #include <vars.hpp>
 
 #include <ext/libcidr/cidr.hpp>
@@ -51,6 +53,7 @@
 #include <policy/profiles.hpp>
 #include <policy/cfgelement.hpp>
 #include <ranges.hpp>
+#include <policy/prefixtable.hpp>
 
 
 class AddressObject : public socle::sobject, public CfgElement {
@@ -73,25 +76,22 @@ public:
 
 class CidrAddress : public AddressObject {
 public:
-    explicit CidrAddress(cidr::CIDR* c) : AddressObject(), c_(raw::allocated<cidr::CIDR*>(c)) { }
-    explicit CidrAddress(std::string const& v) : AddressObject(), c_(raw::allocated<cidr::CIDR*>(cidr::cidr_from_str(v.c_str()))) {}
+    // takes ownership of @c: its content is copied into the object and @c is released
+    explicit CidrAddress(cidr::CIDR* c);
+    explicit CidrAddress(std::string const& v);
+    explicit CidrAddress(cidr::Prefix const& p) : AddressObject(), prefix_(p) { prefix_.to_cidr(c_); }
 
-    cidr::CIDR* cidr() { return c_.value; }
-    std::string ip(int flags = CIDR_ONLYADDR) const {
-        auto temp = raw::allocated(cidr_to_str(c_.value, flags));
-        std::string ret = string_format("%s", temp.value);
-
-        return ret;
-    }
+    cidr::CIDR* cidr() { return prefix_.valid() ? &c_ : nullptr; }
+    cidr::Prefix const& prefix() const { return prefix_; }
+    std::string ip(int flags = CIDR_ONLYADDR) const;
 
     int contains(cidr::CIDR const* other) const;
     bool match(cidr::CIDR* c) override { return (contains(c) >= 0); };
     bool ask_destroy() override { return false; };
 
     std::string to_string(int verbosity) const override {
-        auto temp = raw::allocated(cidr_to_str(c_.value));
 
-        std::string ret = string_format("Cidr: %s",temp.value);
+        std::string ret = "Cidr: " + ip(CIDR_NOFLAGS);
 
         if(!element_name().empty() && verbosity > iINF) {
             ret += string_format(" (name=%s)", element_name().c_str());
@@ -101,7 +101,9 @@ public:
     }
     
 private:
-    raw::var<cidr::CIDR*> c_;
+    // value-type copy used for matching, and CIDR form kept for libcidr API users
+    cidr::Prefix prefix_;
+    cidr::CIDR c_ {};
 
 TYPENAME_OVERRIDE("CidrAddress")
 };
@@ -110,7 +112,7 @@ class DNS_Response;
 
 class FqdnAddress : public AddressObject {
 public:
-    explicit FqdnAddress(std::string s) : AddressObject(), fqdn_(std::move(s)) { }
+    explicit FqdnAddress(std::string s);
     std::string fqdn() const { return fqdn_; }
     std::shared_ptr<DNS_Response> find_dns_response(int cidr_type) const;
     
@@ -121,10 +123,43 @@ public:
 
 private:
     std::string fqdn_;
+    uint64_t fqdn_id_ = 0;   // DNS_ReverseIndex::fqdn_id() of fqdn_
 
 TYPENAME_OVERRIDE("FqdnAddress")
 };
 
+// address object backed by a file with (possibly very many) prefixes, one per line.
+// Prefixes are compiled into PrefixTable; the table is replaced atomically when file changes,
+// so matching never waits for reload.
+class PrefixListAddress : public AddressObject {
+public:
+    explicit PrefixListAddress(std::string path);
+
+    std::string const& path() const { return path_; }
+    std::shared_ptr<PrefixTable const> table() const { return std::atomic_load(&table_); }
+
+    // load file and swap the table. Returns false (keeping current table) if file can't be read.
+    bool reload();
+    // reload only if file modification time changed since last load
+    bool reload_if_changed();
+
+    bool match(cidr::CIDR* c) override;
+    bool ask_destroy() override { return false; };
+
+    std::string to_string(int verbosity) const override;
+
+private:
+    std::string path_;
+    std::shared_ptr<PrefixTable const> table_;
+
+    std::mutex reload_lock_;
+    std::atomic<int64_t> mtime_ns_ {0};
+    std::atomic<std::size_t> bad_lines_ {0};
+    std::atomic<time_t> loaded_at_ {0};
+
+TYPENAME_OVERRIDE("PrefixListAddress")
+};
+
 using CfgAddress = CfgSingle<std::shared_ptr<AddressObject>>;
 using shared_CfgAddress =  std::shared_ptr<CfgAddress>;
 
@@ -42,7 +42,11 @@
 
 #include <string>
 #include <mutex>
+#include <atomic>
 #include <shm/shmauth.hpp>
+#include <shm/shmlog.hpp>
+#include <shm/shmsnapshot.hpp>
+#include <policy/identitytable.hpp>
 
 #include <log/logger.hpp>
 
@@ -56,6 +60,10 @@ struct AuthFactoryOptions {
     std::string portal_address6 = "[::]";
     std::string portal_port_http = "8008";
     std::string portal_port_https = "8043";
+
+    // full reload of shared memory tables (seconds), longer once writers are seen using change log
+    unsigned int shm_full_refresh = 20;
+    unsigned int shm_full_refresh_changelog = 300;
 };
 
 class AuthFactory {
@@ -66,12 +74,21 @@ class AuthFactory {
     using shared_ip4_map_t = shared_logoninfotype_ntoa_map<shm_logon_info,4>;
     using shared_ip6_map_t = shared_logoninfotype_ntoa_map<shm_logon_info6,16>;
 
-    using ip6_map_t = std::unordered_map<std::string,IdentityInfo6>;
-    using ip4_map_t = std::unordered_map<std::string,IdentityInfo> ;
+    using ip6_map_t = sx::auth::ShardedTable<in6_addr, IdentityInfo6, sx::auth::addr6_hash, sx::auth::addr6_equal>;
+    using ip4_map_t = sx::auth::ShardedTable<in_addr, IdentityInfo, sx::auth::addr4_hash, sx::auth::addr4_equal>;
 
     mutable std::recursive_mutex token_lock_;
+    // ip4/ip6 locks protect shared memory table copies (shm_ip4_map, shm_ip6_map), not identity maps:
+    // these have their own per-shard locks
     mutable std::recursive_mutex ip4_lock_;
     mutable std::recursive_mutex ip6_lock_;
+    std::mutex changes_attach_lock_;
+    std::mutex snap_ip4_lock_;
+    std::mutex snap_ip6_lock_;
+    std::mutex snap_removals_lock_;
+
+    // bumped each time identity database content changes
+    std::atomic<uint64_t> identity_epoch_ {0};
 
     AuthFactory() = default;
     virtual ~AuthFactory() = default;
@@ -88,6 +105,9 @@ public:
 
     AuthFactoryOptions options;
 
+    uint64_t identity_epoch() const noexcept { return identity_epoch_.load(std::memory_order_acquire); }
+    void identity_changed() noexcept { identity_epoch_.fetch_add(1, std::memory_order_acq_rel); }
+
     inline std::recursive_mutex& token_lock () const { return token_lock_; };
     inline std::recursive_mutex& ip4_lock () const { return ip4_lock_; };
     inline std::recursive_mutex& ip6_lock () const { return ip6_lock_; };
@@ -111,31 +131,78 @@ public:
 
     static token_map_t& get_token_map() { return get().token_map_; };
 
+    // lock-free generations of ip tables: once published, they take precedence over semaphore protected tables
+    ShmSnapshotTable snap_ip4_;
+    ShmSnapshotTable snap_ip6_;
+    std::atomic<uint64_t> snap_ip4_seen_ {0};
+    std::atomic<uint64_t> snap_ip6_seen_ {0};
+
+    // removals waiting to be published by identity thread, so workers never wait for snapshot writer lock
+    std::vector<in_addr> snap_ip4_removals_;
+    std::vector<in6_addr> snap_ip6_removals_;
+    unsigned int snap_ip4_deferred_ = 0;
+    unsigned int snap_ip6_deferred_ = 0;
+
+    // shared memory change log of tables above, applied as deltas
+    ShmChangeLog shm_changes_;
+    std::atomic<uint64_t> changes_seen_ {0};
+    std::atomic<bool> changes_from_writers_ {false};
+
+
+    // call @fn(GroupSet const&) with group membership of @peer identity (bitset of ids interned
+    // in sx::auth::GroupDict) under its shard lock, false if there is no such identity
+    template<typename F>
+    bool ipX_read_groups(sockaddr_storage const& peer, F&& fn) const {
+        if(auto addr = sx::auth::key4(peer); addr) {
+            return ip4_map_.read(addr.value(), [&fn](IdentityInfo const& id) { fn(id.group_set); });
+        }
+        if(auto addr = sx::auth::key6(peer); addr) {
+            return ip6_map_.read(addr.value(), [&fn](IdentityInfo6 const& id) { fn(id.group_set); });
+        }
+        return false;
+    }
 
-    std::optional<std::vector<std::string>> ip4_get_groups(std::string const& host);
-    std::optional<std::vector<std::string>> ip6_get_groups(std::string const& host);
+    // peer address of cx, identity tables are keyed by it. Host string is parsed only if the socket
+    // can't tell anymore (ie. already reset); ss_family is AF_UNSPEC if both fail.
+    static sockaddr_storage peer_addr(baseHostCX const* cx);
 
     // refresh from shared memory
     int shm_token_table_refresh ();
     int shm_ip6_table_refresh ();
     int shm_ip4_table_refresh ();
 
+    // apply change log records appended since last call, -1 if log is not available
+    bool shm_changes_attach ();
+    int shm_changes_apply ();
+    bool shm_changes_wait (unsigned int timeout_ms);
+    void shm_changes_append (ShmChangeLog::kind_t kind, ShmChangeLog::op_t op, void const* data, std::size_t len);
+    unsigned int shm_full_refresh_interval () const;
+
+    // load new snapshot generation, -1 if snapshots are not used (yet).
+    // Only identities loaded from snapshots are pruned when a generation no longer has them.
+    int shm_ip4_snapshot_refresh ();
+    int shm_ip6_snapshot_refresh ();
+
+    // publish queued removals, whatever can't be published now stays queued for the next call
+    void shm_snapshot_removals_flush ();
+
+    // insert or update identity from shared memory record
+    void ip4_update (shm_logon_info& rt, std::shared_ptr<logon_info_ext> ext = nullptr, bool from_snapshot = false);
+    void ip6_update (shm_logon_info6& rt, std::shared_ptr<logon_info_ext> ext = nullptr, bool from_snapshot = false);
+    void ipX_update (ShmIdentityRecord const& rec, bool from_snapshot = false);
+
 
     void ip4_timeout_check ();
     void ip6_timeout_check ();
 
-    IdentityInfo *ip4_get (std::string &);
-    IdentityInfo6 *ip6_get (std::string &);
-
-    bool ip4_inc_counters (const std::string &host, unsigned int rx, unsigned int tx);
-    bool ip6_inc_counters (const std::string &host, unsigned int rx, unsigned int tx);
+    bool ip4_inc_counters (in_addr const& addr, unsigned int rx, unsigned int tx);
+    bool ip6_inc_counters (in6_addr const& addr, unsigned int rx, unsigned int tx);
 
-    // lookup by ip -> returns pointer IN the auth_ip_map
+    // remove identity, also from shared memory table
     void ip4_remove (const std::string &host);
     void ip6_remove (const std::string &ip6_address);
 
-    bool ipX_inc_counters (baseHostCX *cx, unsigned int rx, unsigned int tx);
-    bool ipX_inc_counters (baseHostCX *cx);
+    bool ipX_inc_counters (sockaddr_storage const& peer, unsigned int rx, unsigned int tx);
 
 
     std::string to_string([[maybe_unused]] int verbosity) const { return "AuthFactory"; };
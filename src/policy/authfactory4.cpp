@@ -37,12 +37,120 @@
     which carries forward this exception.
 */
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <unordered_set>
+
 #include <log/logger.hpp>
 #include <policy/authfactory.hpp>
 #include <service/cfgapi/cfgapi.hpp>
 
+void AuthFactory::ip4_update(shm_logon_info& rt, std::shared_ptr<logon_info_ext> ext, bool from_snapshot) {
+
+    // record starts with the address in network order
+    in_addr key {};
+    std::memcpy(&key, rt.buf().data(), sizeof(key));
+
+    ip4_map_.upsert(key, [&](IdentityInfo& id, bool created) {
+        id.ip = rt.ip();
+        id.last_logon_info = rt;
+        id.ext_logon_info = ext;
+        id.username = ext ? ext->username() : rt.username();
+        id.from_snapshot = from_snapshot;
+        id.update();
+        id.group_set = sx::auth::GroupSet(sx::auth::GroupDict::get().intern_all(id.groups_vec));
+
+        if(created) {
+            _inf("New identity in database: ip: %s, username: %s, groups: %s ",id.ip.c_str(),id.username.c_str(),id.groups.c_str());
+        } else {
+            _dia("Updating identity in database: %s",id.ip.c_str());
+        }
+    });
+}
+
+void AuthFactory::ipX_update(ShmIdentityRecord const& rec, bool from_snapshot) {
+
+    auto const ip = rec.ip();
+
+    // fixed records keep truncated copy, full values live in ext_logon_info
+    std::shared_ptr<logon_info_ext> ext;
+    if(rec.username.size() >= LOGON_INFO_USERNAME_SZ or rec.groups.size() >= LOGON_INFO_GROUPS_SZ) {
+        ext = std::make_shared<logon_info_ext>(ip, rec.username, rec.groups);
+    }
+
+    if(rec.family == AF_INET6) {
+        shm_logon_info6 rt(ip.c_str(), rec.username.c_str(), rec.groups.c_str());
+        ip6_update(rt, std::move(ext), from_snapshot);
+    }
+    else {
+        shm_logon_info rt(ip.c_str(), rec.username.c_str(), rec.groups.c_str());
+        ip4_update(rt, std::move(ext), from_snapshot);
+    }
+}
+
+int AuthFactory::shm_ip4_snapshot_refresh() {
+
+    // other thread is loading, don't wait for it
+    std::unique_lock l_(snap_ip4_lock_, std::try_to_lock);
+    if(not l_.owns_lock()) return snap_ip4_seen_ > 0 ? 0 : -1;
+
+    if(not snap_ip4_.attached()) {
+        std::string name;
+        {
+            std::scoped_lock<std::recursive_mutex> lc_(CfgFactory::lock());
+            name = string_format(AUTH_IP_SNAP_NAME, CfgFactory::get()->tenant_name.c_str());
+        }
+        if(not snap_ip4_.attach(name)) return -1;
+    }
+
+    uint64_t seen = snap_ip4_seen_;
+    std::vector<ShmIdentityRecord> records;
+
+    switch (snap_ip4_.load(seen, records)) {
+        case ShmSnapshotTable::load_t::EMPTY:
+            return -1;
+        case ShmSnapshotTable::load_t::BUSY:
+            _deb("AuthFactory::shm_ip4_snapshot_refresh: generation not available, retrying later");
+            return snap_ip4_seen_ > 0 ? 0 : -1;
+        case ShmSnapshotTable::load_t::UNCHANGED:
+            return 0;
+        case ShmSnapshotTable::load_t::LOADED:
+            break;
+    }
+
+    std::unordered_set<in_addr, sx::auth::addr4_hash, sx::auth::addr4_equal> present;
+    for(auto const& rec: records) {
+        if(rec.family != AF_INET) continue;
+
+        in_addr key {};
+        std::memcpy(&key, rec.addr.data(), sizeof(key));
+        present.insert(key);
+
+        ipX_update(rec, true);
+    }
+
+    // generation is the complete set of snapshot identities. Those from change log or semaphore table
+    // are removed by their own source.
+    std::vector<in_addr> gone;
+    ip4_map_.for_each([&present, &gone](in_addr const& key, IdentityInfo const& id) {
+        if(id.from_snapshot and present.find(key) == present.end()) gone.push_back(key);
+    });
+    for(auto const& key: gone) ip4_map_.erase(key);
+
+    snap_ip4_seen_ = seen;
+    identity_changed();
+
+    _dia("AuthFactory::shm_ip4_snapshot_refresh: generation %lu, identities: %zu, removed: %zu", seen, present.size(), gone.size());
+    return static_cast<int>(present.size());
+}
+
 int AuthFactory::shm_ip4_table_refresh()  {
 
+    // semaphore protected table is not used once writers publish snapshots
+    if(auto const snap = shm_ip4_snapshot_refresh(); snap >= 0) return snap;
+
     {
         std::scoped_lock<std::recursive_mutex> l_(CfgFactory::lock());
 
@@ -79,59 +187,39 @@ int AuthFactory::shm_ip4_table_refresh()  {
 
         _dia("AuthFactory::shm_ip4_table_refresh: new data: version %d, entries %d",shm_ip4_map.header_version(),shm_ip4_map.header_entries());
         for(auto& rt: shm_ip4_map.entries()) {
-
-            std::string ip = rt.ip();
-
-            auto found = ip4_map_.find(ip);
-            if(found != ip4_map_.end()) {
-                _dia("Updating identity in database: %s",ip.c_str());
-                IdentityInfo& id = (*found).second;
-                id.ip = ip;
-                id.last_logon_info = rt;
-                id.username = rt.username();
-                id.update();
-            } else {
-                IdentityInfo i;
-                i.ip = ip;
-                i.last_logon_info = rt;
-                i.username = rt.username();
-                i.update();
-                ip4_map_[ip] = i;
-                _inf("New identity in database: ip: %s, username: %s, groups: %s ",ip.c_str(),i.username.c_str(),i.groups.c_str());
-            }
-            _deb("AuthFactory::shm_ip4_table_refresh: loaded: %d,%s,%s",ip.c_str(),rt.username().c_str(),rt.groups().c_str());
+            ip4_update(rt);
+            _deb("AuthFactory::shm_ip4_table_refresh: loaded: %s,%s,%s",rt.ip().c_str(),rt.username().c_str(),rt.groups().c_str());
         }
 
+        identity_changed();
         return l_ip;
     }
     return 0;
 }
 
 
-std::optional<std::vector<std::string>> AuthFactory::ip4_get_groups(std::string const& host) {
-    std::scoped_lock<std::recursive_mutex> l_(get_ip4_lock());
-
-    auto ip = get_ip4_map().find(host);
-    if (ip != get_ip4_map().end()) {
-        auto* id_ptr = &(*ip).second;
-        if(id_ptr)
-            return id_ptr->groups_vec;
-    }
+sockaddr_storage AuthFactory::peer_addr(baseHostCX const* cx) {
 
-    return std::nullopt;
-}
+    sockaddr_storage ss {};
+    if(not cx) return ss;
 
-std::optional<std::vector<std::string>> AuthFactory::ip6_get_groups(std::string const& host) {
-    std::scoped_lock<std::recursive_mutex> l_(get_ip6_lock());
+    if(cx->com() and cx->com()->resolve_socket_src(cx->socket(), nullptr, nullptr, &ss)) {
+        return ss;
+    }
 
-    auto ip = get_ip6_map().find(host);
-    if (ip != get_ip6_map().end()) {
-        auto* id_ptr = &(*ip).second;
-        if(id_ptr)
-            return id_ptr->groups_vec;
+    ss = sockaddr_storage {};
+    if(auto addr = sx::auth::parse4(cx->host()); addr) {
+        auto* sin = reinterpret_cast<sockaddr_in*>(&ss);
+        sin->sin_family = AF_INET;
+        sin->sin_addr = addr.value();
+    }
+    else if(auto addr6 = sx::auth::parse6(cx->host()); addr6) {
+        auto* sin6 = reinterpret_cast<sockaddr_in6*>(&ss);
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_addr = addr6.value();
     }
 
-    return std::nullopt;
+    return ss;
 }
 
 
@@ -178,36 +266,158 @@ int AuthFactory::shm_token_table_refresh()  {
     return 0;
 }
 
-IdentityInfo* AuthFactory::ip4_get(std::string& host) {
-    IdentityInfo* ret = nullptr;
+bool AuthFactory::shm_changes_attach() {
 
-    std::scoped_lock<std::recursive_mutex> l(AuthFactory::get_ip4_lock());
-    auto ip = ip4_map_.find(host);
+    if(shm_changes_.attached()) return true;
 
-    if (ip != ip4_map_.end()) {
-        IdentityInfo& id = (*ip).second;
-        ret  = &id;
+    auto l_ = std::scoped_lock(changes_attach_lock_);
+    if(shm_changes_.attached()) return true;
+
+    std::string name;
+    {
+        std::scoped_lock<std::recursive_mutex> lc_(CfgFactory::lock());
+        name = string_format(AUTH_LOG_MEM_NAME, CfgFactory::get()->tenant_name.c_str());
+    }
+
+    if(not shm_changes_.attach(name)) {
+        _war("AuthFactory::shm_changes_attach: cannot attach change log %s", name.c_str());
+        return false;
     }
 
-    return ret;
+    // older changes are picked up by full table reload
+    changes_seen_ = shm_changes_.head();
+    _dia("AuthFactory::shm_changes_attach: change log %s attached at sequence %lu", name.c_str(), changes_seen_.load());
 
+    return true;
 }
 
 
-bool  AuthFactory::ip4_inc_counters(const std::string &host, unsigned int rx, unsigned int tx) {
-    bool ret = false;
+int AuthFactory::shm_changes_apply() {
 
-    std::scoped_lock<std::recursive_mutex> l(AuthFactory::get_ip4_lock());
-    auto ip = ip4_map_.find(host);
+    if(not shm_changes_attach()) return -1;
 
-    if (ip != ip4_map_.end()) {
-        IdentityInfo& id = (*ip).second;
-        id.rx_bytes += rx;
-        id.tx_bytes += tx;
-        ret = true;
+    int changed = 0;
+    auto const result = shm_changes_.read(changes_seen_, [&](ShmChangeLog::entry const& e) {
+
+        using kind_t = ShmChangeLog::kind_t;
+        using op_t = ShmChangeLog::op_t;
+
+        auto const* data = reinterpret_cast<unsigned char const*>(e.data.data());
+
+        if(e.kind == kind_t::IP4) {
+            if(e.op == op_t::UPSERT and e.data.size() >= shm_logon_info::record_size()) {
+                unsigned char rec[shm_logon_info::record_size()];
+                std::memcpy(rec, data, sizeof(rec));
+
+                shm_logon_info rt;
+                rt.load(rec);
+                ip4_update(rt);
+
+                changes_from_writers_ = true;
+                ++changed;
+            }
+            else if(e.op == op_t::REMOVE and e.data.size() >= sizeof(in_addr)) {
+                in_addr key {};
+                std::memcpy(&key, data, sizeof(key));
+                if(ip4_map_.erase(key)) ++changed;
+            }
+        }
+        else if(e.kind == kind_t::IP6) {
+            if(e.op == op_t::UPSERT and e.data.size() >= shm_logon_info6::record_size()) {
+                unsigned char rec[shm_logon_info6::record_size()];
+                std::memcpy(rec, data, sizeof(rec));
+
+                shm_logon_info6 rt;
+                rt.load(rec);
+                ip6_update(rt);
+
+                changes_from_writers_ = true;
+                ++changed;
+            }
+            else if(e.op == op_t::REMOVE and e.data.size() >= sizeof(in6_addr)) {
+                in6_addr key {};
+                std::memcpy(&key, data, sizeof(key));
+                if(ip6_map_.erase(key)) ++changed;
+            }
+        }
+        else if(e.kind == kind_t::IDENTITY) {
+            ShmIdentityRecord rec;
+            if(rec.decode(e.data.data(), e.data.size()) == 0) return;
+
+            if(e.op == op_t::UPSERT) {
+                ipX_update(rec);
+                changes_from_writers_ = true;
+                ++changed;
+            }
+            else if(rec.family == AF_INET6) {
+                in6_addr key {};
+                std::memcpy(&key, rec.addr.data(), sizeof(key));
+                if(ip6_map_.erase(key)) ++changed;
+            }
+            else {
+                in_addr key {};
+                std::memcpy(&key, rec.addr.data(), sizeof(key));
+                if(ip4_map_.erase(key)) ++changed;
+            }
+        }
+        // tokens are consumed by portal backend
+    });
+
+    changes_seen_ = result.next;
+
+    if(result.applied > 0) {
+        _dia("AuthFactory::shm_changes_apply: %d identities changed by %zu log records", changed, result.applied);
+    }
+    if(changed > 0) identity_changed();
+
+    if(result.abandoned) {
+        _war("AuthFactory::shm_changes_apply: change log record %lu was never committed, reloading identity tables",
+             result.next - 1);
+        shm_ip4_table_refresh();
+        shm_ip6_table_refresh();
+    }
+    else if(result.overrun) {
+        _war("AuthFactory::shm_changes_apply: change log overrun, reloading identity tables");
+        shm_ip4_table_refresh();
+        shm_ip6_table_refresh();
     }
 
-    return ret;
+    return changed;
+}
+
+
+bool AuthFactory::shm_changes_wait(unsigned int timeout_ms) {
+
+    if(not shm_changes_attach()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+        return false;
+    }
+
+    return shm_changes_.wait(changes_seen_, timeout_ms);
+}
+
+
+void AuthFactory::shm_changes_append(ShmChangeLog::kind_t kind, ShmChangeLog::op_t op, void const* data, std::size_t len) {
+
+    if(not shm_changes_attach()) return;
+
+    if(shm_changes_.append(kind, op, data, len) < 0) {
+        _err("AuthFactory::shm_changes_append: cannot append %lu bytes", len);
+    }
+}
+
+
+unsigned int AuthFactory::shm_full_refresh_interval() const {
+    return changes_from_writers_ ? options.shm_full_refresh_changelog : options.shm_full_refresh;
+}
+
+
+bool  AuthFactory::ip4_inc_counters(in_addr const& addr, unsigned int rx, unsigned int tx) {
+
+    return ip4_map_.modify(addr, [rx, tx](IdentityInfo& id) {
+        id.rx_bytes += rx;
+        id.tx_bytes += tx;
+    });
 }
 
 
@@ -215,14 +425,16 @@ bool  AuthFactory::ip4_inc_counters(const std::string &host, unsigned int rx, un
 // remove IP from AUTH IP MAP and synchronize with SHM AUTH IP TABLE (table which is used to communicate with bend daemon)
 void AuthFactory::ip4_remove(const std::string &host) {
 
+    auto addr = sx::auth::parse4(host);
+    if(not addr) return;
+
     std::scoped_lock<std::recursive_mutex> l(AuthFactory::get_ip4_lock());
-    auto ip = ip4_map_.find(host);
 
-    if (ip != ip4_map_.end()) {
-        // erase internal ip map entry
+    // erase internal ip map entry
+    if (ip4_map_.erase(addr.value())) {
 
         _deb("cfgapi_ip_map_remove: auth ip map - removing: %s",host.c_str());
-        ip4_map_.erase(ip);
+        identity_changed();
 
         // for debug only: print all shm table entries
         if(*log.level() >= DUM) {
@@ -251,26 +463,89 @@ void AuthFactory::ip4_remove(const std::string &host) {
             shm_ip4_map.save(true);
         }
         shm_ip4_map.release();
+
+        if(snap_ip4_seen_ > 0) {
+            auto l_ = std::scoped_lock(snap_removals_lock_);
+            snap_ip4_removals_.push_back(addr.value());
+        }
+
+        shm_changes_append(ShmChangeLog::kind_t::IP4, ShmChangeLog::op_t::REMOVE, &addr.value(), sizeof(in_addr));
+    }
+}
+
+
+void AuthFactory::shm_snapshot_removals_flush() {
+
+    std::vector<in_addr> rm4;
+    std::vector<in6_addr> rm6;
+    {
+        auto l_ = std::scoped_lock(snap_removals_lock_);
+        rm4.swap(snap_ip4_removals_);
+        rm6.swap(snap_ip6_removals_);
+    }
+
+    auto erase_records = [](std::vector<ShmIdentityRecord>& records, auto const& pred) {
+        auto const before = records.size();
+        records.erase(std::remove_if(records.begin(), records.end(), pred), records.end());
+        return records.size() != before;
+    };
+
+    if(not rm4.empty() and snap_ip4_.try_update([&](std::vector<ShmIdentityRecord>& records) {
+            return erase_records(records, [&rm4](ShmIdentityRecord const& rec) {
+                return rec.family == AF_INET and std::any_of(rm4.begin(), rm4.end(), [&rec](in_addr const& a) {
+                    return std::memcmp(rec.addr.data(), &a, sizeof(a)) == 0;
+                });
+            });
+        }) == 0) {
+
+        auto l_ = std::scoped_lock(snap_removals_lock_);
+        snap_ip4_removals_.insert(snap_ip4_removals_.end(), rm4.begin(), rm4.end());
+        ++snap_ip4_deferred_;
+    } else {
+        snap_ip4_deferred_ = 0;
+    }
+
+    if(not rm6.empty() and snap_ip6_.try_update([&](std::vector<ShmIdentityRecord>& records) {
+            return erase_records(records, [&rm6](ShmIdentityRecord const& rec) {
+                return rec.family == AF_INET6 and std::any_of(rm6.begin(), rm6.end(), [&rec](in6_addr const& a) {
+                    return std::memcmp(rec.addr.data(), &a, sizeof(a)) == 0;
+                });
+            });
+        }) == 0) {
+
+        auto l_ = std::scoped_lock(snap_removals_lock_);
+        snap_ip6_removals_.insert(snap_ip6_removals_.end(), rm6.begin(), rm6.end());
+        ++snap_ip6_deferred_;
+    } else {
+        snap_ip6_deferred_ = 0;
+    }
+
+    // writer lock is normally held just for a moment
+    if(snap_ip4_deferred_ > 0 or snap_ip6_deferred_ > 0) {
+        auto const deferred = std::max(snap_ip4_deferred_, snap_ip6_deferred_);
+        if(deferred >= 10) {
+            auto l_ = std::scoped_lock(snap_removals_lock_);
+            _war("AuthFactory::shm_snapshot_removals_flush: cannot publish %zu/%zu removals (ip4/ip6) for %u attempts",
+                 snap_ip4_removals_.size(), snap_ip6_removals_.size(), deferred);
+        } else {
+            _dia("AuthFactory::shm_snapshot_removals_flush: snapshot writer busy, removals deferred");
+        }
     }
 }
 
 
 void AuthFactory::ip4_timeout_check() {
     _deb("cfgapi_ip_auth_timeout_check: started");
-    std::scoped_lock<std::recursive_mutex> l(AuthFactory::get_ip4_lock());
 
     std::set<std::string> to_remove;
 
-    for(auto& e: ip4_map_) {
-        const std::string&  ip = e.first;
-        IdentityInfo& id = e.second;
-
-        _deb("cfgapi_ip_auth_timeout_check: %s", ip.c_str());
+    ip4_map_.for_each([&](in_addr const&, IdentityInfo const& id) {
+        _deb("cfgapi_ip_auth_timeout_check: %s", id.ip.c_str());
         if(id.i_timeout()) {
-            _dia("cfgapi_ip_auth_timeout_check: idle timeout, adding to list %s", ip.c_str());
-            to_remove.insert(ip);
+            _dia("cfgapi_ip_auth_timeout_check: idle timeout, adding to list %s", id.ip.c_str());
+            to_remove.insert(id.ip);
         }
-    }
+    });
 
     for(auto tr: to_remove) {
         ip4_remove(tr);
@@ -279,23 +554,10 @@ void AuthFactory::ip4_timeout_check() {
 }
 
 
-bool AuthFactory::ipX_inc_counters(baseHostCX* cx, unsigned int rx, unsigned int tx) {
-    if(cx && cx->com()) {
-        if(cx->com()->l3_proto() == AF_INET6) {
-            return ip6_inc_counters(cx->host(),rx,tx);
-        } else
-        if(cx->com()->l3_proto() == AF_INET || cx->com()->l3_proto() == 0)  {
-            return ip4_inc_counters(cx->host(),rx,tx);
-        }
-    }
+bool AuthFactory::ipX_inc_counters(sockaddr_storage const& peer, unsigned int rx, unsigned int tx) {
 
-    return false;
-}
-
-bool AuthFactory::ipX_inc_counters(baseHostCX* cx) {
-    if(cx) {
-        return ipX_inc_counters(cx,cx->meter_read_bytes,cx->meter_write_bytes);
-    }
+    if(auto addr = sx::auth::key4(peer); addr) return ip4_inc_counters(addr.value(), rx, tx);
+    if(auto addr = sx::auth::key6(peer); addr) return ip6_inc_counters(addr.value(), rx, tx);
 
     return false;
 }
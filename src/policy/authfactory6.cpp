@@ -37,12 +37,98 @@
     which carries forward this exception.
 */
 
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
 #include <service/cfgapi/cfgapi.hpp>
 #include <policy/authfactory.hpp>
 #include <log/logger.hpp>
 
+void AuthFactory::ip6_update(shm_logon_info6& rt, std::shared_ptr<logon_info_ext> ext, bool from_snapshot) {
+
+    // record starts with the address in network order
+    in6_addr key {};
+    std::memcpy(&key, rt.buf().data(), sizeof(key));
+
+    ip6_map_.upsert(key, [&](IdentityInfo6& id, bool created) {
+        id.ip = rt.ip();
+        id.last_logon_info = rt;
+        id.ext_logon_info = ext;
+        id.username = ext ? ext->username() : rt.username();
+        id.from_snapshot = from_snapshot;
+        id.update();
+        id.group_set = sx::auth::GroupSet(sx::auth::GroupDict::get().intern_all(id.groups_vec));
+
+        if(created) {
+            _inf("New identity in database: ip: %s, username: %s, groups: %s ",id.ip.c_str(),id.username.c_str(),id.groups.c_str());
+        } else {
+            _dia("Updating identity in database: %s",id.ip.c_str());
+        }
+    });
+}
+
+int AuthFactory::shm_ip6_snapshot_refresh() {
+
+    // other thread is loading, don't wait for it
+    std::unique_lock l_(snap_ip6_lock_, std::try_to_lock);
+    if(not l_.owns_lock()) return snap_ip6_seen_ > 0 ? 0 : -1;
+
+    if(not snap_ip6_.attached()) {
+        std::string name;
+        {
+            std::scoped_lock<std::recursive_mutex> lc_(CfgFactory::lock());
+            name = string_format(AUTH_IP6_SNAP_NAME, CfgFactory::get()->tenant_name.c_str());
+        }
+        if(not snap_ip6_.attach(name)) return -1;
+    }
+
+    uint64_t seen = snap_ip6_seen_;
+    std::vector<ShmIdentityRecord> records;
+
+    switch (snap_ip6_.load(seen, records)) {
+        case ShmSnapshotTable::load_t::EMPTY:
+            return -1;
+        case ShmSnapshotTable::load_t::BUSY:
+            _deb("AuthFactory::shm_ip6_snapshot_refresh: generation not available, retrying later");
+            return snap_ip6_seen_ > 0 ? 0 : -1;
+        case ShmSnapshotTable::load_t::UNCHANGED:
+            return 0;
+        case ShmSnapshotTable::load_t::LOADED:
+            break;
+    }
+
+    std::unordered_set<in6_addr, sx::auth::addr6_hash, sx::auth::addr6_equal> present;
+    for(auto const& rec: records) {
+        if(rec.family != AF_INET6) continue;
+
+        in6_addr key {};
+        std::memcpy(&key, rec.addr.data(), sizeof(key));
+        present.insert(key);
+
+        ipX_update(rec, true);
+    }
+
+    // generation is the complete set of snapshot identities. Those from change log or semaphore table
+    // are removed by their own source.
+    std::vector<in6_addr> gone;
+    ip6_map_.for_each([&present, &gone](in6_addr const& key, IdentityInfo6 const& id) {
+        if(id.from_snapshot and present.find(key) == present.end()) gone.push_back(key);
+    });
+    for(auto const& key: gone) ip6_map_.erase(key);
+
+    snap_ip6_seen_ = seen;
+    identity_changed();
+
+    _dia("AuthFactory::shm_ip6_snapshot_refresh: generation %lu, identities: %zu, removed: %zu", seen, present.size(), gone.size());
+    return static_cast<int>(present.size());
+}
+
 int AuthFactory::shm_ip6_table_refresh()  {
 
+    // semaphore protected table is not used once writers publish snapshots
+    if(auto const snap = shm_ip6_snapshot_refresh(); snap >= 0) return snap;
+
     {
         std::scoped_lock<std::recursive_mutex> l_(CfgFactory::lock());
 
@@ -79,76 +165,37 @@ int AuthFactory::shm_ip6_table_refresh()  {
         
         _dia("cfgapi_auth_shm_ip6_table_refresh: new data: version %d, entries %d",shm_ip6_map.header_version(),shm_ip6_map.header_entries());
         for(auto& rt: shm_ip6_map.entries()) {
-            
-            std::string ip = rt.ip();
-            
-            auto found = ip6_map_.find(ip);
-            if(found != ip6_map_.end()) {
-                _dia("Updating identity in database: %s",ip.c_str());
-                IdentityInfo6& id = (*found).second;
-                id.ip = ip;
-                id.last_logon_info = rt;
-                id.username = rt.username();
-                id.update();
-            } else {
-                IdentityInfo6 i;
-                i.ip = ip;
-                i.last_logon_info = rt;
-                i.username = rt.username();
-                i.update();
-                ip6_map_[ip] = i;
-                _inf("New identity in database: ip: %s, username: %s, groups: %s ",ip.c_str(),i.username.c_str(),i.groups.c_str());
-            }
-            _deb("cfgapi_auth_shm_ip6_table_refresh: loaded: %d,%s,%s",ip.c_str(),rt.username().c_str(),rt.groups().c_str());
+            ip6_update(rt);
+            _deb("cfgapi_auth_shm_ip6_table_refresh: loaded: %s,%s,%s",rt.ip().c_str(),rt.username().c_str(),rt.groups().c_str());
         }
         
+        identity_changed();
         return l_ip;
     }
     return 0;
 }
 
-IdentityInfo6* AuthFactory::ip6_get(std::string& host) {
-    IdentityInfo6* ret = nullptr;
+bool  AuthFactory::ip6_inc_counters(in6_addr const& addr, unsigned int rx, unsigned int tx) {
 
-    std::scoped_lock<std::recursive_mutex> l_(AuthFactory::get_ip6_lock());
-    auto ip = ip6_map_.find(host);
-
-    if (ip != ip6_map_.end()) {
-        IdentityInfo6& id = (*ip).second;
-        ret  = &id;
-    }
-
-    return ret;
-}
-
-
-bool  AuthFactory::ip6_inc_counters(const std::string &host, unsigned int rx, unsigned int tx) {
-    bool ret = false;
-
-    std::scoped_lock<std::recursive_mutex> l_(AuthFactory::get_ip6_lock());
-    auto ip = ip6_map_.find(host);
-
-    if (ip != ip6_map_.end()) {
-        IdentityInfo6& id = (*ip).second;
+    return ip6_map_.modify(addr, [rx, tx](IdentityInfo6& id) {
         id.rx_bytes += rx;
         id.tx_bytes += tx;
-        ret = true;
-    }
-    
-    return ret;
+    });
 }
 
 // remove IP from AUTH IP MAP and synchronize with SHM AUTH IP TABLE (table which is used to communicate with bend daemon)
 void AuthFactory::ip6_remove (const std::string &ip6_address) {
 
+    auto addr = sx::auth::parse6(ip6_address);
+    if(not addr) return;
+
     std::scoped_lock<std::recursive_mutex> l_(AuthFactory::get_ip6_lock());
-    auto ip = ip6_map_.find(ip6_address);
 
-    if (ip != ip6_map_.end()) {
-        // erase internal ip map entry
+    // erase internal ip map entry
+    if (ip6_map_.erase(addr.value())) {
 
         _dia("cfgapi_ip_map_remove: auth ip map - removing: %s", ip6_address.c_str());
-        ip6_map_.erase(ip);
+        identity_changed();
 
         // for debug only: print all shm table entries (optimized-out in Release)
         _if_deb {
@@ -178,26 +225,29 @@ void AuthFactory::ip6_remove (const std::string &ip6_address) {
             shm_ip6_map.save(true);
         }
         shm_ip6_map.release();
+
+        if(snap_ip6_seen_ > 0) {
+            auto l_ = std::scoped_lock(snap_removals_lock_);
+            snap_ip6_removals_.push_back(addr.value());
+        }
+
+        shm_changes_append(ShmChangeLog::kind_t::IP6, ShmChangeLog::op_t::REMOVE, &addr.value(), sizeof(in6_addr));
     }
 }
 
 
 void AuthFactory::ip6_timeout_check() {
     _deb("cfgapi_ip_auth_timeout_check: started");
-    std::scoped_lock<std::recursive_mutex> l_(AuthFactory::get_ip6_lock());
-    
+
     std::set<std::string> to_remove;
-    
-    for(auto& e: ip6_map_) {
-        const std::string&  ip = e.first;
-        IdentityInfo6& id = e.second;
 
-        _dia("cfgapi_ip_auth_timeout_check: %s", ip.c_str());
+    ip6_map_.for_each([&](in6_addr const&, IdentityInfo6 const& id) {
+        _dia("cfgapi_ip_auth_timeout_check: %s", id.ip.c_str());
         if(id.i_timeout()) {
-            _dia("cfgapi_ip_auth_timeout_check: idle timeout, adding to list %s", ip.c_str());
-            to_remove.insert(ip);
+            _dia("cfgapi_ip_auth_timeout_check: idle timeout, adding to list %s", id.ip.c_str());
+            to_remove.insert(id.ip);
         }
-    }
+    });
     
     for(auto tr: to_remove) {
         ip6_remove(tr);
@@ -12,6 +12,9 @@
 #include <policy/profiles.hpp>
 #include <ranges.hpp>
 
+#include <unordered_set>
+#include <algorithm>
+
 
 class CfgElement {
     std::string name_;
@@ -29,6 +32,8 @@ public:
     dependency_vec_t const& usage_vec() const noexcept  { return usage_references_; };
     bool has_usage() const { return ! usage_references_.empty(); }
     void usage_add(std::weak_ptr<CfgElement> a);
+    // drop references to @gone elements, expired references are dropped too
+    void usage_remove(std::unordered_set<CfgElement const*> const& gone);
 
     inline std::vector<std::string> usage_strvec() const;
 };
@@ -61,6 +66,14 @@ inline std::vector<std::string> CfgElement::usage_strvec() const {
 
 inline void CfgElement::usage_add (std::weak_ptr<CfgElement> a) { usage_vec().emplace_back(a); }
 
+inline void CfgElement::usage_remove (std::unordered_set<CfgElement const*> const& gone) {
+    auto& vec = usage_vec();
+    vec.erase(std::remove_if(vec.begin(), vec.end(), [&gone](auto const& ref) {
+        auto ptr = ref.lock();
+        return not ptr or gone.find(ptr.get()) != gone.end();
+    }), vec.end());
+}
+
 
 template <typename val_type>
 struct CfgSingle : public CfgElement {
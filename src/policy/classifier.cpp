@@ -0,0 +1,421 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+
+#include <arpa/inet.h>
+
+#include <vars.hpp>
+#include <policy/classifier.hpp>
+
+namespace {
+
+    int sock_2_net(int sock_type) {
+        switch (sock_type) {
+            case SOCK_STREAM:
+                return 6;
+            case SOCK_DGRAM:
+                return 17;
+            default:
+                return 0;
+        }
+    }
+
+    inline void bit_set(PolicyClassifier::bitset_t& b, std::size_t i) {
+        b[i / 64] |= (1ULL << (i % 64));
+    }
+
+    inline bool bit_test(PolicyClassifier::bitset_t const& b, std::size_t i) {
+        return b[i / 64] & (1ULL << (i % 64));
+    }
+
+    inline uint32_t to_u32(uint8_t const* b) {
+        return (static_cast<uint32_t>(b[0]) << 24) | (static_cast<uint32_t>(b[1]) << 16) |
+               (static_cast<uint32_t>(b[2]) << 8) | static_cast<uint32_t>(b[3]);
+    }
+
+    inline PolicyClassifier::uint128_t to_u128(uint8_t const* b) {
+        PolicyClassifier::uint128_t r = 0;
+        for(int i = 0; i < 16; ++i) {
+            r = (r << 8) | b[i];
+        }
+        return r;
+    }
+
+    inline int ctz128(PolicyClassifier::uint128_t v) {
+        auto low = static_cast<uint64_t>(v);
+        return low ? __builtin_ctzll(low) : 64 + __builtin_ctzll(static_cast<uint64_t>(v >> 64));
+    }
+
+    // mask with 'pflen' leading ones
+    template <typename T>
+    inline T prefix_mask(int pflen, int bits) {
+        if(pflen <= 0) return 0;
+        if(pflen >= bits) return ~T(0);
+        return ~T(0) << (bits - pflen);
+    }
+
+    struct AddressRanges {
+        std::vector<PolicyClassifier::IntervalTable<uint32_t>::Range> v4;
+        std::vector<PolicyClassifier::IntervalTable<PolicyClassifier::uint128_t>::Range> v6;
+    };
+
+    // compile address group into ranges; return false if group contains something we can't compile
+    bool compile_addresses(PolicyRule::group_of_addresses const& group, std::size_t rule, AddressRanges& out) {
+
+        for(auto const& cfg_addr: group) {
+            auto* ca = dynamic_cast<CidrAddress*>(cfg_addr->value().get());
+            if(not ca) return false;
+
+            auto const* c = ca->cidr();
+            // invalid address never matches
+            if(not c) continue;
+
+            auto pflen = cidr::cidr_get_pflen(c);
+            if(pflen < 0) return false;
+
+            if(c->proto == CIDR_IPV4) {
+                auto mask = prefix_mask<uint32_t>(pflen, 32);
+                auto low = to_u32(&c->addr[12]) & mask;
+                out.v4.push_back({ low, low | ~mask, rule });
+            }
+            else if(c->proto == CIDR_IPV6) {
+                auto mask = prefix_mask<PolicyClassifier::uint128_t>(pflen, 128);
+                auto low = to_u128(c->addr) & mask;
+                out.v6.push_back({ low, low | ~mask, rule });
+            }
+        }
+
+        return true;
+    }
+
+    void compile_ports(PolicyRule::group_of_ports const& group, std::size_t rule,
+                       std::vector<PolicyClassifier::IntervalTable<uint32_t>::Range>& out) {
+
+        for(auto const& cfg_range: group) {
+            auto low = std::clamp(cfg_range->value().first, 0, 65535);
+            auto high = std::clamp(cfg_range->value().second, 0, 65535);
+            if(low > high) continue;
+
+            out.push_back({ static_cast<uint32_t>(low), static_cast<uint32_t>(high), rule });
+        }
+    }
+}
+
+
+template <typename key_type>
+void PolicyClassifier::IntervalTable<key_type>::build(std::vector<Range> const& ranges, bitset_t const& wildcards) {
+
+    boundaries.clear();
+    bits.clear();
+
+    boundaries.push_back(0);
+    for(auto const& r: ranges) {
+        boundaries.push_back(r.low);
+        if(r.high != ~key_type(0)) boundaries.push_back(r.high + 1);
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+    bits.assign(boundaries.size(), wildcards);
+
+    for(auto const& r: ranges) {
+        auto first = std::lower_bound(boundaries.begin(), boundaries.end(), r.low) - boundaries.begin();
+        auto last = std::upper_bound(boundaries.begin(), boundaries.end(), r.high) - boundaries.begin();
+
+        for(auto i = first; i < last; ++i) {
+            bit_set(bits[i], r.rule);
+        }
+    }
+
+    // merge neighbours with identical rule sets - fewer intervals, shorter binary search
+    std::vector<key_type> merged_boundaries;
+    std::vector<bitset_t> merged_bits;
+    for(std::size_t i = 0; i < boundaries.size(); ++i) {
+        if(not merged_bits.empty() and merged_bits.back() == bits[i]) continue;
+
+        merged_boundaries.push_back(boundaries[i]);
+        merged_bits.push_back(std::move(bits[i]));
+    }
+
+    boundaries = std::move(merged_boundaries);
+    bits = std::move(merged_bits);
+}
+
+template <typename key_type>
+PolicyClassifier::bitset_t const* PolicyClassifier::IntervalTable<key_type>::lookup(key_type value) const {
+    auto it = std::upper_bound(boundaries.begin(), boundaries.end(), value);
+    return &bits[(it - boundaries.begin()) - 1];
+}
+
+
+PolicyClassifier::PolicyClassifier(std::vector<std::shared_ptr<PolicyRule>> const& rules) : rules_(rules) {
+
+    words_ = (rules_.size() + 63) / 64;
+
+    verify_.assign(words_, 0);
+    bitset_t proto_any(words_, 0);
+
+    bitset_t src_any(words_, 0);
+    bitset_t dst_any(words_, 0);
+    bitset_t sport_any(words_, 0);
+    bitset_t dport_any(words_, 0);
+
+    AddressRanges src_ranges;
+    AddressRanges dst_ranges;
+    std::vector<IntervalTable<uint32_t>::Range> sport_ranges;
+    std::vector<IntervalTable<uint32_t>::Range> dport_ranges;
+
+    for(auto& p: proto_) p.assign(words_, 0);
+
+    for(std::size_t i = 0; i < rules_.size(); ++i) {
+        auto const& rule = rules_[i];
+
+        // disabled rules stay out of all tables, so they can't be candidates
+        if(not rule or rule->is_disabled) continue;
+
+        if(rule->proto->value() == 0)
+            bit_set(proto_any, i);
+        else
+            bit_set(proto_[rule->proto->value()], i);
+
+        auto compile_group = [&](PolicyRule::group_of_addresses const& group, AddressRanges& out, bitset_t& any) {
+            if(group.empty()) {
+                bit_set(any, i);
+            }
+            else if(not compile_addresses(group, i, out)) {
+                // dynamic content - let it be a candidate everywhere and verify it later
+                bit_set(any, i);
+                bit_set(verify_, i);
+            }
+        };
+
+        compile_group(rule->src, src_ranges, src_any);
+        compile_group(rule->dst, dst_ranges, dst_any);
+
+        if(rule->src_ports.empty()) bit_set(sport_any, i);
+        else compile_ports(rule->src_ports, i, sport_ranges);
+
+        if(rule->dst_ports.empty()) bit_set(dport_any, i);
+        else compile_ports(rule->dst_ports, i, dport_ranges);
+
+        if(bit_test(verify_, i)) ++verify_count_;
+    }
+
+    for(auto& p: proto_) {
+        for(std::size_t w = 0; w < words_; ++w) p[w] |= proto_any[w];
+    }
+
+    src4_.build(src_ranges.v4, src_any);
+    src6_.build(src_ranges.v6, src_any);
+    dst4_.build(dst_ranges.v4, dst_any);
+    dst6_.build(dst_ranges.v6, dst_any);
+    src_ports_.build(sport_ranges, sport_any);
+    dst_ports_.build(dport_ranges, dport_any);
+
+    // all source interval boundaries are aligned to this prefix
+    for(auto b: src4_.boundaries) {
+        if(b) src4_prefix_ = std::max(src4_prefix_, 32 - __builtin_ctz(b));
+    }
+    for(auto b: src6_.boundaries) {
+        if(b) src6_prefix_ = std::max(src6_prefix_, 128 - ctz128(b));
+    }
+
+    first_uncacheable_ = rules_.size();
+    for(std::size_t i = 0; i < rules_.size(); ++i) {
+        auto const& rule = rules_[i];
+        if(not rule or rule->is_disabled) continue;
+
+        if(bit_test(verify_, i) or not rule->src_ports.empty()) {
+            first_uncacheable_ = i;
+            break;
+        }
+    }
+
+    _dia("PolicyClassifier: compiled %d rules (%d need verification), %dB", rules_.size(), verify_count_, memory_usage());
+}
+
+
+std::optional<PolicyClassifier::Key> PolicyClassifier::Key::from_cx(baseHostCX const* left, baseHostCX const* right) {
+
+    if(not left or not right or not left->com()) return std::nullopt;
+
+    Key k;
+    k.proto = sock_2_net(left->com()->l4_proto());
+    if(k.proto == 0) return std::nullopt;
+
+    auto parse = [](std::string const& host, std::array<uint8_t, 16>& out) -> int {
+        if(inet_pton(AF_INET, host.c_str(), &out[12]) == 1) {
+            return AF_INET;
+        }
+        if(inet_pton(AF_INET6, host.c_str(), out.data()) == 1) {
+            // v4-mapped addresses are treated specially by libcidr - leave them to the slow path
+            if(IN6_IS_ADDR_V4MAPPED(reinterpret_cast<in6_addr const*>(out.data()))) return 0;
+            return AF_INET6;
+        }
+        return 0;
+    };
+
+    k.family = parse(left->host(), k.src);
+    if(k.family == 0 or k.family != parse(right->host(), k.dst)) return std::nullopt;
+
+    k.src_port = safe_val(left->port());
+    k.dst_port = safe_val(right->port());
+
+    return k;
+}
+
+
+int PolicyClassifier::match(Key const& key, baseProxy* proxy, std::vector<baseHostCX*>* left, std::vector<baseHostCX*>* right) const {
+
+    if(rules_.empty()) return -1;
+
+    // invalid ports can't fall into any compiled range, only into wildcards
+    auto port_key = [](int p) { return p < 0 ? 65536U : static_cast<uint32_t>(p); };
+
+    std::array<bitset_t const*, 5> dims {};
+    dims[0] = &proto_[key.proto & 0xff];
+    if(key.family == AF_INET) {
+        dims[1] = src4_.lookup(to_u32(&key.src[12]));
+        dims[2] = dst4_.lookup(to_u32(&key.dst[12]));
+    } else {
+        dims[1] = src6_.lookup(to_u128(key.src.data()));
+        dims[2] = dst6_.lookup(to_u128(key.dst.data()));
+    }
+    dims[3] = src_ports_.lookup(port_key(key.src_port));
+    dims[4] = dst_ports_.lookup(port_key(key.dst_port));
+
+    for(std::size_t w = 0; w < words_; ++w) {
+        uint64_t m = (*dims[0])[w] & (*dims[1])[w] & (*dims[2])[w] & (*dims[3])[w] & (*dims[4])[w];
+
+        while(m) {
+            auto idx = w * 64 + static_cast<std::size_t>(__builtin_ctzll(m));
+            auto const& rule = rules_[idx];
+
+            if(verify_[w] & (m & -m)) {
+                bool verified = proxy ? rule->match(proxy) : rule->match(*left, *right);
+                if(verified) {
+                    _deb("PolicyClassifier::match: verified #%d", idx);
+                    return static_cast<int>(idx);
+                }
+                _deb("PolicyClassifier::match: candidate #%d not verified", idx);
+            }
+            else {
+                _deb("PolicyClassifier::match: matched #%d", idx);
+                rule->cnt_matches.fetch_add(1, std::memory_order_relaxed);
+                return static_cast<int>(idx);
+            }
+
+            m &= (m - 1);
+        }
+    }
+
+    return -1;
+}
+
+bool PolicyClassifier::cacheable(int verdict) const {
+    // implicit deny is a result of all rules
+    if(verdict < 0) return first_uncacheable_ == rules_.size();
+
+    return static_cast<std::size_t>(verdict) < first_uncacheable_;
+}
+
+std::optional<int> PolicyClassifier::match(baseProxy* proxy) const {
+
+    if(not proxy) return std::nullopt;
+
+    // classifier works with exactly one cx on each side
+    if(proxy->ls().size() + proxy->lda().size() != 1) return std::nullopt;
+    if(proxy->rs().size() + proxy->rda().size() != 1) return std::nullopt;
+
+    auto const* l = proxy->ls().empty() ? proxy->lda().front() : proxy->ls().front();
+    auto const* r = proxy->rs().empty() ? proxy->rda().front() : proxy->rs().front();
+
+    auto key = Key::from_cx(l, r);
+    if(not key) return std::nullopt;
+
+    return match(key.value(), proxy, nullptr, nullptr);
+}
+
+std::optional<int> PolicyClassifier::match(std::vector<baseHostCX*>& left, std::vector<baseHostCX*>& right) const {
+
+    if(left.size() != 1 or right.size() != 1) return std::nullopt;
+
+    auto key = Key::from_cx(left.front(), right.front());
+    if(not key) return std::nullopt;
+
+    return match(key.value(), nullptr, &left, &right);
+}
+
+
+std::size_t PolicyClassifier::memory_usage() const {
+
+    std::size_t sz = sizeof(PolicyClassifier) + verify_.size() * sizeof(uint64_t);
+
+    for(auto const& p: proto_) sz += p.size() * sizeof(uint64_t);
+
+    auto table_size = [](auto const& table) {
+        std::size_t ret = table.boundaries.size() * sizeof(decltype(table.boundaries[0]));
+        for(auto const& b: table.bits) ret += b.size() * sizeof(uint64_t);
+        return ret;
+    };
+
+    sz += table_size(src4_) + table_size(dst4_) + table_size(src6_) + table_size(dst6_);
+    sz += table_size(src_ports_) + table_size(dst_ports_);
+
+    return sz;
+}
+
+std::string PolicyClassifier::to_string(int verbosity) const {
+    std::stringstream ss;
+
+    ss << "PolicyClassifier: rules=" << rules_.size() << " verify=" << verify_count_;
+    ss << " cacheable=" << first_uncacheable_ << " src-prefix=" << src4_prefix_ << "/" << src6_prefix_;
+
+    if(verbosity > iINF) {
+        ss << " intervals: src4=" << src4_.boundaries.size() << " dst4=" << dst4_.boundaries.size()
+           << " src6=" << src6_.boundaries.size() << " dst6=" << dst6_.boundaries.size()
+           << " sport=" << src_ports_.boundaries.size() << " dport=" << dst_ports_.boundaries.size();
+        ss << " memory=" << memory_usage() << "B";
+    }
+
+    return ss.str();
+}
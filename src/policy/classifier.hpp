@@ -0,0 +1,146 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef POLICY_CLASSIFIER_HPP
+#define POLICY_CLASSIFIER_HPP
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <optional>
+#include <cstdint>
+
+#include <hostcx.hpp>
+#include <baseproxy.hpp>
+
+#include <policy/policy.hpp>
+
+// PolicyClassifier is a compiled form of the policy list. It's built once when policies are (re)loaded
+// and answers "which is the first rule matching this connection" without walking rules one by one.
+//
+// Each match dimension (l4 proto, source address, source port, destination address, destination port)
+// is split into elementary intervals. Every interval carries a bitset of rules which match any value
+// inside of it. Lookup finds the interval in each dimension (binary search), ANDs the bitsets together and
+// the lowest set bit is the first matching rule.
+//
+// Rules referring to objects which can't be compiled into static intervals (ie. FqdnAddress, whose match
+// depends on DNS cache content) are treated as wildcards in that dimension and marked for verification:
+// if such rule becomes a candidate, the classic PolicyRule::match() is called to get the definitive answer.
+
+class PolicyClassifier {
+
+public:
+    using bitset_t = std::vector<uint64_t>;
+    using uint128_t = unsigned __int128;
+
+    // traffic key - values extracted once per connection
+    struct Key {
+        int proto = 0;
+        int family = 0;
+        std::array<uint8_t, 16> src {};
+        std::array<uint8_t, 16> dst {};
+        int src_port = -1;
+        int dst_port = -1;
+
+        static std::optional<Key> from_cx(baseHostCX const* left, baseHostCX const* right);
+    };
+
+    template <typename key_type>
+    struct IntervalTable {
+        // sorted lower boundaries of elementary intervals, first one is always zero
+        std::vector<key_type> boundaries;
+        // rule bitset for each of elementary intervals
+        std::vector<bitset_t> bits;
+
+        struct Range {
+            key_type low;
+            key_type high;
+            std::size_t rule;
+        };
+
+        void build(std::vector<Range> const& ranges, bitset_t const& wildcards);
+        bitset_t const* lookup(key_type value) const;
+    };
+
+    explicit PolicyClassifier(std::vector<std::shared_ptr<PolicyRule>> const& rules);
+
+    // Return index of first matching rule, -1 if none matches (implicit deny), or nullopt
+    // if connection can't be classified (caller should fall back to the linear rule matching).
+    std::optional<int> match(baseProxy* proxy) const;
+    std::optional<int> match(std::vector<baseHostCX*>& left, std::vector<baseHostCX*>& right) const;
+    int match(Key const& key, baseProxy* proxy, std::vector<baseHostCX*>* left, std::vector<baseHostCX*>* right) const;
+
+    // Connections differing only in source address bits below src_prefix() and in source port get
+    // the same verdict - unless the verdict depends on rules with dynamic content or source ports.
+    int src_prefix(int family) const { return family == AF_INET6 ? src6_prefix_ : src4_prefix_; }
+    bool cacheable(int verdict) const;
+
+    std::size_t size() const { return rules_.size(); }
+    std::size_t verified_rules() const { return verify_count_; }
+    std::size_t memory_usage() const;
+
+    std::string to_string(int verbosity) const;
+
+private:
+    std::vector<std::shared_ptr<PolicyRule>> rules_;
+    std::size_t words_ = 0;
+    std::size_t verify_count_ = 0;
+
+    int src4_prefix_ = 0;
+    int src6_prefix_ = 0;
+    // index of the first rule whose match can't be cached
+    std::size_t first_uncacheable_ = 0;
+
+    // rules which must be confirmed by PolicyRule::match()
+    bitset_t verify_;
+
+    // direct-indexed by IP protocol number
+    std::array<bitset_t, 256> proto_;
+
+    IntervalTable<uint32_t> src4_;
+    IntervalTable<uint32_t> dst4_;
+    IntervalTable<uint128_t> src6_;
+    IntervalTable<uint128_t> dst6_;
+    IntervalTable<uint32_t> src_ports_;
+    IntervalTable<uint32_t> dst_ports_;
+
+    logan_lite log {"policy.classifier"};
+};
+
+#endif
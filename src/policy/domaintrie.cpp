@@ -0,0 +1,155 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <algorithm>
+#include <cctype>
+
+#include <policy/domaintrie.hpp>
+
+namespace {
+
+    // normalize @name into lowercase @buf, strip trailing dot. Returns empty view if name doesn't fit.
+    std::string_view normalize(std::string_view name, char* buf, std::size_t buf_len) {
+        if(not name.empty() and name.back() == '.') name.remove_suffix(1);
+        if(name.empty() or name.size() > buf_len) return {};
+
+        std::transform(name.begin(), name.end(), buf, [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return { buf, name.size() };
+    }
+
+    // pop the rightmost label from @name
+    std::string_view pop_label(std::string_view& name) {
+        auto dot = name.rfind('.');
+        if(dot == std::string_view::npos) {
+            auto ret = name;
+            name = {};
+            return ret;
+        }
+
+        auto ret = name.substr(dot + 1);
+        name = name.substr(0, dot);
+        return ret;
+    }
+}
+
+DomainTrie::Node* DomainTrie::find_node(std::string_view entry, bool& wildcard, bool create) {
+
+    char buf[max_name_len];
+    auto name = normalize(entry, buf, sizeof(buf));
+
+    wildcard = false;
+    if(name.substr(0, 2) == "*.") {
+        wildcard = true;
+        name.remove_prefix(2);
+    }
+    if(name.empty() or name.find('*') != std::string_view::npos) return nullptr;
+    if(name.front() == '.' or name.find("..") != std::string_view::npos) return nullptr;
+
+    uint32_t cur = 0;
+    while(not name.empty()) {
+        auto label = pop_label(name);
+
+        auto it = nodes_[cur].children.find(label);
+        if(it == nodes_[cur].children.end()) {
+            if(not create) return nullptr;
+
+            auto next = static_cast<uint32_t>(nodes_.size());
+            nodes_[cur].children.emplace(std::string(label), next);
+            nodes_.emplace_back();
+            cur = next;
+        }
+        else {
+            cur = it->second;
+        }
+    }
+
+    return &nodes_[cur];
+}
+
+bool DomainTrie::insert(std::string_view entry) {
+
+    bool wildcard = false;
+    auto* node = find_node(entry, wildcard, true);
+    if(not node) return false;
+
+    auto& already = wildcard ? node->wildcard : node->exact;
+    if(not already) {
+        already = true;
+        ++entries_;
+    }
+
+    return true;
+}
+
+bool DomainTrie::erase(std::string_view entry) {
+
+    bool wildcard = false;
+    auto* node = find_node(entry, wildcard, false);
+    if(not node) return false;
+
+    auto& present = wildcard ? node->wildcard : node->exact;
+    if(not present) return false;
+
+    present = false;
+    --entries_;
+
+    return true;
+}
+
+bool DomainTrie::match(std::string_view name_to_match, bool wildcards) const {
+
+    char buf[max_name_len];
+    auto name = normalize(name_to_match, buf, sizeof(buf));
+    if(name.empty()) return false;
+
+    uint32_t cur = 0;
+    while(not name.empty()) {
+        auto label = pop_label(name);
+
+        auto it = nodes_[cur].children.find(label);
+        if(it == nodes_[cur].children.end()) return false;
+
+        cur = it->second;
+
+        // wildcard covers only names below, there must be some labels left
+        if(wildcards and nodes_[cur].wildcard and not name.empty()) return true;
+    }
+
+    return nodes_[cur].exact;
+}
@@ -0,0 +1,89 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef POLICY_DOMAINTRIE_HPP
+#define POLICY_DOMAINTRIE_HPP
+
+#include <vector>
+#include <map>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+// DomainTrie is a compiled set of domain names, stored by labels in reversed order (com -> example -> www).
+// Entries are either exact names ("example.com"), or wildcards ("*.example.com") matching any name
+// below the wildcard domain, but not the domain itself.
+//
+// Lookup walks the name from its rightmost label and costs O(labels), regardless of the number of entries.
+// Matching is case-insensitive and ignores trailing dot.
+
+class DomainTrie {
+
+public:
+    // insert new entry. Returns false if entry is not a valid name.
+    bool insert(std::string_view entry);
+    // remove entry inserted before. Nodes are kept, returns false if entry was not present.
+    bool erase(std::string_view entry);
+
+    // returns true if @name matches any entry. Wildcard entries are ignored if @wildcards is false.
+    bool match(std::string_view name, bool wildcards = true) const;
+
+    std::size_t size() const { return entries_; }
+    std::size_t node_count() const { return nodes_.size(); }
+    bool empty() const { return entries_ == 0; }
+
+    // longest name we are able to lowercase without allocation
+    constexpr static std::size_t max_name_len = 255;
+
+private:
+    // walk to the node of normalized @entry, creating missing nodes if @create is set; nullptr if not found
+    struct Node;
+    Node* find_node(std::string_view entry, bool& wildcard, bool create);
+
+    struct Node {
+        std::map<std::string, uint32_t, std::less<>> children;
+        bool exact = false;
+        bool wildcard = false;
+    };
+
+    std::vector<Node> nodes_ { Node() };
+    std::size_t entries_ = 0;
+};
+
+#endif //POLICY_DOMAINTRIE_HPP
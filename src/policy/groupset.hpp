@@ -0,0 +1,99 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef GROUPSET_HPP
+#define GROUPSET_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sx::auth {
+
+    using group_id_t = uint32_t;
+    // sorted, without duplicates
+    using group_ids_t = std::vector<group_id_t>;
+
+
+    // Bitset indexed by group id, membership tests are word-wise AND. It's sized to the highest id set,
+    // ids are dense, so sets stay as small as the dictionary.
+    class GroupSet {
+    public:
+        GroupSet() = default;
+        explicit GroupSet(group_ids_t const& ids) { for(auto id: ids) set(id); }
+
+        void set(group_id_t id) {
+            auto const w = id / 64;
+            if(w >= words_.size()) words_.resize(w + 1, 0);
+            words_[w] |= (1ULL << (id % 64));
+        }
+
+        bool test(group_id_t id) const {
+            auto const w = id / 64;
+            return w < words_.size() and (words_[w] & (1ULL << (id % 64)));
+        }
+
+        bool intersects(GroupSet const& other) const {
+            auto const n = std::min(words_.size(), other.words_.size());
+            for(std::size_t i = 0; i < n; ++i) {
+                if(words_[i] & other.words_[i]) return true;
+            }
+            return false;
+        }
+
+        void merge(GroupSet const& other) {
+            if(other.words_.size() > words_.size()) words_.resize(other.words_.size(), 0);
+            for(std::size_t i = 0; i < other.words_.size(); ++i) words_[i] |= other.words_[i];
+        }
+
+        std::size_t count() const {
+            std::size_t ret = 0;
+            for(auto w: words_) ret += static_cast<std::size_t>(__builtin_popcountll(w));
+            return ret;
+        }
+
+        bool empty() const { return count() == 0; }
+
+    private:
+        std::vector<uint64_t> words_;
+    };
+}
+
+#endif //GROUPSET_HPP
@@ -0,0 +1,327 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <policy/healthcheck.hpp>
+
+std::string BackendHealth::Target::key() const {
+    return host + ":" + std::to_string(port) + "/" + mode_str(check);
+}
+
+BackendHealth::mode_t BackendHealth::mode_from_str(std::string const& str) {
+    if(str == "tcp") return mode_t::TCP;
+    if(str == "tls") return mode_t::TLS;
+    return mode_t::NONE;
+}
+
+const char* BackendHealth::mode_str(mode_t m) {
+    switch(m) {
+        case mode_t::TCP:
+            return "tcp";
+        case mode_t::TLS:
+            return "tls";
+        default:
+            return "none";
+    }
+}
+
+std::shared_ptr<BackendHealth::Target> BackendHealth::watch(std::string const& host, uint16_t port, mode_t mode) {
+
+    auto key = host + ":" + std::to_string(port) + "/" + mode_str(mode);
+
+    auto l_ = std::scoped_lock(lock_);
+
+    auto& t = targets_[key];
+    if(not t) {
+        t = std::make_shared<Target>(host, port, mode);
+
+        auto const& log = log::health();
+        _dia("BackendHealth::watch: new target %s", key.c_str());
+
+        // probe it on the next claim
+        next_due_ = 0;
+    }
+    t->last_wanted = time(nullptr);
+
+    return t;
+}
+
+std::vector<std::shared_ptr<BackendHealth::Target>> BackendHealth::claim_due(time_t now) {
+
+    std::vector<std::shared_ptr<Target>> ret;
+
+    // all workers call this on each event loop pass
+    if(now < next_due_.load(std::memory_order_relaxed)) return ret;
+
+    auto l_ = std::scoped_lock(lock_);
+
+    // targets in probe are due again at least interval after now, once reported
+    auto next = now + static_cast<time_t>(interval);
+
+    for(auto it = targets_.begin(); it != targets_.end(); ) {
+        auto& t = it->second;
+
+        if(now - t->last_wanted > static_cast<time_t>(expire) and not t->in_probe) {
+            errors_.erase(it->first);
+            it = targets_.erase(it);
+            continue;
+        }
+
+        if(t->check != mode_t::NONE
+            and not t->in_probe
+            and now - t->last_probe >= static_cast<time_t>(interval)) {
+
+            t->in_probe = true;
+            t->last_probe = now;
+            ret.push_back(t);
+        }
+        else if(not t->in_probe) {
+            if(t->check != mode_t::NONE) next = std::min(next, t->last_probe + static_cast<time_t>(interval));
+            next = std::min(next, t->last_wanted + static_cast<time_t>(expire) + 1);
+        }
+
+        ++it;
+    }
+
+    next_due_ = next;
+
+    return ret;
+}
+
+void BackendHealth::report(Target& target, bool ok, int64_t latency_us, std::string const& error) {
+
+    auto const& log = log::health();
+    auto const now = time(nullptr);
+
+    ++target.probes;
+
+    if(ok) {
+        target.failures = 0;
+        auto s = ++target.successes;
+
+        target.latency_us = latency_us;
+        auto ewma = target.latency_ewma_us.load();
+        target.latency_ewma_us = ewma < 0 ? latency_us : (ewma * 7 + latency_us) / 8;
+
+        if(not target.up and s >= rise) {
+            target.up = true;
+            target.last_change = now;
+            _not("BackendHealth: %s is up", target.key().c_str());
+        }
+    }
+    else {
+        target.successes = 0;
+        auto f = ++target.failures;
+        ++target.probes_failed;
+
+        {
+            auto l_ = std::scoped_lock(lock_);
+            errors_[target.key()] = error;
+        }
+
+        if(target.up and f >= fall) {
+            target.up = false;
+            target.last_change = now;
+            _war("BackendHealth: %s is down: %s", target.key().c_str(), error.c_str());
+        }
+        else {
+            _dia("BackendHealth: %s probe failed: %s", target.key().c_str(), error.c_str());
+        }
+    }
+
+    target.last_probe = now;
+    target.in_probe = false;
+}
+
+std::vector<std::shared_ptr<BackendHealth::Target>> BackendHealth::targets() const {
+    std::vector<std::shared_ptr<Target>> ret;
+
+    auto l_ = std::scoped_lock(lock_);
+    ret.reserve(targets_.size());
+    for(auto const& [ _, t ]: targets_) ret.push_back(t);
+
+    return ret;
+}
+
+std::string BackendHealth::last_error(Target const& target) const {
+    auto l_ = std::scoped_lock(lock_);
+    if(auto it = errors_.find(target.key()); it != errors_.end()) return it->second;
+    return {};
+}
+
+std::string BackendHealth::to_string(int verbosity) const {
+
+    std::stringstream ss;
+    auto const now = time(nullptr);
+
+    for(auto const& t: targets()) {
+        ss << t->key() << ": " << (t->up ? "UP" : "DOWN");
+
+        if(t->latency_us >= 0) {
+            ss << " latency=" << t->latency_us / 1000.0 << "ms avg=" << t->latency_ewma_us / 1000.0 << "ms";
+        }
+        ss << " probes=" << t->probes << " failed=" << t->probes_failed;
+
+        if(verbosity > iINF) {
+            ss << " ok_streak=" << t->successes << " fail_streak=" << t->failures;
+            if(t->last_change) ss << " changed=" << now - t->last_change << "s ago";
+            if(auto err = last_error(*t); not err.empty()) ss << " last_error='" << err << "'";
+        }
+        ss << "\n";
+    }
+
+    return ss.str();
+}
+
+
+SSL_CTX* HealthProbeIO::client_ctx() {
+    static SSL_CTX* ctx = [] {
+        auto* c = SSL_CTX_new(TLS_client_method());
+        // only handshake completion is checked, not server identity
+        if(c) SSL_CTX_set_verify(c, SSL_VERIFY_NONE, nullptr);
+        return c;
+    }();
+    return ctx;
+}
+
+HealthProbeIO::~HealthProbeIO() {
+    if(ssl_) SSL_free(ssl_);
+    if(owns_fd_ and fd_ >= 0) ::close(fd_);
+}
+
+HealthProbeIO::result_t HealthProbeIO::fail(std::string err) {
+    error_ = std::move(err);
+    return result_t::FAILED;
+}
+
+int64_t HealthProbeIO::elapsed_us() const {
+    timespec now {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - started_.tv_sec) * 1000000LL + (now.tv_nsec - started_.tv_nsec) / 1000;
+}
+
+int HealthProbeIO::start(std::string const& host, uint16_t port, bool tls) {
+
+    tls_ = tls;
+    clock_gettime(CLOCK_MONOTONIC, &started_);
+
+    sockaddr_storage ss {};
+    socklen_t ss_len = 0;
+
+    if(auto* sin = reinterpret_cast<sockaddr_in*>(&ss); inet_pton(AF_INET, host.c_str(), &sin->sin_addr) == 1) {
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(port);
+        ss_len = sizeof(sockaddr_in);
+    }
+    else if(auto* sin6 = reinterpret_cast<sockaddr_in6*>(&ss); inet_pton(AF_INET6, host.c_str(), &sin6->sin6_addr) == 1) {
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(port);
+        ss_len = sizeof(sockaddr_in6);
+    }
+    else {
+        fail("invalid address");
+        return -1;
+    }
+
+    fd_ = ::socket(ss.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd_ < 0) {
+        fail(string_format("socket: %s", strerror(errno)));
+        return -1;
+    }
+
+    if(::connect(fd_, reinterpret_cast<sockaddr*>(&ss), ss_len) < 0 and errno != EINPROGRESS) {
+        fail(string_format("connect: %s", strerror(errno)));
+        return -1;
+    }
+
+    want_write_ = true;
+    return fd_;
+}
+
+HealthProbeIO::result_t HealthProbeIO::step() {
+
+    if(fd_ < 0) return fail(error_.empty() ? "not started" : error_);
+
+    if(not connected_) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if(getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len) < 0) err = errno;
+
+        if(err == EINPROGRESS or err == EALREADY) return result_t::RUNNING;
+        if(err != 0) return fail(string_format("connect: %s", strerror(err)));
+
+        // writable without error can still be spurious - make sure we have a peer
+        sockaddr_storage peer {};
+        socklen_t peer_len = sizeof(peer);
+        if(getpeername(fd_, reinterpret_cast<sockaddr*>(&peer), &peer_len) < 0) {
+            if(errno == ENOTCONN) return result_t::RUNNING;
+            return fail(string_format("connect: %s", strerror(errno)));
+        }
+
+        connected_ = true;
+        if(not tls_) return result_t::OK;
+
+        auto* ctx = client_ctx();
+        ssl_ = ctx ? SSL_new(ctx) : nullptr;
+        if(not ssl_ or SSL_set_fd(ssl_, fd_) != 1) return fail("tls: cannot create session");
+    }
+
+    auto r = SSL_connect(ssl_);
+    if(r == 1) return result_t::OK;
+
+    switch(SSL_get_error(ssl_, r)) {
+        case SSL_ERROR_WANT_READ:
+            want_write_ = false;
+            return result_t::RUNNING;
+        case SSL_ERROR_WANT_WRITE:
+            want_write_ = true;
+            return result_t::RUNNING;
+        default:
+            return fail("tls: handshake failed");
+    }
+}
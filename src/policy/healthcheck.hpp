@@ -0,0 +1,183 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef POLICY_HEALTHCHECK_HPP
+#define POLICY_HEALTHCHECK_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <ctime>
+#include <cstdint>
+
+#include <openssl/ssl.h>
+
+#include <log/logger.hpp>
+
+// BackendHealth keeps up/down state of routing (DNAT) backends.
+//
+// Routing profiles with health checks enabled register their candidates with watch(). Workers pick targets
+// due for a probe with claim_due() from their event loop, run the probe asynchronously and report() its
+// result. Backend goes down after 'fall' consecutive failed probes and comes back up after 'rise'
+// successful ones, so a single lost probe doesn't flap it. Targets not watched for 'expire' seconds are dropped.
+
+class BackendHealth {
+
+public:
+    using mode_t = enum class mode { NONE, TCP, TLS };
+
+    struct Target {
+        Target(std::string h, uint16_t p, mode_t m) : host(std::move(h)), port(p), check(m) {}
+
+        std::string const host;
+        uint16_t const port;
+        mode_t const check;
+
+        // read on connection path
+        std::atomic_bool up {true};
+
+        // claimed by a worker running the probe
+        std::atomic_bool in_probe {false};
+
+        std::atomic<uint32_t> successes {0};    // consecutive
+        std::atomic<uint32_t> failures {0};     // consecutive
+        std::atomic<uint64_t> probes {0};
+        std::atomic<uint64_t> probes_failed {0};
+        std::atomic<int64_t> latency_us {-1};        // last successful probe
+        std::atomic<int64_t> latency_ewma_us {-1};
+        std::atomic<time_t> last_probe {0};
+        std::atomic<time_t> last_change {0};
+        std::atomic<time_t> last_wanted {0};
+
+        std::string key() const;
+    };
+
+    static inline unsigned int interval = 5;   // seconds between probes of one target
+    static inline unsigned int timeout = 3;    // probe timeout, seconds
+    static inline unsigned int rise = 2;
+    static inline unsigned int fall = 3;
+    static inline unsigned int expire = 60;
+
+    static BackendHealth& get() {
+        static BackendHealth h;
+        return h;
+    }
+
+    // register (or refresh) target, returns its state object
+    std::shared_ptr<Target> watch(std::string const& host, uint16_t port, mode_t mode);
+
+    // targets which should be probed now; they are marked in_probe until report().
+    // Cheap when nothing is due yet: returns without taking the lock.
+    std::vector<std::shared_ptr<Target>> claim_due(time_t now);
+
+    void report(Target& target, bool ok, int64_t latency_us, std::string const& error);
+
+    std::vector<std::shared_ptr<Target>> targets() const;
+    std::string last_error(Target const& target) const;
+    std::string to_string(int verbosity) const;
+
+    static mode_t mode_from_str(std::string const& str);
+    static const char* mode_str(mode_t m);
+
+    struct log {
+        static logan_lite const& health() {
+            static logan_lite l("proxy.routing.health");
+            return l;
+        }
+    };
+
+private:
+    BackendHealth() = default;
+
+    mutable std::mutex lock_;
+    std::unordered_map<std::string, std::shared_ptr<Target>> targets_;
+    std::unordered_map<std::string, std::string> errors_;
+
+    // earliest time claim_due() has anything to do (probe or expire), updated under lock_
+    std::atomic<time_t> next_due_ {0};
+};
+
+
+// Non-blocking TCP connect, optionally followed by TLS handshake. Caller waits for socket events
+// (writable if want_write(), readable otherwise) and calls step() until it returns other than RUNNING.
+
+class HealthProbeIO {
+
+public:
+    using result_t = enum class result { RUNNING, OK, FAILED };
+
+    HealthProbeIO() = default;
+    ~HealthProbeIO();
+
+    HealthProbeIO(HealthProbeIO const&) = delete;
+    HealthProbeIO& operator=(HealthProbeIO const&) = delete;
+
+    // start connecting. Returns socket, or -1 on error (see error()).
+    int start(std::string const& host, uint16_t port, bool tls);
+    result_t step();
+
+    int socket() const { return fd_; }
+    bool want_write() const { return want_write_; }
+    std::string const& error() const { return error_; }
+
+    // elapsed time since start()
+    int64_t elapsed_us() const;
+
+    // socket will be closed by someone else
+    void release() { owns_fd_ = false; }
+
+private:
+    result_t fail(std::string err);
+
+    int fd_ = -1;
+    bool owns_fd_ = true;
+    bool tls_ = false;
+    bool connected_ = false;
+    bool want_write_ = true;
+    SSL* ssl_ = nullptr;
+    std::string error_;
+    timespec started_ {};
+
+    static SSL_CTX* client_ctx();
+};
+
+#endif //POLICY_HEALTHCHECK_HPP
@@ -0,0 +1,127 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <algorithm>
+
+#include <arpa/inet.h>
+
+#include <policy/identitytable.hpp>
+
+namespace sx::auth {
+
+    group_id_t GroupDict::intern(std::string_view name) {
+        {
+            std::shared_lock l(lock_);
+            if(auto it = ids_.find(std::string(name)); it != ids_.end()) return it->second;
+        }
+
+        std::unique_lock l(lock_);
+        auto [ it, inserted ] = ids_.try_emplace(std::string(name), static_cast<group_id_t>(names_.size()));
+        if(inserted) names_.emplace_back(name);
+
+        return it->second;
+    }
+
+    group_ids_t GroupDict::intern_all(std::vector<std::string> const& names) {
+        group_ids_t ret;
+        ret.reserve(names.size());
+
+        for(auto const& n: names) {
+            if(not n.empty()) ret.push_back(intern(n));
+        }
+        std::sort(ret.begin(), ret.end());
+        ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+
+        return ret;
+    }
+
+    std::optional<group_id_t> GroupDict::find(std::string_view name) const {
+        std::shared_lock l(lock_);
+        if(auto it = ids_.find(std::string(name)); it != ids_.end()) return it->second;
+
+        return std::nullopt;
+    }
+
+    std::string GroupDict::name(group_id_t id) const {
+        std::shared_lock l(lock_);
+        return id < names_.size() ? names_[id] : std::string();
+    }
+
+    std::size_t GroupDict::size() const {
+        std::shared_lock l(lock_);
+        return names_.size();
+    }
+
+    bool GroupDict::contains(group_ids_t const& ids, group_id_t id) {
+        return std::binary_search(ids.begin(), ids.end(), id);
+    }
+
+
+    std::optional<in_addr> parse4(std::string const& str) {
+        in_addr a {};
+        if(inet_pton(AF_INET, str.c_str(), &a) != 1) return std::nullopt;
+        return a;
+    }
+
+    std::optional<in6_addr> parse6(std::string const& str) {
+        in6_addr a {};
+        if(inet_pton(AF_INET6, str.c_str(), &a) != 1) return std::nullopt;
+        return a;
+    }
+
+    std::optional<in_addr> key4(sockaddr_storage const& ss) {
+        if(ss.ss_family == AF_INET) {
+            return reinterpret_cast<sockaddr_in const*>(&ss)->sin_addr;
+        }
+        if(ss.ss_family == AF_INET6) {
+            auto const& a6 = reinterpret_cast<sockaddr_in6 const*>(&ss)->sin6_addr;
+            if(not IN6_IS_ADDR_V4MAPPED(&a6)) return std::nullopt;
+
+            in_addr a {};
+            std::memcpy(&a, &a6.s6_addr[12], sizeof(a));
+            return a;
+        }
+        return std::nullopt;
+    }
+
+    std::optional<in6_addr> key6(sockaddr_storage const& ss) {
+        if(ss.ss_family != AF_INET6) return std::nullopt;
+        return reinterpret_cast<sockaddr_in6 const*>(&ss)->sin6_addr;
+    }
+}
@@ -0,0 +1,206 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef IDENTITYTABLE_HPP
+#define IDENTITYTABLE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <policy/groupset.hpp>
+
+namespace sx::auth {
+
+    // Process-wide dictionary of group names. Ids are never reused, so they can be cached anywhere.
+    class GroupDict {
+    public:
+        static GroupDict& get() { static GroupDict d; return d; }
+
+        group_id_t intern(std::string_view name);
+        group_ids_t intern_all(std::vector<std::string> const& names);
+
+        std::optional<group_id_t> find(std::string_view name) const;
+        std::string name(group_id_t id) const;
+        std::size_t size() const;
+
+        static bool contains(group_ids_t const& ids, group_id_t id);
+
+    private:
+        mutable std::shared_mutex lock_;
+        std::unordered_map<std::string, group_id_t> ids_;
+        std::vector<std::string> names_;
+    };
+
+
+    // address keys of identity tables
+    struct addr4_hash {
+        std::size_t operator()(in_addr const& a) const noexcept {
+            return static_cast<std::size_t>(a.s_addr * 0x9E3779B97F4A7C15ULL);
+        }
+    };
+    struct addr4_equal {
+        bool operator()(in_addr const& a, in_addr const& b) const noexcept { return a.s_addr == b.s_addr; }
+    };
+    struct addr6_hash {
+        std::size_t operator()(in6_addr const& a) const noexcept {
+            uint64_t h[2];
+            std::memcpy(h, &a, sizeof(h));
+            return static_cast<std::size_t>((h[0] ^ (h[1] * 0xC2B2AE3D27D4EB4FULL)) * 0x9E3779B97F4A7C15ULL);
+        }
+    };
+    struct addr6_equal {
+        bool operator()(in6_addr const& a, in6_addr const& b) const noexcept { return std::memcmp(&a, &b, sizeof(a)) == 0; }
+    };
+
+    std::optional<in_addr> parse4(std::string const& str);
+    std::optional<in6_addr> parse6(std::string const& str);
+
+    // keys taken directly from a socket address, for lookups on the connection path.
+    // key4 also accepts v4-mapped IPv6 addresses.
+    std::optional<in_addr> key4(sockaddr_storage const& ss);
+    std::optional<in6_addr> key6(sockaddr_storage const& ss);
+
+
+    // Hash table split into shards, each with its own reader/writer lock. Values are reachable only through
+    // callbacks running under the shard lock - never keep pointers or references to them.
+    template<typename Key, typename Value, typename Hash, typename Equal, std::size_t Shards = 64>
+    class ShardedTable {
+    public:
+        // call @fn(Value const&) under shared lock, false if key is not present
+        template<typename F>
+        bool read(Key const& key, F&& fn) const {
+            auto const& s = shard(key);
+            std::shared_lock l(s.lock);
+
+            auto it = s.map.find(key);
+            if(it == s.map.end()) return false;
+
+            fn(it->second);
+            return true;
+        }
+
+        // call @fn(Value&) under exclusive lock, false if key is not present
+        template<typename F>
+        bool modify(Key const& key, F&& fn) {
+            auto& s = shard(key);
+            std::unique_lock l(s.lock);
+
+            auto it = s.map.find(key);
+            if(it == s.map.end()) return false;
+
+            fn(it->second);
+            return true;
+        }
+
+        // call @fn(Value&, bool created) under exclusive lock, value is default-constructed if missing
+        template<typename F>
+        void upsert(Key const& key, F&& fn) {
+            auto& s = shard(key);
+            std::unique_lock l(s.lock);
+
+            auto [ it, created ] = s.map.try_emplace(key);
+            fn(it->second, created);
+        }
+
+        bool erase(Key const& key) {
+            auto& s = shard(key);
+            std::unique_lock l(s.lock);
+
+            return s.map.erase(key) > 0;
+        }
+
+        // call @fn(Key const&, Value const&) for all entries, one shard locked at a time
+        template<typename F>
+        void for_each(F&& fn) const {
+            for(auto const& s: shards_) {
+                std::shared_lock l(s.lock);
+                for(auto const& [ k, v ]: s.map) fn(k, v);
+            }
+        }
+
+        void clear() {
+            for(auto& s: shards_) {
+                std::unique_lock l(s.lock);
+                s.map.clear();
+            }
+        }
+
+        std::size_t size() const {
+            std::size_t ret = 0;
+            for(auto const& s: shards_) {
+                std::shared_lock l(s.lock);
+                ret += s.map.size();
+            }
+            return ret;
+        }
+
+        bool empty() const { return size() == 0; }
+
+    private:
+        struct alignas(64) Shard {
+            mutable std::shared_mutex lock;
+            std::unordered_map<Key, Value, Hash, Equal> map;
+        };
+
+        // top bits of remixed hash, buckets inside of shard use low bits
+        static std::size_t index(Key const& key) {
+            auto const h = static_cast<uint64_t>(Hash{}(key)) * 0xD6E8FEB86659FD93ULL;
+            return static_cast<std::size_t>(h >> 32) % Shards;
+        }
+        Shard& shard(Key const& key) { return shards_[index(key)]; }
+        Shard const& shard(Key const& key) const { return shards_[index(key)]; }
+
+        std::array<Shard, Shards> shards_;
+    };
+}
+
+#endif //IDENTITYTABLE_HPP
@@ -37,55 +37,42 @@
     which carries forward this exception.
 */
 
+#include <cmath>
 
 #include <policy/loadb.hpp>
 
-template <class HostInfoType>
-HostPool<HostInfoType>::~HostPool() {
 
-    auto lc_ = std::scoped_lock(*this);
+void HostInfo::observe_latency(int64_t sample_ns, int64_t now_ns) {
 
-    candidates.clear();
+    if(sample_ns < 0) sample_ns = 0;
 
-    for(auto i: host_data_) {
-        delete i.second();
-    }
-}
-
-template <class HostInfoType>
-bool HostPool<HostInfoType>::insert_new(Host h)  {
-
-    auto lc_ = std::scoped_lock(*this);
+    auto const last = stamp_ns_.exchange(now_ns);
+    auto const w = std::exp(-static_cast<double>(std::max<int64_t>(now_ns - last, 0)) / decay_ns);
 
-    auto i = host_data_.find(h);
+    auto cur = ewma_ns_.load();
+    int64_t next = 0;
+    do {
+        next = sample_ns > cur ? sample_ns
+                               : static_cast<int64_t>(static_cast<double>(cur) * w + static_cast<double>(sample_ns) * (1.0 - w));
+    } while(not ewma_ns_.compare_exchange_weak(cur, next));
+}
 
-    if(i != host_data_.end()) {
-        return false;
-    }
+int64_t HostInfo::latency_ns(int64_t now_ns) const {
 
-    host_data_[h] = new HostInfoType(h);
+    auto const cur = ewma_ns_.load();
+    if(cur == 0) return 0;
 
-    return true;
+    // decay since the last sample, so a host which was slow once gets another chance
+    auto const w = std::exp(-static_cast<double>(std::max<int64_t>(now_ns - stamp_ns_.load(), 0)) / decay_ns);
+    return static_cast<int64_t>(static_cast<double>(cur) * w);
 }
 
+double HostInfo::peak_ewma_cost(int64_t now_ns) const {
 
-template <class HostInfoType>
-const HostInfoType* HostPool<HostInfoType>::compute() {
-    auto lc_ = std::scoped_lock(*this);
+    auto const active = active_sessions.load();
+    auto lat = latency_ns(now_ns);
 
-    int i = compute_index();
-    HostInfoType* r = candidates.at(i);
-}
+    if(lat == 0 and active > 0) lat = penalty_ns;
 
-template <class HostInfoType>
-void HostPool<HostInfoType>::refresh() {
-    auto lc_ = std::scoped_lock(*this);
-    
-    candidates.clear();
-    for(auto i: host_data_) {
-        HostInfoType* hit = i.second();
-        if(hit->is_active) {
-            candidates.push_back(hit);
-        }
-    }
+    return static_cast<double>(lat) * (active + 1);
 }
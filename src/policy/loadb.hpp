@@ -43,27 +43,92 @@
 
 #include <string>
 #include <vector>
-#include <map>
-#include <set>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <ctime>
+#include <algorithm>
+#include <iterator>
 
-#include <hostcx.hpp>
 #include <lockable.hpp>
 
 
 struct HostInfo {
-    HostInfo() : host() {};
-    HostInfo(Host h) : host(h) {};
-    
-    // host ip:port information
-    Host host;
-    
-    // number of uses. It's responsibility of callers to update this counter
-    unsigned int hits{0};
-    
+    explicit HostInfo(std::string h) : host(std::move(h)) {};
+
+    // host ip information
+    std::string const host;
+
     // should this HostsInfo be used? Very important variable. Adds/Removes itself with this from HostPool candidates.
-    bool is_active{true};
+    std::atomic_bool is_active{true};
+
+    // number of uses, and currently open sessions. Maintained by HostSession.
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint32_t> active_sessions{0};
+
+    // peak-EWMA of connect latency: new sample above current value replaces it immediately,
+    // lower samples (and time without samples) decay it with time constant decay_ns.
+    constexpr static int64_t decay_ns = 10'000'000'000LL;
+    // cost of a host with no latency sample yet, but with open sessions; also the least latency
+    // a failed connection attempt is accounted with
+    constexpr static int64_t penalty_ns = 1'000'000'000LL;
+
+    void observe_latency(int64_t sample_ns, int64_t now_ns);
+    int64_t latency_ns(int64_t now_ns) const;
+
+    // expected load of a new session: latency weighted by sessions already open
+    double peak_ewma_cost(int64_t now_ns) const;
+
+    static int64_t now_ns() {
+        timespec ts {};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1'000'000'000LL + ts.tv_nsec;
+    }
+
+private:
+    std::atomic<int64_t> ewma_ns_{0};
+    std::atomic<int64_t> stamp_ns_{0};
+};
+
+
+// Session bound to a host: counts itself in host's active sessions for its lifetime and reports
+// connect latency (time since creation) once connected() is called.
+template <class HostInfoType = HostInfo>
+class HostSession {
+public:
+    explicit HostSession(std::shared_ptr<HostInfoType> h, int64_t now_ns = HostInfo::now_ns()) : info_(std::move(h)), started_ns_(now_ns) {
+        ++info_->hits;
+        ++info_->active_sessions;
+    }
+    ~HostSession() { --info_->active_sessions; }
+
+    HostSession(HostSession const&) = delete;
+    HostSession& operator=(HostSession const&) = delete;
+
+    bool is_connected() const { return connected_; }
+    void connected(int64_t now_ns = HostInfo::now_ns()) {
+        if(connected_) return;
+        connected_ = true;
+        info_->observe_latency(now_ns - started_ns_, now_ns);
+    }
+    // connection attempt failed: report it as (at least) penalty latency, so the host is avoided for a while
+    void failed(int64_t now_ns = HostInfo::now_ns()) {
+        if(connected_) return;
+        connected_ = true;
+        info_->observe_latency(std::max(now_ns - started_ns_, HostInfo::penalty_ns), now_ns);
+    }
+
+    HostInfoType const& info() const { return *info_; }
+
+private:
+    std::shared_ptr<HostInfoType> info_;
+    int64_t started_ns_ = 0;
+    bool connected_ = false;
 };
 
+
 //
 // HostPool is a generic class maintaining usable Host for various purposes. 
 // Loadbalancing is best example. But it can serve also IP address pool, or server active/passive tracking.
@@ -74,32 +139,158 @@ struct HostInfo {
 // correct host we need to maintain also candidate list.
 // So if state of Host (in HostInfo) is changed, is responsibility of user to call refresh() to recompute 
 // candidates.
+//
+// Entries are never removed, only deactivated: statistics survive when backend disappears for a while.
+// Selection may skip some candidates via @usable predicate (ie. failed health checks), which gets
+// index into candidates().
+//
+// Pools created with the same non-empty @scope share HostInfo entries: a pool re-created on config reload
+// continues with session counts and latency of hosts it already knew, as long as anything (old pool,
+// open HostSession) still refers to them.
 
-
-template <class HostInfoType>
+template <class HostInfoType = HostInfo>
 class HostPool : public lockable {
 public:
-    HostPool();
-    virtual ~HostPool();
-    
+    using info_ptr = std::shared_ptr<HostInfoType>;
+    using usable_fn = std::function<bool(std::size_t)>;
+
+    HostPool() = default;
+    explicit HostPool(std::string scope) : scope_(std::move(scope)) {}
+    virtual ~HostPool() = default;
+
     // insert new entry into a list of available Hosts, unless the key is already there. Return false if so.
-    bool insert_new(Host h);
-    // calculate winner, and get me his HostInfo 
-    virtual const HostInfoType* compute();
-    // recalculate candidates. Needed if you insert host, or if state of any inserted host changes. 
-    virtual void refresh();
-    
-    
-    virtual int compute_index() = 0;
-    
+    bool insert_new(std::string const& h) {
+        auto lc_ = std::scoped_lock(*this);
+
+        auto [ it, inserted ] = host_data_.try_emplace(h, nullptr);
+        if(inserted) it->second = scope_.empty() ? std::make_shared<HostInfoType>(h) : shared_info(scope_, h);
+
+        return inserted;
+    }
+
+    // make exactly @hosts active, in this order, and refresh candidates
+    void set_hosts(std::vector<std::string> const& hosts) {
+        auto lc_ = std::scoped_lock(*this);
+
+        for(auto& [ _, hi ]: host_data_) hi->is_active = false;
+        for(auto const& h: hosts) {
+            insert_new(h);
+            host_data_[h]->is_active = true;
+        }
+
+        order_ = hosts;
+        refresh();
+    }
+
+    // recalculate candidates. Needed if you insert host, or if state of any inserted host changes.
+    virtual void refresh() {
+        auto lc_ = std::scoped_lock(*this);
+
+        candidates_.clear();
+        for(auto const& h: order_) {
+            if(auto it = host_data_.find(h); it != host_data_.end() and it->second->is_active) {
+                candidates_.push_back(it->second);
+            }
+        }
+    }
+
+    // calculate winner, and get me its index to candidates(), or -1 if there is none
+    int compute(usable_fn const& usable = nullptr, int64_t now_ns = HostInfo::now_ns()) {
+        auto lc_ = std::scoped_lock(*this);
+        if(candidates_.empty()) return -1;
+
+        return compute_index(usable, now_ns);
+    }
+
+    std::vector<info_ptr> candidates() {
+        auto lc_ = std::scoped_lock(*this);
+        return candidates_;
+    }
+
+    info_ptr candidate(std::size_t index) {
+        auto lc_ = std::scoped_lock(*this);
+        return index < candidates_.size() ? candidates_[index] : nullptr;
+    }
+
 protected:
-    
+    // HostInfo of @h in @scope, shared with other pools of the same scope which still hold it
+    static info_ptr shared_info(std::string const& scope, std::string const& h) {
+        static std::mutex m;
+        static std::unordered_map<std::string, std::weak_ptr<HostInfoType>> registry;
+
+        auto l_ = std::scoped_lock(m);
+
+        // called only when pools are (re)built, so a full sweep of forgotten hosts is cheap enough
+        for(auto it = registry.begin(); it != registry.end(); ) {
+            it = it->second.expired() ? registry.erase(it) : std::next(it);
+        }
+
+        auto& weak = registry[scope + '/' + h];
+        if(auto info = weak.lock(); info) return info;
+
+        auto info = std::make_shared<HostInfoType>(h);
+        weak = info;
+        return info;
+    }
+
+    // called with lock held and non-empty candidates
+    virtual int compute_index(usable_fn const& usable, int64_t now_ns) = 0;
+
+    // index with the lowest @cost; ties are broken by rotating start, so equal hosts share the load
+    template <typename F>
+    int lowest(usable_fn const& usable, F cost) {
+        auto const sz = candidates_.size();
+        auto const start = rotation_++ % sz;
+
+        int best = -1;
+        double best_cost = 0.0;
+        for(std::size_t i = 0; i < sz; ++i) {
+            auto idx = (start + i) % sz;
+            if(usable and not usable(idx)) continue;
+
+            auto c = cost(*candidates_[idx]);
+            if(best < 0 or c < best_cost) {
+                best = static_cast<int>(idx);
+                best_cost = c;
+            }
+        }
+        return best;
+    }
+
+    std::string const scope_;
+
     // full list of possible candidates, including down candidates, or disabled candidates.
-    std::unordered_map<Host,HostInfoType*> host_data_;
-    
-    // list of active and up candidates. This vector is used by compute to 
-    std::vector<HostInfoType*> candidates;
+    std::unordered_map<std::string, info_ptr> host_data_;
+    std::vector<std::string> order_;
+
+    // list of active and up candidates. This vector is used by compute to
+    std::vector<info_ptr> candidates_;
+    std::size_t rotation_ = 0;
+};
+
+
+// pick host with the least active sessions
+template <class HostInfoType = HostInfo>
+class LeastConnPool : public HostPool<HostInfoType> {
+public:
+    using HostPool<HostInfoType>::HostPool;
+protected:
+    int compute_index(typename HostPool<HostInfoType>::usable_fn const& usable, int64_t) override {
+        return this->lowest(usable, [](HostInfoType const& h) { return static_cast<double>(h.active_sessions.load()); });
+    }
+};
+
+
+// pick host with the lowest peak-EWMA connect latency, weighted by its active sessions
+template <class HostInfoType = HostInfo>
+class PeakEwmaPool : public HostPool<HostInfoType> {
+public:
+    using HostPool<HostInfoType>::HostPool;
+protected:
+    int compute_index(typename HostPool<HostInfoType>::usable_fn const& usable, int64_t now_ns) override {
+        return this->lowest(usable, [now_ns](HostInfoType const& h) { return h.peak_ewma_cost(now_ns); });
+    }
 };
 
 
-#endif
\ No newline at end of file
+#endif
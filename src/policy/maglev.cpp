@@ -0,0 +1,106 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <algorithm>
+#include <numeric>
+
+#include <policy/maglev.hpp>
+
+uint64_t MaglevTable::hash(void const* data, std::size_t len, uint64_t seed) {
+
+    // FNV-1a, finalized with splitmix64 to spread low-entropy keys over all bits
+    uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+    auto const* p = static_cast<uint8_t const*>(data);
+    for(std::size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+
+    return h;
+}
+
+void MaglevTable::build(std::vector<std::string> const& backends) {
+
+    table_.clear();
+    if(backends.empty()) return;
+
+    auto const n = std::min(backends.size(), max_backends);
+    constexpr std::size_t m = table_size;
+
+    // fill in sorted order, so the result doesn't depend on order of backends
+    std::vector<std::size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](auto a, auto b) { return backends[a] < backends[b]; });
+
+    std::vector<std::size_t> offset(n);
+    std::vector<std::size_t> skip(n);
+    std::vector<std::size_t> next(n, 0);
+
+    for(std::size_t i = 0; i < n; ++i) {
+        auto const& name = backends[i];
+        offset[i] = hash(name.data(), name.size(), 0x9e3779b97f4a7c15ULL) % m;
+        skip[i] = hash(name.data(), name.size(), 0x7f4a7c159e3779b9ULL) % (m - 1) + 1;
+    }
+
+    constexpr uint16_t unset = UINT16_MAX;
+    table_.assign(m, unset);
+
+    std::size_t filled = 0;
+    while(true) {
+        for(auto i: order) {
+            // next free slot in i-th backend's permutation
+            auto slot = (offset[i] + next[i] * skip[i]) % m;
+            while(table_[slot] != unset) {
+                ++next[i];
+                slot = (offset[i] + next[i] * skip[i]) % m;
+            }
+
+            table_[slot] = static_cast<uint16_t>(i);
+            ++next[i];
+
+            if(++filled == m) return;
+        }
+    }
+}
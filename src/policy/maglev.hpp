@@ -0,0 +1,84 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef POLICY_MAGLEV_HPP
+#define POLICY_MAGLEV_HPP
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// MaglevTable maps 64-bit flow hashes to backends with Maglev consistent hashing.
+//
+// Each backend fills lookup table slots in order of its own pseudo-random permutation, taking turns
+// with the other backends, so every backend owns nearly the same number of slots. When a backend is
+// added or removed, only about 1/N of the slots change their owner - connections of the other backends
+// keep their target. Lookup is a single modulo and array read.
+//
+// Table content depends only on the set of backend names, not on their order.
+
+class MaglevTable {
+
+public:
+    MaglevTable() = default;
+    explicit MaglevTable(std::vector<std::string> const& backends) { build(backends); }
+
+    // (re)build table for @backends. Lookups return index to @backends.
+    void build(std::vector<std::string> const& backends);
+
+    bool empty() const { return table_.empty(); }
+    std::size_t size() const { return table_.size(); }
+
+    // returns backend index, table must not be empty
+    std::size_t lookup(uint64_t hash) const { return table_[hash % table_.size()]; }
+
+    // 64-bit hash of arbitrary bytes, used both for backend names and flow keys
+    static uint64_t hash(void const* data, std::size_t len, uint64_t seed = 0);
+
+    // Table size is prime and fixed - changing it would remap all flows. Each backend needs at least
+    // one slot, backends beyond max_backends are ignored (config load refuses such profiles).
+    constexpr static std::size_t table_size = 65521;
+    constexpr static std::size_t max_backends = table_size;
+    static_assert(table_size < UINT16_MAX, "slots store 16-bit backend index, UINT16_MAX marks unset slot");
+
+private:
+    std::vector<uint16_t> table_;
+};
+
+#endif //POLICY_MAGLEV_HPP
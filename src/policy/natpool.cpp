@@ -0,0 +1,302 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
+
+#include <arpa/inet.h>
+
+#include <log/logger.hpp>
+#include <policy/natpool.hpp>
+
+namespace {
+
+    // worker's current block of pool, family and destination bucket. Cache is small and direct-mapped:
+    // blocks of pools replaced by config reload are given back once their slot is reused.
+    struct current_t {
+        uint64_t key = 0;
+        NatPool::Block const* block = nullptr;
+        NatPool::Word* word = nullptr;
+        std::weak_ptr<NatPool::PortSpace> space;
+
+        void reset() {
+            if(word) {
+                // word belongs to the port space, which may be already gone with its last pool
+                if(auto sp = space.lock(); sp) word->owned = false;
+            }
+            key = 0;
+            block = nullptr;
+            word = nullptr;
+            space.reset();
+        }
+    };
+
+    struct current_cache_t {
+        std::array<current_t, 16> slots;
+
+        current_t& slot(uint64_t key) {
+            auto& ret = slots[key % slots.size()];
+            if(ret.key != key) {
+                ret.reset();
+                ret.key = key;
+            }
+            return ret;
+        }
+
+        ~current_cache_t() {
+            for(auto& s: slots) s.reset();
+        }
+    };
+}
+
+NatPool::Lease::~Lease() {
+    if(pool_ and word_) pool_->release(word_, bit_);
+}
+
+std::shared_ptr<NatPool::PortSpace> NatPool::PortSpace::get(std::string const& address) {
+
+    static std::mutex lock;
+    static std::unordered_map<std::string, std::weak_ptr<PortSpace>> spaces;
+
+    auto l_ = std::scoped_lock(lock);
+
+    for(auto it = spaces.begin(); it != spaces.end(); ) {
+        if(it->second.expired()) it = spaces.erase(it);
+        else ++it;
+    }
+
+    auto& ref = spaces[address];
+    auto ret = ref.lock();
+    if(not ret) {
+        ret = std::make_shared<PortSpace>(address);
+        ref = ret;
+    }
+
+    return ret;
+}
+
+std::shared_ptr<NatPool> NatPool::make(std::vector<std::string> const& addresses,
+                                       std::vector<std::pair<int,int>> const& port_ranges) {
+
+    static std::atomic<uint64_t> pool_ids {0};
+
+    auto pool = std::shared_ptr<NatPool>(new NatPool());
+    pool->id_ = ++pool_ids;
+
+    // 64-port windows which have at least one allowed port, with a mask of allowed ports
+    std::vector<std::pair<uint16_t, uint64_t>> windows;
+    for(unsigned int first = 0; first < 65536; first += block_ports) {
+        uint64_t valid = 0;
+        for(auto const& [ lo, hi ]: port_ranges) {
+            for(unsigned int b = 0; b < block_ports; ++b) {
+                auto port = static_cast<int>(first + b);
+                if(port > 0 and port >= lo and port <= hi) valid |= (1ULL << b);
+            }
+        }
+        if(valid) windows.emplace_back(static_cast<uint16_t>(first), valid);
+    }
+
+    std::vector<std::pair<std::shared_ptr<PortSpace>, int>> spaces;
+    for(auto const& a: addresses) {
+        in6_addr tmp{};
+        int fam = AF_UNSPEC;
+        if(inet_pton(AF_INET, a.c_str(), &tmp) == 1) fam = AF_INET;
+        else if(inet_pton(AF_INET6, a.c_str(), &tmp) == 1) fam = AF_INET6;
+        else continue;
+
+        // canonical form, so differently written addresses share the port space
+        char canon[INET6_ADDRSTRLEN] {};
+        if(not inet_ntop(fam, &tmp, canon, sizeof(canon))) continue;
+
+        if(std::find(pool->addresses_.begin(), pool->addresses_.end(), canon) != pool->addresses_.end()) continue;
+
+        spaces.emplace_back(PortSpace::get(canon), fam);
+        pool->addresses_.emplace_back(canon);
+    }
+
+    // interleave blocks by address
+    for(auto const& [ first, valid ]: windows) {
+        for(auto const& [ space, fam ]: spaces) {
+            auto& f = pool->family(fam);
+            f.capacity += static_cast<std::size_t>(__builtin_popcountll(valid));
+            f.blocks.push_back({ space, first, valid });
+        }
+    }
+
+    return pool;
+}
+
+uint64_t NatPool::destination(std::string_view host, std::string_view port) {
+    uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h](std::string_view s) {
+        for(auto c: s) { h ^= static_cast<uint8_t>(c); h *= 1099511628211ULL; }
+        h ^= ':'; h *= 1099511628211ULL;
+    };
+    mix(host);
+    mix(port);
+
+    return h ^ (h >> 29);
+}
+
+int NatPool::take_port(Word& word, uint64_t valid) {
+
+    auto used = word.used.load(std::memory_order_relaxed);
+    while(true) {
+        auto free = valid & ~used;
+        if(free == 0) return -1;
+
+        auto bit = __builtin_ctzll(free);
+        if(word.used.compare_exchange_weak(used, used | (1ULL << bit), std::memory_order_acq_rel)) {
+            return bit;
+        }
+    }
+}
+
+NatPool::Block const* NatPool::take_block(Family& fam, unsigned int bucket) {
+
+    auto l_ = std::scoped_lock(lock_);
+
+    auto const sz = fam.blocks.size();
+    auto& cursor = fam.cursor[bucket];
+    for(std::size_t i = 0; i < sz; ++i) {
+        auto const& b = fam.blocks[(cursor + i) % sz];
+        auto& w = b.space->word(bucket, b.first_port);
+
+        if(w.owned.load(std::memory_order_relaxed)) continue;
+        if((b.valid & ~w.used.load(std::memory_order_relaxed)) == 0) continue;
+
+        w.owned = true;
+        cursor = (cursor + i + 1) % sz;
+        return &b;
+    }
+
+    return nullptr;
+}
+
+std::unique_ptr<NatPool::Lease> NatPool::allocate(int family_id, uint64_t dst) {
+
+    auto& fam = family(family_id);
+    auto const bucket = static_cast<unsigned int>(dst % dst_buckets);
+
+    thread_local current_cache_t current;
+    auto& cur = current.slot((id_ * 2 + (family_id == AF_INET6 ? 1 : 0)) * dst_buckets + bucket);
+
+    while(true) {
+
+        if(cur.block) {
+            if(auto bit = take_port(*cur.word, cur.block->valid); bit >= 0) {
+                ++in_use_;
+                ++allocations_;
+                return std::make_unique<Lease>(shared_from_this(), cur.block, cur.word, static_cast<unsigned int>(bit));
+            }
+
+            // block is full, let it go - it will be picked again once some ports are released
+            cur.word->owned = false;
+            cur.block = nullptr;
+            cur.word = nullptr;
+        }
+
+        auto const* b = take_block(fam, bucket);
+        if(not b) break;
+
+        cur.block = b;
+        cur.word = &b->space->word(bucket, b->first_port);
+        cur.space = b->space;
+
+        ++block_switches_;
+    }
+
+    if(auto lease = take_shared(fam, bucket); lease) return lease;
+
+    ++exhausted_;
+    return nullptr;
+}
+
+std::unique_ptr<NatPool::Lease> NatPool::take_shared(Family& fam, unsigned int bucket) {
+
+    auto l_ = std::scoped_lock(lock_);
+
+    for(auto const& b: fam.blocks) {
+        auto& w = b.space->word(bucket, b.first_port);
+        if(auto bit = take_port(w, b.valid); bit >= 0) {
+            ++in_use_;
+            ++allocations_;
+            return std::make_unique<Lease>(shared_from_this(), &b, &w, static_cast<unsigned int>(bit));
+        }
+    }
+
+    return nullptr;
+}
+
+void NatPool::release(Word* word, unsigned int bit) {
+    word->used.fetch_and(~(1ULL << bit), std::memory_order_acq_rel);
+    --in_use_;
+}
+
+NatPool::stats_t NatPool::stats() const {
+    stats_t ret;
+
+    ret.addresses = addresses_.size();
+    ret.blocks = v4_.blocks.size() + v6_.blocks.size();
+    ret.capacity = v4_.capacity + v6_.capacity;
+    ret.in_use = in_use_;
+    ret.allocations = allocations_;
+    ret.block_switches = block_switches_;
+    ret.exhausted = exhausted_;
+
+    return ret;
+}
+
+std::string NatPool::to_string(int verbosity) const {
+    auto st = stats();
+
+    std::stringstream ss;
+    ss << "NatPool: addresses=" << st.addresses << " ports=" << st.in_use << "/" << st.capacity
+       << " allocations=" << st.allocations << " exhausted=" << st.exhausted;
+
+    if(verbosity > iINF) {
+        ss << " blocks=" << st.blocks << " block_switches=" << st.block_switches;
+        for(auto const& a: addresses_) {
+            ss << "\n    address: " << a;
+        }
+    }
+
+    return ss.str();
+}
@@ -0,0 +1,181 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef POLICY_NATPOOL_HPP
+#define POLICY_NATPOOL_HPP
+
+#include <vector>
+#include <array>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include <sys/socket.h>
+
+// NatPool hands out source (address, port) pairs for source NAT.
+//
+// Pool ports are split into blocks of 64 consecutive ports of one address, each block is a single bitmap word.
+// Worker thread takes a block for its exclusive use and allocates ports from it without any locking;
+// only when the block is full, a next one is taken from the pool under the lock. Blocks are interleaved
+// by address, so consecutive blocks (and workers) use different source addresses.
+// If all blocks with free ports are owned by other workers, a port is taken from any of them (small pools).
+// Ports are released by Lease destructor, from whichever thread.
+//
+// Source (address, port) has to be unique only per destination. Destinations are hashed into dst_buckets
+// buckets, each with its own port usage: the same source may be leased once in every bucket, so two
+// leases of the same source are always towards different destinations.
+//
+// Port usage is kept per source address in PortSpace, shared by all pools using the address. Pool rebuilt
+// by config reload (or another routing profile with the same address) doesn't hand out ports still
+// leased from other pools.
+
+class NatPool : public std::enable_shared_from_this<NatPool> {
+
+public:
+    constexpr static unsigned int block_ports = 64;
+    constexpr static unsigned int port_words = 65536 / block_ports;
+    constexpr static unsigned int dst_buckets = 8;
+
+    // usage of a 64-port window of single address in one destination bucket
+    struct Word {
+        std::atomic<uint64_t> used {0};
+        std::atomic<bool> owned {false}; // taken by a worker
+    };
+
+    class PortSpace {
+    public:
+        explicit PortSpace(std::string address) : address_(std::move(address)),
+                                                  words_(new Word[port_words * dst_buckets]) {}
+
+        std::string const& address() const { return address_; }
+        Word& word(unsigned int bucket, uint16_t first_port) { return words_[bucket * port_words + first_port / block_ports]; }
+
+        // port space of @address, shared with other pools using it
+        static std::shared_ptr<PortSpace> get(std::string const& address);
+
+    private:
+        std::string address_;
+        std::unique_ptr<Word[]> words_;
+    };
+
+    struct Block {
+        std::shared_ptr<PortSpace> space;
+        uint16_t first_port = 0;
+        uint64_t valid = 0;             // ports of the block which are in configured ranges
+    };
+
+    class Lease {
+    public:
+        Lease(std::shared_ptr<NatPool> pool, Block const* block, Word* word, unsigned int bit)
+            : pool_(std::move(pool)), block_(block), word_(word), bit_(bit) {}
+        ~Lease();
+
+        Lease(Lease const&) = delete;
+        Lease& operator=(Lease const&) = delete;
+
+        std::string const& host() const { return block_->space->address(); }
+        uint16_t port() const { return static_cast<uint16_t>(block_->first_port + bit_); }
+
+    private:
+        std::shared_ptr<NatPool> pool_;
+        Block const* block_ = nullptr;
+        Word* word_ = nullptr;
+        unsigned int bit_ = 0;
+    };
+
+    struct stats_t {
+        std::size_t addresses = 0;
+        std::size_t blocks = 0;
+        std::size_t capacity = 0;       // per destination
+        uint64_t in_use = 0;
+        uint64_t allocations = 0;
+        uint64_t block_switches = 0;
+        uint64_t exhausted = 0;
+    };
+
+    // @addresses: pool IPv4/IPv6 addresses, @port_ranges: allowed source ports (inclusive)
+    static std::shared_ptr<NatPool> make(std::vector<std::string> const& addresses,
+                                         std::vector<std::pair<int,int>> const& port_ranges);
+
+    // destination identifier used by allocate()
+    static uint64_t destination(std::string_view host, std::string_view port);
+
+    // allocate source for connection of @family towards @dst. Returns nullptr if pool has no free port for it.
+    std::unique_ptr<Lease> allocate(int family, uint64_t dst);
+
+    std::vector<std::string> const& addresses() const { return addresses_; }
+    stats_t stats() const;
+    std::string to_string(int verbosity) const;
+
+    NatPool(NatPool const&) = delete;
+    NatPool& operator=(NatPool const&) = delete;
+
+private:
+    NatPool() = default;
+
+    struct Family {
+        std::vector<Block> blocks;
+        std::array<std::size_t, dst_buckets> cursor {};
+        std::size_t capacity = 0;
+    };
+
+    Family& family(int f) { return f == AF_INET6 ? v6_ : v4_; }
+
+    static int take_port(Word& word, uint64_t valid);
+    Block const* take_block(Family& fam, unsigned int bucket);
+    std::unique_ptr<Lease> take_shared(Family& fam, unsigned int bucket);
+    void release(Word* word, unsigned int bit);
+
+    uint64_t id_ = 0;
+    std::vector<std::string> addresses_;
+    Family v4_;
+    Family v6_;
+
+    std::mutex lock_;
+
+    std::atomic<uint64_t> in_use_ {0};
+    std::atomic<uint64_t> allocations_ {0};
+    std::atomic<uint64_t> block_switches_ {0};
+    std::atomic<uint64_t> exhausted_ {0};
+};
+
+#endif //POLICY_NATPOOL_HPP
@@ -134,7 +134,7 @@ std::string PolicyRule::to_string(int verbosity) const {
 
 
     if(verbosity > iINF)
-        out << " [" << std::to_string(cnt_matches) << "x]";
+        out << " [" << std::to_string(cnt_matches.load(std::memory_order_relaxed)) << "x]";
     
     out << ": ";
 
@@ -174,16 +174,24 @@ bool PolicyRule::match_addrgrp_cx(group_of_addresses const& sources, baseHostCX*
          return true;
     }
 
-    auto l = CidrAddress(cx->host());
+    // parsed on stack, this runs for every rule evaluated for a new connection
+    auto const l_prefix = cidr::Prefix::parse(cx->host());
+    cidr::CIDR l {};
+    l_prefix.to_cidr(l);
+
+    char l_str[cidr::Prefix::str_size] = "?";
+    _if_deb {
+        l_prefix.format(l_str, sizeof(l_str), CIDR_ONLYADDR);
+    }
 
     for(auto const& comp: sources) {
 
-        if(comp->value()->match(l.cidr())) {
-            _deb("PolicyRule::match_addrgrp_cx: comparing %s with rule %s: matched", l.ip().c_str(), comp->value()->str().c_str());
+        if(comp->value()->match(&l)) {
+            _deb("PolicyRule::match_addrgrp_cx: comparing %s with rule %s: matched", l_str, comp->value()->str().c_str());
             match = true;
             break;
         } else {
-            _deb("PolicyRule::match_addrgrp_cx: comparing %s with rule %s: not matched", l.ip().c_str(), comp->value()->str().c_str());
+            _deb("PolicyRule::match_addrgrp_cx: comparing %s with rule %s: not matched", l_str, comp->value()->str().c_str());
         }
     }
 
@@ -354,7 +362,7 @@ bool PolicyRule::match(baseProxy* p) {
 
         if (proto_match && lmatch && lpmatch && rmatch && rpmatch) {
             _inf("PolicyRule::match %s OK", p->to_string(iINF).c_str());
-            cnt_matches++;
+            cnt_matches.fetch_add(1, std::memory_order_relaxed);
 
             return true;
 
@@ -428,7 +436,7 @@ bool PolicyRule::match(std::vector<baseHostCX*>& l, std::vector<baseHostCX*>& r)
 
     if (proto_match && lmatch && lpmatch && rmatch && rpmatch) {
         _inf("PolicyRule::match_lr %s <+> %s OK", ls.c_str(), rs.c_str());
-        cnt_matches++;
+        cnt_matches.fetch_add(1, std::memory_order_relaxed);
         
         return true;
     } else {
@@ -439,3 +447,36 @@ bool PolicyRule::match(std::vector<baseHostCX*>& l, std::vector<baseHostCX*>& r)
 }
 
 
+
+PolicyRule::rebuild_result_t PolicyRule::rebuild_affected(db_t& db, int num, std::vector<std::shared_ptr<CfgElement>> const& changed,
+                                                          std::function<std::shared_ptr<PolicyRule>(int)> const& load_entry) {
+    std::unordered_set<CfgElement const*> affected;
+    for(auto const& elem: changed) {
+        for(auto const& ref: elem->usage_vec()) {
+            if(auto r = ref.lock(); r) affected.insert(r.get());
+        }
+    }
+
+    rebuild_result_t ret;
+
+    for(int i = 0; i < num; i++) {
+        auto key = string_format("[%d]", i);
+        auto it = db.find(key);
+
+        // policy which failed to load is retried - it could refer to newly added element
+        if(it != db.end()) {
+            if(affected.find(it->second.get()) == affected.end()) continue;
+
+            ret.gone.insert(it->second.get());
+        }
+
+        if(auto rule = load_entry(i); rule) {
+            db[key] = rule;
+        } else {
+            db.erase(key);
+        }
+        ++ret.rebuilt;
+    }
+
+    return ret;
+}
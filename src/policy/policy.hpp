@@ -42,6 +42,10 @@
  
  
 #include <vector> 
+#include <atomic>
+#include <map>
+#include <unordered_set>
+#include <functional>
 
 #include <hostcx.hpp>
 #include <baseproxy.hpp>
@@ -70,7 +74,8 @@ public:
     using group_of_addresses = std::vector<std::shared_ptr<CfgAddress>>;
     using group_of_tags = std::vector<std::shared_ptr<CfgString>>;
 
-    unsigned int cnt_matches = 0;
+    // bumped by workers on every match, rules are shared with published CfgSnapshot
+    std::atomic<unsigned int> cnt_matches {0};
 
     bool is_disabled = false;
     std::string policy_name;
@@ -117,6 +122,17 @@ public:
     bool ask_destroy() override { return false; }
     std::string to_string(int verbosity) const override;
 
+    // policy table keyed by "[<index>]", as kept by CfgFactory
+    using db_t = std::map<std::string, std::shared_ptr<CfgElement>>;
+    struct rebuild_result_t {
+        size_t rebuilt = 0;
+        std::unordered_set<CfgElement const*> gone;     // replaced rule instances
+    };
+    // reload rules referring (by usage references) to any of @changed elements, and rules which failed
+    // to load before (missing in @db). Other rules are kept untouched.
+    static rebuild_result_t rebuild_affected(db_t& db, int num, std::vector<std::shared_ptr<CfgElement>> const& changed,
+                                             std::function<std::shared_ptr<PolicyRule>(int)> const& load_entry);
+
     logan_lite& get_log() { return log; }
 
     TYPENAME_OVERRIDE("PolicyRule")
@@ -0,0 +1,204 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <fstream>
+#include <cstring>
+
+#include <arpa/inet.h>
+
+#include <policy/prefixtable.hpp>
+
+PrefixTable::entry_t PrefixTable::new_chunk(Tree& t) {
+    auto index = static_cast<entry_t>(t.chunks.size() / chunk_size);
+    t.chunks.resize(t.chunks.size() + chunk_size, EMPTY);
+
+    return CHILD | index;
+}
+
+bool PrefixTable::insert(int family, uint8_t const* addr, unsigned int pflen) {
+
+    unsigned int const bytes = (family == AF_INET6) ? 16 : 4;
+    if((family != AF_INET and family != AF_INET6) or pflen > bytes * 8) return false;
+
+    auto& t = tree(family);
+    if(t.root.empty()) t.root.resize(root_size, EMPTY);
+
+    ++t.prefixes;
+
+    auto root_index = static_cast<std::size_t>(addr[0] << 8 | addr[1]);
+
+    // prefix fits into the root table - expand it over all covered root entries
+    if(pflen <= 16) {
+        auto span = std::size_t(1) << (16 - pflen);
+        root_index &= ~(span - 1);
+
+        // longer prefixes below are now covered too, their chunks become unreachable
+        std::fill_n(t.root.begin() + static_cast<long>(root_index), span, FULL);
+        return true;
+    }
+
+    // walk (and create) chunks down to the byte where prefix ends. Slot is tracked by index,
+    // creating a chunk may reallocate chunk storage.
+    bool slot_in_root = true;
+    std::size_t slot_index = root_index;
+    auto slot = [&]() -> entry_t& { return slot_in_root ? t.root[slot_index] : t.chunks[slot_index]; };
+
+    for(unsigned int level = 2; ; ++level) {
+
+        if(slot() == FULL) return true;  // already covered by shorter prefix
+        if(slot() == EMPTY) {
+            auto chunk = new_chunk(t);
+            slot() = chunk;
+        }
+
+        auto base = static_cast<std::size_t>(slot() & ~CHILD) * chunk_size;
+        auto remaining = pflen - (level * 8);
+
+        if(remaining <= 8) {
+            auto span = std::size_t(1) << (8 - remaining);
+            auto index = static_cast<std::size_t>(addr[level]) & ~(span - 1);
+
+            std::fill_n(t.chunks.begin() + static_cast<long>(base + index), span, FULL);
+            return true;
+        }
+
+        slot_in_root = false;
+        slot_index = base + addr[level];
+    }
+}
+
+bool PrefixTable::insert(std::string_view prefix) {
+
+    auto slash = prefix.find('/');
+    std::string addr_str(prefix.substr(0, slash));
+
+    uint8_t addr[16] {};
+    int family = AF_UNSPEC;
+    unsigned int max_len = 0;
+
+    if(inet_pton(AF_INET, addr_str.c_str(), addr) == 1) {
+        family = AF_INET;
+        max_len = 32;
+    }
+    else if(inet_pton(AF_INET6, addr_str.c_str(), addr) == 1) {
+        family = AF_INET6;
+        max_len = 128;
+    }
+    else {
+        return false;
+    }
+
+    unsigned int pflen = max_len;
+    if(slash != std::string_view::npos) {
+        auto len_str = prefix.substr(slash + 1);
+        if(len_str.empty() or len_str.size() > 3) return false;
+
+        pflen = 0;
+        for(auto c: len_str) {
+            if(c < '0' or c > '9') return false;
+            pflen = pflen * 10 + static_cast<unsigned int>(c - '0');
+        }
+        if(pflen > max_len) return false;
+    }
+
+    return insert(family, addr, pflen);
+}
+
+bool PrefixTable::contains(int family, uint8_t const* addr) const {
+
+    auto const& t = tree(family);
+    if(t.root.empty()) return false;
+
+    auto e = t.root[static_cast<std::size_t>(addr[0] << 8 | addr[1])];
+    for(unsigned int level = 2; e & CHILD; ++level) {
+        e = t.chunks[static_cast<std::size_t>(e & ~CHILD) * chunk_size + addr[level]];
+    }
+
+    return e == FULL;
+}
+
+bool PrefixTable::contains(cidr::CIDR const* c) const {
+    if(not c) return false;
+
+    // libcidr keeps IPv4 address in the last 4 bytes
+    if(c->proto == CIDR_IPV4) return contains(AF_INET, &c->addr[12]);
+    if(c->proto == CIDR_IPV6) return contains(AF_INET6, c->addr);
+
+    return false;
+}
+
+PrefixTable::stats_t PrefixTable::stats() const {
+    stats_t ret;
+
+    for(auto const* t: { &v4_, &v6_ }) {
+        ret.prefixes += t->prefixes;
+        ret.chunks += t->chunks.size() / chunk_size;
+        ret.bytes += (t->root.capacity() + t->chunks.capacity()) * sizeof(entry_t);
+    }
+    ret.bytes += sizeof(PrefixTable);
+
+    return ret;
+}
+
+std::shared_ptr<PrefixTable> PrefixTable::load_file(std::string const& path, std::size_t* bad_lines) {
+
+    std::ifstream in(path);
+    if(not in) return nullptr;
+
+    auto ret = std::make_shared<PrefixTable>();
+    std::size_t bad = 0;
+
+    std::string line;
+    while(std::getline(in, line)) {
+        std::string_view l(line);
+
+        if(auto hash = l.find('#'); hash != std::string_view::npos) l = l.substr(0, hash);
+
+        auto b = l.find_first_not_of(" \t\r");
+        if(b == std::string_view::npos) continue;
+        auto e = l.find_last_not_of(" \t\r");
+        l = l.substr(b, e - b + 1);
+
+        if(not ret->insert(l)) ++bad;
+    }
+
+    if(bad_lines) *bad_lines = bad;
+
+    return ret;
+}
@@ -0,0 +1,108 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef POLICY_PREFIXTABLE_HPP
+#define POLICY_PREFIXTABLE_HPP
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cstdint>
+
+#include <ext/libcidr/cidr.hpp>
+
+// PrefixTable is a set of IPv4 and IPv6 prefixes answering "is this address covered by any of them".
+// It's a multibit trie in DIR-16-8-8 fashion: first 16 bits of the address index a flat root table,
+// each next byte indexes a 256-entry chunk. Prefixes are expanded to the stride boundary at insert time,
+// so lookup is one root access plus one access per byte beyond the longest stored prefix
+// (at most 3 for IPv4, 15 for IPv6) and it doesn't depend on the number of prefixes.
+//
+// Table is filled once and then only read - it's not thread safe for writes, share it as const.
+
+class PrefixTable {
+
+public:
+    struct stats_t {
+        std::size_t prefixes = 0;
+        std::size_t chunks = 0;
+        std::size_t bytes = 0;
+    };
+
+    // insert prefix of @pflen bits, @addr is network order, 4 or 16 bytes according to @family
+    bool insert(int family, uint8_t const* addr, unsigned int pflen);
+
+    // insert textual prefix "192.168.0.0/16", "2001:db8::/32" or a single address
+    bool insert(std::string_view prefix);
+
+    bool contains(int family, uint8_t const* addr) const;
+    bool contains(cidr::CIDR const* c) const;
+
+    stats_t stats() const;
+
+    // load prefixes from file, one per line. Empty lines and text after '#' are ignored.
+    // @bad_lines receives count of lines which could not be parsed.
+    static std::shared_ptr<PrefixTable> load_file(std::string const& path, std::size_t* bad_lines = nullptr);
+
+private:
+    using entry_t = uint32_t;
+
+    constexpr static entry_t EMPTY = 0;
+    constexpr static entry_t FULL = 1;
+    constexpr static entry_t CHILD = 0x80000000;
+
+    constexpr static std::size_t root_size = 65536;
+    constexpr static std::size_t chunk_size = 256;
+
+    struct Tree {
+        std::vector<entry_t> root;
+        std::vector<entry_t> chunks;    // chunk N occupies [N*chunk_size, (N+1)*chunk_size)
+        std::size_t prefixes = 0;
+    };
+
+    Tree& tree(int family) { return family == AF_INET6 ? v6_ : v4_; }
+    Tree const& tree(int family) const { return family == AF_INET6 ? v6_ : v4_; }
+
+    static entry_t new_chunk(Tree& t);
+
+    Tree v4_;
+    Tree v6_;
+};
+
+#endif //POLICY_PREFIXTABLE_HPP
@@ -4,12 +4,19 @@
 #include <proxy/mitmproxy.hpp>
 #include <crc32.hpp>
 
+#include <algorithm>
+
 void ProfileRouting::update() {
-    lb_state.expand_candidates(dnat_addresses);
+    auto changed = lb_state.expand_candidates(dnat_addresses);
+
+    if(health_check != BackendHealth::mode_t::NONE) {
+        lb_state.watch_health(health_check, health_port, changed);
+    }
+
     lb_state.rr_counter++;
 }
 
-std::vector<std::shared_ptr<CidrAddress>> ProfileRouting::lb_candidates(int family) const {
+std::vector<std::shared_ptr<CidrAddress>> const& ProfileRouting::lb_candidates(int family) const {
     return family == CIDR_IPV6 ? lb_state.candidates_v6 : lb_state.candidates_v4;
 }
 
@@ -18,22 +25,35 @@ size_t ProfileRouting::lb_index_rr(size_t sz) const {
 }
 
 
-static uint32_t crc32_proxy_key(MitmProxy* proxy, bool add_port) {
-    std::stringstream ss;
-
-    if(auto const* l = proxy->first_left(); l) {
-        ss << l->host();
-    }
-    if(auto const* r = proxy->first_right(); r) {
-        ss << r->host();
-        if(add_port) {
-            ss << r->port();
+namespace {
+    // binary flow key: source address, original destination address and optionally destination port
+    struct FlowKey {
+        uint8_t bytes[34] {};
+        std::size_t len = 32;
+
+        FlowKey(MitmProxy* proxy, bool add_port) {
+            if(auto const* l = proxy->first_left(); l) {
+                auto p = cidr::Prefix::parse(l->host());
+                if(p.valid()) p.to_bytes(&bytes[0]);
+            }
+            if(auto const* r = proxy->first_right(); r) {
+                auto p = cidr::Prefix::parse(r->host());
+                if(p.valid()) p.to_bytes(&bytes[16]);
+
+                if(add_port) {
+                    auto port = safe_val(r->port(), 0);
+                    bytes[32] = static_cast<uint8_t>(port >> 8);
+                    bytes[33] = static_cast<uint8_t>(port & 0xff);
+                    len = 34;
+                }
+            }
         }
-    }
-
-    auto key = ss.str();
+    };
+}
 
-    return socle::tools::crc32::compute(0, key.data(), key.size());
+static uint32_t crc32_proxy_key(MitmProxy* proxy, bool add_port) {
+    FlowKey key(proxy, add_port);
+    return socle::tools::crc32::compute(0, key.bytes, key.len);
 }
 
 size_t ProfileRouting::lb_index_l3 (MitmProxy* proxy, size_t sz) const {
@@ -43,23 +63,154 @@ size_t ProfileRouting::lb_index_l3 (MitmProxy* proxy, size_t sz) const {
 
 size_t ProfileRouting::lb_index_l4(MitmProxy* proxy, size_t sz) const {
 
-    return sz == 0 ? 0 : crc32_proxy_key(proxy, proxy) % sz;
+    return sz == 0 ? 0 : crc32_proxy_key(proxy, true) % sz;
+}
+
+size_t ProfileRouting::lb_index_maglev(MitmProxy* proxy, int family, bool add_port) const {
+
+    auto table = lb_state.maglev(family);
+    if(not table or table->empty()) return 0;
+
+    FlowKey key(proxy, add_port);
+    return table->lookup(MaglevTable::hash(key.bytes, key.len));
+}
+
+
+int ProfileRouting::lb_index_pool(int family) const {
+
+    auto const& pool = family == CIDR_IPV6 ? lb_state.pool_v6 : lb_state.pool_v4;
+    if(not pool) return -1;
+
+    auto const& health = family == CIDR_IPV6 ? lb_state.health_v6 : lb_state.health_v4;
+    auto healthy = [&health](std::size_t i) { return i >= health.size() or health[i]->up; };
+
+    auto index = pool->compute(healthy);
+    // all down - don't refuse the connection because of health checks
+    if(index < 0) index = pool->compute();
+
+    return index;
+}
+
+std::shared_ptr<HostInfo> ProfileRouting::lb_pool_host(int family, size_t index) const {
+    auto const& pool = family == CIDR_IPV6 ? lb_state.pool_v6 : lb_state.pool_v4;
+    return pool ? pool->candidate(index) : nullptr;
+}
+
+void ProfileRouting::LbState::make_pools(dnat_lb_method_t method, std::string const& profile_name) {
+
+    // scoped by profile name: pools rebuilt on reload keep counters of backends they already knew
+    auto make = [method, &profile_name](const char* family) -> std::shared_ptr<HostPool<>> {
+        auto scope = profile_name + family;
+        if(method == lb_method::LB_LEAST_CONN) return std::make_shared<LeastConnPool<>>(scope);
+        if(method == lb_method::LB_PEAK_EWMA) return std::make_shared<PeakEwmaPool<>>(scope);
+        return nullptr;
+    };
+
+    auto l_ = std::scoped_lock(lock_);
+    pool_v4 = make("/ip4");
+    pool_v6 = make("/ip6");
+}
+
+size_t ProfileRouting::lb_index_healthy(int family, size_t index) const {
+
+    auto const& health = family == CIDR_IPV6 ? lb_state.health_v6 : lb_state.health_v4;
+    auto const sz = health.size();
+    if(sz == 0 or index >= sz) return index;
+
+    for(size_t i = 0; i < sz; ++i) {
+        auto cur = (index + i) % sz;
+        if(health[cur]->up) return cur;
+    }
+
+    // all down - don't refuse the connection because of health checks
+    return index;
+}
+
+
+void ProfileRouting::LbState::watch_health(BackendHealth::mode_t mode, uint16_t port, bool force) {
+
+    auto l_ = std::scoped_lock(lock_);
+
+    auto now = time(nullptr);
+    if(not force and now - last_health_watch <= refresh_interval) return;
+    last_health_watch = now;
+
+    auto watch_all = [&](std::vector<std::shared_ptr<CidrAddress>> const& cands) {
+        std::vector<std::shared_ptr<BackendHealth::Target>> ret;
+        if(port == 0) return ret;
+
+        ret.reserve(cands.size());
+        for(auto const& c: cands) {
+            ret.push_back(BackendHealth::get().watch(c->ip(CIDR_ONLYADDR), port, mode));
+        }
+        return ret;
+    };
+
+    health_v4 = watch_all(candidates_v4);
+    health_v6 = watch_all(candidates_v6);
 }
 
 
 bool ProfileRouting::LbState::expand_candidates(std::vector<std::string> const& addresses) {
 
-    if(auto now = time(nullptr); now - last_refresh > refresh_interval) {
-        last_refresh = now;
+    auto now = time(nullptr);
+    auto last = last_refresh.load();
+
+    // single thread refreshes, others keep using current candidates
+    if(now - last > refresh_interval and last_refresh.compare_exchange_strong(last, now)) {
 
         // get a fresh, expanded list of all IP addresses
-        const std::vector<std::shared_ptr<CidrAddress>> update4 = CfgFactory::get()->expand_to_cidr(addresses, AF_INET);
-        const std::vector<std::shared_ptr<CidrAddress>> update6 = CfgFactory::get()->expand_to_cidr(addresses, AF_INET6);
+        std::vector<std::shared_ptr<CidrAddress>> update4 = CfgFactory::get()->expand_to_cidr(addresses, AF_INET);
+        std::vector<std::shared_ptr<CidrAddress>> update6 = CfgFactory::get()->expand_to_cidr(addresses, AF_INET6);
+
+        // sorted IPs - DNS may return the same set in a different order, that's not a change
+        auto names_of = [](std::vector<std::shared_ptr<CidrAddress>> const& cands) {
+            std::vector<std::string> ret;
+            ret.reserve(cands.size());
+            for(auto const& c: cands) ret.emplace_back(c->ip());
+            std::sort(ret.begin(), ret.end());
+            return ret;
+        };
+
+        auto names4 = names_of(update4);
+        auto names6 = names_of(update6);
+
+        bool changed4 = false;
+        bool changed6 = false;
+        {
+            auto l_ = std::scoped_lock(lock_);
+            changed4 = names4 != names_of(candidates_v4);
+            changed6 = names6 != names_of(candidates_v6);
+        }
+
+        if(not changed4 and not changed6) return false;
+
+        // candidates are indexed by table, keep them in the same (sorted) order
+        auto by_ip = [](auto const& a, auto const& b) { return a->ip() < b->ip(); };
+        std::sort(update4.begin(), update4.end(), by_ip);
+        std::sort(update6.begin(), update6.end(), by_ip);
+
+        // build outside of the lock, other connections keep using current tables meanwhile
+        MaglevTable table4;
+        MaglevTable table6;
+        if(use_maglev and changed4) table4.build(names4);
+        if(use_maglev and changed6) table6.build(names6);
 
         auto l_ = std::scoped_lock(lock_);
-        candidates_v4 = update4;
-        candidates_v6 = update6;
+        if(changed4) {
+            candidates_v4 = std::move(update4);
+            if(use_maglev) std::atomic_store(&maglev_v4, std::make_shared<MaglevTable const>(std::move(table4)));
+            if(pool_v4) pool_v4->set_hosts(names4);
+        }
+        if(changed6) {
+            candidates_v6 = std::move(update6);
+            if(use_maglev) std::atomic_store(&maglev_v6, std::make_shared<MaglevTable const>(std::move(table6)));
+            if(pool_v6) pool_v6->set_hosts(names6);
+        }
+        if(use_maglev) ++maglev_rebuilds;
+
+        return true;
     }
 
     return false;
-}
\ No newline at end of file
+}
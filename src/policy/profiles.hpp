@@ -43,6 +43,13 @@
 
 #include <policy/cfgelement.hpp>
 #include <policy/addrobj.hpp>
+#include <policy/domaintrie.hpp>
+#include <policy/natpool.hpp>
+#include <policy/maglev.hpp>
+#include <policy/healthcheck.hpp>
+#include <policy/loadb.hpp>
+#include <policy/groupset.hpp>
+#include <inspect/rewrite.hpp>
 
 class ProfileDetection : public socle::sobject, public CfgElement {
 
@@ -72,7 +79,6 @@ public:
     std::string replace;
     bool fill_length = false;
     int replace_each_nth = 0;
-    int replace_each_counter_ = 0;
 
     bool ask_destroy() override { return false; };
     std::string to_string(int verbosity) const override {
@@ -156,6 +162,16 @@ public:
 
     ContentCaptureFormat write_format;
     std::vector<ProfileContentRule> content_rules;
+    // content_rules compiled, shared by all sessions using this profile
+    std::shared_ptr<sx::rewrite::Ruleset const> content_ruleset;
+
+    void compile_rules() {
+        std::vector<sx::rewrite::Rule> rules;
+        for(auto const& cr: content_rules) {
+            rules.push_back({ cr.match, cr.replace, cr.fill_length, cr.replace_each_nth });
+        }
+        content_ruleset = std::make_shared<sx::rewrite::Ruleset const>(std::move(rules));
+    }
 
     bool ask_destroy() override { return false; };
     std::string to_string(int verbosity) const override {
@@ -204,14 +220,14 @@ public:
     bool opt_alpn_block = false;
 
     std::shared_ptr<std::vector<std::string>> sni_filter_bypass;
-    std::shared_ptr<std::vector<FqdnAddress>> sni_filter_bypass_addrobj;
+    std::shared_ptr<DomainTrie> sni_filter_bypass_trie;   // sni_filter_bypass compiled at load time
     socle::spointer_set_int redirect_warning_ports;
 
     bool sni_filter_use_dns_cache = true;       // if sni_filter_bypass is set, check during policy match if target IP isn't in DNS cache matching SNI filter entries.
     // For example:
     // Connection to 1.1.1.1 policy check will look in all SNI filter entries ["abc.com","mybank.com"] and will try to find them in DNS cache.
     // Sni filter entry mybank.com is found in DNS cache pointing to 1.1.1.1. Connection is bypassed.
-    // Load increases with SNI filter length lineary, but DNS cache lookup is fast.
+    // Target IP is looked up in DNS reverse index and names it resolves from are matched against compiled filter.
     // DNS cache has to be active this to be working.
     bool sni_filter_use_dns_domain_tree = true;
     // check IP address in full domain tree for each SNI filter entry.
@@ -222,7 +238,7 @@ public:
     // Both "www" and "ecom" are searched in DNS cache. www points to 1.1.1.1, but ecom points to 2.2.2.2.
     // Connection is bypassed.
     // DNS cache has to active and sni_filter_use_dns_cache enabled before this feature can be activated.
-    // Load increases with SNI filter size and subdomain cache, both lineary, so it's intensive feature.
+    // In compiled filter this means "*.mybank.com" entries are also matched against cached names.
 
     bool sslkeylog = false;                     // disable or enable ssl keylogging on this profile
 
@@ -255,6 +271,9 @@ public:
                 }
 
             if(sni_out) {
+                if(sni_filter_bypass_trie)
+                    ret += string_format("\n        sni exclude - compiled: %d entries, %d nodes",
+                                         sni_filter_bypass_trie->size(), sni_filter_bypass_trie->node_count());
                 ret += string_format("\n        sni exclude - use dns cache: %d",sni_filter_use_dns_cache);
                 ret += string_format("\n        sni exclude - use dns domain tree: %d",sni_filter_use_dns_domain_tree);
                 ret += "\n";
@@ -288,12 +307,14 @@ struct ProfileList {
     std::shared_ptr<ProfileRouting> profile_routing = nullptr;
 };
 struct ProfileSubAuth : public ProfileList, public CfgElement {
+    sx::auth::GroupSet group_set;   // element name interned as group
 };
 
 struct ProfileAuth : public CfgElement {
     bool authenticate = false;
     bool resolve = false;  // resolve traffic by ip in auth table
     std::vector<std::shared_ptr<ProfileSubAuth>> sub_policies;
+    sx::auth::GroupSet sub_groups;  // union of sub-policy groups
 };
 
 struct ProfileAlgDns : public CfgElement {
@@ -313,19 +334,37 @@ struct ProfileRouting: public CfgElement {
     std::vector<std::string> dnat_addresses;
     std::vector<std::string> dnat_ports;
 
-    using dnat_lb_method_t = enum class lb_method { LB_RR, LB_L3, LB_L4 };
+    using dnat_lb_method_t = enum class lb_method { LB_RR, LB_L3, LB_L4, LB_MAGLEV_L3, LB_MAGLEV_L4, LB_LEAST_CONN, LB_PEAK_EWMA };
     dnat_lb_method_t dnat_lb_method;
 
+    // source NAT pool, used by policies with 'nat = "pool"'
+    std::vector<std::string> snat_addresses;
+    std::vector<std::string> snat_ports;
+    std::shared_ptr<NatPool> snat_pool;
+
+    // active backend checks; port 0 means port of the first dnat_port object
+    BackendHealth::mode_t health_check = BackendHealth::mode_t::NONE;
+    uint16_t health_check_port = 0;
+    uint16_t health_port = 0;           // resolved when loaded: update() runs per connection, without lookups
+
     // update internal state - run once per one request
     void update();
 
-    // get (cached) address lookup candidates
-    std::vector<std::shared_ptr<CidrAddress>> lb_candidates(int family) const;
+    // get (cached) address lookup candidates - call with lb_state.lock_ held
+    std::vector<std::shared_ptr<CidrAddress>> const& lb_candidates(int family) const;
 
     // helper to get index based on RR scheme
     size_t lb_index_rr(size_t sz) const;
     size_t lb_index_l3 (MitmProxy* proxy, size_t sz) const;
     size_t lb_index_l4(MitmProxy* proxy, size_t sz) const;
+    // consistent hashing, index to lb_candidates(family) - call with lb_state.lock_ held
+    size_t lb_index_maglev(MitmProxy* proxy, int family, bool add_port) const;
+    // least-conn and peak-ewma: healthy candidate chosen by pool, -1 if none - call with lb_state.lock_ held
+    int lb_index_pool(int family) const;
+    std::shared_ptr<HostInfo> lb_pool_host(int family, size_t index) const;
+
+    // first healthy candidate starting at @index (wrapping), or @index if all are down - call with lb_state.lock_ held
+    size_t lb_index_healthy(int family, size_t index) const;
 
     struct LbState {
         constexpr static time_t refresh_interval = 5;
@@ -334,10 +373,36 @@ struct ProfileRouting: public CfgElement {
 
         std::atomic_long rr_counter = 0;
 
-        time_t last_refresh = 0;
+        std::atomic<time_t> last_refresh {0};
         std::vector<std::shared_ptr<CidrAddress>> candidates_v4;
         std::vector<std::shared_ptr<CidrAddress>> candidates_v6;
+
+        // consistent hashing tables, rebuilt only if candidate set changes. Rebuilt table is published
+        // as a whole (together with candidates, under lock_), lookups never see a table being built.
+        // Built only for maglev lb methods (@use_maglev, set on load), other methods don't read them.
+        bool use_maglev = false;
+        std::shared_ptr<MaglevTable const> maglev_v4;
+        std::shared_ptr<MaglevTable const> maglev_v6;
+        std::shared_ptr<MaglevTable const> maglev(int family) const {
+            return std::atomic_load(family == CIDR_IPV6 ? &maglev_v6 : &maglev_v4);
+        }
+        std::atomic_long maglev_rebuilds = 0;
+
+        // session and latency aware pools (least-conn, peak-ewma), same order as candidates
+        std::shared_ptr<HostPool<>> pool_v4;
+        std::shared_ptr<HostPool<>> pool_v6;
+        // pools of the same @profile_name share host statistics, so they survive config reload
+        void make_pools(dnat_lb_method_t method, std::string const& profile_name);
+
+        // health state of candidates, same order as candidates (empty if checks are disabled)
+        std::vector<std::shared_ptr<BackendHealth::Target>> health_v4;
+        std::vector<std::shared_ptr<BackendHealth::Target>> health_v6;
+
+        // returns true if candidates have changed
         bool expand_candidates(std::vector<std::string> const& addresses);
+        // (re)register candidates for health checks, at most once per refresh_interval unless forced
+        void watch_health(BackendHealth::mode_t mode, uint16_t port, bool force);
+        time_t last_health_watch = 0;
     };
 
     LbState lb_state;
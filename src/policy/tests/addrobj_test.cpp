@@ -1,6 +1,9 @@
 #include <policy/addrobj.cpp>
 #include <log/logan.hpp>
 
+#include <fstream>
+#include <unistd.h>
+
 #include <gtest/gtest.h>
 
 using namespace cidr;
@@ -30,4 +33,43 @@ TEST(CidrAddressTest, NonsenseInput3) {
 TEST(CidrAddressTest, Host_HostTest) {
     auto a = cidr_from_str("1.1.1.1");
     ASSERT_TRUE(std::string(cidr_numhost(a)) == "1");
-}
\ No newline at end of file
+}
+
+TEST(PrefixListAddressTest, LoadMatchReload) {
+    char path[] = "/tmp/sx_prefixlist_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    {
+        std::ofstream f(path);
+        f << "# comment\n10.0.0.0/8\n  192.168.1.128/25 # trailing\n2001:db8::/32\nnot-a-prefix\n";
+    }
+
+    auto pl = PrefixListAddress(path);
+    ASSERT_TRUE(pl.table());
+    ASSERT_TRUE(pl.table()->stats().prefixes == 3);
+
+    auto in4 = cidr_from_str("10.20.30.40");
+    auto in4b = cidr_from_str("192.168.1.200");
+    auto out4 = cidr_from_str("192.168.1.100");
+    auto in6 = cidr_from_str("2001:db8:ffff::1");
+    ASSERT_TRUE(pl.match(in4));
+    ASSERT_TRUE(pl.match(in4b));
+    ASSERT_FALSE(pl.match(out4));
+    ASSERT_TRUE(pl.match(in6));
+
+    {
+        std::ofstream f(path);
+        f << "192.168.1.0/24\n";
+    }
+    ASSERT_TRUE(pl.reload());
+    ASSERT_FALSE(pl.match(in4));
+    ASSERT_TRUE(pl.match(out4));
+
+    cidr_free(in4);
+    cidr_free(in4b);
+    cidr_free(out4);
+    cidr_free(in6);
+    unlink(path);
+}
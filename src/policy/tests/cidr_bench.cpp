@@ -0,0 +1,66 @@
+// Prefix vs. libcidr timing comparison. Not part of sx_gtests: timings are only printed, and
+// assertions check just that both implementations compute the same results.
+
+#include <ext/libcidr/cidr.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cidr;
+
+TEST(CidrPrefix, Benchmark) {
+    std::mt19937 rng(42);
+    std::vector<std::string> ips;
+    for(int i = 0; i < 2000; ++i) {
+        ips.push_back(std::to_string(rng() % 256) + "." + std::to_string(rng() % 256) + "."
+                      + std::to_string(rng() % 256) + "." + std::to_string(rng() % 256));
+    }
+    auto* net = cidr_from_str("128.0.0.0/1");
+    auto const net_p = Prefix::parse("128.0.0.0/1");
+
+    auto measure = [&](auto fn) {
+        auto start = std::chrono::steady_clock::now();
+        long sum = 0;
+        for(auto const& ip: ips) sum += fn(ip);
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        return std::make_pair(ns / static_cast<long>(ips.size()), sum);
+    };
+
+    measure([](auto const& ip) { return static_cast<long>(ip.size()); });  // warm-up
+    auto [ parse_old, s1 ] = measure([](auto const& ip) { auto* c = cidr_from_str(ip.c_str()); long r = c->addr[15]; cidr_free(c); return r; });
+    auto [ parse_new, s2 ] = measure([](auto const& ip) { return static_cast<long>(Prefix::parse(ip).addr & 0xff); });
+    ASSERT_EQ(s1, s2);
+
+    std::vector<CIDR*> parsed;
+    std::vector<Prefix> parsed_p;
+    for(auto const& ip: ips) {
+        parsed.push_back(cidr_from_str(ip.c_str()));
+        parsed_p.push_back(Prefix::parse(ip));
+    }
+
+    std::size_t idx = 0;
+    auto [ contains_old, s3 ] = measure([&](auto const&) { return static_cast<long>(cidr_contains(net, parsed[idx++]) == 0); });
+    idx = 0;
+    auto [ contains_new, s4 ] = measure([&](auto const&) { return static_cast<long>(net_p.contains(parsed_p[idx++])); });
+    ASSERT_EQ(s3, s4);
+
+    idx = 0;
+    auto [ format_old, s5 ] = measure([&](auto const&) { char* s = cidr_to_str(parsed[idx++], CIDR_ONLYADDR); long r = static_cast<long>(strlen(s)); free(s); return r; });
+    idx = 0;
+    auto [ format_new, s6 ] = measure([&](auto const&) { char buf[Prefix::str_size]; return static_cast<long>(parsed_p[idx++].format(buf, sizeof(buf), CIDR_ONLYADDR)); });
+    ASSERT_EQ(s5, s6);
+
+    std::cout << "parse:    libcidr " << parse_old << "ns, Prefix " << parse_new << "ns\n";
+    std::cout << "contains: libcidr " << contains_old << "ns, Prefix " << contains_new << "ns\n";
+    std::cout << "format:   libcidr " << format_old << "ns, Prefix " << format_new << "ns\n";
+
+    for(auto* c: parsed) cidr_free(c);
+    cidr_free(net);
+}
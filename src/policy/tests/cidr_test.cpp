@@ -0,0 +1,71 @@
+#include <ext/libcidr/cidr.hpp>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace cidr;
+
+TEST(CidrPrefix, ParseAndFormat) {
+    char buf[Prefix::str_size];
+
+    auto p4 = Prefix::parse("192.168.1.0/24");
+    ASSERT_TRUE(p4.valid());
+    ASSERT_EQ(p4.proto, CIDR_IPV4);
+    ASSERT_EQ(p4.prefix_len(), 24);
+    ASSERT_GT(p4.format(buf, sizeof(buf)), 0u);
+    ASSERT_STREQ(buf, "192.168.1.0/24");
+    p4.format(buf, sizeof(buf), CIDR_ONLYADDR);
+    ASSERT_STREQ(buf, "192.168.1.0");
+
+    auto p6 = Prefix::parse("2001:db8::1");
+    ASSERT_TRUE(p6.valid());
+    ASSERT_EQ(p6.prefix_len(), 128);
+    p6.format(buf, sizeof(buf));
+    ASSERT_STREQ(buf, "2001:db8::1/128");
+
+    ASSERT_FALSE(Prefix::parse("10.0.0.0/33").valid());
+    ASSERT_FALSE(Prefix::parse("this.is.a.4").valid());
+    ASSERT_FALSE(Prefix::parse("").valid());
+    ASSERT_EQ(Prefix().format(buf, sizeof(buf)), 0u);
+    ASSERT_EQ(p4.format(buf, 4), 0u);
+}
+
+TEST(CidrPrefix, SameResultsAsLibcidr) {
+    std::vector<std::pair<const char*, const char*>> pairs {
+            { "0.0.0.0/0", "1.0.0.1" },
+            { "10.0.0.0/8", "10.20.30.40" },
+            { "10.0.0.0/8", "11.0.0.1" },
+            { "10.1.0.0/16", "10.0.0.0/8" },
+            { "192.168.1.128/25", "192.168.1.127" },
+            { "1.1.1.1", "1.1.1.1" },
+            { "::/0", "2001:db8::1" },
+            { "2001:db8::/32", "2001:db8:ffff::1" },
+            { "2001:db8::/33", "2001:db8:8000::1" },
+            { "10.0.0.0/8", "::ffff:10.0.0.1" },
+    };
+
+    for(auto const& [ big, little ]: pairs) {
+        auto* cb = cidr_from_str(big);
+        auto* cl = cidr_from_str(little);
+        ASSERT_TRUE(cb and cl);
+
+        auto pb = Prefix::from_cidr(cb);
+        auto pl = Prefix::from_cidr(cl);
+        ASSERT_EQ(pb, Prefix::parse(big)) << big;
+        ASSERT_EQ(pb.contains(pl), cidr_contains(cb, cl) == 0) << big << " > " << little;
+
+        CIDR back {};
+        pb.to_cidr(back);
+        ASSERT_EQ(cidr_equals(&back, cb), 0) << big;
+
+        cidr_free(cb);
+        cidr_free(cl);
+    }
+
+    sockaddr_in sin {};
+    sin.sin_family = AF_INET;
+    inet_pton(AF_INET, "10.20.30.40", &sin.sin_addr);
+    ASSERT_EQ(Prefix::from_sockaddr(reinterpret_cast<sockaddr*>(&sin)), Prefix::parse("10.20.30.40"));
+}
@@ -0,0 +1,101 @@
+// Compiled classifier vs. linear rule scan timing. Not part of sx_gtests: timings are only printed, and
+// assertions check just that both find the same rules.
+
+#include <tcpcom.hpp>
+
+#include <policy/policy.hpp>
+#include <policy/classifier.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace {
+
+    std::string random_ip4(std::mt19937& rng, int octets=4) {
+        std::uniform_int_distribution<int> d(1, 254);
+        std::string ret;
+        for(int i = 0; i < 4; ++i) {
+            if(i) ret += ".";
+            ret += i < octets ? std::to_string(d(rng)) : "0";
+        }
+        return ret;
+    }
+
+    // generate rules with mix of host and /24 network destinations and port ranges, last rule matches anything
+    std::vector<std::shared_ptr<PolicyRule>> make_rules(std::size_t count, std::mt19937& rng) {
+        std::vector<std::shared_ptr<PolicyRule>> rules;
+        std::uniform_int_distribution<int> port(1, 10000);
+
+        for(std::size_t i = 0; i + 1 < count; ++i) {
+            auto r = std::make_shared<PolicyRule>();
+
+            if(i % 3 == 0)
+                r->src.push_back(std::make_shared<CfgAddress>(std::make_shared<CidrAddress>(random_ip4(rng, 3) + "/24")));
+
+            r->dst.push_back(std::make_shared<CfgAddress>(std::make_shared<CidrAddress>(
+                    i % 2 ? random_ip4(rng) : random_ip4(rng, 3) + "/24")));
+
+            if(i % 4 == 0) {
+                auto p = port(rng);
+                r->dst_ports.push_back(std::make_shared<CfgRange>(std::pair<int, int>(p, p + 100)));
+            }
+
+            rules.push_back(r);
+        }
+
+        rules.push_back(std::make_shared<PolicyRule>());
+        return rules;
+    }
+
+    int linear_match(std::vector<std::shared_ptr<PolicyRule>> const& rules, std::vector<baseHostCX*>& l, std::vector<baseHostCX*>& r) {
+        for(std::size_t i = 0; i < rules.size(); ++i) {
+            if(rules[i]->match(l, r)) return static_cast<int>(i);
+        }
+        return -1;
+    }
+}
+
+TEST(PolicyClassifierTest, Benchmark) {
+
+    for(std::size_t count: { 10, 1000, 10000 }) {
+        std::mt19937 rng(1);
+        auto rules = make_rules(count, rng);
+
+        auto t_build = std::chrono::steady_clock::now();
+        PolicyClassifier cls(rules);
+        auto build_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_build).count();
+
+        constexpr int lookups = 200;
+        std::vector<std::pair<std::unique_ptr<baseHostCX>, std::unique_ptr<baseHostCX>>> traffic;
+        for(int i = 0; i < lookups; ++i) {
+            traffic.emplace_back(std::make_unique<baseHostCX>(new TCPCom(), random_ip4(rng), "1024"),
+                                 std::make_unique<baseHostCX>(new TCPCom(), random_ip4(rng), "443"));
+        }
+
+        auto run = [&](auto fn) {
+            auto start = std::chrono::steady_clock::now();
+            long sum = 0;
+            for(auto& [ s, d ]: traffic) {
+                std::vector<baseHostCX*> l { s.get() };
+                std::vector<baseHostCX*> r { d.get() };
+                sum += fn(l, r);
+            }
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            return std::make_pair(ns / lookups, sum);
+        };
+
+        auto [ linear_ns, linear_sum ] = run([&](auto& l, auto& r) { return linear_match(rules, l, r); });
+        auto [ compiled_ns, compiled_sum ] = run([&](auto& l, auto& r) { return cls.match(l, r).value_or(-2); });
+
+        ASSERT_EQ(linear_sum, compiled_sum);
+
+        std::cout << "rules: " << count
+                  << ", linear: " << linear_ns << "ns/lookup"
+                  << ", compiled: " << compiled_ns << "ns/lookup"
+                  << ", build: " << build_us << "us"
+                  << ", memory: " << cls.memory_usage() / 1024 << "kB" << std::endl;
+    }
+}
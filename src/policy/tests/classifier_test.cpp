@@ -0,0 +1,114 @@
+#include <tcpcom.hpp>
+
+#include <policy/policy.hpp>
+#include <policy/classifier.hpp>
+#include <log/logan.hpp>
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+namespace {
+
+    std::string random_ip4(std::mt19937& rng, int octets=4) {
+        std::uniform_int_distribution<int> d(1, 254);
+        std::string ret;
+        for(int i = 0; i < 4; ++i) {
+            if(i) ret += ".";
+            ret += i < octets ? std::to_string(d(rng)) : "0";
+        }
+        return ret;
+    }
+
+    // generate rules with mix of host and /24 network destinations and port ranges, last rule matches anything
+    std::vector<std::shared_ptr<PolicyRule>> make_rules(std::size_t count, std::mt19937& rng) {
+        std::vector<std::shared_ptr<PolicyRule>> rules;
+        std::uniform_int_distribution<int> port(1, 10000);
+
+        for(std::size_t i = 0; i + 1 < count; ++i) {
+            auto r = std::make_shared<PolicyRule>();
+
+            if(i % 3 == 0)
+                r->src.push_back(std::make_shared<CfgAddress>(std::make_shared<CidrAddress>(random_ip4(rng, 3) + "/24")));
+
+            r->dst.push_back(std::make_shared<CfgAddress>(std::make_shared<CidrAddress>(
+                    i % 2 ? random_ip4(rng) : random_ip4(rng, 3) + "/24")));
+
+            if(i % 4 == 0) {
+                auto p = port(rng);
+                r->dst_ports.push_back(std::make_shared<CfgRange>(std::pair<int, int>(p, p + 100)));
+            }
+
+            rules.push_back(r);
+        }
+
+        rules.push_back(std::make_shared<PolicyRule>());
+        return rules;
+    }
+
+    int linear_match(std::vector<std::shared_ptr<PolicyRule>> const& rules, std::vector<baseHostCX*>& l, std::vector<baseHostCX*>& r) {
+        for(std::size_t i = 0; i < rules.size(); ++i) {
+            if(rules[i]->match(l, r)) return static_cast<int>(i);
+        }
+        return -1;
+    }
+}
+
+TEST(PolicyClassifierTest, MatchesLinearScan) {
+    std::mt19937 rng(42);
+
+    auto rules = make_rules(500, rng);
+
+    // pick traffic to hit existing rules, plus some random noise
+    auto disabled = std::make_shared<PolicyRule>();
+    disabled->is_disabled = true;
+    rules.insert(rules.begin(), disabled);
+
+    PolicyClassifier cls(rules);
+
+    std::uniform_int_distribution<std::size_t> pick(1, rules.size() - 1);
+    std::uniform_int_distribution<int> port(1, 10100);
+
+    for(int i = 0; i < 2000; ++i) {
+        std::string dst_ip = random_ip4(rng);
+        auto const& r = rules[pick(rng)];
+        if(i % 2 and not r->dst.empty()) {
+            dst_ip = r->dst[0]->value()->str().substr(6);   // "Cidr: x.x.x.x/n"
+            dst_ip = dst_ip.substr(0, dst_ip.find('/'));
+        }
+
+        auto src = baseHostCX(new TCPCom(), random_ip4(rng), "1024");
+        auto dst = baseHostCX(new TCPCom(), dst_ip, std::to_string(port(rng)));
+        std::vector<baseHostCX*> l { &src };
+        std::vector<baseHostCX*> rr { &dst };
+
+        auto compiled = cls.match(l, rr);
+        ASSERT_TRUE(compiled.has_value());
+        ASSERT_EQ(compiled.value(), linear_match(rules, l, rr));
+    }
+}
+
+TEST(PolicyClassifierTest, EmptyAndIPv6) {
+    std::vector<std::shared_ptr<PolicyRule>> rules;
+
+    PolicyClassifier empty(rules);
+    auto src = baseHostCX(new TCPCom(), "2001:db8::1", "1024");
+    auto dst = baseHostCX(new TCPCom(), "2001:db8:1::1", "443");
+    std::vector<baseHostCX*> l { &src };
+    std::vector<baseHostCX*> r { &dst };
+
+    ASSERT_EQ(empty.match(l, r).value_or(-2), -1);
+
+    auto v4 = std::make_shared<PolicyRule>();
+    v4->dst.push_back(std::make_shared<CfgAddress>(std::make_shared<CidrAddress>("0.0.0.0/0")));
+    auto v6 = std::make_shared<PolicyRule>();
+    v6->dst.push_back(std::make_shared<CfgAddress>(std::make_shared<CidrAddress>("2001:db8:1::/48")));
+    rules.push_back(v4);
+    rules.push_back(v6);
+
+    PolicyClassifier cls(rules);
+    ASSERT_EQ(cls.match(l, r).value_or(-2), 1);
+
+    dst.host("2001:db8:2::1");
+    ASSERT_EQ(cls.match(l, r).value_or(-2), -1);
+}
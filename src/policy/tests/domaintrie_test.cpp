@@ -0,0 +1,84 @@
+#include <policy/domaintrie.hpp>
+
+#include <gtest/gtest.h>
+
+TEST(DomainTrieTest, ExactAndWildcard) {
+    DomainTrie trie;
+
+    ASSERT_TRUE(trie.insert("MyBank.com"));
+    ASSERT_TRUE(trie.insert("*.health.org."));
+    ASSERT_FALSE(trie.insert("*."));
+    ASSERT_FALSE(trie.insert("a..b"));
+    ASSERT_EQ(trie.size(), 2);
+
+    ASSERT_TRUE(trie.match("mybank.com"));
+    ASSERT_TRUE(trie.match("MYBANK.COM."));
+    ASSERT_FALSE(trie.match("www.mybank.com"));
+    ASSERT_FALSE(trie.match("com"));
+
+    // wildcard covers any name below, but not the domain itself
+    ASSERT_TRUE(trie.match("portal.health.org"));
+    ASSERT_TRUE(trie.match("a.b.health.org"));
+    ASSERT_FALSE(trie.match("health.org"));
+    ASSERT_FALSE(trie.match("portal.health.org", false));
+
+    ASSERT_FALSE(trie.match(""));
+    ASSERT_FALSE(trie.match(std::string(DomainTrie::max_name_len + 1, 'a')));
+}
+
+TEST(DomainTrieTest, OverlappingSuffixes) {
+    DomainTrie trie;
+
+    ASSERT_TRUE(trie.insert("example.com"));
+    ASSERT_TRUE(trie.insert("*.example.com"));
+    ASSERT_TRUE(trie.insert("deep.sub.example.com"));
+    ASSERT_TRUE(trie.insert("*.other.sub.example.com"));
+    ASSERT_EQ(trie.size(), 4);
+
+    // exact and wildcard on the same node are independent
+    ASSERT_TRUE(trie.match("example.com"));
+    ASSERT_TRUE(trie.match("www.example.com"));
+    ASSERT_TRUE(trie.match("deep.sub.example.com", false));
+    ASSERT_FALSE(trie.match("sub.example.com", false));
+    ASSERT_FALSE(trie.match("x.other.sub.example.com", false));
+
+    // label boundaries are respected
+    ASSERT_FALSE(trie.match("ample.com"));
+    ASSERT_FALSE(trie.match("badexample.com"));
+    ASSERT_FALSE(trie.match("example.com.evil.net"));
+}
+
+TEST(DomainTrieTest, Erase) {
+    DomainTrie trie;
+
+    ASSERT_TRUE(trie.insert("example.com"));
+    ASSERT_TRUE(trie.insert("*.example.com"));
+    ASSERT_TRUE(trie.insert("www.shop.example.com"));
+    auto nodes = trie.node_count();
+
+    // removing wildcard keeps exact entry of the same domain and entries below it
+    ASSERT_TRUE(trie.erase("*.Example.com."));
+    ASSERT_EQ(trie.size(), 2);
+    ASSERT_TRUE(trie.match("example.com"));
+    ASSERT_FALSE(trie.match("www.example.com"));
+    ASSERT_TRUE(trie.match("www.shop.example.com"));
+
+    // entries not present
+    ASSERT_FALSE(trie.erase("*.example.com"));
+    ASSERT_FALSE(trie.erase("shop.example.com"));
+    ASSERT_FALSE(trie.erase("unknown.org"));
+    ASSERT_FALSE(trie.erase("a..b"));
+    ASSERT_EQ(trie.size(), 2);
+
+    ASSERT_TRUE(trie.erase("example.com"));
+    ASSERT_FALSE(trie.match("example.com"));
+    ASSERT_TRUE(trie.match("www.shop.example.com"));
+
+    ASSERT_TRUE(trie.erase("www.shop.example.com"));
+    ASSERT_TRUE(trie.empty());
+    ASSERT_EQ(trie.node_count(), nodes);
+
+    // erased entry can be inserted again
+    ASSERT_TRUE(trie.insert("example.com"));
+    ASSERT_TRUE(trie.match("example.com"));
+}
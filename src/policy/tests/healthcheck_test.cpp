@@ -0,0 +1,131 @@
+#include <policy/healthcheck.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+namespace {
+    // listening socket on loopback, returns its port
+    int listen_local(int& fd) {
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in sin {};
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(bind(fd, reinterpret_cast<sockaddr*>(&sin), sizeof(sin)) < 0) return -1;
+        if(listen(fd, 16) < 0) return -1;
+
+        socklen_t len = sizeof(sin);
+        getsockname(fd, reinterpret_cast<sockaddr*>(&sin), &len);
+        return ntohs(sin.sin_port);
+    }
+
+    HealthProbeIO::result_t run_probe(uint16_t port, bool tls) {
+        HealthProbeIO io;
+        if(io.start("127.0.0.1", port, tls) < 0) return HealthProbeIO::result_t::FAILED;
+
+        for(int i = 0; i < 50; ++i) {
+            pollfd pfd { io.socket(), static_cast<short>(io.want_write() ? POLLOUT : POLLIN), 0 };
+            poll(&pfd, 1, 100);
+
+            if(auto r = io.step(); r != HealthProbeIO::result_t::RUNNING) return r;
+        }
+        return HealthProbeIO::result_t::RUNNING;
+    }
+}
+
+TEST(BackendHealthTest, Hysteresis) {
+    auto& bh = BackendHealth::get();
+    auto t = bh.watch("192.0.2.10", 443, BackendHealth::mode_t::TCP);
+
+    ASSERT_TRUE(t->up);
+    ASSERT_EQ(bh.claim_due(time(nullptr) + 10).size(), 1);
+    // already in probe
+    ASSERT_TRUE(bh.claim_due(time(nullptr) + 20).empty());
+
+    for(unsigned int i = 1; i < BackendHealth::fall; ++i) {
+        bh.report(*t, false, 0, "refused");
+        ASSERT_TRUE(t->up);
+    }
+    bh.report(*t, false, 0, "refused");
+    ASSERT_FALSE(t->up);
+    ASSERT_EQ(bh.last_error(*t), "refused");
+
+    bh.report(*t, true, 1500, "");
+    ASSERT_FALSE(t->up);
+    bh.report(*t, true, 500, "");
+    ASSERT_TRUE(t->up);
+    ASSERT_EQ(t->latency_us, 500);
+    ASSERT_EQ(t->probes, BackendHealth::fall + 2);
+}
+
+TEST(BackendHealthTest, ProbeLocalListener) {
+    int lfd = -1;
+    int port = listen_local(lfd);
+    ASSERT_GT(port, 0);
+
+    ASSERT_EQ(run_probe(port, false), HealthProbeIO::result_t::OK);
+    ::close(accept(lfd, nullptr, nullptr));
+
+    // plain TCP listener never answers ClientHello with a handshake
+    {
+        HealthProbeIO io;
+        ASSERT_GE(io.start("127.0.0.1", port, true), 0);
+
+        int acc = -1;
+        for(int i = 0; i < 50 and acc < 0; ++i) {
+            pollfd pfd { io.socket(), static_cast<short>(io.want_write() ? POLLOUT : POLLIN), 0 };
+            poll(&pfd, 1, 100);
+            ASSERT_EQ(io.step(), HealthProbeIO::result_t::RUNNING);
+            acc = accept(lfd, nullptr, nullptr);
+        }
+        ASSERT_GE(acc, 0);
+        ::close(acc);
+
+        HealthProbeIO::result_t r = HealthProbeIO::result_t::RUNNING;
+        for(int i = 0; i < 50 and r == HealthProbeIO::result_t::RUNNING; ++i) {
+            pollfd pfd { io.socket(), static_cast<short>(io.want_write() ? POLLOUT : POLLIN), 0 };
+            poll(&pfd, 1, 100);
+            r = io.step();
+        }
+        ASSERT_EQ(r, HealthProbeIO::result_t::FAILED);
+    }
+
+    // stopped listener
+    ::close(lfd);
+    ASSERT_EQ(run_probe(port, false), HealthProbeIO::result_t::FAILED);
+}
+
+TEST(BackendHealthTest, NextDue) {
+    auto& bh = BackendHealth::get();
+    auto now = time(nullptr) + 1000;
+
+    auto t = bh.watch("192.0.2.20", 80, BackendHealth::mode_t::TCP);
+    t->last_wanted = now;
+
+    auto due = bh.claim_due(now);
+    ASSERT_EQ(std::count(due.begin(), due.end(), t), 1);
+    bh.report(*t, true, 100, "");
+    t->last_probe = now;
+
+    // nothing due until interval passes
+    ASSERT_TRUE(bh.claim_due(now + 1).empty());
+
+    // newly watched target is probed on the next claim
+    auto t2 = bh.watch("192.0.2.21", 80, BackendHealth::mode_t::TCP);
+    t2->last_wanted = now;
+    due = bh.claim_due(now + 1);
+    ASSERT_EQ(due.size(), 1);
+    ASSERT_EQ(due[0], t2);
+    bh.report(*t2, true, 100, "");
+    t2->last_probe = now + 1;
+
+    due = bh.claim_due(now + BackendHealth::interval);
+    ASSERT_EQ(std::count(due.begin(), due.end(), t), 1);
+    ASSERT_EQ(std::count(due.begin(), due.end(), t2), 0);
+    bh.report(*t, true, 100, "");
+}
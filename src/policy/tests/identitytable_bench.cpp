@@ -0,0 +1,159 @@
+// Group strings vs. group sets in matching, locked string-keyed map vs. sharded identity table under concurrent
+// lookups. Not part of sx_gtests: timings are only printed, table and matching behaviour is checked in
+// identitytable_test.cpp.
+
+#include <policy/identitytable.hpp>
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using namespace sx::auth;
+
+namespace {
+
+    struct Ident {
+        std::string username;
+        std::vector<std::string> groups_vec;
+        GroupSet group_set;
+        uint64_t rx_bytes = 0;
+    };
+
+    using table4_t = ShardedTable<in_addr, Ident, addr4_hash, addr4_equal>;
+
+    in_addr nth_addr(uint32_t i) {
+        in_addr a {};
+        a.s_addr = htonl(0x0a000000U + i);
+        return a;
+    }
+
+    std::vector<std::string> nth_groups(uint32_t i) {
+        return { "staff", "group" + std::to_string(i % 50), "site" + std::to_string(i % 7) };
+    }
+}
+
+// Identity in 250 groups against auth profile with 20 sub-policies, only the last one matching:
+// previous per-name string comparison, versus single AND of precomputed sets.
+TEST(IdentityTableBench, GroupMatching) {
+
+    std::vector<std::string> user_groups;
+    for(int i = 0; i < 250; ++i) user_groups.emplace_back("CN=Group" + std::to_string(i) + ",OU=Groups,DC=example,DC=com");
+
+    std::vector<std::string> policies;
+    for(int i = 0; i < 19; ++i) policies.emplace_back("CN=Policy" + std::to_string(i) + ",OU=Groups,DC=example,DC=com");
+    policies.emplace_back(user_groups[200]);
+
+    auto& dict = GroupDict::get();
+    GroupSet const identity(dict.intern_all(user_groups));
+    GroupSet profile;
+    for(auto const& p: policies) profile.set(dict.intern(p));
+
+    constexpr int rounds = 20000;
+    using clk = std::chrono::steady_clock;
+
+    std::size_t matched_strings = 0;
+    auto t0 = clk::now();
+    for(int r = 0; r < rounds; ++r) {
+        auto const groups = user_groups;   // copied out of the identity map as before
+        for(auto const& p: policies) {
+            if(std::find(groups.begin(), groups.end(), p) != groups.end()) { ++matched_strings; break; }
+        }
+    }
+    auto const str_ns = std::chrono::duration<double, std::nano>(clk::now() - t0).count() / rounds;
+
+    std::size_t matched_bits = 0;
+    t0 = clk::now();
+    for(int r = 0; r < rounds; ++r) {
+        auto const groups = identity;
+        if(groups.intersects(profile)) ++matched_bits;
+    }
+    auto const bit_ns = std::chrono::duration<double, std::nano>(clk::now() - t0).count() / rounds;
+
+    EXPECT_EQ(matched_strings, static_cast<std::size_t>(rounds));
+    EXPECT_EQ(matched_bits, static_cast<std::size_t>(rounds));
+
+    std::cout << "group match, 250 groups x 20 sub-policies: strings " << str_ns << " ns, bitset " << bit_ns << " ns\n";
+}
+
+// Group lookup per new connection: previous string-keyed map under one recursive mutex, copying group names,
+// versus sharded table keyed by address, copying interned group ids.
+TEST(IdentityTableBench, ConcurrentLookups) {
+
+    constexpr uint32_t identities = 100'000;
+    constexpr unsigned readers = 16;
+    constexpr uint32_t lookups = 100'000;   // per reader
+
+    std::recursive_mutex old_lock;
+    std::unordered_map<std::string, Ident> old_map;
+    table4_t table;
+
+    for(uint32_t i = 0; i < identities; ++i) {
+        auto const addr = nth_addr(i);
+        char str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr, str, sizeof(str));
+
+        auto const groups = nth_groups(i);
+        old_map[str] = Ident { "user" + std::to_string(i), groups, {}, 0 };
+        table.upsert(addr, [&](Ident& id, bool) {
+            id.username = "user" + std::to_string(i);
+            id.group_set = GroupSet(GroupDict::get().intern_all(groups));
+        });
+    }
+
+    auto const wanted = GroupDict::get().find("group7").value();
+
+    auto run = [&](bool sharded) {
+        std::atomic_uint64_t hits = 0;
+        std::vector<std::thread> threads;
+
+        auto const t0 = std::chrono::steady_clock::now();
+        for(unsigned t = 0; t < readers; ++t) {
+            threads.emplace_back([&, t]() {
+                uint64_t local = 0;
+                uint32_t x = t * 7919U;
+                for(uint32_t n = 0; n < lookups; ++n) {
+                    x = x * 1664525U + 1013904223U;
+                    auto const addr = nth_addr(x % identities);
+
+                    if(sharded) {
+                        std::optional<GroupSet> groups;
+                        table.read(addr, [&groups](Ident const& id) { groups = id.group_set; });
+                        if(groups and groups->test(wanted)) ++local;
+                    }
+                    else {
+                        char str[INET_ADDRSTRLEN];
+                        inet_ntop(AF_INET, &addr, str, sizeof(str));
+
+                        std::optional<std::vector<std::string>> groups;
+                        {
+                            auto l_ = std::scoped_lock(old_lock);
+                            auto it = old_map.find(str);
+                            if(it != old_map.end()) groups = it->second.groups_vec;
+                        }
+                        if(groups and std::find(groups->begin(), groups->end(), "group7") != groups->end()) ++local;
+                    }
+                }
+                hits += local;
+            });
+        }
+        for(auto& th: threads) th.join();
+        auto const secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        // every 50th identity is in group7, ~2% of random lookups
+        EXPECT_GT(hits.load(), readers * lookups / 100);
+        EXPECT_LT(hits.load(), readers * lookups / 25);
+
+        std::cout << (sharded ? "sharded table, group set:  " : "locked map, group strings: ")
+                  << static_cast<double>(readers) * lookups / secs / 1e6 << " M lookups/s ("
+                  << readers << " readers, " << std::thread::hardware_concurrency() << " cpus)\n";
+    };
+
+    run(false);
+    run(true);
+}
@@ -0,0 +1,213 @@
+#include <policy/identitytable.hpp>
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using namespace sx::auth;
+
+namespace {
+
+    struct Ident {
+        std::string username;
+        GroupSet group_set;
+        uint64_t rx_bytes = 0;
+    };
+
+    using table4_t = ShardedTable<in_addr, Ident, addr4_hash, addr4_equal>;
+
+    in_addr nth_addr(uint32_t i) {
+        in_addr a {};
+        a.s_addr = htonl(0x0a000000U + i);
+        return a;
+    }
+
+    std::vector<std::string> nth_groups(uint32_t i) {
+        return { "staff", "group" + std::to_string(i % 50), "site" + std::to_string(i % 7) };
+    }
+}
+
+TEST(IdentityTable, GroupDict) {
+    auto& dict = GroupDict::get();
+
+    auto const a = dict.intern("admins");
+    EXPECT_EQ(dict.intern("admins"), a);
+    EXPECT_EQ(dict.name(a), "admins");
+    EXPECT_FALSE(dict.find("no-such-group-here").has_value());
+
+    auto const ids = dict.intern_all({ "users", "admins", "users" });
+    ASSERT_EQ(ids.size(), 2U);
+    EXPECT_TRUE(std::is_sorted(ids.begin(), ids.end()));
+    EXPECT_TRUE(GroupDict::contains(ids, a));
+    EXPECT_TRUE(GroupDict::contains(ids, dict.find("users").value()));
+}
+
+TEST(IdentityTable, GroupSet) {
+    GroupSet a(group_ids_t { 1, 70, 300 });
+    GroupSet b;
+    EXPECT_TRUE(b.empty());
+    EXPECT_FALSE(a.intersects(b));
+
+    b.set(5);
+    EXPECT_FALSE(a.intersects(b));
+    b.set(300);
+    EXPECT_TRUE(a.intersects(b));
+    EXPECT_TRUE(b.intersects(a));
+
+    EXPECT_TRUE(a.test(70));
+    EXPECT_FALSE(a.test(71));
+    EXPECT_FALSE(a.test(100000));
+
+    a.merge(b);
+    EXPECT_EQ(a.count(), 4U);
+}
+
+// Identity in 250 groups against auth profile with 20 sub-policies, only the last one matching: single AND
+// of precomputed sets gives the same answer as per-name string comparison.
+TEST(IdentityTable, GroupMatching) {
+
+    std::vector<std::string> user_groups;
+    for(int i = 0; i < 250; ++i) user_groups.emplace_back("CN=Group" + std::to_string(i) + ",OU=Groups,DC=example,DC=com");
+
+    std::vector<std::string> policies;
+    for(int i = 0; i < 19; ++i) policies.emplace_back("CN=Policy" + std::to_string(i) + ",OU=Groups,DC=example,DC=com");
+
+    auto& dict = GroupDict::get();
+    GroupSet const identity(dict.intern_all(user_groups));
+    GroupSet profile;
+    for(auto const& p: policies) profile.set(dict.intern(p));
+
+    auto matches_strings = [&]() {
+        return std::any_of(policies.begin(), policies.end(), [&](auto const& p) {
+            return std::find(user_groups.begin(), user_groups.end(), p) != user_groups.end();
+        });
+    };
+
+    EXPECT_FALSE(matches_strings());
+    EXPECT_FALSE(identity.intersects(profile));
+
+    policies.emplace_back(user_groups[200]);
+    profile.set(dict.intern(policies.back()));
+
+    EXPECT_TRUE(matches_strings());
+    EXPECT_TRUE(identity.intersects(profile));
+}
+
+TEST(IdentityTable, Basic) {
+    table4_t table;
+    auto const key = parse4("10.1.2.3");
+    ASSERT_TRUE(key.has_value());
+    EXPECT_FALSE(parse4("10.1.2.").has_value());
+    EXPECT_FALSE(parse6("10.1.2.3").has_value());
+    EXPECT_TRUE(parse6("fe80::1").has_value());
+
+    EXPECT_FALSE(table.read(key.value(), [](Ident const&) {}));
+
+    table.upsert(key.value(), [](Ident& id, bool created) { EXPECT_TRUE(created); id.username = "alice"; });
+    table.upsert(key.value(), [](Ident& id, bool created) { EXPECT_FALSE(created); EXPECT_EQ(id.username, "alice"); });
+    EXPECT_TRUE(table.modify(key.value(), [](Ident& id) { id.rx_bytes += 10; }));
+
+    uint64_t rx = 0;
+    EXPECT_TRUE(table.read(key.value(), [&rx](Ident const& id) { rx = id.rx_bytes; }));
+    EXPECT_EQ(rx, 10U);
+
+    for(uint32_t i = 0; i < 1000; ++i) table.upsert(nth_addr(i), [](Ident&, bool) {});
+    EXPECT_EQ(table.size(), 1001U);
+
+    std::size_t visited = 0;
+    table.for_each([&visited](in_addr const&, Ident const&) { ++visited; });
+    EXPECT_EQ(visited, 1001U);
+
+    EXPECT_TRUE(table.erase(key.value()));
+    EXPECT_FALSE(table.erase(key.value()));
+    table.clear();
+    EXPECT_TRUE(table.empty());
+}
+
+TEST(IdentityTable, SockaddrKeys) {
+    sockaddr_storage ss {};
+    auto* sin = reinterpret_cast<sockaddr_in*>(&ss);
+    sin->sin_family = AF_INET;
+    sin->sin_addr = parse4("10.1.2.3").value();
+
+    auto k4 = key4(ss);
+    ASSERT_TRUE(k4.has_value());
+    EXPECT_TRUE(addr4_equal()(k4.value(), parse4("10.1.2.3").value()));
+    EXPECT_FALSE(key6(ss).has_value());
+
+    ss = sockaddr_storage {};
+    auto* sin6 = reinterpret_cast<sockaddr_in6*>(&ss);
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_addr = parse6("::ffff:10.1.2.3").value();
+
+    k4 = key4(ss);
+    ASSERT_TRUE(k4.has_value());
+    EXPECT_TRUE(addr4_equal()(k4.value(), parse4("10.1.2.3").value()));
+
+    sin6->sin6_addr = parse6("fe80::1").value();
+    EXPECT_FALSE(key4(ss).has_value());
+    auto const k6 = key6(ss);
+    ASSERT_TRUE(k6.has_value());
+    EXPECT_TRUE(addr6_equal()(k6.value(), parse6("fe80::1").value()));
+
+    EXPECT_FALSE(key4(sockaddr_storage {}).has_value());
+}
+
+// Readers look up group membership while the table is being updated; every lookup sees a whole identity.
+TEST(IdentityTable, ConcurrentLookups) {
+
+    constexpr uint32_t identities = 10'000;
+    constexpr unsigned readers = 4;
+    constexpr uint32_t lookups = 20'000;   // per reader
+
+    table4_t table;
+    auto set_identity = [&table](uint32_t i) {
+        auto const groups = GroupSet(GroupDict::get().intern_all(nth_groups(i)));
+        table.upsert(nth_addr(i), [&](Ident& id, bool) {
+            id.username = "user" + std::to_string(i);
+            id.group_set = groups;
+        });
+    };
+    for(uint32_t i = 0; i < identities; ++i) set_identity(i);
+
+    auto const wanted = GroupDict::get().find("group7").value();
+
+    std::atomic_bool stop = false;
+    std::thread writer([&]() {
+        for(uint32_t i = 0; not stop; i = (i + 1) % identities) set_identity(i);
+    });
+
+    std::atomic_uint64_t hits = 0;
+    std::atomic_uint64_t torn = 0;
+    std::vector<std::thread> threads;
+    for(unsigned t = 0; t < readers; ++t) {
+        threads.emplace_back([&, t]() {
+            uint32_t x = t * 7919U;
+            for(uint32_t n = 0; n < lookups; ++n) {
+                x = x * 1664525U + 1013904223U;
+                auto const i = x % identities;
+
+                std::optional<GroupSet> groups;
+                table.read(nth_addr(i), [&](Ident const& id) {
+                    if(id.username != "user" + std::to_string(i)) ++torn;
+                    groups = id.group_set;
+                });
+                if(groups and groups->test(wanted)) ++hits;
+            }
+        });
+    }
+    for(auto& th: threads) th.join();
+    stop = true;
+    writer.join();
+
+    EXPECT_EQ(torn.load(), 0U);
+    EXPECT_EQ(table.size(), identities);
+
+    // every 50th identity is in group7, ~2% of random lookups
+    EXPECT_GT(hits.load(), readers * lookups / 100);
+    EXPECT_LT(hits.load(), readers * lookups / 25);
+}
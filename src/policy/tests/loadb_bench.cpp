@@ -0,0 +1,90 @@
+// Round-robin vs. least-conn and peak-ewma session durations over simulated backends. Not part of
+// sx_gtests: results are only printed, distribution checks are in loadb_test.cpp.
+
+#include <policy/loadb.hpp>
+
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <queue>
+#include <map>
+
+namespace {
+
+    struct Backend {
+        int64_t connect_ns;
+        int64_t service_ns;
+    };
+
+    struct SimResult {
+        std::vector<int> hits;
+        double avg_duration_ms = 0.0;
+    };
+
+    // one new session every ms for @seconds; sessions live connect + service time of their backend
+    SimResult simulate(HostPool<>* pool, std::vector<Backend> const& backends, int seconds) {
+        constexpr int64_t ms = 1'000'000;
+
+        std::vector<std::string> names;
+        for(std::size_t i = 0; i < backends.size(); ++i) names.emplace_back("10.0.0." + std::to_string(i + 1));
+        if(pool) pool->set_hosts(names);
+
+        SimResult res;
+        res.hits.assign(backends.size(), 0);
+
+        // event time -> session; connect event (first) and end event (second)
+        std::multimap<int64_t, std::pair<std::shared_ptr<HostSession<>>, bool>> events;
+        int64_t total_duration = 0;
+        int sessions = 0;
+
+        for(int64_t now = 0; now < seconds * 1000 * ms; now += ms) {
+
+            // process due events
+            while(not events.empty() and events.begin()->first <= now) {
+                auto& [ session, is_connect ] = events.begin()->second;
+                if(is_connect) session->connected(events.begin()->first);
+                events.erase(events.begin());
+            }
+
+            auto idx = pool ? pool->compute(nullptr, now) : static_cast<int>(sessions % backends.size());
+            EXPECT_GE(idx, 0);
+
+            auto const& b = backends[idx];
+            auto info = pool ? pool->candidate(idx) : std::make_shared<HostInfo>(names[idx]);
+            auto session = std::make_shared<HostSession<>>(info, now);
+
+            events.emplace(now + b.connect_ns, std::make_pair(session, true));
+            events.emplace(now + b.connect_ns + b.service_ns, std::make_pair(session, false));
+
+            ++res.hits[idx];
+            total_duration += b.connect_ns + b.service_ns;
+            ++sessions;
+        }
+
+        res.avg_duration_ms = static_cast<double>(total_duration) / sessions / ms;
+        return res;
+    }
+
+    // fast, moderate and overloaded backend
+    std::vector<Backend> const skewed {
+        { 1'000'000, 20'000'000 },
+        { 5'000'000, 50'000'000 },
+        { 80'000'000, 800'000'000 },
+    };
+}
+
+TEST(HostPoolBench, SkewedBackends) {
+    auto rr = simulate(nullptr, skewed, 20);
+
+    LeastConnPool<> lc_pool;
+    auto lc = simulate(&lc_pool, skewed, 20);
+
+    PeakEwmaPool<> pe_pool;
+    auto pe = simulate(&pe_pool, skewed, 20);
+
+    std::cout << "round-robin avg " << rr.avg_duration_ms << "ms\n";
+    std::cout << "least-conn  avg " << lc.avg_duration_ms << "ms, hits: "
+              << lc.hits[0] << "/" << lc.hits[1] << "/" << lc.hits[2] << "\n";
+    std::cout << "peak-ewma   avg " << pe.avg_duration_ms << "ms, hits: "
+              << pe.hits[0] << "/" << pe.hits[1] << "/" << pe.hits[2] << "\n";
+}
@@ -0,0 +1,151 @@
+#include <policy/loadb.hpp>
+
+#include <gtest/gtest.h>
+
+#include <queue>
+#include <map>
+
+namespace {
+
+    struct Backend {
+        int64_t connect_ns;
+        int64_t service_ns;
+    };
+
+    struct SimResult {
+        std::vector<int> hits;
+        double avg_duration_ms = 0.0;
+    };
+
+    // one new session every ms for @seconds; sessions live connect + service time of their backend
+    SimResult simulate(HostPool<>* pool, std::vector<Backend> const& backends, int seconds) {
+        constexpr int64_t ms = 1'000'000;
+
+        std::vector<std::string> names;
+        for(std::size_t i = 0; i < backends.size(); ++i) names.emplace_back("10.0.0." + std::to_string(i + 1));
+        if(pool) pool->set_hosts(names);
+
+        SimResult res;
+        res.hits.assign(backends.size(), 0);
+
+        // event time -> session; connect event (first) and end event (second)
+        std::multimap<int64_t, std::pair<std::shared_ptr<HostSession<>>, bool>> events;
+        int64_t total_duration = 0;
+        int sessions = 0;
+
+        for(int64_t now = 0; now < seconds * 1000 * ms; now += ms) {
+
+            // process due events
+            while(not events.empty() and events.begin()->first <= now) {
+                auto& [ session, is_connect ] = events.begin()->second;
+                if(is_connect) session->connected(events.begin()->first);
+                events.erase(events.begin());
+            }
+
+            auto idx = pool ? pool->compute(nullptr, now) : static_cast<int>(sessions % backends.size());
+            EXPECT_GE(idx, 0);
+
+            auto const& b = backends[idx];
+            auto info = pool ? pool->candidate(idx) : std::make_shared<HostInfo>(names[idx]);
+            auto session = std::make_shared<HostSession<>>(info, now);
+
+            events.emplace(now + b.connect_ns, std::make_pair(session, true));
+            events.emplace(now + b.connect_ns + b.service_ns, std::make_pair(session, false));
+
+            ++res.hits[idx];
+            total_duration += b.connect_ns + b.service_ns;
+            ++sessions;
+        }
+
+        res.avg_duration_ms = static_cast<double>(total_duration) / sessions / ms;
+        return res;
+    }
+
+    // fast, moderate and overloaded backend
+    std::vector<Backend> const skewed {
+        { 1'000'000, 20'000'000 },
+        { 5'000'000, 50'000'000 },
+        { 80'000'000, 800'000'000 },
+    };
+}
+
+TEST(HostPoolTest, LeastConnSkewed) {
+    auto rr = simulate(nullptr, skewed, 20);
+
+    LeastConnPool<> pool;
+    auto lc = simulate(&pool, skewed, 20);
+
+    ASSERT_GT(lc.hits[0], lc.hits[1]);
+    ASSERT_GT(lc.hits[1], lc.hits[2]);
+    ASSERT_LT(lc.avg_duration_ms, rr.avg_duration_ms / 2);
+
+    // all sessions are gone
+    for(auto const& c: pool.candidates()) ASSERT_EQ(c->active_sessions, 0);
+}
+
+TEST(HostPoolTest, PeakEwmaSkewed) {
+    auto rr = simulate(nullptr, skewed, 20);
+
+    PeakEwmaPool<> pool;
+    auto pe = simulate(&pool, skewed, 20);
+
+    ASSERT_GT(pe.hits[0], pe.hits[2]);
+    ASSERT_LT(pe.hits[2], pe.hits[0] / 10);
+    ASSERT_LT(pe.avg_duration_ms, rr.avg_duration_ms / 2);
+}
+
+TEST(HostPoolTest, UsableAndDeactivated) {
+    LeastConnPool<> pool;
+    pool.set_hosts({ "a", "b", "c" });
+
+    // 'a' is unusable
+    for(int i = 0; i < 10; ++i) {
+        auto idx = pool.compute([](std::size_t i) { return i != 0; });
+        ASSERT_NE(idx, 0);
+    }
+    ASSERT_EQ(pool.compute([](std::size_t) { return false; }), -1);
+
+    auto b = pool.candidate(1);
+    HostSession<> s(b);
+    pool.set_hosts({ "c", "b" });
+    ASSERT_EQ(pool.candidates().size(), 2);
+    // stats survive
+    ASSERT_EQ(pool.candidate(1)->active_sessions, 1);
+    ASSERT_EQ(pool.candidate(1)->hits, 1);
+}
+
+TEST(HostPoolTest, ScopeSurvivesRebuild) {
+    auto old_pool = std::make_unique<LeastConnPool<>>("route-a/4");
+    old_pool->set_hosts({ "a", "b" });
+
+    HostSession<> s(old_pool->candidate(0));
+
+    // reload: new pool of the same scope continues with counters of unchanged hosts
+    LeastConnPool<> pool("route-a/4");
+    old_pool.reset();
+    pool.set_hosts({ "b", "a", "c" });
+
+    ASSERT_EQ(pool.candidate(1)->active_sessions, 1);
+    ASSERT_EQ(pool.candidate(0)->active_sessions, 0);
+    ASSERT_NE(pool.compute(), 1);
+
+    // other scope is independent
+    LeastConnPool<> other("route-b/4");
+    other.set_hosts({ "a" });
+    ASSERT_EQ(other.candidate(0)->active_sessions, 0);
+}
+
+TEST(HostPoolTest, FailedConnectPenalized) {
+    PeakEwmaPool<> pool;
+    pool.set_hosts({ "a", "b" });
+
+    int64_t const now = 1'000'000'000'000LL;
+    {
+        HostSession<> s(pool.candidate(0), now);
+        s.failed(now + 1'000'000);
+        // reported only once
+        s.connected(now + 2'000'000);
+    }
+    ASSERT_GE(pool.candidate(0)->latency_ns(now + 2'000'000), HostInfo::penalty_ns / 2);
+    ASSERT_EQ(pool.compute(nullptr, now + 2'000'000), 1);
+}
@@ -0,0 +1,60 @@
+#include <policy/maglev.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+namespace {
+    std::vector<std::string> backends(int n) {
+        std::vector<std::string> ret;
+        for(int i = 0; i < n; ++i) ret.emplace_back("10.0.0." + std::to_string(i + 1));
+        return ret;
+    }
+}
+
+TEST(MaglevTableTest, Balance) {
+    auto names = backends(10);
+    MaglevTable table(names);
+
+    ASSERT_EQ(table.size(), MaglevTable::table_size);
+
+    std::vector<int> hits(names.size(), 0);
+    for(uint64_t i = 0; i < 100000; ++i) {
+        ++hits[table.lookup(MaglevTable::hash(&i, sizeof(i)))];
+    }
+
+    auto [ lo, hi ] = std::minmax_element(hits.begin(), hits.end());
+    ASSERT_LT(*hi - *lo, 1000);
+
+    // order of backends doesn't matter
+    auto reversed = names;
+    std::reverse(reversed.begin(), reversed.end());
+    MaglevTable table_r(reversed);
+    for(uint64_t i = 0; i < 1000; ++i) {
+        auto h = MaglevTable::hash(&i, sizeof(i));
+        ASSERT_EQ(names[table.lookup(h)], reversed[table_r.lookup(h)]);
+    }
+}
+
+TEST(MaglevTableTest, MinimalDisruption) {
+    auto names = backends(10);
+    auto fewer = names;
+    fewer.erase(fewer.begin() + 3);
+
+    MaglevTable before(names);
+    MaglevTable after(fewer);
+
+    int moved = 0;
+    constexpr int flows = 100000;
+    for(uint64_t i = 0; i < flows; ++i) {
+        auto h = MaglevTable::hash(&i, sizeof(i));
+        auto const& was = names[before.lookup(h)];
+        auto const& now = fewer[after.lookup(h)];
+
+        if(was == names[3]) continue;
+        if(was != now) ++moved;
+    }
+
+    // flows of remaining backends mostly stay - modulo hashing would move ~90% of them
+    ASSERT_LT(moved, flows / 50);
+}
@@ -0,0 +1,132 @@
+#include <policy/natpool.hpp>
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <thread>
+
+TEST(NatPoolTest, ExhaustAndRelease) {
+    auto const dst = NatPool::destination("198.51.100.1", "443");
+    auto pool = NatPool::make({ "192.0.2.1", "192.0.2.2", "bogus", "2001:db8::1" }, { {1000, 1009} });
+
+    ASSERT_EQ(pool->addresses().size(), 3);
+    ASSERT_EQ(pool->stats().capacity, 30);
+
+    std::vector<std::unique_ptr<NatPool::Lease>> leases;
+    std::set<std::pair<std::string, uint16_t>> seen;
+    for(int i = 0; i < 20; ++i) {
+        auto l = pool->allocate(AF_INET, dst);
+        ASSERT_TRUE(l);
+        ASSERT_GE(l->port(), 1000);
+        ASSERT_LE(l->port(), 1009);
+        ASSERT_TRUE(seen.emplace(l->host(), l->port()).second);
+        leases.emplace_back(std::move(l));
+    }
+
+    // v4 is full, v6 has its own ports
+    ASSERT_FALSE(pool->allocate(AF_INET, dst));
+    ASSERT_EQ(pool->stats().exhausted, 1);
+    auto l6 = pool->allocate(AF_INET6, dst);
+    ASSERT_TRUE(l6);
+    ASSERT_EQ(l6->host(), "2001:db8::1");
+
+    auto host = leases.back()->host();
+    auto port = leases.back()->port();
+    leases.pop_back();
+
+    auto again = pool->allocate(AF_INET, dst);
+    ASSERT_TRUE(again);
+    ASSERT_EQ(again->host(), host);
+    ASSERT_EQ(again->port(), port);
+    ASSERT_EQ(pool->stats().in_use, 21);
+}
+
+TEST(NatPoolTest, ConcurrentUnique) {
+    auto const dst = NatPool::destination("198.51.100.1", "443");
+    auto pool = NatPool::make({ "192.0.2.1", "192.0.2.2" }, { {1024, 65535} });
+
+    constexpr int threads = 8;
+    constexpr int per_thread = 5000;
+
+    std::vector<std::vector<std::unique_ptr<NatPool::Lease>>> leases(threads);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            for(int i = 0; i < per_thread; ++i) {
+                auto l = pool->allocate(AF_INET, dst);
+                if(l) leases[t].emplace_back(std::move(l));
+
+                // release some of them, from other positions than allocated
+                if(i % 3 == 0 and leases[t].size() > 10) leases[t].erase(leases[t].begin() + 5);
+            }
+        });
+    }
+    for(auto& w: workers) w.join();
+
+    std::set<std::pair<std::string, uint16_t>> seen;
+    std::size_t total = 0;
+    for(auto const& v: leases) {
+        for(auto const& l: v) {
+            ASSERT_TRUE(seen.emplace(l->host(), l->port()).second);
+            ++total;
+        }
+    }
+
+    ASSERT_EQ(pool->stats().in_use, total);
+    ASSERT_EQ(pool->stats().exhausted, 0);
+
+    leases.clear();
+    ASSERT_EQ(pool->stats().in_use, 0);
+}
+
+TEST(NatPoolTest, SourceReusedPerDestination) {
+    auto pool = NatPool::make({ "192.0.2.10" }, { {2000, 2001} });
+    ASSERT_EQ(pool->stats().capacity, 2);
+
+    // destinations 0 and 8 share a bucket, 1 uses another one
+    auto a1 = pool->allocate(AF_INET, 0);
+    auto a2 = pool->allocate(AF_INET, 0);
+    ASSERT_TRUE(a1 and a2);
+    ASSERT_FALSE(pool->allocate(AF_INET, 0));
+    ASSERT_FALSE(pool->allocate(AF_INET, NatPool::dst_buckets));
+
+    auto b1 = pool->allocate(AF_INET, 1);
+    auto b2 = pool->allocate(AF_INET, 1);
+    ASSERT_TRUE(b1 and b2);
+    ASSERT_FALSE(pool->allocate(AF_INET, 1));
+
+    std::set<uint16_t> ports { b1->port(), b2->port() };
+    ASSERT_TRUE(ports.count(a1->port()) and ports.count(a2->port()));
+    ASSERT_EQ(pool->stats().in_use, 4);
+
+    a1.reset();
+    auto a3 = pool->allocate(AF_INET, NatPool::dst_buckets);
+    ASSERT_TRUE(a3);
+}
+
+TEST(NatPoolTest, LeasesSurviveReload) {
+    auto const dst = NatPool::destination("198.51.100.1", "443");
+
+    auto pool = NatPool::make({ "2001:db8::20" }, { {3000, 3001} });
+    auto old_lease = pool->allocate(AF_INET6, dst);
+    ASSERT_TRUE(old_lease);
+    auto const old_port = old_lease->port();
+
+    // reloaded config: same address written differently, wider port range
+    auto reloaded = NatPool::make({ "2001:0db8:0::0020" }, { {3000, 3002} });
+    pool.reset();
+
+    std::vector<std::unique_ptr<NatPool::Lease>> leases;
+    while(auto l = reloaded->allocate(AF_INET6, dst)) {
+        ASSERT_NE(l->port(), old_port);
+        leases.emplace_back(std::move(l));
+    }
+    ASSERT_EQ(leases.size(), 2);
+
+    // lease of the old pool given back, port is available to the new one
+    old_lease.reset();
+    auto again = reloaded->allocate(AF_INET6, dst);
+    ASSERT_TRUE(again);
+    ASSERT_EQ(again->port(), old_port);
+    ASSERT_EQ(again->host(), "2001:db8::20");
+}
@@ -73,3 +73,66 @@ TEST(PolicyTest, match_rangevec_cx) {
     g.push_back(std::make_shared<CfgRange>(std::pair<int, int>(143,143)));
     ASSERT_FALSE(p.match_rangegrp_cx(g, &h));
 }
+
+
+TEST(PolicyTest, rebuild_affected) {
+
+    auto addr_a = std::make_shared<CfgAddress>(std::make_shared<CidrAddress>("10.0.0.0/8"));
+    auto addr_b = std::make_shared<CfgAddress>(std::make_shared<CidrAddress>("192.168.0.0/16"));
+
+    // rule i refers to uses[i], slot 2 refers to an object which doesn't exist yet
+    std::vector<std::shared_ptr<CfgAddress>> uses = { addr_a, addr_b, nullptr };
+    int loads = 0;
+
+    auto load = [&](int i) -> std::shared_ptr<PolicyRule> {
+        ++loads;
+        if(not uses[i]) return nullptr;
+
+        auto r = std::make_shared<PolicyRule>();
+        r->src.push_back(uses[i]);
+        uses[i]->usage_add(r);
+        return r;
+    };
+
+    PolicyRule::db_t db;
+    for(int i = 0; i < 3; i++) {
+        if(auto r = load(i); r) db[string_format("[%d]", i)] = r;
+    }
+    ASSERT_EQ(db.size(), 2);
+
+    auto rule_0 = db["[0]"];
+    auto rule_1 = db["[1]"];
+
+    // slot 2 now gets its object, addr_a is changed
+    uses[2] = std::make_shared<CfgAddress>(std::make_shared<CidrAddress>("172.16.0.0/12"));
+    loads = 0;
+
+    auto res = PolicyRule::rebuild_affected(db, 3, { addr_a }, load);
+
+    // rule referring to addr_a and previously failed rule are reloaded, rule_1 is untouched
+    EXPECT_EQ(res.rebuilt, 2);
+    EXPECT_EQ(loads, 2);
+    EXPECT_EQ(res.gone.size(), 1);
+    EXPECT_TRUE(res.gone.count(rule_0.get()));
+
+    ASSERT_EQ(db.size(), 3);
+    EXPECT_NE(db["[0]"], rule_0);
+    EXPECT_EQ(db["[1]"], rule_1);
+    EXPECT_TRUE(db["[2]"]);
+
+    // change nobody refers to: nothing is rebuilt
+    auto unused = std::make_shared<CfgAddress>(std::make_shared<CidrAddress>("1.1.1.1/32"));
+    loads = 0;
+    res = PolicyRule::rebuild_affected(db, 3, { unused }, load);
+    EXPECT_EQ(res.rebuilt, 0);
+    EXPECT_EQ(loads, 0);
+    EXPECT_TRUE(res.gone.empty());
+    EXPECT_EQ(db["[1]"], rule_1);
+
+    // rule which fails to reload is dropped from the table
+    uses[1] = nullptr;
+    res = PolicyRule::rebuild_affected(db, 3, { addr_b }, load);
+    EXPECT_EQ(res.rebuilt, 1);
+    EXPECT_TRUE(res.gone.count(rule_1.get()));
+    EXPECT_EQ(db.count("[1]"), 0);
+}
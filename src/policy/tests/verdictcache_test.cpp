@@ -0,0 +1,122 @@
+#include <tcpcom.hpp>
+
+#include <policy/policy.hpp>
+#include <policy/verdictcache.hpp>
+
+#include <gtest/gtest.h>
+
+namespace {
+    std::shared_ptr<PolicyRule> rule_src(std::string const& src) {
+        auto r = std::make_shared<PolicyRule>();
+        r->src.push_back(std::make_shared<CfgAddress>(std::make_shared<CidrAddress>(src)));
+        return r;
+    }
+}
+
+TEST(VerdictCacheTest, SourcePrefixAndCacheability) {
+    std::vector<std::shared_ptr<PolicyRule>> rules { rule_src("10.0.0.0/8"), rule_src("192.168.1.0/24") };
+
+    PolicyClassifier cls(rules);
+    ASSERT_EQ(cls.src_prefix(AF_INET), 24);
+    ASSERT_TRUE(cls.cacheable(0));
+    ASSERT_TRUE(cls.cacheable(-1));
+
+    // source port rule makes following verdicts uncacheable
+    auto sport = std::make_shared<PolicyRule>();
+    sport->src_ports.push_back(std::make_shared<CfgRange>(std::pair<int, int>(1000, 2000)));
+    rules.push_back(sport);
+
+    PolicyClassifier cls2(rules);
+    ASSERT_TRUE(cls2.cacheable(1));
+    ASSERT_FALSE(cls2.cacheable(2));
+    ASSERT_FALSE(cls2.cacheable(-1));
+
+    // clients from the same /24 share the key, other subnet doesn't
+    auto s1 = baseHostCX(new TCPCom(), "192.168.1.10", "40000");
+    auto s2 = baseHostCX(new TCPCom(), "192.168.1.20", "40001");
+    auto s3 = baseHostCX(new TCPCom(), "192.168.2.10", "40000");
+    auto d = baseHostCX(new TCPCom(), "1.1.1.1", "53");
+
+    auto k1 = VerdictCache::make_key(cls, &s1, &d, 0);
+    auto k2 = VerdictCache::make_key(cls, &s2, &d, 0);
+    auto k3 = VerdictCache::make_key(cls, &s3, &d, 0);
+    ASSERT_TRUE(k1 and k2 and k3);
+    ASSERT_TRUE(k1.value() == k2.value());
+    ASSERT_FALSE(k1.value() == k3.value());
+
+    // identity epoch is part of the key
+    ASSERT_FALSE(k1.value() == VerdictCache::make_key(cls, &s1, &d, 1).value());
+}
+
+TEST(VerdictCacheTest, LookupAndInvalidation) {
+    auto& cache = VerdictCache::get();
+    cache.clear();
+
+    VerdictCache::Key key;
+    key.proto = 6;
+    key.family = AF_INET;
+    key.dst_port = 443;
+
+    VerdictCache::Generation gen { 1, 1000 };
+
+    auto hits = cache.stats().hits.load();
+    auto misses = cache.stats().misses.load();
+
+    ASSERT_FALSE(cache.lookup(key, gen));
+    cache.store(key, gen, 3);
+    ASSERT_EQ(cache.lookup(key, gen).value_or(-2), 3);
+
+    // new config snapshot or board version invalidates the entry
+    ASSERT_FALSE(cache.lookup(key, { 2, 1000 }));
+    cache.store(key, gen, 3);
+    ASSERT_FALSE(cache.lookup(key, { 1, 1001 }));
+
+    ASSERT_EQ(cache.stats().hits.load() - hits, 1U);
+    ASSERT_EQ(cache.stats().misses.load() - misses, 3U);
+    ASSERT_EQ(cache.size(), 0U);
+
+    // shards are bounded
+    for(uint32_t i = 0; i < VerdictCache::shard_count * VerdictCache::shard_capacity * 2; ++i) {
+        key.dst[12] = i >> 16; key.dst[13] = i >> 8; key.dst[14] = i;
+        cache.store(key, gen, 1);
+    }
+    ASSERT_LE(cache.size(), VerdictCache::shard_count * VerdictCache::shard_capacity);
+}
+
+TEST(VerdictCacheTest, LeastRecentlyUsedEviction) {
+    VerdictCache cache(2);
+    VerdictCache::Generation gen { 1, 1 };
+
+    // collect three keys landing in the same shard
+    std::vector<VerdictCache::Key> keys;
+    VerdictCache::Key key;
+    key.proto = 6;
+    key.family = AF_INET;
+    key.dst_port = 80;
+    std::optional<std::size_t> idx;
+    for(uint32_t i = 0; keys.size() < 3; ++i) {
+        key.dst[13] = i >> 8; key.dst[14] = i;
+        auto ki = VerdictCache::shard_index(key);
+        if(not idx) idx = ki;
+        if(ki == idx) keys.push_back(key);
+    }
+
+    cache.store(keys[0], gen, 0);
+    cache.store(keys[1], gen, 1);
+
+    // touch first key, so the second one is least recently used
+    ASSERT_EQ(cache.lookup(keys[0], gen).value_or(-2), 0);
+
+    cache.store(keys[2], gen, 2);
+    ASSERT_EQ(cache.stats().evictions.load(), 1U);
+    ASSERT_EQ(cache.size(), 2U);
+
+    ASSERT_EQ(cache.lookup(keys[0], gen).value_or(-2), 0);
+    ASSERT_FALSE(cache.lookup(keys[1], gen));
+    ASSERT_EQ(cache.lookup(keys[2], gen).value_or(-2), 2);
+
+    // overwriting existing entry doesn't evict
+    cache.store(keys[0], gen, 5);
+    ASSERT_EQ(cache.stats().evictions.load(), 1U);
+    ASSERT_EQ(cache.lookup(keys[0], gen).value_or(-2), 5);
+}
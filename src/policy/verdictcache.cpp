@@ -0,0 +1,178 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include <policy/verdictcache.hpp>
+
+
+bool VerdictCache::Key::operator==(Key const& other) const {
+    return proto == other.proto and family == other.family and dst_port == other.dst_port and
+           epoch == other.epoch and src == other.src and dst == other.dst;
+}
+
+std::size_t VerdictCache::KeyHash::operator()(Key const& k) const noexcept {
+
+    // FNV-1a over 64bit words
+    auto mix = [](uint64_t h, uint64_t v) { return (h ^ v) * 0x100000001b3ULL; };
+
+    uint64_t words[4];
+    std::memcpy(&words[0], k.src.data(), 16);
+    std::memcpy(&words[2], k.dst.data(), 16);
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(auto w: words) h = mix(h, w);
+    h = mix(h, (static_cast<uint64_t>(k.proto) << 24) | (static_cast<uint64_t>(k.family) << 16) | k.dst_port);
+    h = mix(h, k.epoch);
+
+    return static_cast<std::size_t>(h ^ (h >> 32));
+}
+
+
+std::optional<VerdictCache::Key> VerdictCache::make_key(PolicyClassifier const& classifier, baseHostCX const* left, baseHostCX const* right, uint64_t epoch) {
+
+    auto ck = PolicyClassifier::Key::from_cx(left, right);
+    if(not ck or ck->dst_port < 0 or ck->dst_port > 65535) return std::nullopt;
+
+    Key k;
+    k.proto = static_cast<uint8_t>(ck->proto);
+    k.family = static_cast<uint8_t>(ck->family);
+    k.dst_port = static_cast<uint16_t>(ck->dst_port);
+    k.dst = ck->dst;
+    k.epoch = epoch;
+
+    // keep only source address bits which policy can distinguish
+    int const offset = ck->family == AF_INET ? 12 : 0;
+    int pflen = classifier.src_prefix(ck->family);
+    for(int i = offset; i < 16; ++i) {
+        auto bits = std::clamp(pflen, 0, 8);
+        k.src[i] = bits ? ck->src[i] & static_cast<uint8_t>(0xff << (8 - bits)) : 0;
+        pflen -= 8;
+    }
+
+    return k;
+}
+
+
+std::optional<int> VerdictCache::lookup(Key const& key, Generation const& gen) {
+
+    auto& sh = shard(key);
+    auto l_ = std::scoped_lock(sh.lock);
+
+    auto it = sh.entries.find(key);
+    if(it == sh.entries.end()) {
+        stats_.misses++;
+        return std::nullopt;
+    }
+
+    auto& entry = it->second->second;
+    if(not (entry.gen == gen)) {
+        sh.lru.erase(it->second);
+        sh.entries.erase(it);
+        stats_.stale++;
+        stats_.misses++;
+        return std::nullopt;
+    }
+
+    sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+
+    stats_.hits++;
+    return entry.verdict;
+}
+
+void VerdictCache::store(Key const& key, Generation const& gen, int verdict) {
+
+    auto& sh = shard(key);
+    auto l_ = std::scoped_lock(sh.lock);
+
+    if(auto it = sh.entries.find(key); it != sh.entries.end()) {
+        it->second->second = { verdict, gen };
+        sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+    }
+    else {
+        if(sh.entries.size() >= capacity_ and not sh.lru.empty()) {
+            sh.entries.erase(sh.lru.back().first);
+            sh.lru.pop_back();
+            stats_.evictions++;
+        }
+
+        sh.lru.emplace_front(key, Entry { verdict, gen });
+        sh.entries.emplace(key, sh.lru.begin());
+    }
+
+    stats_.stores++;
+}
+
+void VerdictCache::clear() {
+    for(auto& sh: shards_) {
+        auto l_ = std::scoped_lock(sh.lock);
+        sh.entries.clear();
+        sh.lru.clear();
+    }
+}
+
+std::size_t VerdictCache::size() const {
+    std::size_t ret = 0;
+    for(auto const& sh: shards_) {
+        auto l_ = std::scoped_lock(sh.lock);
+        ret += sh.entries.size();
+    }
+    return ret;
+}
+
+std::string VerdictCache::to_string(int verbosity) const {
+    std::stringstream ss;
+
+    auto hits = stats_.hits.load();
+    auto misses = stats_.misses.load();
+    auto total = hits + misses;
+
+    ss << "VerdictCache: entries=" << size() << " hits=" << hits << " misses=" << misses;
+    ss << " ratio=" << (total ? (100 * hits / total) : 0) << "%";
+
+    if(verbosity > iINF) {
+        ss << " stale=" << stats_.stale.load() << " stores=" << stats_.stores.load()
+           << " evictions=" << stats_.evictions.load();
+        ss << " shards=" << shard_count << "x" << capacity_;
+    }
+
+    return ss.str();
+}
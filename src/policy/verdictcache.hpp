@@ -0,0 +1,138 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef VERDICTCACHE_HPP
+#define VERDICTCACHE_HPP
+
+#include <array>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+#include <policy/classifier.hpp>
+
+// VerdictCache remembers policy match results of recent connections, so repetitive short-lived flows
+// (health checks, polling, DNS over TCP) don't need to go through policy matching again.
+//
+// Entries are keyed by binary (l4 proto, masked source address, destination address, destination port,
+// identity epoch). Source address is masked to the prefix provided by the classifier, so whole client
+// subnets can share single entry where policy allows. Each entry is bound to the config snapshot and
+// UpdateBoard versions it was created with - any configuration change makes it stale.
+
+class VerdictCache {
+
+public:
+    struct Key {
+        uint8_t proto = 0;
+        uint8_t family = 0;
+        uint16_t dst_port = 0;
+        std::array<uint8_t, 16> src {};
+        std::array<uint8_t, 16> dst {};
+        uint64_t epoch = 0;
+
+        bool operator==(Key const& other) const;
+    };
+
+    struct KeyHash {
+        std::size_t operator()(Key const& k) const noexcept;
+    };
+
+    // config generation the verdict belongs to
+    struct Generation {
+        uint64_t snapshot = 0;
+        uint64_t board = 0;
+
+        bool operator==(Generation const& other) const { return snapshot == other.snapshot and board == other.board; }
+    };
+
+    static constexpr std::size_t shard_count = 16;
+    static constexpr std::size_t shard_capacity = 4096;
+
+    static VerdictCache& get() {
+        static VerdictCache c;
+        return c;
+    }
+
+    explicit VerdictCache(std::size_t capacity = shard_capacity) : capacity_(capacity) {}
+
+    // create cache key from connection; nullopt if connection can't be cached
+    static std::optional<Key> make_key(PolicyClassifier const& classifier, baseHostCX const* left, baseHostCX const* right, uint64_t epoch);
+
+    std::optional<int> lookup(Key const& key, Generation const& gen);
+    void store(Key const& key, Generation const& gen, int verdict);
+    void clear();
+
+    std::size_t size() const;
+
+    static std::size_t shard_index(Key const& key) { return (KeyHash()(key) >> 7) % shard_count; }
+
+    struct stats_t {
+        std::atomic<uint64_t> hits {0};
+        std::atomic<uint64_t> misses {0};
+        std::atomic<uint64_t> stale {0};
+        std::atomic<uint64_t> stores {0};
+        std::atomic<uint64_t> evictions {0};
+    };
+    stats_t const& stats() const { return stats_; }
+
+    std::string to_string(int verbosity) const;
+
+private:
+    struct Entry {
+        int verdict = -1;
+        Generation gen;
+    };
+
+    // least recently used entries are at the back of the list and evicted first
+    struct Shard {
+        mutable std::mutex lock;
+        std::list<std::pair<Key, Entry>> lru;
+        std::unordered_map<Key, std::list<std::pair<Key, Entry>>::iterator, KeyHash> entries;
+    };
+
+    Shard& shard(Key const& key) { return shards_[shard_index(key)]; }
+
+    std::size_t const capacity_;
+    std::array<Shard, shard_count> shards_;
+    stats_t stats_;
+};
+
+#endif
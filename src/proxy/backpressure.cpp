@@ -0,0 +1,80 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <proxy/backpressure.hpp>
+
+Watermark::change_t Watermark::update(std::size_t queued, marks_t const& marks) {
+
+    auto& budget = WriteBudget::get();
+
+    if(queued > accounted_) budget.used += queued - accounted_;
+    else budget.used -= accounted_ - queued;
+    accounted_ = queued;
+
+    bool const tight = budget.exceeded();
+
+    if(not paused_) {
+        if(queued >= marks.high or (tight and queued >= marks.low)) {
+            paused_ = true;
+            budget.throttled++;
+            budget.throttled_total++;
+            return change_t::PAUSE;
+        }
+    }
+    // empty queue always resumes: paused session with nothing queued can't help the budget
+    else if(queued == 0 or (queued <= marks.low and not tight)) {
+        paused_ = false;
+        budget.throttled--;
+        return change_t::RESUME;
+    }
+
+    return change_t::NONE;
+}
+
+void Watermark::release() {
+    auto& budget = WriteBudget::get();
+
+    budget.used -= accounted_;
+    accounted_ = 0;
+
+    if(paused_) {
+        paused_ = false;
+        budget.throttled--;
+    }
+}
@@ -0,0 +1,95 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef BACKPRESSURE_HPP
+#define BACKPRESSURE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Read back-pressure: session stops reading from a side while the opposite side's write queue is above the high
+// watermark, and resumes at the low watermark. All sessions together are also bound by a process-wide budget:
+// once it's exceeded, sessions pause already at the low watermark.
+
+class WriteBudget {
+public:
+    static WriteBudget& get() { static WriteBudget b; return b; }
+
+    // 0 means unlimited
+    std::atomic_size_t limit = 0;
+
+    std::atomic_size_t used = 0;            // bytes queued for write in all sessions
+    std::atomic_uint64_t throttled = 0;     // currently paused directions
+    std::atomic_uint64_t throttled_total = 0;
+
+    bool exceeded() const { auto const l = limit.load(); return l > 0 and used.load() > l; }
+};
+
+
+// one direction of a session: reading from one side, queueing to the other one
+class Watermark {
+public:
+    enum class change_t { NONE, PAUSE, RESUME };
+
+    struct marks_t {
+        std::size_t high = 4 * 1024 * 1024;
+        std::size_t low = 1024 * 1024;
+    };
+
+    Watermark() = default;
+    ~Watermark() { release(); }
+
+    Watermark(Watermark const&) = delete;
+    Watermark& operator=(Watermark const&) = delete;
+
+    // account current size of the write queue and tell if reading should be paused or resumed
+    change_t update(std::size_t queued, marks_t const& marks);
+    // give back everything charged to the budget, ie. when session ends
+    void release();
+
+    bool paused() const { return paused_; }
+    std::size_t accounted() const { return accounted_; }
+
+private:
+    bool paused_ = false;
+    std::size_t accounted_ = 0;
+};
+
+#endif //BACKPRESSURE_HPP
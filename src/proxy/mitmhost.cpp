@@ -65,6 +65,10 @@ std::string MitmHostCX::to_string(int verbosity) const {
     }
     ret << "<" << AppHostCX::to_string(verbosity) << ">";
 
+    if(verbosity > iINF and client_hello) {
+        ret << " hello: " << client_hello->to_string();
+    }
+
     return ret.str();
 }
 
@@ -43,6 +43,9 @@
 #include <inspect/engine.hpp>
 #include <apphostcx.hpp>
 #include <policy/inspectors.hpp>
+#include <inspect/tlshello.hpp>
+
+#include <optional>
 
 class MitmHostCX : public AppHostCX, public socle::sobject {
 public:
@@ -84,6 +87,12 @@ public:
 
     bool is_ssl = false;
     bool is_ssl_port = false;
+    // accepted before first bytes arrived, ssl autodetection continues asynchronously
+    bool ssl_autodetect_pending = false;
+    // TLS connection accepted before whole ClientHello arrived
+    bool client_hello_pending = false;
+    // ClientHello parsed by acceptor, before any TLS handshake work
+    std::optional<sx::tls::HelloInfo> client_hello;
     
     bool is_http = false;
     bool is_http_port = false;
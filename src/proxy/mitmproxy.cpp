@@ -46,9 +46,11 @@
 #include <proxy/filters/sinkhole.hpp>
 
 #include <proxy/proxymaker.hpp>
+#include <proxy/relayproxy.hpp>
 
 #include <log/logger.hpp>
 #include <service/cfgapi/cfgapi.hpp>
+#include <service/netservice.hpp>
 
 #include <uxcom.hpp>
 #include <staticcontent.hpp>
@@ -215,13 +217,13 @@ std::string MitmProxy::to_string(int verbosity) const {
 
 
         r << speed_str;
+        if(spliced()) r << " splice";
         
         if(verbosity > INF) { 
             r << string_format("\n    Policy  index: %d", matched_policy());
 
 
-            if(matched_policy() >= 0) {
-                auto p = CfgFactory::get()->db_policy_list.at(matched_policy());
+            if(auto p = matched_policy_rule(); p) {
                 r << string_format("\n    PolicyRule oid: 0x%x", p->oid());
             }
 
@@ -236,67 +238,37 @@ std::string MitmProxy::to_string(int verbosity) const {
     return r.str();
 }
 
-std::optional<std::vector<std::string>> MitmProxy::find_id_groups(baseHostCX const* cx) {
-
-    int af = AF_INET;
-    if(cx->com()) {
-        af = cx->com()->l3_proto();
-    }
-    const std::string str_af = SockOps::family_str(af);
-
-    bool found = false;
-    std::vector<std::string> group_vec;
-
-    auto from_map = [&group_vec](auto const& map, auto const& host) -> bool {
-
-        auto ip = map.find(host);
-        if (ip != map.end()) {
-            auto* id_ptr = &(*ip).second;
-
-            if(id_ptr) {
-                for (auto const &my_id: id_ptr->groups_vec) {
-                    group_vec.emplace_back(my_id);
-                }
+std::shared_ptr<PolicyRule> MitmProxy::matched_policy_rule() const {
+    auto const& snap = cfg_snapshot_ ? cfg_snapshot_ : CfgFactory::get()->snapshot();
+    return snap->policy(matched_policy());
+}
 
-                return true;
-            }
-        }
-        return false;
-    };
+std::shared_ptr<ProfileAuth> MitmProxy::policy_prof_auth(int index) const {
+    auto const& snap = cfg_snapshot_ ? cfg_snapshot_ : CfgFactory::get()->snapshot();
+    return snap->policy_prof_auth(index);
+}
 
-    if(af == AF_INET or af == 0) {
-        auto lc_ = std::scoped_lock(AuthFactory::get_ip4_lock());
-        found = from_map(AuthFactory::get_ip4_map(), cx->host());
-    }
-    else if(af == AF_INET6) {
-        auto lc_ = std::scoped_lock(AuthFactory::get_ip6_lock());
-        found = from_map(AuthFactory::get_ip6_map(), cx->host());
+sockaddr_storage const& MitmProxy::id_peer(baseHostCX const* cx) {
+    if(cx != id_peer_cx_ or id_peer_.ss_family == AF_UNSPEC) {
+        id_peer_ = AuthFactory::peer_addr(cx);
+        id_peer_cx_ = cx;
     }
-
-    if(found) return group_vec;
-
-    return std::nullopt;
+    return id_peer_;
 }
 
-std::shared_ptr<ProfileSubAuth> MitmProxy::find_auth_subprofile(std::vector<std::string> const& groups) {
+std::shared_ptr<ProfileSubAuth> MitmProxy::find_auth_subprofile(std::shared_ptr<ProfileAuth> const& auth_policy, sx::auth::GroupSet const& groups) {
 
-    auto policy = CfgFactory::get()->db_policy_list.at(matched_policy());
-    auto auth_policy = policy->profile_auth;
     std::shared_ptr<ProfileSubAuth> to_ret;
 
-    if (auth_policy) {
+    // none of sub-policies applies, don't walk them
+    if (auth_policy and groups.intersects(auth_policy->sub_groups)) {
         for (auto const &sub_prof: auth_policy->sub_policies) {
 
             _dia("apply_id_policies: checking identity policy for: %s", sub_prof->element_name().c_str());
 
-            for (auto const &my_id: groups) {
-                _dia("apply_id_policies: identity in policy: %s, match-test real user group '%s'",
-                     sub_prof->element_name().c_str(), my_id.c_str());
-                if (sub_prof->element_name() == my_id) {
-                    _dia("apply_id_policies: .. matched.");
-                    to_ret = sub_prof;
-                    break;
-                }
+            if (groups.intersects(sub_prof->group_set)) {
+                _dia("apply_id_policies: .. matched.");
+                to_ret = sub_prof;
             }
 
             if (to_ret != nullptr) {
@@ -312,17 +284,19 @@ bool MitmProxy::apply_id_policies(baseHostCX* cx) {
 
     _dia("apply_id_policies: matched policy: %d", matched_policy());
 
-    auto opt_group_vec = find_id_groups(cx);
+    auto const policy = matched_policy_rule();
+    if(not policy or not cx) return false;
 
+    std::shared_ptr<ProfileSubAuth> final_profile;
+    bool const found = AuthFactory::get().ipX_read_groups(id_peer(cx), [&](sx::auth::GroupSet const& groups) {
+        final_profile = find_auth_subprofile(policy->profile_auth, groups);
+    });
 
-    if( not opt_group_vec.has_value() ) {
-        _deb("apply_id_policies: %d groups not found");
+    if(not found) {
+        _deb("apply_id_policies: groups not found");
         return false;
     }
 
-    _deb("apply_id_policies: %d groups found", opt_group_vec.value().size());
-    auto final_profile = find_auth_subprofile(opt_group_vec.value());
-
     if (not final_profile) {
         _deb("apply_id_policies: %d no subprofile found");
         return false;
@@ -407,18 +381,17 @@ bool MitmProxy::resolve_identity(baseHostCX* cx, bool insert_guest = false) {
 
     bool valid_ip_auth = false;
     std::unique_ptr<shm_logon_info_base> id_ptr;
+    auto const& peer = id_peer(cx);
 
     if(af == AF_INET || af == 0) {
 
-        std::scoped_lock<std::recursive_mutex> l_(AuthFactory::get_ip4_lock());
         AuthFactory::get().shm_ip4_table_refresh();
 
-        _deb("identity check[%s]: table size: %d", str_af.c_str(), AuthFactory::get_ip4_map().size());
-        auto ip = AuthFactory::get_ip4_map().find(cx->host());
-        if (ip != AuthFactory::get_ip4_map().end()) {
-            shm_logon_info& li = ip->second.last_logon_info;
-            id_ptr.reset(std::move(li.clone()));
-        } else {
+        auto addr = sx::auth::key4(peer);
+        bool const found = addr and AuthFactory::get_ip4_map().read(addr.value(), [&id_ptr](IdentityInfo const& id) {
+            id_ptr.reset(id.logon_info().clone());
+        });
+        if (not found) {
             if (insert_guest) {
                 id_ptr = std::make_unique<shm_logon_info>(cx->host().c_str(),"guest","guest+guests+guests_ipv4");
             }
@@ -427,15 +400,13 @@ bool MitmProxy::resolve_identity(baseHostCX* cx, bool insert_guest = false) {
     else if(af == AF_INET6) {
         /* maintain in sync with previous if block */
 
-        std::scoped_lock<std::recursive_mutex> l_(AuthFactory::get_ip6_lock());
         AuthFactory::get().shm_ip6_table_refresh();
 
-        _deb("identity check[%s]: table size: %d", str_af.c_str(), AuthFactory::get_ip6_map().size());
-        auto ip = AuthFactory::get_ip6_map().find(cx->host());
-        if (ip != AuthFactory::get_ip6_map().end()) {
-            shm_logon_info6& li = (*ip).second.last_logon_info;
-            id_ptr.reset(std::move(li.clone()));
-        } else {
+        auto addr = sx::auth::key6(peer);
+        bool const found = addr and AuthFactory::get_ip6_map().read(addr.value(), [&id_ptr](IdentityInfo6 const& id) {
+            id_ptr.reset(id.logon_info().clone());
+        });
+        if (not found) {
             if (insert_guest) {
                 id_ptr = std::make_unique<shm_logon_info6>(cx->host().c_str(),"guest","guest+guests+guests_ipv6");
             }
@@ -497,46 +468,37 @@ bool MitmProxy::update_auth_ipX_map(baseHostCX* cx) {
 
     _dum("update_auth_ip_map: start for %s %s", str_af.c_str(), cx->host().c_str());
     
-    IdentityInfoBase* id_ptr = nullptr;
-    
-    if(af == AF_INET || af == 0) {
-        std::scoped_lock<std::recursive_mutex> l_(AuthFactory::get_ip4_lock());
+    bool timed_out = false;
 
-        auto ip = AuthFactory::get_ip4_map().find(cx->host());
-        if (ip != AuthFactory::get_ip4_map().end()) {
-            id_ptr = &(*ip).second;
-        }
-    }
-    else if(af == AF_INET6) {
-        std::scoped_lock<std::recursive_mutex> l_(AuthFactory::get_ip6_lock());
+    // runs under identity table shard lock
+    auto update = [&](IdentityInfoBase& id) {
+        _deb("update_auth_ip_map: user %s from %s %s (groups: %s)",id.username.c_str(), str_af.c_str(), cx->host().c_str(), id.groups.c_str());
 
-        auto ip = AuthFactory::get_ip6_map().find(cx->host());
-        if (ip != AuthFactory::get_ip6_map().end()) {
-            id_ptr = &(*ip).second;
-        }
-    }
-    
-    if(id_ptr != nullptr) {
-        _deb("update_auth_ip_map: user %s from %s %s (groups: %s)",id_ptr->username.c_str(), str_af.c_str(), cx->host().c_str(), id_ptr->groups.c_str());
+        id.last_seen_policy = matched_policy();
 
-        id_ptr->last_seen_policy = matched_policy();
-        
-        if (!id_ptr->i_timeout()) {
-            id_ptr->touch();
+        if (!id.i_timeout()) {
+            id.touch();
             ret = true;
         } else {
-            _inf("identity timeout: user %s from %s %s (groups: %s)",id_ptr->username.c_str(), str_af.c_str(), cx->host().c_str(), id_ptr->groups.c_str());
-            
-            // erase internal ip map entry
-            if(af == AF_INET || af == 0) {
-                std::scoped_lock<std::recursive_mutex> l_(AuthFactory::get_ip4_lock());
-                AuthFactory::get().ip4_remove(cx->host());
-            }
-            else if(af == AF_INET6) {
-                std::scoped_lock<std::recursive_mutex> l_(AuthFactory::get_ip6_lock());
-                AuthFactory::get().ip6_remove(cx->host());
-            }
+            _inf("identity timeout: user %s from %s %s (groups: %s)",id.username.c_str(), str_af.c_str(), cx->host().c_str(), id.groups.c_str());
+            timed_out = true;
         }
+    };
+
+    auto const& peer = id_peer(cx);
+
+    if(af == AF_INET || af == 0) {
+        if(auto addr = sx::auth::key4(peer); addr) {
+            AuthFactory::get_ip4_map().modify(addr.value(), update);
+        }
+        // erase internal ip map entry
+        if(timed_out) AuthFactory::get().ip4_remove(cx->host());
+    }
+    else if(af == AF_INET6) {
+        if(auto addr = sx::auth::key6(peer); addr) {
+            AuthFactory::get_ip6_map().modify(addr.value(), update);
+        }
+        if(timed_out) AuthFactory::get().ip6_remove(cx->host());
     }
     
     _dum("update_auth_ip_map: finished for %s %s, result %d",str_af.c_str(), cx->host().c_str(),ret);
@@ -550,9 +512,257 @@ void MitmProxy::add_filter(std::string const& name, FilterProxy* fp) {
 
 
 int MitmProxy::handle_sockets_once(baseCom* xcom) {
-    
 
-    return baseProxy::handle_sockets_once(xcom);
+    if(splice_) return RelayProxy::splice_round(*this, *splice_, stats_.mtr_up, stats_.mtr_down, half_holdtimer);
+
+    auto ret = baseProxy::handle_sockets_once(xcom);
+
+    // report backend connect latency once the connection is established
+    if(backend_session_ and not backend_session_->is_connected()) {
+        if(auto const* r = first_right(); r and not r->opening() and not state().dead()) {
+            backend_session_->connected();
+        }
+    }
+
+    if(opt_sg_write and not state().dead()) {
+        sg_round();
+    }
+
+    if(not state().dead()) {
+        backpressure_round();
+    }
+
+    // partial matches held back too long are released (hold timer does it if no socket event comes)
+    if(content_rewrite() and not state().dead()) {
+        content_rewrite_flush(side_t::LEFT, true);
+        content_rewrite_flush(side_t::RIGHT, true);
+    }
+
+    if(opt_splice and not state().dead() and splice_eligible()) {
+        splice_start();
+    }
+
+    return ret;
+}
+
+
+bool MitmProxy::passthrough() {
+
+    if(ls().size() != 1 or rs().size() != 1 or not lda().empty() or not rda().empty()) return false;
+
+    // anything which needs to see payload keeps session in the proxy
+    if(content_rewrite() or not filters_.empty()) return false;
+    if(writer_opts_ and writer_opts_->write_payload) return false;
+    if(opt_auth_authenticate or opt_auth_resolve or auth_block_identity) return false;
+
+    auto* lf = first_left();
+    auto* rg = first_right();
+    if(not lf or not rg) return false;
+
+    if(lf->com()->l4_proto() != SOCK_STREAM) return false;
+    if(lf->ssl_autodetect_pending or lf->client_hello_pending) return false;
+    if(lf->mode() != AppHostCX::mode_t::NONE) return false;
+    if(not lf->inspectors_.empty() or not rg->inspectors_.empty()) return false;
+
+    // TLS is terminated by proxy, unless bypassed
+    for(baseHostCX* cx: { static_cast<baseHostCX*>(lf), static_cast<baseHostCX*>(rg) }) {
+        if(auto const* scom = dynamic_cast<SSLCom*>(cx->com()); scom and not scom->opt.bypass) return false;
+    }
+
+    return true;
+}
+
+
+bool MitmProxy::splice_eligible() {
+
+    if(ls().size() != 1 or rs().size() != 1) return false;
+
+    // classify the session once, not every round
+    if(not passthrough_) {
+        auto const* lf = first_left();
+        auto const* rg = first_right();
+        if(not lf or not rg or lf->opening() or rg->opening()) return false;
+        if(lf->ssl_autodetect_pending or lf->client_hello_pending) return false;
+
+        passthrough_ = passthrough();
+    }
+    if(not passthrough_.value()) return false;
+
+    // backend must be connected and everything already read must be written out
+    if(ls().at(0)->opening() or rs().at(0)->opening()) return false;
+    for(baseHostCX* cx: { ls().at(0), rs().at(0) }) {
+        if(not cx->to_read().empty() or not cx->writebuf()->empty()) return false;
+    }
+    if(sg_pending()) return false;
+
+    return true;
+}
+
+
+bool MitmProxy::sg_eligible(baseHostCX* to) const {
+
+    if(not filters_.empty() or to->opening()) return false;
+    if(to->com()->l4_proto() != SOCK_STREAM) return false;
+
+    // TLS has its own record buffering, only plain sockets are written directly
+    return dynamic_cast<SSLCom*>(to->com()) == nullptr;
+}
+
+
+std::unique_ptr<SegmentChain>* MitmProxy::sg_chain(baseHostCX* to) {
+    if(ls().size() != 1 or rs().size() != 1) return nullptr;
+
+    if(to == ls().at(0)) return &sg_left_;
+    if(to == rs().at(0)) return &sg_right_;
+
+    return nullptr;
+}
+
+
+void MitmProxy::deliver(baseHostCX* to, buffer& b) {
+
+    // once the peer is backlogged, everything goes behind the queued segments
+    if(auto* chain = sg_chain(to); chain and *chain and not (*chain)->empty()) {
+        (*chain)->push(b.data(), b.size());
+        return;
+    }
+
+    // socle moves the buffer if writebuf is empty, no copy in that case
+    to->to_write(b);
+}
+
+void MitmProxy::deliver_shared(baseHostCX* to, buffer& b, bool last) {
+
+    if(last) {
+        deliver(to, b);
+        return;
+    }
+
+    buffer copy;
+    copy.append(b.data(), b.size());
+    deliver(to, copy);
+}
+
+
+void MitmProxy::sg_round() {
+
+    if(ls().size() != 1 or rs().size() != 1) return;
+
+    for(baseHostCX* cx: { ls().at(0), rs().at(0) }) {
+        auto* chain = sg_chain(cx);
+
+        // socle couldn't write everything: take over the backlog, so following data are not appended to it.
+        // Replacement messages closing the connection stay with socle.
+        if(not cx->writebuf()->empty() and not (*chain and not (*chain)->empty())
+           and not cx->close_after_write() and sg_eligible(cx)) {
+            if(not *chain) *chain = std::make_unique<SegmentChain>();
+
+            (*chain)->push(cx->writebuf()->data(), cx->writebuf()->size());
+            cx->writebuf()->clear();
+            _deb("sg_round: %d bytes backlog moved to segment chain", (*chain)->size());
+        }
+
+        if(not *chain or (*chain)->empty() or not cx->writebuf()->empty()) continue;
+
+        auto const syscalls = (*chain)->stats().syscalls;
+        auto res = (*chain)->send(cx->socket());
+
+        sg_syscalls() += (*chain)->stats().syscalls - syscalls;
+        if(res.written > 0) {
+            sg_bytes() += res.written;
+            cx->meter_write_bytes += res.written;
+            cx->meter_write_count++;
+        }
+
+        if(res.error) {
+            _dia("sg_round: write error, closing");
+            state().dead(true);
+            return;
+        }
+
+        // touch the poller only when backlog appears or is gone, monitors are not ours only (see backpressure_round)
+        auto& backlog = (cx == ls().at(0)) ? sg_left_backlog_ : sg_right_backlog_;
+        if(backlog != not (*chain)->empty()) {
+            backlog = not backlog;
+
+            if(backlog) com()->set_write_monitor(cx->socket());
+            else com()->set_monitor(cx->socket());
+        }
+    }
+}
+
+
+void MitmProxy::sg_to_writebuf(baseHostCX* to) {
+    auto* chain = sg_chain(to);
+    if(not chain or not *chain or (*chain)->empty()) return;
+
+    (*chain)->for_each([to](uint8_t const* data, std::size_t len) { to->writebuf()->append(data, len); });
+    (*chain)->clear();
+
+    // socle writes it from now on
+    ((to == ls().at(0)) ? sg_left_backlog_ : sg_right_backlog_) = false;
+}
+
+
+std::size_t MitmProxy::write_queued(baseHostCX* cx) {
+    std::size_t ret = cx->writebuf()->size();
+
+    if(auto* chain = sg_chain(cx); chain and *chain) ret += (*chain)->size();
+    return ret;
+}
+
+
+void MitmProxy::backpressure_round() {
+
+    // direction is held back by its most backlogged writer, all readers of the direction pause together
+    auto most_queued = [this](auto const& cxs) {
+        std::size_t ret = 0;
+        for(auto* cx: cxs) ret = std::max(ret, write_queued(cx));
+        return ret;
+    };
+    auto const q_left = most_queued(ls());
+    auto const q_right = most_queued(rs());
+
+    auto apply = [this](auto const& readers, char side, Watermark& wm, std::size_t peer_queued) {
+        auto const change = wm.update(peer_queued, opt_write_marks);
+
+        if(change == Watermark::change_t::PAUSE) {
+            _dia("backpressure: peer has %d bytes queued, pausing read on %c side", peer_queued, side);
+        }
+        else if(change == Watermark::change_t::RESUME) {
+            _dia("backpressure: peer has %d bytes queued, resuming read on %c side", peer_queued, side);
+        }
+        else if(not wm.paused()) {
+            return;
+        }
+
+        // while paused this is repeated each round, socle re-arms EPOLLIN when it handles the socket
+        for(auto* reader: readers) {
+            auto const fd = reader->socket();
+            auto const reader_queued = write_queued(reader);
+
+            if(wm.paused()) {
+                if(reader_queued > 0) com()->set_write_monitor_only(fd);
+                else com()->unset_monitor(fd);
+            }
+            else {
+                if(reader_queued > 0) com()->set_write_monitor(fd);
+                else com()->set_monitor(fd);
+            }
+        }
+    };
+
+    apply(ls(), 'L', wm_up_, q_right);
+    apply(rs(), 'R', wm_down_, q_left);
+}
+
+
+void MitmProxy::splice_start() {
+
+    splice_ = std::make_unique<SpliceRelay>();
+    spliced_sessions()++;
+
+    _dia("splice_start: session moved to splice fast lane");
 }
 
 
@@ -817,15 +1027,21 @@ void MitmProxy::proxy(baseHostCX* from, baseHostCX* to, side_t side, bool redire
     if(not to or not from or from->to_read().empty()) return;
 
     if (!redirected) {
-        if (content_rule() != nullptr) {
-            buffer b = content_replace_apply(from->to_read());
+        if (content_rewrite()) {
+            // content_rewritten_ was prepared once for all peers by on_left/right_bytes, which proxy to
+            // sockets first, then to delayed accepts
+            auto& b = content_rewritten_;
+            auto const& sockets = (side == side_t::LEFT) ? right_sockets : left_sockets;
+            auto const& delayed = (side == side_t::LEFT) ? right_delayed_accepts : left_delayed_accepts;
+            auto const* last = delayed.empty() ? (sockets.empty() ? nullptr : sockets.back()) : delayed.back();
 
             if(*log_dump.level() >= iDIA)
                 proxy_dump_packet(side, b);
 
-            to->to_write(b);
+            auto const sz = b.size();
+            if(sz > 0) deliver_shared(to, b, to == last);
             _dia("mitmproxy::proxy-%c: original %d bytes replaced with %d bytes", from_side(side), from->to_read().size(),
-                 b.size());
+                 sz);
         } else {
 
             if(*log_dump.level() >= iDIA)
@@ -839,7 +1055,7 @@ void MitmProxy::proxy(baseHostCX* from, baseHostCX* to, side_t side, bool redire
             }
 
             auto sz = from->to_read().size();
-            to->to_write(from->to_read());
+            deliver(to, from->to_read());
             auto fastlane = sz > 0 and from->to_read().empty();
 
             _dia("mitmproxy::proxy-%c: %d copied %s", from_side(side), sz, fastlane ? "(fastlane)": "");
@@ -873,6 +1089,8 @@ void MitmProxy::on_left_bytes(baseHostCX* cx) {
     //update meters
     total_mtr_up().update(cx->to_read().size());
 
+    if(content_rewrite() and not redirected) content_rewritten_ = content_rewrite_apply(side_t::LEFT, cx->to_read());
+
     // because we have left bytes, let's copy them into all right side sockets!
     std::for_each(
             right_sockets.begin(),
@@ -888,19 +1106,48 @@ void MitmProxy::on_left_bytes(baseHostCX* cx) {
 }
 
 
+bool MitmProxy::auth_recheck_needed(MitmHostCX const* mh) {
+
+    if(not (opt_auth_authenticate or opt_auth_resolve)) return false;
+
+    // session waiting for authentication is redirected or closed soon, keep checking it
+    if(opt_auth_authenticate and not identity_resolved()) return true;
+
+    // blocked identity can be refused only with replacement, which is known once protocol is detected
+    // from the first bytes
+    if(auth_block_identity and mh->replacement_type() != MitmHostCX::REPLACETYPE_HTTP
+       and mh->meter_read_bytes < 1024 and mh->meter_write_bytes < 1024) {
+        return true;
+    }
+
+    if(auth_epoch_ == AuthFactory::get().identity_epoch() and ::time(nullptr) < auth_checked_ + auth_recheck_interval) {
+        return false;
+    }
+
+    return true;
+}
+
 bool MitmProxy::handle_requirements(baseHostCX* cx) {
 
     bool redirected = false;
 
-    auto* mh = dynamic_cast<MitmHostCX*>(cx);
+    if(cx != requirements_cx_) {
+        requirements_cx_ = cx;
+        requirements_mh_ = dynamic_cast<MitmHostCX*>(cx);
+    }
+    auto* mh = requirements_mh_;
 
     if(mh != nullptr) {
 
-        if((cx->meter_read_bytes < 1024 and cx->meter_write_bytes < 1024)
-           or
-           ((cx->meter_read_count + cx->meter_write_count) % 100 == 0)) {
+        if(auth_recheck_needed(mh)) {
+            // identities changed during the check are seen on the next round
+            auto const epoch = AuthFactory::get().identity_epoch();
+
             // check authentication
             redirected = handle_authentication(mh);
+
+            auth_epoch_ = epoch;
+            auth_checked_ = ::time(nullptr);
         }
 
         // check com responses
@@ -950,6 +1197,8 @@ void MitmProxy::on_right_bytes(baseHostCX* cx) {
     // update total meters
     total_mtr_down().update(cx->to_read().size());
 
+    if(content_rewrite() and not redirected) content_rewritten_ = content_rewrite_apply(side_t::RIGHT, cx->to_read());
+
     std::for_each(
             left_sockets.begin(),
             left_sockets.end(),
@@ -1090,6 +1339,11 @@ std::string get_connection_details_str(MitmProxy* px, baseHostCX* cx, char side)
 
 
 void MitmProxy::on_error(baseHostCX* cx, char side, const char* side_label) {
+
+    // cx may be removed after error, don't keep its cast around
+    requirements_cx_ = nullptr;
+    requirements_mh_ = nullptr;
+
     if(cx == nullptr) {
         std::stringstream msg;
 
@@ -1111,6 +1365,11 @@ void MitmProxy::on_error(baseHostCX* cx, char side, const char* side_label) {
     // if not dead (yet), do some cleanup/logging chores
     if( !state().dead()) {
 
+        // release bytes held back by content rewrite, this side will not send anything to complete the match
+        content_rewrite_flush(side == 'L' ? side_t::LEFT : side_t::RIGHT, false);
+        // half-close handling below looks at writebuf only
+        if(cx->peer()) sg_to_writebuf(cx->peer());
+
         // don't waste time on low-effort delivery stuff, just get rid of it now.
         if(com()->l4_proto() == SOCK_DGRAM) {
             state().dead(true);
@@ -1226,14 +1485,20 @@ void MitmProxy::on_left_error(baseHostCX* cx) {
     on_error(cx, 'L', "client");
 
     if(state().dead())
-        AuthFactory::get().ipX_inc_counters(cx);
+        AuthFactory::get().ipX_inc_counters(id_peer(cx), cx->meter_read_bytes, cx->meter_write_bytes);
 }
 
 void MitmProxy::on_right_error(baseHostCX* cx) {
+
+    // server side failed before it was ever established: let the balancer know
+    if(backend_session_ and not backend_session_->is_connected()) {
+        backend_session_->failed();
+    }
+
     on_error(cx, 'R', "server");
 
     if(state().dead() && cx->peer())
-        AuthFactory::get().ipX_inc_counters(cx->peer());
+        AuthFactory::get().ipX_inc_counters(id_peer(cx->peer()), cx->peer()->meter_read_bytes, cx->peer()->meter_write_bytes);
 
 }
 
@@ -1316,9 +1581,11 @@ void MitmProxy::handle_replacement_auth(MitmHostCX* cx) {
             
             std::string token_text = cx->engine_ctx.application_data->original_request();
           
-            for(auto const& i: CfgFactory::get()->policy_prof_auth(cx->matched_policy())->sub_policies) {
-                _dia("MitmProxy::handle_replacement_auth: token: requesting identity %s", i->element_name().c_str());
-                token_text  += " |" + i->element_name();
+            if(auto const auth_profile = policy_prof_auth(cx->matched_policy()); auth_profile) {
+                for(auto const& i: auth_profile->sub_policies) {
+                    _dia("MitmProxy::handle_replacement_auth: token: requesting identity %s", i->element_name().c_str());
+                    token_text  += " |" + i->element_name();
+                }
             }
             shm_logon_token tok = shm_logon_token(token_text.c_str());
             
@@ -1358,6 +1625,8 @@ void MitmProxy::handle_replacement_auth(MitmHostCX* cx) {
             AuthFactory::get().shm_token_map_.acquire();
             AuthFactory::get().shm_token_map_.save(true);
             AuthFactory::get().shm_token_map_.release();
+            AuthFactory::get().shm_changes_append(ShmChangeLog::kind_t::TOKEN, ShmChangeLog::op_t::UPSERT,
+                                                  tok.buf().data(), tok.buf().size());
             
             _dia("MitmProxy::handle_replacement_auth: token table updated");
             AuthFactory::get_token_map()[cx->host()] = std::pair<unsigned int,std::string>(time(nullptr),tok.token());
@@ -1743,71 +2012,76 @@ void MitmProxy::handle_replacement_ssl(MitmHostCX* cx) {
     }
 }
 
-void MitmProxy::init_content_replace() {
-    content_rule_ = std::make_unique<std::vector<ProfileContentRule>>();
+buffer MitmProxy::content_rewrite_apply(side_t side, buffer const& ref) {
+
+    auto const dir = (side == side_t::LEFT) ? sx::rewrite::Session::dir_t::UP : sx::rewrite::Session::dir_t::DOWN;
+
+    std::string result;
+    result.reserve(ref.size());
+    content_rewrite()->apply(dir, std::string_view(reinterpret_cast<const char*>(ref.data()), ref.size()), result);
+
+    buffer ret_b;
+    ret_b.append(result.data(), result.size());
+
+    _dia("content rewritten: original %d bytes with new %d bytes, %d held back.", ref.size(), ret_b.size(),
+                                                                                  content_rewrite()->held(dir));
+    if(content_rewrite()->held(dir) > 0) content_rewrite_arm();
+    _dum("Replacing bytes (%d):\n%s\n# with bytes(%d):\n%s", ref.size(), hex_dump(ref).c_str(),
+                                                            ret_b.size(),hex_dump(ret_b).c_str());
+    return ret_b;
 }
 
-buffer MitmProxy::content_replace_apply(const buffer &ref) {
-    const std::string data = ref.str();
-    std::string result = data;
-    
-    int stage = 0;
-    for(auto& profile: *content_rule()) {
-        
-        try {
-            const std::regex re_match(profile.match.c_str());
-            const std::string repl = profile.replace;
-            
-            if(profile.replace_each_nth != 0) {
+void MitmProxy::content_rewrite_flush(side_t side, bool expired_only) {
 
-                // unfortunately std::regex_replace doesn't return if it really replaced something
-                // ... which is no problem if we don't care. But in case we want to replace only 
-                // .... nth occurrence, we have to do extra search to check (requiring one extra regex match).
-                std::smatch sm;
-                const bool is_there = std::regex_search(result,sm,re_match);
+    auto* rw = content_rewrite();
+    if(not rw) return;
 
-                if(is_there) {
-                    profile.replace_each_counter_++;
-                    if(profile.replace_each_counter_ >= profile.replace_each_nth) {
-                        
-                        if(profile.fill_length) {
-                            result = regex_replace_fill(result, profile.match, repl);
-                        } else {
-                            result = std::regex_replace(result, re_match, repl);              
-                        }
-                        profile.replace_each_counter_ = 0;
-                        _dia("Replacing bytes[stage %d]: n-th counter hit", stage);
-                    }
-                }
-                
-            } else {
-                if(profile.fill_length) {
-                    result = regex_replace_fill(result, profile.match, repl);
-                } else {
-                    result = std::regex_replace(result, re_match, repl);              
-                }
+    auto const dir = (side == side_t::LEFT) ? sx::rewrite::Session::dir_t::UP : sx::rewrite::Session::dir_t::DOWN;
+    if(rw->held(dir) == 0) return;
+    if(expired_only and not rw->hold_expired(dir)) return;
+
+    std::string result;
+    rw->flush(dir, result);
+    if(result.empty()) return;
+
+    buffer b;
+    b.append(result.data(), result.size());
+
+    auto const sz = b.size();
+    auto const& peers = (side == side_t::LEFT) ? rs() : ls();
+    for(auto* to: peers) {
+        deliver_shared(to, b, to == peers.back());
+        // flush may come from the timer, get woken up to write it
+        com()->set_write_monitor(to->socket());
+    }
+    _dia("content rewrite: flushed %d held bytes from %c side", sz, from_side(side));
+}
+
+void MitmProxy::content_rewrite_arm() {
+
+    if(content_rewrite_timer_ and content_rewrite_timer_->armed()) return;
+
+    auto* owner = first_left();
+    if(not owner) return;
+
+    if(not content_rewrite_timer_) {
+        content_rewrite_timer_ = std::make_unique<AsyncTimer>(owner, [this](bool const&) {
+            if(state().dead()) return;
+
+            content_rewrite_flush(side_t::LEFT, true);
+            content_rewrite_flush(side_t::RIGHT, true);
+
+            // held again in the meantime, with later deadline
+            auto const* rw = content_rewrite();
+            if(rw->held(sx::rewrite::Session::dir_t::UP) > 0 or rw->held(sx::rewrite::Session::dir_t::DOWN) > 0) {
+                content_rewrite_arm();
             }
+        });
+    }
 
-            _dia("Replacing bytes[stage %d]:",stage);
-        }
-        catch(std::regex_error const& e) {
-        _not("MitmProxy::content_replace_apply: failed to replace string: %s", e.what());
-        }
-        
-        ++stage;
+    if(not content_rewrite_timer_->arm(sx::rewrite::Ruleset::hold_timeout)) {
+        _war("content rewrite: cannot arm hold timer, held bytes wait for next data");
     }
-    
-    
-    
-    
-    
-    buffer ret_b;
-    ret_b.append(result.c_str(),result.size());
-    
-    _dia("content rewritten: original %d bytes with new %d bytes.", ref.size(), ret_b.size());
-    _dum("Replacing bytes (%d):\n%s\n# with bytes(%d):\n%s", data.size(), hex_dump(ref).c_str(),
-                                                            ret_b.size(),hex_dump(ret_b).c_str());
-    return ret_b;
 }
 
 
@@ -1913,42 +2187,17 @@ MitmHostCX* MitmProxy::first_right() {
 
 
 
-bool MitmMasterProxy::detect_ssl_on_plain_socket(int sock) {
-    
-    int ret = false;
-    constexpr unsigned int NEW_CX_PEEK_BUFFER_SZ = 10;
-    constexpr int time_increment = 2500; // 2.5ms
-    constexpr int time_max = time_increment*5;
-
-    int time_taken = 0;
-    
-    if (sock > 0) {
-
-        again:
-        char peek_buffer[NEW_CX_PEEK_BUFFER_SZ];
+SslAutodetect::result_t MitmMasterProxy::detect_ssl_on_plain_socket(int sock) {
 
-        auto b = ::recv(sock, peek_buffer, NEW_CX_PEEK_BUFFER_SZ, MSG_PEEK | MSG_DONTWAIT);
-        
-        if(b > 6) {
-            if (peek_buffer[0] == 0x16 && peek_buffer[1] == 0x03 && ( peek_buffer[5] == 0x00 || peek_buffer[5] == 0x01 || peek_buffer[5] == 0x02 )) {
-                _inf("detect_ssl_on_plain_socket: SSL detected on socket %d", sock);
-                ret = true;
-            }
-        } else {
-            if(ssl_autodetect_harder && time_taken < time_max) {
-                struct timespec t{};
-                t.tv_sec = 0;
-                t.tv_nsec = time_increment;
-                
-                ::nanosleep(&t,nullptr);
-                time_taken += time_increment;
-                _dia("detect_ssl_on_plain_socket: SSL strict detection on socket %d: delayed by %dnsec", sock, time_increment);
+    auto ret = SslAutodetect::peek(sock);
 
-                goto again;
-            }
-        }
+    if(ret == SslAutodetect::result_t::TLS) {
+        _inf("detect_ssl_on_plain_socket: SSL detected on socket %d", sock);
     }
-    
+    else if(ret == SslAutodetect::result_t::PENDING) {
+        _dia("detect_ssl_on_plain_socket: no data yet on socket %d", sock);
+    }
+
     return ret;
 }
 
@@ -1958,6 +2207,7 @@ baseHostCX* MitmMasterProxy::new_cx(int s) {
     
     bool is_ssl = false;
     bool is_ssl_port = false;
+    bool is_pending = false;
     
     auto* my_sslcom = dynamic_cast<SSLCom*>(com());
     baseCom* c = nullptr;
@@ -1968,7 +2218,12 @@ baseHostCX* MitmMasterProxy::new_cx(int s) {
     else if(ssl_autodetect) {
         // my com is NOT ssl-based, trigger auto-detect
 
-        is_ssl = detect_ssl_on_plain_socket(s);
+        auto detected = detect_ssl_on_plain_socket(s);
+        is_ssl = (detected == SslAutodetect::result_t::TLS);
+
+        // client didn't send anything yet: don't wait here, on_left_new parks it until it does
+        is_pending = (detected == SslAutodetect::result_t::PENDING and ssl_autodetect_harder);
+
         if(! is_ssl) {
             c = com()->slave();
         } else {
@@ -1990,6 +2245,20 @@ baseHostCX* MitmMasterProxy::new_cx(int s) {
     if(is_ssl_port) {
         r->is_ssl = true;
     }
+    r->ssl_autodetect_pending = is_pending;
+
+    if(r->is_ssl and tls_early_hello) {
+        sx::tls::HelloInfo info;
+        auto hello = SslAutodetect::peek_hello(s, info);
+
+        if(hello == SslAutodetect::result_t::TLS) {
+            _dia("new_cx: %s early hello: %s", r->c_type(), info.to_string().c_str());
+            r->client_hello = std::move(info);
+        }
+        else if(hello == SslAutodetect::result_t::PENDING) {
+            r->client_hello_pending = true;
+        }
+    }
     
     _deb("Pausing new connection %s", r->c_type());
     r->waiting_for_peercom(true);
@@ -1997,6 +2266,98 @@ baseHostCX* MitmMasterProxy::new_cx(int s) {
 }
 
 void MitmMasterProxy::on_left_new(baseHostCX* just_accepted_cx) {
+
+    // sub-workers are running now, acceptor can be pinned without them inheriting its cpu
+    if(accept_stats_.on_accept()) NetworkServiceFactory::pin_acceptor(this);
+
+    if(auto const* mh = dynamic_cast<MitmHostCX*>(just_accepted_cx);
+            mh and (mh->ssl_autodetect_pending or mh->client_hello_pending)) {
+
+        auto task = std::make_unique<AsyncSslAutodetect>(just_accepted_cx,
+                                                         std::chrono::microseconds(ssl_autodetect_timeout_us),
+                                                         std::chrono::milliseconds(tls_early_hello_timeout_ms),
+                                                         not mh->ssl_autodetect_pending,
+                                                         tls_early_hello);
+        task->start();
+        autodetect_pending_.push_back({ std::unique_ptr<baseHostCX>(just_accepted_cx), std::move(task) });
+
+        _dia("on_left_new: %s waiting for first flight, %zu pending", just_accepted_cx->c_type(), autodetect_pending_.size());
+        return;
+    }
+
+    on_left_ready(just_accepted_cx);
+}
+
+baseHostCX* MitmMasterProxy::autodetect_tls(std::unique_ptr<baseHostCX> plain_cx) {
+
+    int s = plain_cx->socket();
+
+    auto* c = new baseSSLMitmCom<SSLCom>();
+    c->master(com());
+
+    auto* n_cx = new MitmHostCX(c, s);
+    n_cx->is_ssl = true;
+    n_cx->waiting_for_peercom(true);
+    n_cx->com()->nonlocal_dst(true);
+    n_cx->com()->nonlocal_dst_host() = plain_cx->com()->nonlocal_dst_host();
+    n_cx->com()->nonlocal_dst_port() = plain_cx->com()->nonlocal_dst_port();
+    n_cx->com()->nonlocal_dst_resolved(plain_cx->com()->nonlocal_dst_resolved());
+
+    _inf("Connection %s: SSL detected on unusual port.", n_cx->c_type());
+
+    // socket now belongs to the new cx
+    plain_cx->remove_socket();
+
+    return n_cx;
+}
+
+void MitmMasterProxy::autodetect_round() {
+
+    if(autodetect_pending_.empty()) return;
+
+    auto const now = AsyncSslAutodetect::clock_t::now();
+
+    // pick decided first, handing them over runs policy and connects
+    std::vector<AutodetectPending> decided;
+    for(auto it = autodetect_pending_.begin(); it != autodetect_pending_.end(); ) {
+        if(it->task->done(now)) {
+            decided.emplace_back(std::move(*it));
+            it = autodetect_pending_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    for(auto& pending: decided) {
+        auto const result = pending.task->yield();
+        auto hello = std::move(pending.task->hello());
+        pending.task.reset();
+
+        _dia("autodetect_round: %s classified as %s, hello: %s", pending.cx->c_type(), SslAutodetect::str(result),
+                                                                   hello ? hello->to_string().c_str() : "none");
+
+        if(result == SslAutodetect::result_t::CLOSED) {
+            pending.cx->shutdown();
+            continue;
+        }
+
+        auto const* mh = dynamic_cast<MitmHostCX*>(pending.cx.get());
+        bool const recreate = (mh and mh->ssl_autodetect_pending and result == SslAutodetect::result_t::TLS);
+
+        auto* ready = recreate ? autodetect_tls(std::move(pending.cx)) : pending.cx.release();
+
+        if(auto* ready_mh = dynamic_cast<MitmHostCX*>(ready); ready_mh) {
+            ready_mh->ssl_autodetect_pending = false;
+            ready_mh->client_hello_pending = false;
+            ready_mh->client_hello = std::move(hello);
+        }
+
+        on_left_ready(ready);
+    }
+}
+
+void MitmMasterProxy::on_left_ready(baseHostCX* just_accepted_cx) {
     // ok, we just accepted socket, created context for it (using new_cx) and we probably need ... 
     // to create child proxy and attach this cx to it.
 
@@ -2061,14 +2422,43 @@ void MitmMasterProxy::on_left_new(baseHostCX* just_accepted_cx) {
         return;
     }
 
-    _deb("MitmMasterProxy::on_left_new: finished");
+    _deb("MitmMasterProxy::on_left_ready: finished");
 }
 
 int MitmMasterProxy::handle_sockets_once(baseCom* c) {
     //T__dia("slist",5,this->hr()+"\n===============\n");
+    autodetect_round();
+    health_probes_round();
     return ThreadedAcceptorProxy<MitmProxy>::handle_sockets_once(c);
 }
 
+void MitmMasterProxy::health_probes_round() {
+
+    // once per second is enough for probes scheduled in seconds
+    auto const now = time(nullptr);
+    if(now == health_round_at_) return;
+    health_round_at_ = now;
+
+    health_probes_.erase(std::remove_if(health_probes_.begin(), health_probes_.end(),
+                                        [now](auto const& p) { return p->expired(now); }),
+                         health_probes_.end());
+
+    // all workers compete for due targets, each target is probed by only one of them
+    auto due = BackendHealth::get().claim_due(now);
+    if(due.empty()) return;
+
+    if(not health_cx_) {
+        health_cx_ = std::make_unique<baseHostCX>(com()->slave(), "health-check", "0");
+    }
+
+    for(auto& t: due) {
+        auto probe = std::make_unique<AsyncHealthProbe>(health_cx_.get(), std::move(t));
+        if(probe->start()) {
+            health_probes_.emplace_back(std::move(probe));
+        }
+    }
+}
+
 
 void MitmUdpProxy::on_left_new(baseHostCX* just_accepted_cx)
 {
@@ -42,6 +42,8 @@
  #define MITMPROXY_HPP
 
 #include <atomic>
+#include <optional>
+#include <utility>
 
 #include <basecom.hpp>
 #include <hostcx.hpp>
@@ -60,13 +62,21 @@
 
 #include <sslcertval.hpp>
 #include <proxy/ocspinvoker.hpp>
+#include <proxy/splicerelay.hpp>
+#include <proxy/segchain.hpp>
+#include <proxy/backpressure.hpp>
+#include <async/asynchealth.hpp>
+#include <async/asyncautodetect.hpp>
+#include <async/asynctimer.hpp>
 #include <inspect/engine/http.hpp>
+#include <inspect/rewrite.hpp>
 
 
 struct whitelist_verify_entry {
 };
 
 class FilterProxy;
+struct CfgSnapshot;
 
 
 class IOController {
@@ -87,10 +97,49 @@ class MitmProxy : public baseProxy, public socle::sobject, public IOController {
     
     bool identity_resolved_ = false;    // meant if attempt has been done, regardless of its result.
     std::unique_ptr<shm_logon_info_base> identity_;
+
+    // result of last authentication check is valid while identity epoch is the same
+    uint64_t auth_epoch_ = 0;
+    time_t auth_checked_ = 0;
+
+    // identity tables key of id_peer_cx_, resolved from its socket once
+    baseHostCX const* id_peer_cx_ = nullptr;
+    sockaddr_storage id_peer_ {};
+
+    // last handle_requirements() cx and its MitmHostCX cast
+    baseHostCX* requirements_cx_ = nullptr;
+    MitmHostCX* requirements_mh_ = nullptr;
     
-    std::unique_ptr<std::vector<ProfileContentRule>> content_rule_; //save some space and store it as a pointer. Init it only when needed and delete in dtor.
+    std::unique_ptr<sx::rewrite::Session> content_rewrite_; // only for sessions with content rules
+    std::unique_ptr<AsyncTimer> content_rewrite_timer_;     // releases held bytes on time, even if no more data come
+    buffer content_rewritten_;                              // current chunk after rewrite, written to all peers
     int matched_policy_ = -1;
 
+    // configuration snapshot this proxy was created with
+    std::shared_ptr<CfgSnapshot const> cfg_snapshot_;
+
+    // source NAT address and port, returned to the pool with the proxy
+    std::unique_ptr<NatPool::Lease> snat_lease_;
+
+    // routing backend stats (least-conn, peak-ewma balancing)
+    std::unique_ptr<HostSession<>> backend_session_;
+
+    // set once session was moved to splice() fast lane, payload is no longer read by proxy
+    std::unique_ptr<SpliceRelay> splice_;
+    // passthrough() verdict, kept once the session is classified (both sides connected, autodetection done)
+    std::optional<bool> passthrough_;
+
+    // write queues of backlogged plain TCP peers, written with sendmsg() instead of socle writebuf
+    std::unique_ptr<SegmentChain> sg_left_;
+    std::unique_ptr<SegmentChain> sg_right_;
+    // chain was left non-empty by last sg_round(): poller watches the peer for writing
+    bool sg_left_backlog_ = false;
+    bool sg_right_backlog_ = false;
+
+    // read back-pressure: wm_up_ pauses reading left while right's write queue is too long, wm_down_ the other way
+    Watermark wm_up_;
+    Watermark wm_down_;
+
     std::string replacement_msg;
     static inline long half_timeout_ = 5;
 public:
@@ -136,6 +185,19 @@ public:
 
     int matched_policy() const { return matched_policy_; }
     void matched_policy(int p)  { matched_policy_ = p; }
+
+    std::shared_ptr<CfgSnapshot const> const& config_snapshot() const { return cfg_snapshot_; }
+    void config_snapshot(std::shared_ptr<CfgSnapshot const> s) { cfg_snapshot_ = std::move(s); }
+
+    NatPool::Lease const* snat_lease() const { return snat_lease_.get(); }
+    void snat_lease(std::unique_ptr<NatPool::Lease> l) { snat_lease_ = std::move(l); }
+    std::unique_ptr<NatPool::Lease> take_snat_lease() { return std::move(snat_lease_); }
+    void backend_session(std::unique_ptr<HostSession<>> s) { backend_session_ = std::move(s); }
+    std::unique_ptr<HostSession<>> take_backend_session() { return std::move(backend_session_); }
+    // matched policy rule, looked up in proxy's own config snapshot
+    std::shared_ptr<PolicyRule> matched_policy_rule() const;
+    // auth profile of policy @index in the pinned config snapshot
+    std::shared_ptr<ProfileAuth> policy_prof_auth(int index) const;
     
     inline bool identity_resolved() const { return identity_resolved_; }
     inline void identity_resolved(bool b) { identity_resolved_ = b; }
@@ -146,9 +208,10 @@ public:
     bool resolve_identity(bool insert_guest = false) { return resolve_identity(first_left(), insert_guest); }
     bool resolve_identity(baseHostCX* custom_cx, bool insert_guest);
     bool update_auth_ipX_map(baseHostCX*);
+    sockaddr_storage const& id_peer(baseHostCX const* cx);
     bool apply_id_policies(baseHostCX* cx);
-    std::optional<std::vector<std::string>> find_id_groups(baseHostCX const* cx);
-    std::shared_ptr<ProfileSubAuth> find_auth_subprofile(std::vector<std::string> const& groups);
+    // runs under identity table shard lock
+    std::shared_ptr<ProfileSubAuth> find_auth_subprofile(std::shared_ptr<ProfileAuth> const& auth_policy, sx::auth::GroupSet const& groups);
 
 
     std::unique_ptr<socle::baseTrafficLogger>& tlog() { return tlog_; }
@@ -175,6 +238,10 @@ public:
     virtual void on_half_close(baseHostCX* cx);
 
     bool handle_requirements(baseHostCX* cx);
+    // true if identity database changed since last check, or identity should be touched to keep it alive
+    bool auth_recheck_needed(MitmHostCX const* mh);
+    // resolved identity is touched (and its timeout checked) at least this often, seconds
+    static inline time_t auth_recheck_interval = 5;
     virtual bool handle_authentication(MitmHostCX* cx);
     virtual void handle_replacement_auth(MitmHostCX* cx);
 
@@ -205,16 +272,45 @@ public:
     std::string to_string(int verbosity) const override;
     
     int handle_sockets_once(baseCom*) override;
-    
-    void init_content_replace();
-    std::vector<ProfileContentRule>* content_rule() { return content_rule_.get(); }
-    void content_replace(std::vector<ProfileContentRule> const& x) {
-        for(auto const& i: x) {
-            content_rule_->push_back(i);
-        }
+
+    // relay payload with splice() once nothing in proxy needs to see it
+    static inline bool opt_splice = false;
+    bool spliced() const { return splice_ != nullptr; }
+    // policy doesn't need to see payload of this session
+    bool passthrough();
+    bool splice_eligible();
+    void splice_start();
+
+    // queue payload of backlogged plain TCP peers in segment chains, written once per round
+    static inline bool opt_sg_write = false;
+    bool sg_eligible(baseHostCX* to) const;
+    std::unique_ptr<SegmentChain>* sg_chain(baseHostCX* to);
+    bool sg_pending() const { return (sg_left_ and not sg_left_->empty()) or (sg_right_ and not sg_right_->empty()); }
+    // append @b to @to's write queue, keeping order with data already queued
+    void deliver(baseHostCX* to, buffer& b);
+    // deliver @b shared by several peers: socle may move it, so all but the @last peer get a copy
+    void deliver_shared(baseHostCX* to, buffer& b, bool last);
+    // take over backlog from writebuf and write queued chains
+    void sg_round();
+    // hand queued data back to socle writebuf, ie. for half-close handling
+    void sg_to_writebuf(baseHostCX* to);
+
+    // per-session write queue watermarks; global budget is in WriteBudget::get()
+    static inline Watermark::marks_t opt_write_marks;
+    std::size_t write_queued(baseHostCX* cx);
+    // pause or resume reading of each side depending on the largest write queue of the opposite side
+    void backpressure_round();
+
+    sx::rewrite::Session* content_rewrite() { return content_rewrite_.get(); }
+    void content_rewrite(std::shared_ptr<sx::rewrite::Ruleset const> rules) {
+        content_rewrite_ = std::make_unique<sx::rewrite::Session>(std::move(rules));
     }
-    
-    buffer content_replace_apply(const buffer &ref);
+
+    buffer content_rewrite_apply(side_t side, buffer const& ref);
+    // write out bytes of @side held back by rewrite into the peer side
+    void content_rewrite_flush(side_t side, bool expired_only);
+    // make sure held bytes are flushed by their deadline
+    void content_rewrite_arm();
     
     void _debug_zero_connections(baseHostCX* cx);
     
@@ -223,6 +319,9 @@ public:
 
     static std::atomic_uint64_t& current_sessions() { static std::atomic_uint64_t current; return current; };
     static std::atomic_uint64_t& total_sessions() { static std::atomic_uint64_t total; return total; };
+    static std::atomic_uint64_t& spliced_sessions() { static std::atomic_uint64_t spliced; return spliced; };
+    static std::atomic_uint64_t& sg_syscalls() { static std::atomic_uint64_t c; return c; };
+    static std::atomic_uint64_t& sg_bytes() { static std::atomic_uint64_t c; return c; };
     static socle::meter& total_mtr_up()  { static socle::meter t_up(12); return t_up; };
     static socle::meter& total_mtr_down() {static socle::meter t_down(12); return t_down; };
 
@@ -235,6 +334,19 @@ private:
     logan_lite log_dump {"proxy.payload"};
 };
 
+// accepted connections counter of the acceptor worker, shown in 'diag worker list'
+struct AcceptStats {
+    // returns true for the first connection accepted by the worker
+    bool on_accept() { mtr_accept.update(1); return not std::exchange(first_seen_, true); }
+
+    unsigned long accepted() const { return mtr_accept.total(); }
+    unsigned long rate() const { return mtr_accept.get(); }
+
+private:
+    mutable socle::meter mtr_accept {12};
+    bool first_seen_ = false;
+};
+
 class MitmMasterProxy : public ThreadedAcceptorProxy<MitmProxy> {
 public:
     
@@ -247,10 +359,44 @@ public:
     
     static inline bool ssl_autodetect = false;
     static inline bool ssl_autodetect_harder = true;
+    // how long 'harder' autodetection waits for the first bytes before it considers connection plaintext.
+    // Kept short: servers speaking first (SMTP, FTP, SSH) are not connected until the wait is over.
+    static inline unsigned int ssl_autodetect_timeout_us = 500;
+    // how long TLS connections wait for ClientHello to be parsed early
+    static inline unsigned int tls_early_hello_timeout_ms = 50;
+    // parse ClientHello in acceptor, so SNI bypass is decided before TLS handshake starts
+    static inline bool tls_early_hello = true;
+
+    SslAutodetect::result_t detect_ssl_on_plain_socket(int sock);
 
-    bool detect_ssl_on_plain_socket(int sock);
+    AcceptStats const& accept_stats() const { return accept_stats_; }
+    std::size_t autodetect_pending() const { return autodetect_pending_.size(); }
 
 private:
+    AcceptStats accept_stats_;
+
+    // accepted connection continues to policy and connect
+    void on_left_ready(baseHostCX* just_accepted_cx);
+
+    // connections parked until autodetection decides about their com (or ClientHello arrives). Task is declared after cx, so it is
+    // destroyed (and stops watching the socket) first.
+    struct AutodetectPending {
+        std::unique_ptr<baseHostCX> cx;
+        std::unique_ptr<AsyncSslAutodetect> task;
+    };
+    std::vector<AutodetectPending> autodetect_pending_;
+
+    // hand over decided connections, plaintext ones as they are, TLS ones re-created with SSL com
+    void autodetect_round();
+    baseHostCX* autodetect_tls(std::unique_ptr<baseHostCX> plain_cx);
+
+    // start due routing backend health probes, reap finished ones
+    void health_probes_round();
+
+    std::unique_ptr<baseHostCX> health_cx_;
+    time_t health_round_at_ = 0;
+    std::vector<std::unique_ptr<AsyncHealthProbe>> health_probes_;
+
     logan_lite log {"com.tcp.acceptor"};
 };
 
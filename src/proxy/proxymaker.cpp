@@ -39,7 +39,9 @@
 
 #include <service/cfgapi/cfgapi.hpp>
 #include <policy/authfactory.hpp>
+#include <policy/verdictcache.hpp>
 #include <proxy/mitmproxy.hpp>
+#include <proxy/relayproxy.hpp>
 
 #include <proxy/proxymaker.hpp>
 
@@ -116,6 +118,42 @@ namespace sx::proxymaker {
         return new_proxy;
     }
 
+    int cached_policy_apply (std::unique_ptr<MitmProxy>& proxy) {
+
+        auto const& log = log::policy();
+
+        auto const& snap = proxy->config_snapshot();
+        if(not snap or not snap->classifier) {
+            return CfgFactory::get()->policy_apply(proxy->first_left(), proxy.get());
+        }
+
+        auto key = VerdictCache::make_key(*snap->classifier, proxy->first_left(), proxy->first_right(),
+                                          AuthFactory::get().identity_epoch());
+        VerdictCache::Generation const gen { snap->version, CfgFactory::board()->version_current() };
+
+        if(key) {
+            if(auto cached = VerdictCache::get().lookup(key.value(), gen); cached) {
+                auto policy_num = cached.value();
+
+                if(policy_num >= 0) {
+                    if(auto rule = snap->policy(policy_num); rule) rule->cnt_matches.fetch_add(1, std::memory_order_relaxed);
+                    return CfgFactory::get()->policy_apply(proxy->first_left(), proxy.get(), policy_num);
+                }
+
+                _inf("Connection %s denied: policy=%d (cached)", proxy->first_left()->full_name('L').c_str(), policy_num);
+                return policy_num;
+            }
+        }
+
+        auto policy_num = CfgFactory::get()->policy_apply(proxy->first_left(), proxy.get());
+
+        if(key and snap->classifier->cacheable(policy_num)) {
+            VerdictCache::get().store(key.value(), gen, policy_num);
+        }
+
+        return policy_num;
+    }
+
     bool policy (std::unique_ptr<MitmProxy>& proxy, bool implicit_allow) {
 
         auto const& log = log::policy();
@@ -137,7 +175,9 @@ namespace sx::proxymaker {
             bypass_cx(proxy->first_right());
             policy_num = PolicyRule::POLICY_IMPLICIT_PASS;
         } else {
-            policy_num = CfgFactory::get()->policy_apply(proxy->first_left(), proxy.get());
+            // pin current configuration to the proxy, so reload during its lifetime won't affect it
+            proxy->config_snapshot(CfgFactory::get()->snapshot());
+            policy_num = cached_policy_apply(proxy);
         }
 
         auto *src_cx = proxy->first_left();
@@ -163,7 +203,7 @@ namespace sx::proxymaker {
         // we are done
         if(policy_num < 0) return true;
 
-        if( auto policy = CfgFactory::get()->lookup_policy(policy_num); policy) {
+        if( auto policy = proxy->matched_policy_rule(); policy) {
 
             if(policy->profile_routing and not route(proxy, policy->profile_routing))
                 _err("routing failed");
@@ -188,7 +228,8 @@ namespace sx::proxymaker {
 
         {
             auto l_ = std::scoped_lock(routing_profile->lb_state.lock_);
-            auto candidates = routing_profile->lb_candidates(proxy->com()->l3_proto());
+            auto const family = proxy->com()->l3_proto();
+            auto const& candidates = routing_profile->lb_candidates(family);
             if(candidates.empty()) return { std::nullopt, std::nullopt };
 
             size_t index = 0;
@@ -204,17 +245,39 @@ namespace sx::proxymaker {
                 case ProfileRouting::lb_method::LB_L4:
                     index = routing_profile->lb_index_l4(proxy.get(), candidates.size());
                     break;
+                case ProfileRouting::lb_method::LB_MAGLEV_L3:
+                    index = routing_profile->lb_index_maglev(proxy.get(), family, false);
+                    break;
+                case ProfileRouting::lb_method::LB_MAGLEV_L4:
+                    index = routing_profile->lb_index_maglev(proxy.get(), family, true);
+                    break;
+                case ProfileRouting::lb_method::LB_LEAST_CONN:
+                case ProfileRouting::lb_method::LB_PEAK_EWMA:
+                    if(auto pi = routing_profile->lb_index_pool(family); pi >= 0 and static_cast<size_t>(pi) < candidates.size()) {
+                        index = pi;
+                    }
+                    break;
                 default:
                     // act as LB_RR
                     index = routing_profile->lb_index_rr(candidates.size());
             }
 
+            index = routing_profile->lb_index_healthy(family, index);
             ip = candidates[index]->ip();
+
+            // count the session in stats of the backend really used, until proxy is gone
+            if(routing_profile->dnat_lb_method == ProfileRouting::lb_method::LB_LEAST_CONN or
+               routing_profile->dnat_lb_method == ProfileRouting::lb_method::LB_PEAK_EWMA) {
+                if(auto host = routing_profile->lb_pool_host(family, index); host) {
+                    proxy->backend_session(std::make_unique<HostSession<>>(host));
+                }
+            }
         }
 
         if(not routing_profile->dnat_ports.empty()) {
             // find address object referred in "routing"
-            auto prt = CfgFactory::get()->lookup_port(routing_profile->dnat_ports[0].c_str());
+            auto const& snap = proxy->config_snapshot() ? proxy->config_snapshot() : CfgFactory::get()->snapshot();
+            auto prt = snap->lookup_port(routing_profile->dnat_ports[0]);
             if(prt) {
                 if( auto port_obj = std::dynamic_pointer_cast<CfgRange>(prt); port_obj) {
                     // no balancing on ports
@@ -307,8 +370,9 @@ namespace sx::proxymaker {
         if (not left or not right) return false;
 
 
-        auto const policy = CfgFactory::get()->policy_prof_auth(left->matched_policy());
-        if(not policy) return false;
+        // objects of the policy which matched, even if config was reloaded since
+        auto const auth_profile = proxy->policy_prof_auth(left->matched_policy());
+        if(not auth_profile) return false;
 
         auto const& log = log::authorize();
 
@@ -321,31 +385,19 @@ namespace sx::proxymaker {
         }
         std::string str_af = SockOps::family_str(af);
 
-        // use common base pointer, so we can use all IdentityInfo types
-
-        std::optional<std::vector<std::string>> maybe_groups;
-        if (af == AF_INET or af == 0) {
-            maybe_groups = AuthFactory::get().ip4_get_groups(left->host());
-        } else if (af == AF_INET6) {
-            maybe_groups = AuthFactory::get().ip6_get_groups(left->host());
-        }
-
-        if(not maybe_groups) return bad_auth;
-
-        for (auto const &sub_policy: CfgFactory::get()->policy_prof_auth(left->matched_policy())->sub_policies) {
-            for (auto const &candidate: maybe_groups.value()) {
-                _deb("Connection identities: testing ip identity '%s' against policy '%s'", candidate.c_str(), sub_policy->element_name().c_str());
-                if (candidate == sub_policy->element_name()) {
-                    _dia("Connection identities: ip identity '%s' matches policy '%s'", candidate.c_str(),
-                         sub_policy->element_name().c_str());
-                    bad_auth = false;
-                    break;
-                }
-            }
+        // any of sub-policies' groups
+        bool matches = false;
+        bool const found = AuthFactory::get().ipX_read_groups(proxy->id_peer(left), [&](sx::auth::GroupSet const& groups) {
+            matches = groups.intersects(auth_profile->sub_groups);
+        });
+        if(not found) return bad_auth;
 
-            // don't iterate if we know we are ok
-            if (not bad_auth)
-                break;
+        if (matches) {
+            _dia("Connection identities: %s identity matches auth profile '%s'", str_af.c_str(), auth_profile->element_name().c_str());
+            bad_auth = false;
+        } else {
+            _deb("Connection identities: %s identity in none of auth profile '%s' groups", str_af.c_str(),
+                 auth_profile->element_name().c_str());
         }
 
         return bad_auth;
@@ -396,6 +448,38 @@ namespace sx::proxymaker {
         return std::find(ports.begin(), ports.end(), port) != ports.end();
     }
 
+    bool setup_snat_pool (MitmProxy* proxy, baseHostCX const* target_cx) {
+
+        auto const& log = log::snat();
+
+        auto rule = proxy->matched_policy_rule();
+        auto pool = rule and rule->profile_routing ? rule->profile_routing->snat_pool : nullptr;
+        if(not pool) {
+            _err("proxy_setup_snat (pool)[%s]: policy #%d: routing profile has no snat pool", proxy->to_string(iINF).c_str(),
+                 proxy->matched_policy());
+            return false;
+        }
+
+        auto const family = cidr::Prefix::parse(target_cx->host()).proto;
+        auto lease = pool->allocate(family, NatPool::destination(target_cx->host(), target_cx->port()));
+        if(not lease) {
+            _war("proxy_setup_snat (pool)[%s]: policy #%d: pool exhausted", proxy->to_string(iINF).c_str(),
+                 proxy->matched_policy());
+            return false;
+        }
+
+        _dia("proxy_setup_snat (pool)[%s]: source %s:%d", proxy->to_string(iINF).c_str(),
+             lease->host().c_str(), lease->port());
+
+        target_cx->com()->nonlocal_src_port() = lease->port();
+        target_cx->com()->nonlocal_src_host() = lease->host();
+        target_cx->com()->nonlocal_src(true);
+
+        proxy->snat_lease(std::move(lease));
+
+        return true;
+    }
+
     bool setup_snat (std::unique_ptr<MitmProxy> &proxy, std::string const &source_host, std::string const &source_port) {
 
         if (not proxy) return false;
@@ -411,12 +495,18 @@ namespace sx::proxymaker {
         // setup NAT
         if (not enforce_nat) {
             try {
-                if (CfgFactory::get()->db_policy_list.at(proxy->matched_policy())->nat == PolicyRule::POLICY_NAT_NONE) {
+                auto rule = proxy->matched_policy_rule();
+                if(not rule) throw std::out_of_range("policy not found");
+
+                if (rule->nat == PolicyRule::POLICY_NAT_NONE) {
 
                     target_cx->com()->nonlocal_src_port() = std::stoi(source_port);
                     target_cx->com()->nonlocal_src_host() = source_host;
                     target_cx->com()->nonlocal_src(true);
                 }
+                else if (rule->nat == PolicyRule::POLICY_NAT_POOL) {
+                    if(not setup_snat_pool(proxy.get(), target_cx)) return false;
+                }
             }
             catch (std::invalid_argument const &e) {
                 _err("proxy_setup_snat (nonat)[%s]: policy #%d: error %s", proxy->to_string(iINF).c_str(),
@@ -435,16 +525,13 @@ namespace sx::proxymaker {
     }
 
 
-    bool connect(MasterProxy* owner, std::unique_ptr<MitmProxy> &&new_proxy) {
-
-        auto proxy_of_mine = std::move(new_proxy);
+    template <class ProxyType>
+    bool connect_proxy(MasterProxy* owner, std::unique_ptr<ProxyType> proxy_of_mine, baseHostCX const* left, baseHostCX* right) {
 
         auto const& log = log::connect();
 
         if (owner and proxy_of_mine) {
 
-            auto const* left = proxy_of_mine->first_left();
-            auto* right = proxy_of_mine->first_right();
             auto *oc = owner->com();
 
             if (left and right and oc) {
@@ -468,10 +555,30 @@ namespace sx::proxymaker {
         }
 
 
-        _deb("proxymaker::connect[%s]: cannot connect null objects");
+        _deb("proxymaker::connect: cannot connect null objects");
 
         return false;
     }
 
+    bool connect(MasterProxy* owner, std::unique_ptr<MitmProxy> &&new_proxy) {
 
-}
\ No newline at end of file
+        auto proxy_of_mine = std::move(new_proxy);
+
+        // nothing in the policy needs payload: continue in slim proxy
+        if(RelayProxy::enabled and RelayProxy::eligible(proxy_of_mine.get())) {
+            auto const& log = log::connect();
+            _dia("proxymaker::connect[%s]: pass-through policy, using relay proxy", proxy_of_mine->to_string(iINF).c_str());
+
+            auto relay = RelayProxy::take_over(*proxy_of_mine);
+            proxy_of_mine.reset();
+
+            auto* left = relay->ls().at(0);
+            auto* right = relay->rs().at(0);
+            return connect_proxy(owner, std::move(relay), left, right);
+        }
+
+        auto const* left = proxy_of_mine ? proxy_of_mine->first_left() : nullptr;
+        auto* right = proxy_of_mine ? proxy_of_mine->first_right() : nullptr;
+        return connect_proxy(owner, std::move(proxy_of_mine), left, right);
+    }
+}
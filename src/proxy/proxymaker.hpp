@@ -49,6 +49,8 @@ namespace sx::proxymaker {
 
     std::unique_ptr<MitmProxy> make (baseHostCX *left, baseHostCX *right);
     bool policy (std::unique_ptr<MitmProxy> &proxy, bool implicit_allow);
+    // policy_apply() with verdict cache in front of policy matching
+    int cached_policy_apply (std::unique_ptr<MitmProxy> &proxy);
     bool route_existing(MitmProxy* proxy, std::shared_ptr<ProfileRouting> routing_profile);
     bool route(std::unique_ptr<MitmProxy> &proxy, std::shared_ptr<ProfileRouting> routing_profile);
     std::pair<std::string, unsigned short> to_magic(unsigned short target_port);
@@ -57,6 +59,8 @@ namespace sx::proxymaker {
     bool authorize (std::unique_ptr<MitmProxy> &proxy);
 
     bool setup_snat (std::unique_ptr<MitmProxy> &proxy, std::string const &source_host, std::string const &source_port);
+    // lease source from routing profile snat pool of matched policy, set it to @target_cx
+    bool setup_snat_pool (MitmProxy* proxy, baseHostCX const* target_cx);
     bool connect (MasterProxy *owner, std::unique_ptr<MitmProxy> &&new_proxy);
 }
 
@@ -0,0 +1,263 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <sstream>
+
+#include <tcpcom.hpp>
+
+#include <proxy/relayproxy.hpp>
+#include <proxy/mitmhost.hpp>
+
+namespace {
+    logan_lite& proxy_log() {
+        static auto l_ = logan_lite("proxy.relay");
+        return l_;
+    }
+
+    // plain TCP com on the same master as @like. Slave of bypassed SSLCom would be SSLCom again (without
+    // the bypass), relay must pass TLS bytes as they are.
+    baseCom* plain_com(baseCom* like) {
+        auto* c = new TCPCom();
+        c->master(like->master());
+        return c;
+    }
+}
+
+RelayProxy::RelayProxy(baseCom* c): baseProxy(c), sobject() {
+    current_sessions()++;
+    MitmProxy::current_sessions()++;
+}
+
+RelayProxy::~RelayProxy() {
+    current_sessions()--;
+    MitmProxy::current_sessions()--;
+}
+
+
+bool RelayProxy::eligible(MitmProxy* proxy) {
+
+    if(not proxy or not proxy->passthrough()) return false;
+
+    // implicit pass (magic IP redirects) and denied sessions stay in MitmProxy
+    if(proxy->matched_policy() < 0) return false;
+
+    return proxy->ls().at(0)->readbuf()->empty();
+}
+
+
+std::unique_ptr<RelayProxy> RelayProxy::take_over(MitmProxy& proxy) {
+
+    auto* old_left = proxy.ls().at(0);
+    auto* old_right = proxy.rs().at(0);
+
+    auto relay = std::make_unique<RelayProxy>(plain_com(proxy.com()));
+    relay->matched_policy_ = proxy.matched_policy();
+    relay->snat_lease_ = proxy.take_snat_lease();
+    relay->backend_session_ = proxy.take_backend_session();
+
+    // accepted socket continues in plain context, old one must not close it
+    auto const s = old_left->socket();
+    auto* left = new baseHostCX(plain_com(old_left->com()), s);
+    left->com()->l3_proto(old_left->com()->l3_proto());
+    old_left->remove_socket();
+
+    // backend is not connected yet, just copy where and how to connect
+    auto* right = new baseHostCX(plain_com(old_right->com()), old_right->host().c_str(), old_right->port().c_str());
+    right->com()->l3_proto(old_left->com()->l3_proto());
+    if(old_right->com()->nonlocal_src()) {
+        right->com()->nonlocal_src_host() = old_right->com()->nonlocal_src_host();
+        right->com()->nonlocal_src_port() = old_right->com()->nonlocal_src_port();
+        right->com()->nonlocal_src(true);
+    }
+
+    left->peer(right);
+    right->peer(left);
+
+    relay->ladd(left);
+    relay->radd(right);
+
+    return relay;
+}
+
+
+void RelayProxy::on_left_bytes(baseHostCX* cx) {
+    MitmProxy::total_mtr_up().update(cx->to_read().size());
+    for(auto* to: rs()) to->to_write(cx->to_read());
+}
+
+void RelayProxy::on_right_bytes(baseHostCX* cx) {
+    MitmProxy::total_mtr_down().update(cx->to_read().size());
+    for(auto* to: ls()) to->to_write(cx->to_read());
+}
+
+void RelayProxy::on_left_error(baseHostCX* cx) {
+    _dia("on_left_error: %s", cx->c_type());
+    state().dead(true);
+}
+
+void RelayProxy::on_right_error(baseHostCX* cx) {
+    _dia("on_right_error: %s", cx->c_type());
+    state().dead(true);
+}
+
+
+int RelayProxy::handle_sockets_once(baseCom* xcom) {
+
+    if(splice_) return splice_round(*this, *splice_, stats_.mtr_up, stats_.mtr_down, half_holdtimer_);
+
+    // until backend connects (or for good, if splice is off), socle does the usual job
+    auto ret = baseProxy::handle_sockets_once(xcom);
+    if(state().dead() or ls().empty() or rs().empty()) return ret;
+
+    auto* lf = ls().at(0);
+    auto* rg = rs().at(0);
+
+    if(rg->opening()) return ret;
+
+    if(backend_session_) backend_session_->connected();
+
+    if(not MitmProxy::opt_splice) return ret;
+
+    if(lf->to_read().empty() and lf->writebuf()->empty() and rg->to_read().empty() and rg->writebuf()->empty()) {
+        _dia("handle_sockets_once: backend connected, splicing");
+        splice_ = std::make_unique<SpliceRelay>();
+        MitmProxy::spliced_sessions()++;
+    }
+
+    return ret;
+}
+
+
+int RelayProxy::splice_round(baseProxy& proxy, SpliceRelay& relay, socle::meter& mtr_up, socle::meter& mtr_down,
+                             time_t& half_holdtimer) {
+
+    auto const& log = proxy_log();
+
+    auto* lf = proxy.ls().at(0);
+    auto* rg = proxy.rs().at(0);
+    auto* com = proxy.com();
+
+    int const l = lf->socket();
+    int const r = rg->socket();
+
+    // idle timers are still maintained by poller
+    if(com->in_idleset(l) and com->in_idleset(r)) {
+        _dia("splice_round: idle timeout");
+        proxy.state().dead(true);
+        return 0;
+    }
+
+    auto res = relay.round(l, r);
+
+    auto account = [](baseHostCX* from, baseHostCX* to, SpliceRelay::step_t const& st, socle::meter& mtr, socle::meter& total) {
+        if(st.read > 0) {
+            from->meter_read_bytes += st.read;
+            from->meter_read_count++;
+            mtr.update(st.read);
+            total.update(st.read);
+        }
+        if(st.written > 0) {
+            to->meter_write_bytes += st.written;
+            to->meter_write_count++;
+        }
+    };
+    account(lf, rg, res.up, mtr_up, MitmProxy::total_mtr_up());
+    account(rg, lf, res.down, mtr_down, MitmProxy::total_mtr_down());
+
+    if(res.error()) {
+        _dia("splice_round: socket error, closing");
+        proxy.state().dead(true);
+        return 0;
+    }
+
+    if(relay.finished()) {
+        proxy.state().dead(true);
+        return 0;
+    }
+
+    // remaining direction of half-closed session is kept up for half_timeout() of inactivity
+    if(relay.half_closed()) {
+        auto const now = ::time(nullptr);
+        if(res.up.written + res.down.written > 0 or half_holdtimer == 0) {
+            half_holdtimer = now;
+        }
+        else if(now > half_holdtimer + MitmProxy::half_timeout()) {
+            _dia("splice_round: half-closed session timeout");
+            proxy.state().dead(true);
+            return 0;
+        }
+    }
+
+    auto watch = [com](int fd, SpliceRelay::watch_t w) {
+        switch (w) {
+            case SpliceRelay::watch_t::WRITE:
+                com->set_write_monitor(fd);
+                break;
+            case SpliceRelay::watch_t::READ:
+                com->set_monitor(fd);
+                break;
+            case SpliceRelay::watch_t::NONE:
+                com->unset_monitor(fd);
+                break;
+        }
+    };
+    watch(l, res.left);
+    watch(r, res.right);
+
+    return static_cast<int>(res.up.read + res.down.read);
+}
+
+
+std::string RelayProxy::to_string(int verbosity) const {
+    std::stringstream r;
+    if(verbosity >= INF) r << "Relay|";
+
+    r << baseProxy::to_string(verbosity);
+
+    if(verbosity >= INF) {
+        r << string_format(" policy: %d ", matched_policy());
+
+        std::string const sp_str = number_suffixed(stats_.mtr_up.get()*8) + "/" + number_suffixed(stats_.mtr_down.get()*8);
+        r << ((sp_str == "0.0/0.0") ? "up/dw: --" : string_format("up/dw: %s", sp_str.c_str()));
+
+        if(splice_) r << " splice";
+    }
+
+    return r.str();
+}
@@ -0,0 +1,101 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef RELAYPROXY_HPP
+#define RELAYPROXY_HPP
+
+#include <baseproxy.hpp>
+
+#include <proxy/mitmproxy.hpp>
+#include <proxy/splicerelay.hpp>
+
+// Slim L4 proxy for sessions whose policy needs nothing from the payload: no inspection, content rules,
+// capture or authentication. Both sides are plain baseHostCX on TCPCom (bypassed TLS is relayed as is). Once
+// backend is connected and splice fast lane is enabled (MitmProxy::opt_splice), payload is relayed by splice()
+// and the proxy doesn't keep any per-session buffers. Otherwise payload is copied through socle buffers.
+//
+// Sessions are always created and policy-matched as MitmProxy. sx::proxymaker then hands eligible ones over
+// to RelayProxy before connecting backend, see take_over().
+
+class RelayProxy : public baseProxy, public socle::sobject {
+public:
+    explicit RelayProxy(baseCom* c);
+    ~RelayProxy() override;
+
+    static inline bool enabled = true;
+
+    // policy-level check, MitmProxy must not be connected yet
+    static bool eligible(MitmProxy* proxy);
+    // move connections, NAT lease and backend stats out of @proxy; @proxy is supposed to be discarded
+    static std::unique_ptr<RelayProxy> take_over(MitmProxy& proxy);
+
+    // one round of spliced session, shared with MitmProxy splice mode: updates meters, watches sockets and
+    // sets proxy dead when session is finished
+    static int splice_round(baseProxy& proxy, SpliceRelay& relay, socle::meter& mtr_up, socle::meter& mtr_down,
+                            time_t& half_holdtimer);
+
+    int matched_policy() const { return matched_policy_; }
+
+    void on_left_bytes(baseHostCX* cx) override;
+    void on_right_bytes(baseHostCX* cx) override;
+    void on_left_error(baseHostCX* cx) override;
+    void on_right_error(baseHostCX* cx) override;
+
+    int handle_sockets_once(baseCom* xcom) override;
+
+    bool ask_destroy() override { state().dead(true); return true; };
+    std::string to_string(int verbosity) const override;
+
+    static std::atomic_uint64_t& current_sessions() { static std::atomic_uint64_t current; return current; };
+
+    TYPENAME_OVERRIDE("RelayProxy")
+    DECLARE_LOGGING(to_string)
+
+private:
+    int matched_policy_ = -1;
+    std::unique_ptr<NatPool::Lease> snat_lease_;
+    std::unique_ptr<HostSession<>> backend_session_;
+
+    std::unique_ptr<SpliceRelay> splice_;
+    time_t half_holdtimer_ = 0;
+
+    logan_lite log {"proxy.relay"};
+};
+
+#endif //RELAYPROXY_HPP
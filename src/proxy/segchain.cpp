@@ -0,0 +1,154 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+
+#include <proxy/segchain.hpp>
+
+SegmentChain::segment_ptr SegmentChain::make_segment(uint8_t const* data, std::size_t len, std::size_t capacity) {
+    auto seg = std::make_shared<Segment>();
+    seg->capacity = std::max(len, capacity);
+    seg->data = std::make_unique<uint8_t[]>(seg->capacity);
+    if(len > 0) std::memcpy(seg->data.get(), data, len);
+    seg->size = len;
+
+    return seg;
+}
+
+void SegmentChain::push(segment_ptr const& seg) {
+    if(not seg or seg->size == 0) return;
+
+    refs_.push_back({ seg, 0, seg->size });
+    size_ += seg->size;
+}
+
+void SegmentChain::push(uint8_t const* data, std::size_t len) {
+    if(len == 0) return;
+
+    // tail segment has room and our reference ends exactly at its end: just extend it
+    if(not refs_.empty()) {
+        auto& tail = refs_.back();
+        auto& seg = *tail.seg;
+        if(tail.offset + tail.len == seg.size and seg.capacity - seg.size >= len) {
+            std::memcpy(seg.data.get() + seg.size, data, len);
+            seg.size += len;
+            tail.len += len;
+            size_ += len;
+            stats_.copied += len;
+            return;
+        }
+    }
+
+    // small chunks get a segment with spare room for following ones
+    auto seg = make_segment(data, len, len < segment_size ? segment_size : 0);
+    stats_.copied += len;
+    stats_.segments++;
+    push(seg);
+}
+
+std::size_t SegmentChain::iov(iovec* out, std::size_t max) const {
+    std::size_t n = 0;
+    for(auto it = refs_.begin(); it != refs_.end() and n < max; ++it, ++n) {
+        out[n].iov_base = it->seg->data.get() + it->offset;
+        out[n].iov_len = it->len;
+    }
+    return n;
+}
+
+void SegmentChain::consume(std::size_t len) {
+    len = std::min(len, size_);
+    size_ -= len;
+
+    while(len > 0) {
+        auto& front = refs_.front();
+        if(len < front.len) {
+            front.offset += len;
+            front.len -= len;
+            return;
+        }
+        len -= front.len;
+        refs_.pop_front();
+    }
+}
+
+void SegmentChain::clear() {
+    refs_.clear();
+    size_ = 0;
+}
+
+SegmentChain::send_t SegmentChain::send(int fd, bool more) {
+    send_t ret;
+
+    // normally a single call; another one only if the chain didn't fit into iov_max entries
+    while(not empty()) {
+        iovec vec[iov_max];
+        msghdr msg {};
+        msg.msg_iov = vec;
+        msg.msg_iovlen = iov(vec, iov_max);
+
+        std::size_t total = 0;
+        for(std::size_t i = 0; i < msg.msg_iovlen; ++i) total += vec[i].iov_len;
+
+        bool const last = (total == size_);
+        int const flags = MSG_NOSIGNAL | MSG_DONTWAIT | ((more or not last) ? MSG_MORE : 0);
+
+        stats_.syscalls++;
+        auto const n = ::sendmsg(fd, &msg, flags);
+        if(n < 0) {
+            if(errno == EAGAIN or errno == EWOULDBLOCK) ret.want_write = true;
+            else if(errno != EINTR) ret.error = true;
+            break;
+        }
+
+        consume(static_cast<std::size_t>(n));
+        ret.written += static_cast<std::size_t>(n);
+        stats_.sent += static_cast<std::size_t>(n);
+
+        if(static_cast<std::size_t>(n) < total) {
+            ret.want_write = true;
+            break;
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,122 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef SEGCHAIN_HPP
+#define SEGCHAIN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Write queue made of refcounted segments. Payload is copied once when it enters the chain, the same segment
+// can be queued to several chains without copying, and consumed bytes are dropped without moving the rest.
+// send() writes out as many segments as fit into one sendmsg() call.
+
+class SegmentChain {
+public:
+    struct Segment {
+        std::unique_ptr<uint8_t[]> data;
+        std::size_t size = 0;
+        std::size_t capacity = 0;
+    };
+    using segment_ptr = std::shared_ptr<Segment>;
+
+    struct stats_t {
+        uint64_t syscalls = 0;      // sendmsg() calls
+        uint64_t copied = 0;        // bytes copied into segments
+        uint64_t segments = 0;      // segments allocated
+        uint64_t sent = 0;          // bytes written to socket
+    };
+
+    struct send_t {
+        std::size_t written = 0;
+        bool want_write = false;    // socket is full, rest is still queued
+        bool error = false;
+    };
+
+    // small chunks are appended to the tail segment up to this size
+    constexpr static std::size_t segment_size = 16 * 1024;
+    // iovec entries passed to a single sendmsg()
+    constexpr static std::size_t iov_max = 64;
+
+    // copy @len bytes into a new segment, with room for at least @capacity bytes
+    static segment_ptr make_segment(uint8_t const* data, std::size_t len, std::size_t capacity = 0);
+
+    // queue already existing segment, no copy
+    void push(segment_ptr const& seg);
+    // queue a copy of @data, coalescing it with the tail segment if it has room
+    void push(uint8_t const* data, std::size_t len);
+
+    bool empty() const { return size_ == 0; }
+    std::size_t size() const { return size_; }
+    std::size_t segments() const { return refs_.size(); }
+
+    // fill @out with up to @max entries pointing to queued data, returns number of entries
+    std::size_t iov(iovec* out, std::size_t max) const;
+    void consume(std::size_t len);
+    void clear();
+
+    // one non-blocking sendmsg() of queued data. @more sets MSG_MORE: caller knows more data follow soon.
+    send_t send(int fd, bool more = false);
+
+    // visit queued data in order, ie. to move it into other kind of buffer
+    template<typename F>
+    void for_each(F&& f) const {
+        for(auto const& r: refs_) f(r.seg->data.get() + r.offset, r.len);
+    }
+
+    stats_t const& stats() const { return stats_; }
+
+private:
+    struct Ref {
+        segment_ptr seg;
+        std::size_t offset = 0;
+        std::size_t len = 0;
+    };
+
+    std::deque<Ref> refs_;
+    std::size_t size_ = 0;
+    stats_t stats_;
+};
+
+#endif //SEGCHAIN_HPP
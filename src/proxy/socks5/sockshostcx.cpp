@@ -277,11 +277,8 @@ socks5_request_error socksServerCX::handle5_connect_fqdn() {
     auto ipver = com()->l3_proto();
 
     // Some implementations use atype FQDN, but target is an IP address
-    auto* adr_as_fqdn = cidr::cidr_from_str(req_str_addr.c_str());
-    if(adr_as_fqdn != nullptr) {
+    if(cidr::Prefix::parse(req_str_addr).valid()) {
         // hmm, it's an address
-        cidr_free(adr_as_fqdn);
-
         target_ips.push_back(req_str_addr);
     } else {
         // really FQDN.
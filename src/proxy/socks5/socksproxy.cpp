@@ -44,6 +44,7 @@
 #include <proxy/socks5/socksproxy.hpp>
 #include <proxy/mitmhost.hpp>
 #include <service/cfgapi/cfgapi.hpp>
+#include <service/netservice.hpp>
 #include <policy/authfactory.hpp>
 
 #include <vector>
@@ -75,15 +76,11 @@ void SocksProxy::on_left_message(baseHostCX* basecx) {
                 r.emplace_back(cx->right.get());
 
 
-                auto lc_ = std::scoped_lock(CfgFactory::lock());
+                config_snapshot(CfgFactory::get()->snapshot());
 
-                matched_policy(CfgFactory::get()->policy_match(l, r));
-                verdict = CfgFactory::get()->policy_action(matched_policy());
-
-                std::shared_ptr<PolicyRule> p;
-                if (matched_policy() >= 0) {
-                    p = CfgFactory::get()->db_policy_list.at(matched_policy());
-                }
+                matched_policy(config_snapshot()->policy_match(l, r));
+                auto p = matched_policy_rule();
+                verdict = (p and p->action == PolicyRule::POLICY_ACTION_PASS);
 
                 const char *resp = verdict ? "accept" : "reject";
                 _dia("socksProxy::on_left_message: policy check result: policy# %d, verdict %s", matched_policy(),
@@ -139,10 +136,9 @@ void SocksProxy::socks5_handoff(socksServerCX* cx) {
         state().dead(true);
         return;
     } 
-    else if(matched_policy() >= (signed int)CfgFactory::get()->db_policy_list.size()) {
-        _dia("SocksProxy::sock5_handoff: matching policy out of policy index table: %d/%d: dropping.",
-                                         matched_policy(),
-                                         CfgFactory::get()->db_policy_list.size());
+    else if(not matched_policy_rule()) {
+        _dia("SocksProxy::sock5_handoff: matching policy out of policy index table: %d: dropping.",
+                                         matched_policy());
         state().dead(true);
         return;
     }
@@ -211,8 +207,7 @@ void SocksProxy::socks5_handoff(socksServerCX* cx) {
 
 
     {
-        auto lc_ = std::scoped_lock(CfgFactory::lock());
-        if (CfgFactory::get()->db_policy_list.at(matched_policy())->nat == PolicyRule::POLICY_NAT_NONE) {
+        if (matched_policy_rule()->nat == PolicyRule::POLICY_NAT_NONE) {
             target_cx->com()->nonlocal_src(true);
             target_cx->com()->nonlocal_src_host() = h;
             target_cx->com()->nonlocal_src_port() = std::stoi(p);
@@ -228,10 +223,17 @@ void SocksProxy::socks5_handoff(socksServerCX* cx) {
     
     radd(target_cx);
 
-    if( auto policy = CfgFactory::get()->lookup_policy(matched_policy()); policy) {
+    if( auto policy = matched_policy_rule(); policy) {
 
         if(policy->profile_routing and not sx::proxymaker::route_existing(this, policy->profile_routing))
             _err("SocksProxy::socks5_handoff: routing failed");
+
+        // source from the pool is leased for the final (routed) destination
+        if(policy->nat == PolicyRule::POLICY_NAT_POOL and not sx::proxymaker::setup_snat_pool(this, target_cx)) {
+            _inf("SocksProxy::socks5_handoff: no source from NAT pool");
+            state().dead(true);
+            return;
+        }
     }
 
     if ((CfgFactory::get()->policy_apply(n_cx, this, matched_policy()) < 0) or
@@ -309,28 +311,20 @@ bool SocksProxy::socks5_handoff_authenticate(MitmHostCX *cx) {
     std::string str_af = SockOps::family_str(af);
 
 
-    std::optional<std::vector<std::string>> groups_vec;
+    auto const auth_profile = policy_prof_auth(matched_policy());
 
-    if (af == AF_INET || af == 0) {
-        groups_vec = AuthFactory::get().ip4_get_groups(cx->host());
-    } else if (af == AF_INET6) {
-        groups_vec = AuthFactory::get().ip6_get_groups(cx->host());
-    }
+    bool matches = false;
+    bool const found = AuthFactory::get().ipX_read_groups(id_peer(cx), [&](sx::auth::GroupSet const& groups) {
+        matches = auth_profile != nullptr and groups.intersects(auth_profile->sub_groups);
+    });
 
-    if ( groups_vec ) {
-
-        if (CfgFactory::get()->policy_prof_auth(matched_policy()) != nullptr)
-            for (auto const& sub_pol: CfgFactory::get()->policy_prof_auth(matched_policy())->sub_policies) {
-                for (auto const& x: groups_vec.value()) {
-                    _deb("Connection identities: ip identity '%s' against policy '%s'", x.c_str(),
-                         sub_pol->element_name().c_str());
-                    if (x == sub_pol->element_name()) {
-                        _dia("Connection identities: ip identity '%s' matches policy '%s'", x.c_str(),
-                             sub_pol->element_name().c_str());
-                        bad_auth = false;
-                    }
-                }
-            }
+    if ( found ) {
+
+        if (matches) {
+            _dia("Connection identities: %s identity matches auth profile '%s'", str_af.c_str(),
+                 auth_profile->element_name().c_str());
+            bad_auth = false;
+        }
         if (bad_auth) {
             short unsigned int target_port = cx->com()->nonlocal_dst_port();
 
@@ -361,10 +355,9 @@ void SocksProxy::socks5_handoff_udp(socksServerCX* cx) {
         state().dead(true);
         return;
     }
-    else if(matched_policy() >= (signed int)CfgFactory::get()->db_policy_list.size()) {
-        _dia("SocksProxy::socks5_handoff_udp: matching policy out of policy index table: %d/%d: dropping.",
-             matched_policy(),
-             CfgFactory::get()->db_policy_list.size());
+    else if(not matched_policy_rule()) {
+        _dia("SocksProxy::socks5_handoff_udp: matching policy out of policy index table: %d: dropping.",
+             matched_policy());
         state().dead(true);
         return;
     }
@@ -387,8 +380,7 @@ void SocksProxy::socks5_handoff_udp(socksServerCX* cx) {
     }
 
     {
-        auto lc_ = std::scoped_lock(CfgFactory::lock());
-        if (CfgFactory::get()->db_policy_list.at(matched_policy())->nat == PolicyRule::POLICY_NAT_NONE) {
+        if (matched_policy_rule()->nat == PolicyRule::POLICY_NAT_NONE) {
             target_cx->com()->nonlocal_src(true);
         }
     }
@@ -398,10 +390,17 @@ void SocksProxy::socks5_handoff_udp(socksServerCX* cx) {
 
     radd(target_cx);
 
-    if( auto policy = CfgFactory::get()->lookup_policy(matched_policy()); policy) {
+    if( auto policy = matched_policy_rule(); policy) {
 
         if(policy->profile_routing and not sx::proxymaker::route_existing(this, policy->profile_routing))
             _err("SocksProxy::socks5_handoff_udp: routing failed");
+
+        // source from the pool is leased for the final (routed) destination
+        if(policy->nat == PolicyRule::POLICY_NAT_POOL and not sx::proxymaker::setup_snat_pool(this, target_cx)) {
+            _inf("SocksProxy::socks5_handoff_udp: no source from NAT pool");
+            state().dead(true);
+            return;
+        }
     }
 
     if (CfgFactory::get()->policy_apply(n_cx.get(), this, matched_policy()) < 0) {
@@ -452,6 +451,9 @@ baseHostCX* MitmSocksProxy::new_cx(int s) {
 
 void MitmSocksProxy::on_left_new(baseHostCX* just_accepted_cx) {
 
+    // sub-workers are running now, acceptor can be pinned without them inheriting its cpu
+    if(accept_stats_.on_accept()) NetworkServiceFactory::pin_acceptor(this);
+
     auto* new_proxy = new SocksProxy(com()->slave());
     // let's add this just_accepted_cx into new_proxy
     std::string h;
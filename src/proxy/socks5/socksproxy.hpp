@@ -78,12 +78,16 @@ public:
     baseHostCX* new_cx(int s) override;
     void on_left_new(baseHostCX* just_accepted_cx) override;
 
+    AcceptStats const& accept_stats() const { return accept_stats_; }
+
     std::string to_string(int lev) const override { static std::string r(string_format("MitmSocksProxy[%s]", baseProxy::to_string(lev).c_str())); return r; };
 
     TYPENAME_OVERRIDE("MitmSocksProxy")
     DECLARE_LOGGING(to_string)
 
 private:
+    AcceptStats accept_stats_;
+
     logan_lite log {"com.socks.acceptor"};
 };
 
@@ -0,0 +1,159 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <cerrno>
+#include <initializer_list>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <proxy/splicerelay.hpp>
+
+SpliceRelay::~SpliceRelay() {
+    up.close();
+    down.close();
+}
+
+bool SpliceRelay::Lane::open() {
+    if(opened()) return true;
+
+    if(::pipe2(pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        pipe[0] = pipe[1] = -1;
+        return false;
+    }
+    // best effort, default 64kB pipe makes splice slower than plain copy
+    ::fcntl(pipe[1], F_SETPIPE_SZ, static_cast<int>(chunk));
+    return true;
+}
+
+void SpliceRelay::Lane::close() {
+    for(int& fd: pipe) {
+        if(fd >= 0) ::close(fd);
+        fd = -1;
+    }
+}
+
+SpliceRelay::step_t SpliceRelay::step(int from, int to, Lane& lane) {
+
+    step_t ret;
+
+    if(not lane.opened() and not lane.eof) {
+        char c;
+        auto n = ::recv(from, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if(n == 0) {
+            lane.eof = true;
+            return ret;
+        }
+        if(n < 0) {
+            ret.error = (errno != EAGAIN and errno != EINTR);
+            return ret;
+        }
+        if(not lane.open()) {
+            ret.error = true;
+            return ret;
+        }
+    }
+
+    while(ret.read < step_max) {
+
+        // flush the pipe first, new data are read only into empty pipe
+        while(lane.pending > 0) {
+            auto n = ::splice(lane.pipe[0], nullptr, to, nullptr, lane.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if(n > 0) {
+                lane.pending -= static_cast<std::size_t>(n);
+                ret.written += static_cast<std::size_t>(n);
+                continue;
+            }
+            if(n < 0 and errno == EINTR) continue;
+            if(n < 0 and errno == EAGAIN) {
+                ret.want_write = true;
+            } else {
+                ret.error = true;
+            }
+            return ret;
+        }
+
+        if(lane.eof) break;
+
+        auto n = ::splice(from, nullptr, lane.pipe[1], nullptr, chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if(n > 0) {
+            lane.pending += static_cast<std::size_t>(n);
+            ret.read += static_cast<std::size_t>(n);
+            continue;
+        }
+        if(n == 0) {
+            lane.eof = true;
+            break;
+        }
+        if(errno == EINTR) continue;
+        if(errno != EAGAIN) ret.error = true;
+        break;
+    }
+
+    return ret;
+}
+
+SpliceRelay::round_t SpliceRelay::round(int left, int right) {
+
+    round_t ret;
+    ret.up = step(left, right, up);
+    ret.down = step(right, left, down);
+
+    if(ret.error()) return ret;
+
+    for(auto [lane, to]: { std::make_pair(&up, right), std::make_pair(&down, left) }) {
+        if(lane->finished() and not lane->shut) {
+            ::shutdown(to, SHUT_WR);
+            lane->shut = true;
+        }
+    }
+
+    // read only when there is space in the pipe, write only when pipe is blocked
+    auto watch = [](Lane const& outgoing, bool want_write) {
+        if(want_write) return watch_t::WRITE;
+        if(not outgoing.eof and outgoing.drained()) return watch_t::READ;
+        return watch_t::NONE;
+    };
+    ret.left = watch(up, ret.down.want_write);
+    ret.right = watch(down, ret.up.want_write);
+
+    return ret;
+}
@@ -0,0 +1,111 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef SPLICERELAY_HPP
+#define SPLICERELAY_HPP
+
+#include <cstddef>
+#include <sys/types.h>
+
+// Zero-copy relay of TCP payload between two sockets, using splice() through a pipe for each direction.
+// Payload never enters userspace. All calls are non-blocking: step() moves what it can and reports whether
+// it is blocked on the target socket. Pipes are created only when first payload arrives, idle session
+// costs just this object.
+
+class SpliceRelay {
+public:
+    // one direction: from-socket -> pipe -> to-socket
+    struct Lane {
+        int pipe[2] = { -1, -1 };
+        std::size_t pending = 0;    // bytes sitting in the pipe
+        bool eof = false;           // source socket was closed
+        bool shut = false;          // eof was propagated to target socket
+
+        bool opened() const { return pipe[0] >= 0; }
+        bool drained() const { return pending == 0; }
+        bool finished() const { return eof and drained(); }
+
+        // create pipe, false if not possible (fd limit)
+        bool open();
+        void close();
+    };
+
+    struct step_t {
+        std::size_t read = 0;
+        std::size_t written = 0;
+        bool want_write = false;    // target socket is full, data wait in the pipe
+        bool error = false;
+    };
+
+    // what socket should be polled for after round()
+    enum class watch_t { NONE, READ, WRITE };
+
+    struct round_t {
+        step_t up;
+        step_t down;
+        watch_t left = watch_t::READ;
+        watch_t right = watch_t::READ;
+
+        bool error() const { return up.error or down.error; }
+    };
+
+    // per step limit, so a single busy session doesn't starve the rest of the worker
+    constexpr static std::size_t step_max = 1024 * 1024;
+    // pipe capacity requested in Lane::open(); kernel may cap it (see /proc/sys/fs/pipe-max-size)
+    constexpr static std::size_t chunk = 256 * 1024;
+
+    SpliceRelay() = default;
+    ~SpliceRelay();
+
+    SpliceRelay(SpliceRelay const&) = delete;
+    SpliceRelay& operator=(SpliceRelay const&) = delete;
+
+    static step_t step(int from, int to, Lane& lane);
+
+    // step both directions, propagate half-close and tell what to poll for
+    round_t round(int left, int right);
+
+    bool finished() const { return up.finished() and down.finished(); }
+    bool half_closed() const { return up.finished() or down.finished(); }
+
+    Lane up;      // left -> right
+    Lane down;    // right -> left
+};
+
+#endif //SPLICERELAY_HPP
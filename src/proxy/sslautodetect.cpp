@@ -0,0 +1,160 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <cerrno>
+
+#include <sys/socket.h>
+
+#include <proxy/sslautodetect.hpp>
+
+SslAutodetect::result_t SslAutodetect::classify(uint8_t const* buf, std::size_t len) {
+
+    if(len < peek_size) return result_t::PENDING;
+
+    // handshake record, SSLv3/TLS major version, 16-bit length with handshake type behind
+    if(buf[0] == 0x16 && buf[1] == 0x03 && ( buf[5] == 0x00 || buf[5] == 0x01 || buf[5] == 0x02 )) {
+        return result_t::TLS;
+    }
+
+    return result_t::PLAIN;
+}
+
+SslAutodetect::result_t SslAutodetect::peek(int sock, std::size_t* buffered) {
+
+    if(sock < 0) return result_t::CLOSED;
+
+    uint8_t peek_buffer[peek_size];
+    auto b = ::recv(sock, peek_buffer, peek_size, MSG_PEEK | MSG_DONTWAIT);
+    if(buffered) *buffered = b > 0 ? static_cast<std::size_t>(b) : 0;
+
+    if(b == 0) return result_t::CLOSED;
+    if(b < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? result_t::PENDING : result_t::CLOSED;
+    }
+
+    return classify(peek_buffer, static_cast<std::size_t>(b));
+}
+
+SslAutodetect::result_t SslAutodetect::peek_hello(int sock, sx::tls::HelloInfo& out, std::size_t* buffered) {
+
+    if(sock < 0) return result_t::CLOSED;
+
+    thread_local uint8_t peek_buffer[sx::tls::ClientHello::max_size];
+    auto b = ::recv(sock, peek_buffer, sizeof(peek_buffer), MSG_PEEK | MSG_DONTWAIT);
+    if(buffered) *buffered = b > 0 ? static_cast<std::size_t>(b) : 0;
+
+    if(b == 0) return result_t::CLOSED;
+    if(b < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? result_t::PENDING : result_t::CLOSED;
+    }
+
+    sx::tls::ClientHello hello;
+    switch(sx::tls::ClientHello::parse(peek_buffer, static_cast<std::size_t>(b), hello)) {
+        case sx::tls::ClientHello::status_t::OK:
+            out = hello.info();
+            return result_t::TLS;
+
+        case sx::tls::ClientHello::status_t::INCOMPLETE:
+            return result_t::PENDING;
+
+        case sx::tls::ClientHello::status_t::INVALID:
+            break;
+    }
+    return result_t::PLAIN;
+}
+
+SslAutodetect::Probe::watch_t SslAutodetect::Probe::update(int sock) {
+
+    if(watch_ == watch_t::DONE) return watch_;
+
+    std::size_t buffered = 0;
+
+    if(result_ == result_t::PENDING) {
+        result_ = peek(sock, &buffered);
+        if(result_ == result_t::PENDING) return pending(buffered);
+    }
+
+    if(result_ != result_t::TLS or not want_hello_) return watch_ = watch_t::DONE;
+
+    sx::tls::HelloInfo info;
+    switch(peek_hello(sock, info, &buffered)) {
+        case result_t::PENDING:
+            return pending(buffered);
+
+        case result_t::TLS:
+            hello_ = std::move(info);
+            break;
+
+        case result_t::CLOSED:
+            result_ = result_t::CLOSED;
+            break;
+
+        case result_t::PLAIN:
+            // not parseable, TLS stack will deal with it
+            break;
+    }
+
+    return watch_ = watch_t::DONE;
+}
+
+bool SslAutodetect::Probe::round(int sock, clock_t::time_point now) {
+
+    if(watch_ == watch_t::IDLE) update(sock);
+    if(watch_ == watch_t::DONE) return true;
+    if(now < (result_ == result_t::PENDING ? detect_deadline_ : hello_deadline_)) return false;
+
+    if(result_ == result_t::PENDING) result_ = result_t::PLAIN;
+    watch_ = watch_t::DONE;
+
+    return true;
+}
+
+const char* SslAutodetect::str(result_t r) {
+    switch(r) {
+        case result_t::PENDING:
+            return "pending";
+        case result_t::PLAIN:
+            return "plain";
+        case result_t::TLS:
+            return "tls";
+        case result_t::CLOSED:
+            return "closed";
+    }
+    return "<?>";
+}
@@ -0,0 +1,116 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef SSLAUTODETECT_HPP
+#define SSLAUTODETECT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <optional>
+
+#include <inspect/tlshello.hpp>
+
+// Classification of a freshly accepted plaintext-port connection: does client start with TLS ClientHello?
+// Everything here is non-blocking - if not enough bytes arrived yet, result is PENDING and caller decides
+// whether to wait for more (from its event loop) or give up.
+
+struct SslAutodetect {
+
+    using result_t = enum class result { PENDING, PLAIN, TLS, CLOSED };
+
+    // minimum bytes needed to make a decision: record header + handshake type
+    constexpr static std::size_t peek_size = 6;
+
+    static result_t classify(uint8_t const* buf, std::size_t len);
+
+    // MSG_PEEK the socket, data stay in the kernel buffer for the real reader. @buffered (if set) receives
+    // number of bytes seen.
+    static result_t peek(int sock, std::size_t* buffered = nullptr);
+
+    // MSG_PEEK the first flight and parse ClientHello from it. TLS: @out is filled, PENDING: hello is not
+    // complete yet, PLAIN: data can't be parsed as ClientHello.
+    static result_t peek_hello(int sock, sx::tls::HelloInfo& out, std::size_t* buffered = nullptr);
+
+    static const char* str(result_t r);
+
+    // Decision about one accepted connection, driven by its socket events (update) and by rounds of the
+    // owning event loop (round). It doesn't own the socket, it tells the caller how to watch it instead.
+    class Probe {
+    public:
+        using clock_t = std::chrono::steady_clock;
+
+        // READ: wait until socket is readable
+        // IDLE: some bytes are buffered, but not enough - don't wait for readable socket (level-triggered
+        //       poller would report it again right away), round() re-checks it
+        // DONE: decision is made
+        using watch_t = enum class watch { READ, IDLE, DONE };
+
+        // @tls_known: connection is TLS already (by port), only ClientHello is awaited
+        // @detect_deadline: silent connection is considered plaintext after it
+        // @hello_deadline: TLS connection stops waiting for complete ClientHello after it
+        Probe(clock_t::time_point detect_deadline, clock_t::time_point hello_deadline, bool tls_known, bool want_hello) :
+                detect_deadline_(detect_deadline),
+                hello_deadline_(hello_deadline),
+                want_hello_(want_hello),
+                result_(tls_known ? result_t::TLS : result_t::PENDING) {}
+
+        watch_t update(int sock);
+
+        // re-check idle socket and apply deadlines (silent connection is then considered plaintext, TLS
+        // connection continues without early ClientHello); true once decided
+        bool round(int sock, clock_t::time_point now);
+
+        watch_t watch() const { return watch_; }
+        result_t const& result() const { return result_; }
+        std::optional<sx::tls::HelloInfo>& hello() { return hello_; }
+
+    private:
+        watch_t pending(std::size_t buffered) { return watch_ = (buffered > 0 ? watch_t::IDLE : watch_t::READ); }
+
+        clock_t::time_point detect_deadline_;
+        clock_t::time_point hello_deadline_;
+        bool want_hello_;
+        result_t result_;
+        watch_t watch_ = watch_t::READ;
+        std::optional<sx::tls::HelloInfo> hello_;
+    };
+};
+
+#endif //SSLAUTODETECT_HPP
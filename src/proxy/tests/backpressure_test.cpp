@@ -0,0 +1,166 @@
+#include <proxy/backpressure.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+TEST(Backpressure, Watermarks) {
+    auto& budget = WriteBudget::get();
+    budget.limit = 0;
+
+    Watermark::marks_t const marks { 1000, 100 };
+    {
+        Watermark wm;
+        EXPECT_EQ(wm.update(500, marks), Watermark::change_t::NONE);
+        EXPECT_EQ(wm.update(1000, marks), Watermark::change_t::PAUSE);
+        EXPECT_EQ(budget.throttled.load(), 1U);
+        EXPECT_EQ(wm.update(500, marks), Watermark::change_t::NONE);
+        EXPECT_EQ(wm.update(100, marks), Watermark::change_t::RESUME);
+        EXPECT_EQ(budget.throttled.load(), 0U);
+
+        EXPECT_EQ(wm.update(2000, marks), Watermark::change_t::PAUSE);
+        EXPECT_EQ(budget.used.load(), 2000U);
+    }
+    // destroyed session gives everything back
+    EXPECT_EQ(budget.used.load(), 0U);
+    EXPECT_EQ(budget.throttled.load(), 0U);
+
+    // over budget, sessions pause already at low watermark
+    budget.limit = 1500;
+    {
+        Watermark a, b, c;
+        EXPECT_EQ(a.update(900, marks), Watermark::change_t::NONE);
+        EXPECT_EQ(b.update(900, marks), Watermark::change_t::PAUSE);
+        EXPECT_EQ(a.update(900, marks), Watermark::change_t::PAUSE);
+        EXPECT_EQ(c.update(1500, marks), Watermark::change_t::PAUSE);
+        EXPECT_EQ(b.update(50, marks), Watermark::change_t::NONE);     // below low, but budget is still exceeded
+        EXPECT_EQ(b.update(0, marks), Watermark::change_t::RESUME);    // nothing queued
+        EXPECT_EQ(c.update(0, marks), Watermark::change_t::RESUME);
+        EXPECT_EQ(a.update(50, marks), Watermark::change_t::RESUME);
+        EXPECT_EQ(budget.throttled_total.load(), 5U);
+    }
+    budget.limit = 0;
+}
+
+// Fast sender -> relay -> slow reader, relay stops polling for input at high watermark.
+TEST(Backpressure, SlowReader) {
+
+    constexpr std::size_t transfer = 32 * 1024 * 1024;
+    constexpr std::size_t read_chunk = 64 * 1024;
+
+    auto run = [&](bool bounded) {
+        int in[2], out[2];
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, in), 0);
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, out), 0);
+        ::fcntl(in[1], F_SETFL, O_NONBLOCK);
+        ::fcntl(out[0], F_SETFL, O_NONBLOCK);
+
+        std::thread sender([&]() {
+            std::vector<char> buf(read_chunk, 's');
+            std::size_t sent = 0;
+            while(sent < transfer) {
+                auto n = ::write(in[0], buf.data(), std::min(buf.size(), transfer - sent));
+                if(n <= 0) break;
+                sent += n;
+            }
+            ::shutdown(in[0], SHUT_WR);
+        });
+
+        std::atomic_size_t received = 0;
+        std::thread reader([&]() {
+            std::vector<char> buf(16 * 1024);
+            while(true) {
+                auto n = ::read(out[1], buf.data(), buf.size());
+                if(n <= 0) break;
+                received += n;
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+
+        int ep = ::epoll_create1(0);
+        auto watch = [&](int fd, uint32_t events, int op) {
+            epoll_event ev {};
+            ev.events = events;
+            ev.data.fd = fd;
+            ::epoll_ctl(ep, op, fd, &ev);
+        };
+        watch(in[1], EPOLLIN, EPOLL_CTL_ADD);
+        watch(out[0], 0, EPOLL_CTL_ADD);
+
+        Watermark::marks_t const marks { 1024 * 1024, 256 * 1024 };
+        Watermark wm;
+        std::string queue;
+        std::size_t max_queued = 0;
+        uint64_t pauses = 0;
+        bool eof = false;
+
+        std::vector<char> buf(read_chunk);
+        while(not eof or not queue.empty()) {
+            epoll_event events[2];
+            auto nev = ::epoll_wait(ep, events, 2, 100);
+
+            for(int i = 0; i < nev; ++i) {
+                if(events[i].data.fd == in[1]) {
+                    auto n = ::read(in[1], buf.data(), buf.size());
+                    if(n > 0) queue.append(buf.data(), n);
+                    else if(n == 0) { eof = true; watch(in[1], 0, EPOLL_CTL_MOD); }
+                }
+            }
+
+            if(not queue.empty()) {
+                auto n = ::send(out[0], queue.data(), queue.size(), MSG_NOSIGNAL);
+                if(n > 0) queue.erase(0, n);
+            }
+            max_queued = std::max(max_queued, queue.size());
+
+            if(bounded and not eof) {
+                switch (wm.update(queue.size(), marks)) {
+                    case Watermark::change_t::PAUSE:
+                        ++pauses;
+                        watch(in[1], 0, EPOLL_CTL_MOD);
+                        break;
+                    case Watermark::change_t::RESUME:
+                        watch(in[1], EPOLLIN, EPOLL_CTL_MOD);
+                        break;
+                    case Watermark::change_t::NONE:
+                        break;
+                }
+            }
+            watch(out[0], queue.empty() ? 0U : static_cast<uint32_t>(EPOLLOUT), EPOLL_CTL_MOD);
+        }
+
+        ::shutdown(out[0], SHUT_WR);
+        sender.join();
+        reader.join();
+        wm.release();
+        ::close(ep);
+        for(int fd: { in[0], in[1], out[0], out[1] }) ::close(fd);
+
+        EXPECT_EQ(received.load(), transfer);
+        if(bounded) {
+            EXPECT_GT(pauses, 0U);
+            EXPECT_LE(max_queued, marks.high + read_chunk);
+        }
+        else {
+            // slow reader makes unbounded queue grow past the mark, otherwise the bound above proves nothing
+            EXPECT_GT(max_queued, marks.high + read_chunk);
+        }
+    };
+
+    run(false);
+    run(true);
+
+    EXPECT_EQ(WriteBudget::get().used.load(), 0U);
+    EXPECT_EQ(WriteBudget::get().throttled.load(), 0U);
+}
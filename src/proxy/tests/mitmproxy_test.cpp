@@ -0,0 +1,197 @@
+#include <proxy/mitmproxy.hpp>
+#include <proxy/mitmhost.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <tcpcom.hpp>
+
+namespace {
+
+    void set_nonblocking(int fd) { ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK); }
+
+    // proxy with both sides on socket pairs: client() and server() are the far ends
+    struct Session {
+        int left[2] {-1, -1};
+        int right[2] {-1, -1};
+        std::unique_ptr<MitmProxy> proxy;
+        MitmHostCX* lcx = nullptr;
+        MitmHostCX* rcx = nullptr;
+
+        Session() {
+            ::socketpair(AF_UNIX, SOCK_STREAM, 0, left);
+            ::socketpair(AF_UNIX, SOCK_STREAM, 0, right);
+            set_nonblocking(left[1]);
+            set_nonblocking(right[0]);
+
+            proxy = std::make_unique<MitmProxy>(new TCPCom());
+            lcx = new MitmHostCX(new TCPCom(), left[1]);
+            rcx = new MitmHostCX(new TCPCom(), right[0]);
+            lcx->peer(rcx);
+            rcx->peer(lcx);
+            proxy->ladd(lcx);
+            proxy->radd(rcx);
+        }
+        ~Session() {
+            // proxy sides are closed by their cx
+            proxy.reset();
+            ::close(left[0]);
+            ::close(right[1]);
+        }
+
+        int client() const { return left[0]; }
+        int server() const { return right[1]; }
+    };
+
+    std::string pattern(std::size_t len) {
+        std::string ret(len, '\0');
+        for(std::size_t i = 0; i < len; ++i) ret[i] = static_cast<char>(i % 251);
+        return ret;
+    }
+
+    // read what is available, at most @max bytes
+    void drain(int fd, std::string& out, std::size_t max) {
+        char buf[4096];
+        while(max > 0) {
+            auto r = ::recv(fd, buf, std::min(sizeof(buf), max), MSG_DONTWAIT);
+            if(r <= 0) break;
+            out.append(buf, static_cast<std::size_t>(r));
+            max -= static_cast<std::size_t>(r);
+        }
+    }
+}
+
+// Backlogged peer is written from segment chain: payload delivered while the chain is not empty is queued
+// behind it, nothing is lost or reordered, and it all goes through sendmsg() of sg_round().
+TEST(MitmProxy, SegmentChainDelivery) {
+    auto const saved = MitmProxy::opt_sg_write;
+    MitmProxy::opt_sg_write = true;
+
+    Session s;
+    int small = 4096;
+    ::setsockopt(s.right[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+
+    auto const payload = pattern(1024 * 1024);
+    constexpr std::size_t chunk = 16 * 1024;
+
+    auto const sg_before = MitmProxy::sg_bytes().load();
+    std::string received;
+
+    for(std::size_t off = 0; off < payload.size(); off += chunk) {
+        buffer b;
+        b.append(payload.data() + off, std::min(chunk, payload.size() - off));
+        s.proxy->deliver(s.rcx, b);
+        s.proxy->sg_round();
+
+        // slow server
+        drain(s.server(), received, chunk / 4);
+    }
+
+    for(int i = 0; i < 10000 and received.size() < payload.size(); ++i) {
+        s.proxy->sg_round();
+        drain(s.server(), received, payload.size());
+    }
+
+    MitmProxy::opt_sg_write = saved;
+
+    ASSERT_FALSE(s.proxy->state().dead());
+    ASSERT_EQ(received.size(), payload.size());
+    ASSERT_TRUE(received == payload);
+    ASSERT_EQ(s.proxy->write_queued(s.rcx), 0U);
+    ASSERT_EQ(MitmProxy::sg_bytes().load() - sg_before, payload.size());
+}
+
+// Server doesn't keep up: reading from client pauses once server's queue passes the high mark, and resumes when
+// the server has read it down.
+TEST(MitmProxy, BackpressureSlowReader) {
+    auto const saved_sg = MitmProxy::opt_sg_write;
+    auto const saved_marks = MitmProxy::opt_write_marks;
+    MitmProxy::opt_sg_write = true;
+    MitmProxy::opt_write_marks = { 256 * 1024, 64 * 1024 };
+
+    auto& budget = WriteBudget::get();
+    auto const throttled = budget.throttled.load();
+
+    {
+        Session s;
+        int small = 4096;
+        ::setsockopt(s.right[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+
+        auto const payload = pattern(1024 * 1024);
+        constexpr std::size_t chunk = 16 * 1024;
+        std::string received;
+
+        // proxy keeps reading from client only while not paused
+        std::size_t off = 0;
+        while(off < payload.size() and budget.throttled.load() == throttled) {
+            buffer b;
+            b.append(payload.data() + off, chunk);
+            off += chunk;
+
+            s.proxy->deliver(s.rcx, b);
+            s.proxy->sg_round();
+            s.proxy->backpressure_round();
+        }
+        ASSERT_EQ(budget.throttled.load(), throttled + 1);
+        ASSERT_GE(s.proxy->write_queued(s.rcx), MitmProxy::opt_write_marks.high);
+        ASSERT_LT(off, payload.size());
+
+        // server reads slowly; paused session doesn't take more from client
+        for(int i = 0; i < 10000 and budget.throttled.load() != throttled; ++i) {
+            drain(s.server(), received, 4096);
+            s.proxy->sg_round();
+            s.proxy->backpressure_round();
+        }
+        ASSERT_EQ(budget.throttled.load(), throttled);
+        ASSERT_LE(s.proxy->write_queued(s.rcx), MitmProxy::opt_write_marks.low);
+
+        for(int i = 0; i < 10000 and received.size() < off; ++i) {
+            s.proxy->sg_round();
+            drain(s.server(), received, off);
+        }
+        ASSERT_TRUE(received == payload.substr(0, off));
+    }
+
+    MitmProxy::opt_sg_write = saved_sg;
+    MitmProxy::opt_write_marks = saved_marks;
+}
+
+// Sessions with more peers on a side are paused by their most backlogged peer.
+TEST(MitmProxy, BackpressureMorePeers) {
+    auto const saved_marks = MitmProxy::opt_write_marks;
+    MitmProxy::opt_write_marks = { 64 * 1024, 16 * 1024 };
+
+    auto& budget = WriteBudget::get();
+    auto const throttled = budget.throttled.load();
+
+    {
+        Session s;
+
+        int extra[2] {-1, -1};
+        ::socketpair(AF_UNIX, SOCK_STREAM, 0, extra);
+        set_nonblocking(extra[0]);
+        auto* second = new MitmHostCX(new TCPCom(), extra[0]);
+        s.proxy->radd(second);
+
+        auto const payload = pattern(128 * 1024);
+        buffer b;
+        b.append(payload.data(), payload.size());
+        s.proxy->deliver(second, b);
+
+        s.proxy->backpressure_round();
+        ASSERT_EQ(budget.throttled.load(), throttled + 1);
+
+        s.proxy.reset();
+        ::close(extra[1]);
+    }
+
+    ASSERT_EQ(budget.throttled.load(), throttled);
+    MitmProxy::opt_write_marks = saved_marks;
+}
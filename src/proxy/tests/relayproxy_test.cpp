@@ -0,0 +1,62 @@
+#include <proxy/relayproxy.hpp>
+#include <proxy/mitmhost.hpp>
+
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <malloc.h>
+
+#include <tcpcom.hpp>
+
+namespace {
+
+    std::size_t heap_in_use() { return mallinfo2().uordblks; }
+
+    // average heap held by a session created by @make, with both sides attached, not connected
+    template <typename F>
+    std::size_t heap_per_session(std::size_t count, F make) {
+        std::vector<std::unique_ptr<baseProxy>> sessions;
+        sessions.reserve(count);
+
+        auto const before = heap_in_use();
+        for(std::size_t i = 0; i < count; ++i) sessions.emplace_back(make());
+        auto const after = heap_in_use();
+
+        return after > before ? (after - before) / count : 0;
+    }
+
+    template <class Proxy, class CX>
+    std::unique_ptr<baseProxy> make_session() {
+        auto proxy = std::make_unique<Proxy>(new TCPCom());
+
+        auto* left = new CX(new TCPCom(), "192.0.2.1", "40000");
+        auto* right = new CX(new TCPCom(), "198.51.100.1", "80");
+        left->peer(right);
+        right->peer(left);
+
+        proxy->ladd(left);
+        proxy->radd(right);
+
+        return proxy;
+    }
+}
+
+// pass-through sessions are handed over to relay to keep thousands of idle connections cheap
+TEST(RelayProxy, HeapPerSession) {
+    constexpr std::size_t sessions = 2000;
+
+    // warm up allocator caches, so the first measurement isn't charged for them
+    heap_per_session(sessions / 10, make_session<MitmProxy, MitmHostCX>);
+    heap_per_session(sessions / 10, make_session<RelayProxy, baseHostCX>);
+
+    auto const mitm = heap_per_session(sessions, make_session<MitmProxy, MitmHostCX>);
+    auto const relay = heap_per_session(sessions, make_session<RelayProxy, baseHostCX>);
+
+    std::cout << "heap per session: MitmProxy+MitmHostCX " << mitm << " bytes, RelayProxy+baseHostCX " << relay << " bytes\n";
+
+    ASSERT_GT(relay, 0U);
+    ASSERT_LT(relay, mitm);
+}
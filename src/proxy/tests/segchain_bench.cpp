@@ -0,0 +1,114 @@
+// Contiguous write buffer vs. segment chain: syscalls and copies per MB. Not part of sx_gtests: ratios are
+// only printed, chain behaviour is checked in segchain_test.cpp.
+
+#include <proxy/segchain.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Compare contiguous write buffer (append, write, erase front) with segment chain flushed once per loop round.
+// Reads of random size arrive in bursts, receiver is slower than sender, so the write queue builds up.
+TEST(SegmentChainBench, SyscallsAndCopies) {
+
+    constexpr std::size_t transfer = 64 * 1024 * 1024;
+
+    auto run = [&](bool chained) {
+        int sv[2];
+        EXPECT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+        std::atomic_bool done = false;
+        std::atomic_size_t received = 0;
+        std::thread reader([&]() {
+            std::vector<char> buf(32 * 1024);
+            while(true) {
+                auto n = ::read(sv[1], buf.data(), buf.size());
+                if(n <= 0) break;
+                received += n;
+                if(received % (1024 * 1024) < static_cast<std::size_t>(n)) std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            done = true;
+        });
+
+        std::mt19937 rng(7);
+        std::vector<uint8_t> chunk(16 * 1024, 'z');
+
+        uint64_t syscalls = 0;
+        uint64_t copied = 0;
+
+        std::vector<uint8_t> wbuf;   // contiguous write buffer
+        SegmentChain chain;
+
+        std::size_t produced = 0;
+        while(produced < transfer or not wbuf.empty() or not chain.empty()) {
+
+            auto const reads = (produced < transfer) ? 1 + rng() % 8 : 0;
+            for(unsigned i = 0; i < reads; ++i) {
+                auto const len = 512 + rng() % (chunk.size() - 512);
+                produced += len;
+
+                if(chained) {
+                    chain.push(chunk.data(), len);
+                }
+                else {
+                    // append: copy, plus moving everything on reallocation
+                    if(wbuf.size() + len > wbuf.capacity()) copied += wbuf.size();
+                    wbuf.insert(wbuf.end(), chunk.data(), chunk.data() + len);
+                    copied += len;
+
+                    // each read is followed by write attempt
+                    ++syscalls;
+                    auto n = ::send(sv[0], wbuf.data(), wbuf.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+                    if(n > 0) {
+                        copied += wbuf.size() - n;
+                        wbuf.erase(wbuf.begin(), wbuf.begin() + n);
+                    }
+                }
+            }
+
+            if(chained) {
+                chain.send(sv[0]);
+            }
+            else if(reads == 0 and not wbuf.empty()) {
+                ++syscalls;
+                auto n = ::send(sv[0], wbuf.data(), wbuf.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+                if(n > 0) {
+                    copied += wbuf.size() - n;
+                    wbuf.erase(wbuf.begin(), wbuf.begin() + n);
+                }
+            }
+
+            if(chain.size() + wbuf.size() > 4 * 1024 * 1024) {
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+        }
+
+        ::shutdown(sv[0], SHUT_WR);
+        reader.join();
+        ::close(sv[0]);
+        ::close(sv[1]);
+
+        EXPECT_EQ(received.load(), produced);
+
+        if(chained) {
+            syscalls = chain.stats().syscalls;
+            copied = chain.stats().copied;
+        }
+
+        double const mb = static_cast<double>(produced) / (1024 * 1024);
+        std::cout << (chained ? "segment chain:     " : "contiguous buffer: ")
+                  << static_cast<double>(syscalls) / mb << " syscalls/MB, "
+                  << static_cast<double>(copied) / mb / (1024 * 1024) << " MB copied/MB\n";
+    };
+
+    run(false);
+    run(true);
+}
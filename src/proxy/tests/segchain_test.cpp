@@ -0,0 +1,157 @@
+#include <proxy/segchain.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+    std::string drain(int fd) {
+        std::string ret;
+        char buf[65536];
+        while(true) {
+            auto n = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if(n <= 0) break;
+            ret.append(buf, n);
+        }
+        return ret;
+    }
+
+    uint8_t const* bytes(std::string const& s) { return reinterpret_cast<uint8_t const*>(s.data()); }
+}
+
+TEST(SegmentChain, PushConsume) {
+    SegmentChain chain;
+
+    std::string a = "hello ", b = "world", big(SegmentChain::segment_size * 2, 'x');
+    chain.push(bytes(a), a.size());
+    chain.push(bytes(b), b.size());
+    EXPECT_EQ(chain.segments(), 1U);    // coalesced into one segment
+    chain.push(bytes(big), big.size());
+    EXPECT_EQ(chain.segments(), 2U);
+    EXPECT_EQ(chain.size(), a.size() + b.size() + big.size());
+
+    chain.consume(3);
+    iovec vec[4];
+    ASSERT_EQ(chain.iov(vec, 4), 2U);
+    EXPECT_EQ(std::string(static_cast<char*>(vec[0].iov_base), vec[0].iov_len), "lo world");
+
+    chain.consume(8 + 10);
+    EXPECT_EQ(chain.segments(), 1U);
+    EXPECT_EQ(chain.size(), big.size() - 10);
+
+    EXPECT_EQ(chain.stats().copied, a.size() + b.size() + big.size());
+}
+
+TEST(SegmentChain, SharedSegment) {
+    std::string payload = "shared payload";
+    auto seg = SegmentChain::make_segment(bytes(payload), payload.size());
+
+    SegmentChain c1, c2;
+    c1.push(seg);
+    c2.push(seg);
+    c1.consume(7);
+
+    std::string out1, out2;
+    c1.for_each([&](uint8_t const* d, std::size_t l) { out1.append(reinterpret_cast<char const*>(d), l); });
+    c2.for_each([&](uint8_t const* d, std::size_t l) { out2.append(reinterpret_cast<char const*>(d), l); });
+    EXPECT_EQ(out1, "payload");
+    EXPECT_EQ(out2, payload);
+    EXPECT_EQ(c1.stats().copied + c2.stats().copied, 0U);
+
+    // appending to one chain must not extend the other's view of the segment
+    c2.push(bytes(payload), payload.size());
+    c1.push(bytes(payload), payload.size());
+    out1.clear();
+    c1.for_each([&](uint8_t const* d, std::size_t l) { out1.append(reinterpret_cast<char const*>(d), l); });
+    EXPECT_EQ(out1, "payload" + payload);
+}
+
+TEST(SegmentChain, PartialSend) {
+    int sv[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    int sz = 4096;
+    ::setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz));
+
+    std::string data;
+    for(int i = 0; data.size() < 1024 * 1024; ++i) data += std::to_string(i) + ",";
+
+    SegmentChain chain;
+    for(std::size_t off = 0; off < data.size(); off += 1000) {
+        chain.push(bytes(data) + off, std::min<std::size_t>(1000, data.size() - off));
+    }
+
+    std::string received;
+    while(not chain.empty()) {
+        auto r = chain.send(sv[0]);
+        ASSERT_FALSE(r.error);
+        received += drain(sv[1]);
+    }
+    received += drain(sv[1]);
+    EXPECT_EQ(received, data);
+
+    ::close(sv[1]);
+    chain.push(bytes(data), 10);
+    EXPECT_TRUE(chain.send(sv[0]).error);
+    ::close(sv[0]);
+}
+
+// Bursts of reads queue up behind slow receiver; chain copies each byte once and delivers all of it.
+TEST(SegmentChain, SlowReceiver) {
+
+    constexpr std::size_t transfer = 8 * 1024 * 1024;
+
+    int sv[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+    std::atomic_size_t received = 0;
+    std::thread reader([&]() {
+        std::vector<char> buf(32 * 1024);
+        while(true) {
+            auto n = ::read(sv[1], buf.data(), buf.size());
+            if(n <= 0) break;
+            received += n;
+            if(received % (1024 * 1024) < static_cast<std::size_t>(n)) std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    });
+
+    std::mt19937 rng(7);
+    std::vector<uint8_t> chunk(16 * 1024, 'z');
+    SegmentChain chain;
+
+    std::size_t produced = 0;
+    while(produced < transfer or not chain.empty()) {
+
+        auto const reads = (produced < transfer) ? 1 + rng() % 8 : 0;
+        for(unsigned i = 0; i < reads; ++i) {
+            auto const len = 512 + rng() % (chunk.size() - 512);
+            produced += len;
+            chain.push(chunk.data(), len);
+        }
+
+        ASSERT_FALSE(chain.send(sv[0]).error);
+
+        if(chain.size() > 4 * 1024 * 1024) {
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+    }
+
+    ::shutdown(sv[0], SHUT_WR);
+    reader.join();
+    ::close(sv[0]);
+    ::close(sv[1]);
+
+    EXPECT_EQ(received.load(), produced);
+    EXPECT_EQ(chain.stats().sent, produced);
+    EXPECT_EQ(chain.stats().copied, produced);
+}
@@ -0,0 +1,170 @@
+// Splice vs. read/write relay throughput over loopback. Not part of sx_gtests: rates are only printed,
+// transfer and lane checks are in splicerelay_test.cpp.
+
+#include <proxy/splicerelay.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+namespace {
+
+    constexpr std::size_t transfer_size = 256 * 1024 * 1024;
+
+    // connected loopback TCP pair: [0] is client side, [1] is accepted side
+    bool tcp_pair(int fds[2]) {
+        int lfd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in sin {};
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(bind(lfd, reinterpret_cast<sockaddr*>(&sin), sizeof(sin)) < 0 or listen(lfd, 1) < 0) {
+            ::close(lfd);
+            return false;
+        }
+        socklen_t len = sizeof(sin);
+        getsockname(lfd, reinterpret_cast<sockaddr*>(&sin), &len);
+
+        fds[0] = ::socket(AF_INET, SOCK_STREAM, 0);
+        if(connect(fds[0], reinterpret_cast<sockaddr*>(&sin), sizeof(sin)) < 0) {
+            ::close(lfd);
+            return false;
+        }
+        fds[1] = ::accept(lfd, nullptr, nullptr);
+        ::close(lfd);
+        return fds[1] >= 0;
+    }
+
+    void set_nonblocking(int fd) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    // classic userspace copy, what proxy does for non-spliced sessions
+    bool copy_step(int from, int to, std::vector<char>& buf, std::size_t& pending, bool& eof) {
+        while(true) {
+            while(pending > 0) {
+                auto n = ::write(to, buf.data(), pending);
+                if(n < 0) return errno == EAGAIN;
+                std::memmove(buf.data(), buf.data() + n, pending - n);
+                pending -= static_cast<std::size_t>(n);
+            }
+            if(eof) return true;
+
+            auto n = ::read(from, buf.data(), buf.size());
+            if(n == 0) { eof = true; continue; }
+            if(n < 0) return errno == EAGAIN;
+            pending = static_cast<std::size_t>(n);
+        }
+    }
+
+    double thread_cpu() {
+        rusage ru {};
+        ::getrusage(RUSAGE_THREAD, &ru);
+        return static_cast<double>(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+               static_cast<double>(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+    }
+
+    struct result_t {
+        double mbps = 0;
+        double relay_cpu = 0;   // seconds spent by the relaying thread
+    };
+
+    // source -> [relay] -> sink; relay body is driven by @relay_once, returns false when done
+    result_t run_relay(std::function<bool(int, int)> const& relay_once, std::size_t& received) {
+        int src[2], dst[2];
+        if(not tcp_pair(src) or not tcp_pair(dst)) return {};
+
+        set_nonblocking(src[1]);
+        set_nonblocking(dst[0]);
+
+        received = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        std::thread producer([fd = src[0]] {
+            std::vector<char> chunk(256 * 1024);
+            for(std::size_t i = 0; i < chunk.size(); ++i) chunk[i] = static_cast<char>(i % 251);
+
+            std::size_t sent = 0;
+            while(sent < transfer_size) {
+                auto n = ::write(fd, chunk.data(), std::min(chunk.size(), transfer_size - sent));
+                if(n <= 0) break;
+                sent += static_cast<std::size_t>(n);
+            }
+            ::shutdown(fd, SHUT_WR);
+        });
+
+        std::thread consumer([fd = dst[1], &received] {
+            std::vector<char> chunk(256 * 1024);
+            bool ok = true;
+            while(true) {
+                auto n = ::read(fd, chunk.data(), chunk.size());
+                if(n <= 0) break;
+                // sample one byte per read, full compare would dominate the measurement
+                auto pos = received + static_cast<std::size_t>(n) / 2;
+                ok = ok and chunk[n / 2] == static_cast<char>(pos % (256 * 1024) % 251);
+                received += static_cast<std::size_t>(n);
+            }
+            if(not ok) received = 0;
+        });
+
+        auto cpu_start = thread_cpu();
+        while(relay_once(src[1], dst[0])) {
+            pollfd p[2] = { { src[1], POLLIN, 0 }, { dst[0], POLLOUT, 0 } };
+            ::poll(p, 2, 10);
+        }
+        ::shutdown(dst[0], SHUT_WR);
+        auto cpu = thread_cpu() - cpu_start;
+
+        producer.join();
+        consumer.join();
+
+        auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for(int fd: { src[0], src[1], dst[0], dst[1] }) ::close(fd);
+
+        return { static_cast<double>(transfer_size) / (1024 * 1024) / secs, cpu };
+    }
+}
+
+TEST(SpliceRelayBench, LoopbackThroughput) {
+
+    SpliceRelay relay;
+
+    std::size_t spliced = 0;
+    std::size_t received = 0;
+    auto splice_rate = run_relay([&](int from, int to) {
+        auto r = SpliceRelay::step(from, to, relay.up);
+        spliced += r.written;
+        EXPECT_FALSE(r.error);
+        return not r.error and not relay.up.finished();
+    }, received);
+
+    ASSERT_EQ(received, transfer_size);
+    ASSERT_EQ(spliced, transfer_size);
+
+    std::vector<char> buf(64 * 1024);
+    std::size_t pending = 0;
+    bool eof = false;
+    auto copy_rate = run_relay([&](int from, int to) {
+        return copy_step(from, to, buf, pending, eof) and not (eof and pending == 0);
+    }, received);
+
+    ASSERT_EQ(received, transfer_size);
+
+    std::cout << "splice relay: " << static_cast<int>(splice_rate.mbps) << " MB/s, cpu " << splice_rate.relay_cpu << "s\n"
+              << "read/write relay: " << static_cast<int>(copy_rate.mbps) << " MB/s, cpu " << copy_rate.relay_cpu << "s\n";
+}
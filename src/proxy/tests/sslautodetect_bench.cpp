@@ -0,0 +1,169 @@
+// Throughput of first flight classification in acceptor-like loop. Not part of sx_gtests: rates are only
+// printed, classification and deadline checks are in sslautodetect_test.cpp.
+
+#include <proxy/sslautodetect.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+
+namespace {
+    // TLS record header + ClientHello handshake type
+    constexpr uint8_t client_hello[] = { 0x16, 0x03, 0x01, 0x00, 0xc8, 0x01, 0x00, 0x00, 0xc4, 0x03, 0x03 };
+    constexpr char http_get[] = "GET / HTTP/1.1\r\n";
+
+    int listen_local(int& fd) {
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in sin {};
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(bind(fd, reinterpret_cast<sockaddr*>(&sin), sizeof(sin)) < 0) return -1;
+        if(listen(fd, 1024) < 0) return -1;
+
+        socklen_t len = sizeof(sin);
+        getsockname(fd, reinterpret_cast<sockaddr*>(&sin), &len);
+        return ntohs(sin.sin_port);
+    }
+
+    int connect_local(uint16_t port) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in sin {};
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sin.sin_port = htons(port);
+        if(connect(fd, reinterpret_cast<sockaddr*>(&sin), sizeof(sin)) < 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+}
+
+// Slow clients connect and stay silent (or send only a part of record header), fast ones send ClientHello
+// or HTTP right away. Acceptor loop - socket events drive Probe::update(), every round calls Probe::round() -
+// classifies fast clients while slow ones wait for their deadline.
+TEST(SslAutodetectBench, SlowClients) {
+    using clock_t = SslAutodetect::Probe::clock_t;
+    using watch_t = SslAutodetect::Probe::watch_t;
+
+    constexpr int slow_clients = 64;
+    constexpr int fast_clients = 512;
+    constexpr auto timeout = std::chrono::milliseconds(50);
+
+    int lfd = -1;
+    auto port = listen_local(lfd);
+    ASSERT_GT(port, 0);
+    ::fcntl(lfd, F_SETFL, O_NONBLOCK);
+
+    std::vector<int> clients;
+    std::thread generator([&clients, port]() {
+        for(int i = 0; i < slow_clients + fast_clients; ++i) {
+            int fd = connect_local(port);
+            if(fd < 0) continue;
+
+            clients.push_back(fd);
+            // every 9th client is slow, half of them send incomplete record header
+            if(i % 9 == 0 and i / 9 < slow_clients) {
+                if(i % 2) ::send(fd, client_hello, 3, 0);
+                continue;
+            }
+
+            if(i % 2) ::send(fd, client_hello, sizeof(client_hello), 0);
+            else      ::send(fd, http_get, sizeof(http_get) - 1, 0);
+        }
+    });
+
+    // level-triggered, as acceptor's poller
+    int efd = epoll_create1(0);
+    epoll_event ev { EPOLLIN, {} };
+    ev.data.fd = lfd;
+    epoll_ctl(efd, EPOLL_CTL_ADD, lfd, &ev);
+
+    std::unordered_map<int, SslAutodetect::Probe> pending;
+    std::unordered_map<SslAutodetect::result_t, int> results;
+    int classified_by_data = 0;
+    int wakeups = 0;
+
+    auto const start = clock_t::now();
+    clock_t::time_point last_fast = start;
+
+    auto decide = [&](int fd, bool by_data) {
+        auto const& probe = pending.at(fd);
+        results[probe.result()]++;
+        if(by_data) {
+            classified_by_data++;
+            last_fast = clock_t::now();
+        }
+        epoll_ctl(efd, EPOLL_CTL_DEL, fd, nullptr);
+        pending.erase(fd);
+        ::close(fd);
+    };
+
+    // what the task does with the poller after update
+    auto watch = [&](int fd, watch_t w) {
+        if(w == watch_t::DONE) {
+            decide(fd, true);
+            return;
+        }
+        epoll_event pev { w == watch_t::READ ? static_cast<uint32_t>(EPOLLIN) : 0U, {} };
+        pev.data.fd = fd;
+        if(epoll_ctl(efd, EPOLL_CTL_MOD, fd, &pev) != 0) epoll_ctl(efd, EPOLL_CTL_ADD, fd, &pev);
+    };
+
+    while(results[SslAutodetect::result_t::TLS] + results[SslAutodetect::result_t::PLAIN] < slow_clients + fast_clients
+          and clock_t::now() - start < std::chrono::seconds(10)) {
+
+        epoll_event events[64];
+        int n = epoll_wait(efd, events, 64, 5);
+
+        for(int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+
+            if(fd == lfd) {
+                for(int s = ::accept(lfd, nullptr, nullptr); s >= 0; s = ::accept(lfd, nullptr, nullptr)) {
+                    auto const deadline = clock_t::now() + timeout;
+                    auto [ it, _ ] = pending.try_emplace(s, deadline, deadline, false, false);
+                    watch(s, it->second.update(s));
+                }
+                continue;
+            }
+
+            if(auto it = pending.find(fd); it != pending.end()) {
+                wakeups++;
+                watch(fd, it->second.update(fd));
+            }
+        }
+
+        // acceptor round
+        auto now = clock_t::now();
+        std::vector<int> decided;
+        for(auto& [fd, probe]: pending) {
+            if(probe.round(fd, now)) decided.push_back(fd);
+        }
+        for(int fd: decided) decide(fd, false);
+    }
+
+    generator.join();
+    for(int fd: clients) ::close(fd);
+    ::close(efd);
+    ::close(lfd);
+
+    auto const fast_ms = std::chrono::duration_cast<std::chrono::milliseconds>(last_fast - start).count();
+
+    std::cout << "fast clients classified in " << fast_ms << "ms (" << fast_clients * 1000 / std::max<long>(fast_ms, 1)
+              << " conn/s), blocking detection would wait at least "
+              << slow_clients * std::chrono::milliseconds(timeout).count() << "ms on slow clients, "
+              << wakeups << " socket wakeups\n";
+
+    ASSERT_EQ(classified_by_data, fast_clients);
+}
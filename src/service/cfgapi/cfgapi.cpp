@@ -58,6 +58,7 @@
 
 #include <proxy/mitmproxy.hpp>
 #include <proxy/mitmhost.hpp>
+#include <proxy/relayproxy.hpp>
 
 #include <proxy/filters/sinkhole.hpp>
 
@@ -593,6 +594,8 @@ bool CfgFactory::load_settings () {
     load_if_exists(cfgapi.getRoot()["settings"], "accept_tproxy", accept_tproxy);
     load_if_exists(cfgapi.getRoot()["settings"], "accept_redirect", accept_redirect);
     load_if_exists(cfgapi.getRoot()["settings"], "accept_socks", accept_socks);
+    load_if_exists(cfgapi.getRoot()["settings"], "accept_reuseport", accept_reuseport);
+    load_if_exists(cfgapi.getRoot()["settings"], "accept_reuseport_cpu_steering", accept_reuseport_cpu_steering);
     load_if_exists(cfgapi.getRoot()["settings"], "accept_api", accept_api);
     load_if_exists(cfgapi.getRoot()["settings"], "plaintext_port",listen_tcp_port_base); listen_tcp_port = listen_tcp_port_base;
     load_if_exists(cfgapi.getRoot()["settings"], "plaintext_workers",num_workers_tcp);
@@ -673,9 +676,31 @@ bool CfgFactory::load_settings () {
 
     load_if_exists(cfgapi.getRoot()["settings"], "ssl_autodetect",MitmMasterProxy::ssl_autodetect);
     load_if_exists(cfgapi.getRoot()["settings"], "ssl_autodetect_harder",MitmMasterProxy::ssl_autodetect_harder);
+    load_if_exists(cfgapi.getRoot()["settings"], "ssl_early_hello",MitmMasterProxy::tls_early_hello);
     load_if_exists(cfgapi.getRoot()["settings"], "ssl_ocsp_status_ttl",SSLFactory::options::ocsp_status_ttl);
     load_if_exists(cfgapi.getRoot()["settings"], "ssl_crl_status_ttl",SSLFactory::options::crl_status_ttl);
     load_if_exists(cfgapi.getRoot()["settings"], "ssl_use_ktls",SSLFactory::options::ktls);
+    load_if_exists(cfgapi.getRoot()["settings"], "splice_fastlane",MitmProxy::opt_splice);
+    load_if_exists(cfgapi.getRoot()["settings"], "sg_write",MitmProxy::opt_sg_write);
+
+    {
+        auto& marks = MitmProxy::opt_write_marks;
+        int high = static_cast<int>(marks.high);
+        int low = static_cast<int>(marks.low);
+        int budget_mb = static_cast<int>(WriteBudget::get().limit.load() / (1024 * 1024));
+
+        if(load_if_exists(cfgapi.getRoot()["settings"], "write_high_mark", high) and high > 0) marks.high = high;
+        if(load_if_exists(cfgapi.getRoot()["settings"], "write_low_mark", low) and low > 0) marks.low = low;
+        if(load_if_exists(cfgapi.getRoot()["settings"], "write_budget_mb", budget_mb) and budget_mb >= 0) {
+            WriteBudget::get().limit = static_cast<std::size_t>(budget_mb) * 1024 * 1024;
+        }
+
+        if(marks.low >= marks.high) {
+            _war("load_settings: write_low_mark %d is not lower than write_high_mark %d, using quarter of high mark", marks.low, marks.high);
+            marks.low = marks.high / 4;
+        }
+    }
+    load_if_exists(cfgapi.getRoot()["settings"], "relay_proxy",RelayProxy::enabled);
 
     if(cfgapi.getRoot()["settings"].exists("udp_quick_ports")) {
 
@@ -919,116 +944,140 @@ int CfgFactory::load_db_address () {
         Setting& curr_set = cfgapi.getRoot()["address_objects"];
 
         for( int i = 0; i < num; i++) {
+            load_db_address_entry(curr_set[i]);
+        }
+    }
+    
+    return num;
+}
 
-            Setting &cur_object = curr_set[i];
+bool CfgFactory::load_db_address_entry (Setting& cur_object) {
+    std::scoped_lock<std::recursive_mutex> l(lock_);
 
-            if (!cur_object.getName()) {
-                _dia("cfgapi_load_address: unnamed object index %d: not ok", i);
-                continue;
-            }
+    if (!cur_object.getName()) {
+        _dia("cfgapi_load_address: unnamed object index %d: not ok", cur_object.getIndex());
+        return false;
+    }
 
-            std::string name;
-            name = cur_object.getName();
-            if (name.find("__") == 0) {
-                // don't process reserved names
-                continue;
-            }
+    std::string name;
+    name = cur_object.getName();
+    if (name.find("__") == 0) {
+        // don't process reserved names
+        return false;
+    }
 
-            auto load_addr_09_30 = [&]() {
+    bool ok = false;
 
-                std::string address;
-                int type;
+    auto load_addr_09_30 = [&]() {
 
-                _deb("cfgapi_load_addresses: processing '%s'", name.c_str());
+        std::string address;
+        int type;
 
-                if (load_if_exists(cur_object, "type", type)) {
-                    switch (type) {
-                        case 0: // CIDR notation
-                            if (load_if_exists(cur_object, "cidr", address)) {
-                                auto *c = cidr::cidr_from_str(address.c_str());
+        _deb("cfgapi_load_addresses: processing '%s'", name.c_str());
 
-                                db_address[name] = std::make_shared<CfgAddress>(
-                                        std::shared_ptr<AddressObject>(new CidrAddress(c)));
-                                db_address[name]->element_name() = name;
-                                _dia("cfgapi_load_addresses: cidr '%s': ok", name.c_str());
-                            }
-                            break;
-                        case 1: // FQDN notation
-                            if (load_if_exists(cur_object, "fqdn", address)) {
+        if (load_if_exists(cur_object, "type", type)) {
+            switch (type) {
+                case 0: // CIDR notation
+                    if (load_if_exists(cur_object, "cidr", address)) {
+                        auto *c = cidr::cidr_from_str(address.c_str());
 
-                                db_address[name] = std::make_shared<CfgAddress>(
-                                        std::shared_ptr<AddressObject>(new FqdnAddress(address)));
-                                db_address[name]->element_name() = name;
-                                _dia("cfgapi_load_addresses: fqdn '%s': ok", name.c_str());
-                            }
-                            break;
-                        default:
-                            _dia("cfgapi_load_addresses: fqdn '%s': unknown type value(ignoring)", name.c_str());
+                        db_address[name] = std::make_shared<CfgAddress>(
+                                std::shared_ptr<AddressObject>(new CidrAddress(c)));
+                        db_address[name]->element_name() = name;
+                        _dia("cfgapi_load_addresses: cidr '%s': ok", name.c_str());
+                        ok = true;
                     }
-                } else {
-                    _dia("cfgapi_load_addresses: '%s': not ok", name.c_str());
-                }
-            };
+                    break;
+                case 1: // FQDN notation
+                    if (load_if_exists(cur_object, "fqdn", address)) {
+
+                        db_address[name] = std::make_shared<CfgAddress>(
+                                std::shared_ptr<AddressObject>(new FqdnAddress(address)));
+                        db_address[name]->element_name() = name;
+                        _dia("cfgapi_load_addresses: fqdn '%s': ok", name.c_str());
+                        ok = true;
+                    }
+                    break;
+                default:
+                    _dia("cfgapi_load_addresses: fqdn '%s': unknown type value(ignoring)", name.c_str());
+            }
+        } else {
+            _dia("cfgapi_load_addresses: '%s': not ok", name.c_str());
+        }
+    };
 
-            auto load_addr = [&]() {
+    auto load_addr = [&]() {
 
-                std::string address;
-                std::string type;
+        std::string address;
+        std::string type;
 
-                _deb("cfgapi_load_addresses: processing '%s'", name.c_str());
+        _deb("cfgapi_load_addresses: processing '%s'", name.c_str());
 
-                if (load_if_exists(cur_object, "type", type)) {
+        if (load_if_exists(cur_object, "type", type)) {
 
-                    if(type == "cidr") {
-                        if (load_if_exists(cur_object, "value", address)) {
-                            auto *c = cidr::cidr_from_str(address.c_str());
+            if(type == "cidr") {
+                if (load_if_exists(cur_object, "value", address)) {
+                    auto *c = cidr::cidr_from_str(address.c_str());
 
-                            db_address[name] = std::make_shared<CfgAddress>(
-                                    std::shared_ptr<AddressObject>(new CidrAddress(c)));
-                            db_address[name]->element_name() = name;
-                            _dia("cfgapi_load_addresses: cidr '%s': ok", name.c_str());
-                        }
-                    }
-                    else if(type == "fqdn") {
-                        if (load_if_exists(cur_object, "value", address)) {
+                    db_address[name] = std::make_shared<CfgAddress>(
+                            std::shared_ptr<AddressObject>(new CidrAddress(c)));
+                    db_address[name]->element_name() = name;
+                    _dia("cfgapi_load_addresses: cidr '%s': ok", name.c_str());
+                    ok = true;
+                }
+            }
+            else if(type == "fqdn") {
+                if (load_if_exists(cur_object, "value", address)) {
+
+                    db_address[name] = std::make_shared<CfgAddress>(
+                            std::shared_ptr<AddressObject>(new FqdnAddress(address)));
+                    db_address[name]->element_name() = name;
+                    _dia("cfgapi_load_addresses: fqdn '%s': ok", name.c_str());
+                    ok = true;
+                }
+            }
+            else if(type == "file") {
+                if (load_if_exists(cur_object, "value", address)) {
 
-                            db_address[name] = std::make_shared<CfgAddress>(
-                                    std::shared_ptr<AddressObject>(new FqdnAddress(address)));
-                            db_address[name]->element_name() = name;
-                            _dia("cfgapi_load_addresses: fqdn '%s': ok", name.c_str());
-                        }
+                    auto plist = std::make_shared<PrefixListAddress>(address);
+                    if(not plist->table()) {
+                        _err("cfgapi_load_addresses: file '%s': cannot load %s", name.c_str(), address.c_str());
                     }
-                    else {
-                        _dia("cfgapi_load_addresses: fqdn '%s': unknown type value(ignoring)", name.c_str());
-                    }
-                } else {
-                    _dia("cfgapi_load_addresses: '%s': not ok", name.c_str());
-                }
-            };
 
-            // since 0.9.31 cidr objects have differrent config syntax:
-            // OLD = {
-            //     type = <int>
-            //     cidr = "cidr_string" ; if type = 0
-            //     fqdn = "fqdn_string" ; if type = 1
-            // }
-            // NEW = {
-            //     type = <string>  ; "cidr" or "fqdn"
-            //     value = "value"
-            // }
-
-            // detect config style version, value is present in new scheme
-            if(cur_object.exists("value")) {
-                load_addr();
+                    db_address[name] = std::make_shared<CfgAddress>(std::move(plist));
+                    db_address[name]->element_name() = name;
+                    _dia("cfgapi_load_addresses: file '%s': ok", name.c_str());
+                    ok = true;
+                }
             }
             else {
-                load_addr_09_30();
+                _dia("cfgapi_load_addresses: fqdn '%s': unknown type value(ignoring)", name.c_str());
             }
-
+        } else {
+            _dia("cfgapi_load_addresses: '%s': not ok", name.c_str());
         }
+    };
+
+    // since 0.9.31 cidr objects have differrent config syntax:
+    // OLD = {
+    //     type = <int>
+    //     cidr = "cidr_string" ; if type = 0
+    //     fqdn = "fqdn_string" ; if type = 1
+    // }
+    // NEW = {
+    //     type = <string>  ; "cidr", "fqdn" or "file" (prefix list, one per line)
+    //     value = "value"
+    // }
+
+    // detect config style version, value is present in new scheme
+    if(cur_object.exists("value")) {
+        load_addr();
     }
-    
-    return num;
+    else {
+        load_addr_09_30();
+    }
+
+    return ok;
 }
 
 int CfgFactory::load_db_port () {
@@ -1047,47 +1096,54 @@ int CfgFactory::load_db_port () {
         Setting& curr_set = cfgapi.getRoot()["port_objects"];
 
         for( int i = 0; i < num; i++) {
-            std::string name;
-            int a;
-            int b;
-            
-            Setting& cur_object = curr_set[i];
+            load_db_port_entry(curr_set[i]);
+        }
+    }
+    
+    return num;
+}
 
-            if (  ! cur_object.getName() ) {
-                _dia("cfgapi_load_ports: unnamed object index %d: not ok", i);
-                continue;
-            }
+bool CfgFactory::load_db_port_entry (Setting& cur_object) {
 
-            name = cur_object.getName();
+    std::scoped_lock<std::recursive_mutex> l(lock_);
 
-            if(name.find("__") == 0) {
-                // don't process reserved names
-                continue;
-            }
+    std::string name;
+    int a;
+    int b;
 
-            _deb("cfgapi_load_ports: processing '%s'", name.c_str());
-            
-            if( load_if_exists(cur_object, "start", a) &&
-                    load_if_exists(cur_object, "end", b)   ) {
-                
-                if(a <= b) {
-                    auto cf = std::make_shared<CfgRange>(std::pair(a, b));
-                    cf->element_name() = name;
-                    db_port[name] = cf;
-                } else {
-                    auto cf = std::make_shared<CfgRange>(std::pair(b, a));
-                    cf->element_name() = name;
-                    db_port[name] = cf;
-                }
+    if (  ! cur_object.getName() ) {
+        _dia("cfgapi_load_ports: unnamed object index %d: not ok", cur_object.getIndex());
+        return false;
+    }
 
-                _dia("cfgapi_load_ports: '%s': ok", name.c_str());
-            } else {
-                _dia("cfgapi_load_ports: '%s': not ok", name.c_str());
-            }
+    name = cur_object.getName();
+
+    if(name.find("__") == 0) {
+        // don't process reserved names
+        return false;
+    }
+
+    _deb("cfgapi_load_ports: processing '%s'", name.c_str());
+
+    if( load_if_exists(cur_object, "start", a) &&
+            load_if_exists(cur_object, "end", b)   ) {
+
+        if(a <= b) {
+            auto cf = std::make_shared<CfgRange>(std::pair(a, b));
+            cf->element_name() = name;
+            db_port[name] = cf;
+        } else {
+            auto cf = std::make_shared<CfgRange>(std::pair(b, a));
+            cf->element_name() = name;
+            db_port[name] = cf;
         }
+
+        _dia("cfgapi_load_ports: '%s': ok", name.c_str());
+        return true;
     }
-    
-    return num;
+
+    _dia("cfgapi_load_ports: '%s': not ok", name.c_str());
+    return false;
 }
 
 int CfgFactory::load_db_proto () {
@@ -1106,40 +1162,47 @@ int CfgFactory::load_db_proto () {
         Setting& curr_set = cfgapi.getRoot()["proto_objects"];
 
         for( int i = 0; i < num; i++) {
-            std::string name;
-            
-            Setting& cur_object = curr_set[i];
+            load_db_proto_entry(curr_set[i]);
+        }
+    }
+    
+    return num;
+}
 
-            if (  ! cur_object.getName() ) {
-                _dia("cfgapi_load_proto: unnamed object index %d: not ok", i);
-                continue;
-            }
-            
-            name = cur_object.getName();
+bool CfgFactory::load_db_proto_entry (Setting& cur_object) {
 
-            if(name.find("__") == 0) {
-                // don't process reserved names
-                continue;
-            }
+    std::scoped_lock<std::recursive_mutex> l(lock_);
 
-            _deb("cfgapi_load_proto: processing '%s'", name.c_str());
+    std::string name;
 
-            int ia;
-            if( load_if_exists(cur_object, "id", ia) ) {
+    if (  ! cur_object.getName() ) {
+        _dia("cfgapi_load_proto: unnamed object index %d: not ok", cur_object.getIndex());
+        return false;
+    }
 
-                auto a = std::make_shared<CfgUint8>(static_cast<uint8_t>(ia));
-                a->element_name() = name;
+    name = cur_object.getName();
 
-                db_proto[name] = a;
+    if(name.find("__") == 0) {
+        // don't process reserved names
+        return false;
+    }
 
-                _dia("cfgapi_load_proto: '%s': ok", name.c_str());
-            } else {
-                _dia("cfgapi_load_proto: '%s': not ok", name.c_str());
-            }
-        }
+    _deb("cfgapi_load_proto: processing '%s'", name.c_str());
+
+    int ia;
+    if( load_if_exists(cur_object, "id", ia) ) {
+
+        auto a = std::make_shared<CfgUint8>(static_cast<uint8_t>(ia));
+        a->element_name() = name;
+
+        db_proto[name] = a;
+
+        _dia("cfgapi_load_proto: '%s': ok", name.c_str());
+        return true;
     }
-    
-    return num;
+
+    _dia("cfgapi_load_proto: '%s': not ok", name.c_str());
+    return false;
 }
 
 int CfgFactory::load_db_features() {
@@ -1174,380 +1237,455 @@ int CfgFactory::load_db_policy () {
         Setting& curr_set = cfgapi.getRoot()["policy"];
 
         for( int i = 0; i < num; i++) {
-            Setting& cur_object = curr_set[i];
+            if(auto rule = load_db_policy_entry(curr_set[i], i); rule) {
+                db_policy_list.push_back(rule);
+                db_policy[string_format("[%d]", i)] = rule;
+            }
+        }
+    }
 
-            bool this_disabled = false;
-            std::string proto;
-            std::string dst;
-            std::string dport;
-            std::string src;
-            std::string sport;
-            std::string profile_detection;
-            std::string profile_content;
-            std::string action;
-            std::string nat;
-            
-            bool error = false;
+    publish_snapshot();
 
-            _dia("cfgapi_load_policy: processing #%d", i);
-            
-            auto rule = std::make_shared<PolicyRule>();
+    return num;
+}
 
-            if(load_if_exists(cur_object, "disabled", this_disabled)) {
-                rule->is_disabled = this_disabled;
-            }
+std::shared_ptr<PolicyRule> CfgFactory::load_db_policy_entry (Setting& cur_object, int i) {
 
-            load_if_exists(cur_object, "name", rule->policy_name);
+    std::scoped_lock<std::recursive_mutex> l(lock_);
 
-            if(load_if_exists(cur_object, "proto", proto)) {
-                auto r = lookup_proto(proto.c_str());
-                if(r) {
-                    r->usage_add(std::weak_ptr(rule));
-                    rule->proto = r;
-                    _dia("cfgapi_load_policy[#%d]: proto object: %s", i, proto.c_str());
-                } else {
-                    _dia("cfgapi_load_policy[#%d]: proto object not found: %s", i, proto.c_str());
-                    error = true;
-                    rule->is_disabled = true;
-                }
-            }
+    bool this_disabled = false;
+    std::string proto;
+    std::string dst;
+    std::string dport;
+    std::string src;
+    std::string sport;
+    std::string profile_detection;
+    std::string profile_content;
+    std::string action;
+    std::string nat;
+    
+    bool error = false;
+
+    _dia("cfgapi_load_policy: processing #%d", i);
+    
+    auto rule = std::make_shared<PolicyRule>();
+
+    if(load_if_exists(cur_object, "disabled", this_disabled)) {
+        rule->is_disabled = this_disabled;
+    }
+
+    load_if_exists(cur_object, "name", rule->policy_name);
+
+    if(load_if_exists(cur_object, "proto", proto)) {
+        auto r = lookup_proto(proto.c_str());
+        if(r) {
+            r->usage_add(std::weak_ptr(rule));
+            rule->proto = r;
+            _dia("cfgapi_load_policy[#%d]: proto object: %s", i, proto.c_str());
+        } else {
+            _dia("cfgapi_load_policy[#%d]: proto object not found: %s", i, proto.c_str());
+            error = true;
+            rule->is_disabled = true;
+        }
+    }
+    
+    const Setting& sett_src = cur_object["src"];
+    if(sett_src.isScalar()) {
+        _dia("cfgapi_load_policy[#%d]: scalar src address object", i);
+        if(load_if_exists(cur_object, "src", src)) {
             
-            const Setting& sett_src = cur_object["src"];
-            if(sett_src.isScalar()) {
-                _dia("cfgapi_load_policy[#%d]: scalar src address object", i);
-                if(load_if_exists(cur_object, "src", src)) {
-                    
-                    auto r = lookup_address(src.c_str());
-                    if(r) {
-                        r->usage_add(std::weak_ptr(rule));
-                        rule->src.push_back(r);
-                        _dia("cfgapi_load_policy[#%d]: src address object: %s", i, src.c_str());
-                    } else {
-                        _dia("cfgapi_load_policy[#%d]: src address object not found: %s", i, src.c_str());
-                        error = true;
-                        rule->is_disabled = true;
-                    }
-                }
+            auto r = lookup_address(src.c_str());
+            if(r) {
+                r->usage_add(std::weak_ptr(rule));
+                rule->src.push_back(r);
+                _dia("cfgapi_load_policy[#%d]: src address object: %s", i, src.c_str());
             } else {
-                int sett_src_count = sett_src.getLength();
-                _dia("cfgapi_load_policy[#%d]: src address list", i);
-                for(int y = 0; y < sett_src_count; y++) {
-                    const char* obj_name = sett_src[y];
-                    
-                    auto r = lookup_address(obj_name);
-                    if(r) {
-                        r->usage_add(std::weak_ptr(rule));
-                        rule->src.push_back(r);
-                        _dia("cfgapi_load_policy[#%d]: src address object: %s", i, obj_name);
-                    } else {
-                        _dia("cfgapi_load_policy[#%d]: src address object not found: %s", i, obj_name);
-                        error = true;
-                        rule->is_disabled = true;
-                    }
-
-                }
+                _dia("cfgapi_load_policy[#%d]: src address object not found: %s", i, src.c_str());
+                error = true;
+                rule->is_disabled = true;
             }
+        }
+    } else {
+        int sett_src_count = sett_src.getLength();
+        _dia("cfgapi_load_policy[#%d]: src address list", i);
+        for(int y = 0; y < sett_src_count; y++) {
+            const char* obj_name = sett_src[y];
             
-            const Setting& sett_sport = cur_object["sport"];
-            if(sett_sport.isScalar()) {
-                if(load_if_exists(cur_object, "sport", sport)) {
-                    auto r = lookup_port(sport.c_str());
-                    if(r) {
-                        r->usage_add(std::weak_ptr(rule));
-                        rule->src_ports.emplace_back(r);
-                        _dia("cfgapi_load_policy[#%d]: src_port object: %s", i, sport.c_str());
-                    } else {
-                        _dia("cfgapi_load_policy[#%d]: src_port object not found: %s", i, sport.c_str());
-                        error = true;
-                        rule->is_disabled = true;
-                    }
-                }
+            auto r = lookup_address(obj_name);
+            if(r) {
+                r->usage_add(std::weak_ptr(rule));
+                rule->src.push_back(r);
+                _dia("cfgapi_load_policy[#%d]: src address object: %s", i, obj_name);
             } else {
-                int sett_sport_count = sett_sport.getLength();
-                _dia("cfgapi_load_policy[#%d]: sport list", i);
-                for(int y = 0; y < sett_sport_count; y++) {
-                    const char* obj_name = sett_sport[y];
-                    
-                    auto r = lookup_port(obj_name);
-                    if(r) {
-                        r->usage_add(std::weak_ptr(rule));
-                        rule->src_ports.emplace_back(r);
-                        _dia("cfgapi_load_policy[#%d]: src_port object: %s", i, obj_name);
-                    } else {
-                        _dia("cfgapi_load_policy[#%d]: src_port object not found: %s", i, obj_name);
-                        error = true;
-                        rule->is_disabled = true;
-                    }
-                }
+                _dia("cfgapi_load_policy[#%d]: src address object not found: %s", i, obj_name);
+                error = true;
+                rule->is_disabled = true;
             }
 
-            const Setting& sett_dst = cur_object["dst"];
-            if(sett_dst.isScalar()) {
-                if(load_if_exists(cur_object, "dst", dst)) {
-                    auto r = lookup_address(dst.c_str());
-                    if(r) {
-                        r->usage_add(std::weak_ptr(rule));
-                        rule->dst.push_back(r);
-                        _dia("cfgapi_load_policy[#%d]: dst address object: %s", i, dst.c_str());
-                    } else {
-                        _dia("cfgapi_load_policy[#%d]: dst address object not found: %s", i, dst.c_str());
-                        error = true;
-                        rule->is_disabled = true;
-                    }                
-                }
+        }
+    }
+    
+    const Setting& sett_sport = cur_object["sport"];
+    if(sett_sport.isScalar()) {
+        if(load_if_exists(cur_object, "sport", sport)) {
+            auto r = lookup_port(sport.c_str());
+            if(r) {
+                r->usage_add(std::weak_ptr(rule));
+                rule->src_ports.emplace_back(r);
+                _dia("cfgapi_load_policy[#%d]: src_port object: %s", i, sport.c_str());
             } else {
-                int sett_dst_count = sett_dst.getLength();
-                _dia("cfgapi_load_policy[#%d]: dst list", i);
-                for(int y = 0; y < sett_dst_count; y++) {
-                    const char* obj_name = sett_dst[y];
-
-                    auto r = lookup_address(obj_name);
-                    if(r) {
-                        r->usage_add(std::weak_ptr(rule));
-                        rule->dst.push_back(r);
-                        _dia("cfgapi_load_policy[#%d]: dst address object: %s", i, obj_name);
-                    } else {
-                        _dia("cfgapi_load_policy[#%d]: dst address object not found: %s", i, obj_name);
-                        error = true;
-                        rule->is_disabled = true;
-                    }                
-                }
+                _dia("cfgapi_load_policy[#%d]: src_port object not found: %s", i, sport.c_str());
+                error = true;
+                rule->is_disabled = true;
             }
+        }
+    } else {
+        int sett_sport_count = sett_sport.getLength();
+        _dia("cfgapi_load_policy[#%d]: sport list", i);
+        for(int y = 0; y < sett_sport_count; y++) {
+            const char* obj_name = sett_sport[y];
             
-            
-            const Setting& sett_dport = cur_object["dport"];
-            if(sett_dport.isScalar()) { 
-                if(load_if_exists(cur_object, "dport", dport)) {
-                    auto r = lookup_port(dport.c_str());
-                    if(r) {
-                        r->usage_add(std::weak_ptr(rule));
-                        rule->dst_ports.emplace_back(r);
-                        _dia("cfgapi_load_policy[#%d]: dst_port object: %s", i, dport.c_str());
-                    } else {
-                        _dia("cfgapi_load_policy[#%d]: dst_port object not found: %s", i, dport.c_str());
-                        error = true;
-                        rule->is_disabled = true;
-                    }
-                }
+            auto r = lookup_port(obj_name);
+            if(r) {
+                r->usage_add(std::weak_ptr(rule));
+                rule->src_ports.emplace_back(r);
+                _dia("cfgapi_load_policy[#%d]: src_port object: %s", i, obj_name);
             } else {
-                int sett_dport_count = sett_dport.getLength();
-                _dia("cfgapi_load_policy[#%d]: dst_port object list", i);
-                for(int y = 0; y < sett_dport_count; y++) {
-                    const char* obj_name = sett_dport[y];
-                    
-                    auto r = lookup_port(obj_name);
-                    if(r) {
-                        r->usage_add(std::weak_ptr(rule));
-                        rule->dst_ports.emplace_back(r);
-                        _dia("cfgapi_load_policy[#%d]: dst_port object: %s", i, obj_name);
-                    } else {
-                        _dia("cfgapi_load_policy[#%d]: dst_port object not found: %s", i, obj_name);
-                        error = true;
-                        rule->is_disabled = true;
-                    }                    
-                }
+                _dia("cfgapi_load_policy[#%d]: src_port object not found: %s", i, obj_name);
+                error = true;
+                rule->is_disabled = true;
             }
+        }
+    }
 
-            if(cur_object.exists("features")) {
-                const Setting &sett_features = cur_object["features"];
-                if (not sett_features.isScalar()) {
-                    int sett_filters_count = sett_features.getLength();
-                    _dia("cfgapi_load_policy[#%d]: features object list", i);
-                    for (int y = 0; y < sett_filters_count; y++) {
-                        const char *obj_name = sett_features[y];
-
-                        auto r = lookup_features(obj_name);
-                        if (r) {
-                            r->usage_add(std::weak_ptr(rule));
-                            rule->features.emplace_back(r);
-                            _dia("cfgapi_load_policy[#%d]: features object: %s", i, obj_name);
-                        } else {
-                            _dia("cfgapi_load_policy[#%d]: features object not found: %s", i, obj_name);
-                            error = true;
-                            rule->is_disabled = true;
-                        }
-                    }
-                }
+    const Setting& sett_dst = cur_object["dst"];
+    if(sett_dst.isScalar()) {
+        if(load_if_exists(cur_object, "dst", dst)) {
+            auto r = lookup_address(dst.c_str());
+            if(r) {
+                r->usage_add(std::weak_ptr(rule));
+                rule->dst.push_back(r);
+                _dia("cfgapi_load_policy[#%d]: dst address object: %s", i, dst.c_str());
+            } else {
+                _dia("cfgapi_load_policy[#%d]: dst address object not found: %s", i, dst.c_str());
+                error = true;
+                rule->is_disabled = true;
+            }                
+        }
+    } else {
+        int sett_dst_count = sett_dst.getLength();
+        _dia("cfgapi_load_policy[#%d]: dst list", i);
+        for(int y = 0; y < sett_dst_count; y++) {
+            const char* obj_name = sett_dst[y];
+
+            auto r = lookup_address(obj_name);
+            if(r) {
+                r->usage_add(std::weak_ptr(rule));
+                rule->dst.push_back(r);
+                _dia("cfgapi_load_policy[#%d]: dst address object: %s", i, obj_name);
+            } else {
+                _dia("cfgapi_load_policy[#%d]: dst address object not found: %s", i, obj_name);
+                error = true;
+                rule->is_disabled = true;
+            }                
+        }
+    }
+    
+    
+    const Setting& sett_dport = cur_object["dport"];
+    if(sett_dport.isScalar()) { 
+        if(load_if_exists(cur_object, "dport", dport)) {
+            auto r = lookup_port(dport.c_str());
+            if(r) {
+                r->usage_add(std::weak_ptr(rule));
+                rule->dst_ports.emplace_back(r);
+                _dia("cfgapi_load_policy[#%d]: dst_port object: %s", i, dport.c_str());
+            } else {
+                _dia("cfgapi_load_policy[#%d]: dst_port object not found: %s", i, dport.c_str());
+                error = true;
+                rule->is_disabled = true;
             }
+        }
+    } else {
+        int sett_dport_count = sett_dport.getLength();
+        _dia("cfgapi_load_policy[#%d]: dst_port object list", i);
+        for(int y = 0; y < sett_dport_count; y++) {
+            const char* obj_name = sett_dport[y];
             
-            if(load_if_exists(cur_object, "action", action)) {
-                int r_a = PolicyRule::POLICY_ACTION_PASS;
-                if(action == "deny") {
-                    _dia("cfgapi_load_policy[#%d]: action: deny", i);
-                    r_a = PolicyRule::POLICY_ACTION_DENY;
-                    rule->action_name = action;
-
-                } else if (action == "accept"){
-                    _dia("cfgapi_load_policy[#%d]: action: accept", i);
-                    r_a = PolicyRule::POLICY_ACTION_PASS;
-                    rule->action_name = action;
+            auto r = lookup_port(obj_name);
+            if(r) {
+                r->usage_add(std::weak_ptr(rule));
+                rule->dst_ports.emplace_back(r);
+                _dia("cfgapi_load_policy[#%d]: dst_port object: %s", i, obj_name);
+            } else {
+                _dia("cfgapi_load_policy[#%d]: dst_port object not found: %s", i, obj_name);
+                error = true;
+                rule->is_disabled = true;
+            }                    
+        }
+    }
+
+    if(cur_object.exists("features")) {
+        const Setting &sett_features = cur_object["features"];
+        if (not sett_features.isScalar()) {
+            int sett_filters_count = sett_features.getLength();
+            _dia("cfgapi_load_policy[#%d]: features object list", i);
+            for (int y = 0; y < sett_filters_count; y++) {
+                const char *obj_name = sett_features[y];
+
+                auto r = lookup_features(obj_name);
+                if (r) {
+                    r->usage_add(std::weak_ptr(rule));
+                    rule->features.emplace_back(r);
+                    _dia("cfgapi_load_policy[#%d]: features object: %s", i, obj_name);
                 } else {
-                    _dia("cfgapi_load_policy[#%d]: action: unknown action '%s'", i, action.c_str());
-                    r_a  = PolicyRule::POLICY_ACTION_DENY;
+                    _dia("cfgapi_load_policy[#%d]: features object not found: %s", i, obj_name);
                     error = true;
+                    rule->is_disabled = true;
                 }
-                
-                rule->action = r_a;
-            } else {
-                rule->action = PolicyRule::POLICY_ACTION_DENY;
-                rule->action_name = "deny";
             }
+        }
+    }
+    
+    if(load_if_exists(cur_object, "action", action)) {
+        int r_a = PolicyRule::POLICY_ACTION_PASS;
+        if(action == "deny") {
+            _dia("cfgapi_load_policy[#%d]: action: deny", i);
+            r_a = PolicyRule::POLICY_ACTION_DENY;
+            rule->action_name = action;
+
+        } else if (action == "accept"){
+            _dia("cfgapi_load_policy[#%d]: action: accept", i);
+            r_a = PolicyRule::POLICY_ACTION_PASS;
+            rule->action_name = action;
+        } else {
+            _dia("cfgapi_load_policy[#%d]: action: unknown action '%s'", i, action.c_str());
+            r_a  = PolicyRule::POLICY_ACTION_DENY;
+            error = true;
+        }
+        
+        rule->action = r_a;
+    } else {
+        rule->action = PolicyRule::POLICY_ACTION_DENY;
+        rule->action_name = "deny";
+    }
 
-            if(load_if_exists(cur_object, "nat", nat)) {
-                int nat_a = PolicyRule::POLICY_NAT_NONE;
-                
-                if(nat == "none") {
-                    _dia("cfgapi_load_policy[#%d]: nat: none", i);
-                    nat_a = PolicyRule::POLICY_NAT_NONE;
-                    rule->nat_name = nat;
-
-                } else if (nat == "auto"){
-                    _dia("cfgapi_load_policy[#%d]: nat: auto", i);
-                    nat_a = PolicyRule::POLICY_NAT_AUTO;
-                    rule->nat_name = nat;
-                } else {
-                    _dia("cfgapi_load_policy[#%d]: nat: unknown nat method '%s'", i, nat.c_str());
-                    nat_a  = PolicyRule::POLICY_NAT_NONE;
-                    rule->nat_name = "none";
+    if(load_if_exists(cur_object, "nat", nat)) {
+        int nat_a = PolicyRule::POLICY_NAT_NONE;
+        
+        if(nat == "none") {
+            _dia("cfgapi_load_policy[#%d]: nat: none", i);
+            nat_a = PolicyRule::POLICY_NAT_NONE;
+            rule->nat_name = nat;
+
+        } else if (nat == "auto"){
+            _dia("cfgapi_load_policy[#%d]: nat: auto", i);
+            nat_a = PolicyRule::POLICY_NAT_AUTO;
+            rule->nat_name = nat;
+        } else if (nat == "pool"){
+            // pool itself is taken from routing profile
+            _dia("cfgapi_load_policy[#%d]: nat: pool", i);
+            nat_a = PolicyRule::POLICY_NAT_POOL;
+            rule->nat_name = nat;
+        } else {
+            _dia("cfgapi_load_policy[#%d]: nat: unknown nat method '%s'", i, nat.c_str());
+            nat_a  = PolicyRule::POLICY_NAT_NONE;
+            rule->nat_name = "none";
+            error = true;
+        }
+        
+        rule->nat = nat_a;
+    } else {
+        rule->nat = PolicyRule::POLICY_NAT_NONE;
+    }            
+    
+    
+    /* try to load policy profiles */
+    
+    if(rule->action == 1) {
+        // makes sense to load profiles only when action is accept! 
+        std::string name_content;
+        std::string name_detection;
+        std::string name_tls;
+        std::string name_auth;
+        std::string name_alg_dns;
+        std::string name_script;
+        std::string name_routing;
+
+        if(load_if_exists(cur_object, "detection_profile", name_detection)) {
+            auto prf  = lookup_prof_detection(name_detection.c_str());
+            if(prf) {
+                prf->usage_add(std::weak_ptr(rule));
+                _dia("cfgapi_load_policy[#%d]: detect profile %s", i, name_detection.c_str());
+                rule->profile_detection = std::shared_ptr<ProfileDetection>(prf);
+            }
+            else if(not name_detection.empty()) {
+                _err("cfgapi_load_policy[#%d]: detect profile %s cannot be loaded", i, name_detection.c_str());
+                error = true;
+            }
+        }
+        
+        if(load_if_exists(cur_object, "content_profile", name_content)) {
+            auto prf  = lookup_prof_content(name_content.c_str());
+            if(prf) {
+                prf->usage_add(std::weak_ptr(rule));
+                _dia("cfgapi_load_policy[#%d]: content profile %s", i, name_content.c_str());
+                rule->profile_content = prf;
+            }
+            else if(not name_content.empty()) {
+                _err("cfgapi_load_policy[#%d]: content profile %s cannot be loaded", i, name_content.c_str());
+                error = true;
+            }
+        }                
+        if(load_if_exists(cur_object, "tls_profile", name_tls)) {
+            auto tls  = lookup_prof_tls(name_tls.c_str());
+            if(tls) {
+                tls->usage_add(std::weak_ptr(rule));
+                _dia("cfgapi_load_policy[#%d]: tls profile %s", i, name_tls.c_str());
+                rule->profile_tls= std::shared_ptr<ProfileTls>(tls);
+            }
+            else if(not name_tls.empty()){
+                _err("cfgapi_load_policy[#%d]: tls profile %s cannot be loaded", i, name_tls.c_str());
+                error = true;
+            }
+        }         
+        if(load_if_exists(cur_object, "auth_profile", name_auth)) {
+            auto auth  = lookup_prof_auth(name_auth.c_str());
+            if(auth) {
+                auth->usage_add(std::weak_ptr(rule));
+                _dia("cfgapi_load_policy[#%d]: auth profile %s", i, name_auth.c_str());
+                rule->profile_auth= auth;
+            }
+            else if(not name_auth.empty()) {
+                _err("cfgapi_load_policy[#%d]: auth profile %s cannot be loaded", i, name_auth.c_str());
+                error = true;
+            }
+        }
+        if(load_if_exists(cur_object, "alg_dns_profile", name_alg_dns)) {
+            auto dns  = lookup_prof_alg_dns(name_alg_dns.c_str());
+            if(dns) {
+                dns->usage_add(std::weak_ptr(rule));
+                _dia("cfgapi_load_policy[#%d]: DNS alg profile %s", i, name_alg_dns.c_str());
+                rule->profile_alg_dns = dns;
+            }
+            else if(not name_alg_dns.empty()) {
+                _err("cfgapi_load_policy[#%d]: DNS alg %s cannot be loaded", i, name_alg_dns.c_str());
+                error = true;
+            }
+        }
+
+        if(load_if_exists(cur_object, "script_profile", name_script)) {
+            auto scr  = lookup_prof_script(name_script.c_str());
+            if(scr) {
+                scr->usage_add(std::weak_ptr(rule));
+                _dia("cfgapi_load_policy[#%d]: script profile %s", i, name_script.c_str());
+                rule->profile_script = scr;
+            }
+            else if(not name_script.empty()){
+                _err("cfgapi_load_policy[#%d]: script profile %s cannot be loaded", i, name_script.c_str());
+                error = true;
+            }
+        }
+
+        if(load_if_exists(cur_object, "routing", name_routing)) {
+
+            if(name_routing.empty()) name_routing = "none";
+
+            if(name_routing != "none") {
+                auto scr = lookup_prof_routing(name_routing.c_str());
+                if (scr) {
+                    scr->usage_add(std::weak_ptr(rule));
+                    _dia("cfgapi_load_policy[#%d]: routing profile %s", i, name_routing.c_str());
+                    rule->profile_routing = scr;
+                } else if (not name_routing.empty()) {
+                    _err("cfgapi_load_policy[#%d]: routing profile %s cannot be loaded", i,
+                         name_routing.c_str());
                     error = true;
                 }
-                
-                rule->nat = nat_a;
-            } else {
-                rule->nat = PolicyRule::POLICY_NAT_NONE;
-            }            
-            
-            
-            /* try to load policy profiles */
-            
-            if(rule->action == 1) {
-                // makes sense to load profiles only when action is accept! 
-                std::string name_content;
-                std::string name_detection;
-                std::string name_tls;
-                std::string name_auth;
-                std::string name_alg_dns;
-                std::string name_script;
-                std::string name_routing;
-
-                if(load_if_exists(cur_object, "detection_profile", name_detection)) {
-                    auto prf  = lookup_prof_detection(name_detection.c_str());
-                    if(prf) {
-                        prf->usage_add(std::weak_ptr(rule));
-                        _dia("cfgapi_load_policy[#%d]: detect profile %s", i, name_detection.c_str());
-                        rule->profile_detection = std::shared_ptr<ProfileDetection>(prf);
-                    }
-                    else if(not name_detection.empty()) {
-                        _err("cfgapi_load_policy[#%d]: detect profile %s cannot be loaded", i, name_detection.c_str());
-                        error = true;
-                    }
-                }
-                
-                if(load_if_exists(cur_object, "content_profile", name_content)) {
-                    auto prf  = lookup_prof_content(name_content.c_str());
-                    if(prf) {
-                        prf->usage_add(std::weak_ptr(rule));
-                        _dia("cfgapi_load_policy[#%d]: content profile %s", i, name_content.c_str());
-                        rule->profile_content = prf;
-                    }
-                    else if(not name_content.empty()) {
-                        _err("cfgapi_load_policy[#%d]: content profile %s cannot be loaded", i, name_content.c_str());
-                        error = true;
-                    }
-                }                
-                if(load_if_exists(cur_object, "tls_profile", name_tls)) {
-                    auto tls  = lookup_prof_tls(name_tls.c_str());
-                    if(tls) {
-                        tls->usage_add(std::weak_ptr(rule));
-                        _dia("cfgapi_load_policy[#%d]: tls profile %s", i, name_tls.c_str());
-                        rule->profile_tls= std::shared_ptr<ProfileTls>(tls);
-                    }
-                    else if(not name_tls.empty()){
-                        _err("cfgapi_load_policy[#%d]: tls profile %s cannot be loaded", i, name_tls.c_str());
-                        error = true;
-                    }
-                }         
-                if(load_if_exists(cur_object, "auth_profile", name_auth)) {
-                    auto auth  = lookup_prof_auth(name_auth.c_str());
-                    if(auth) {
-                        auth->usage_add(std::weak_ptr(rule));
-                        _dia("cfgapi_load_policy[#%d]: auth profile %s", i, name_auth.c_str());
-                        rule->profile_auth= auth;
-                    }
-                    else if(not name_auth.empty()) {
-                        _err("cfgapi_load_policy[#%d]: auth profile %s cannot be loaded", i, name_auth.c_str());
-                        error = true;
-                    }
-                }
-                if(load_if_exists(cur_object, "alg_dns_profile", name_alg_dns)) {
-                    auto dns  = lookup_prof_alg_dns(name_alg_dns.c_str());
-                    if(dns) {
-                        dns->usage_add(std::weak_ptr(rule));
-                        _dia("cfgapi_load_policy[#%d]: DNS alg profile %s", i, name_alg_dns.c_str());
-                        rule->profile_alg_dns = dns;
-                    }
-                    else if(not name_alg_dns.empty()) {
-                        _err("cfgapi_load_policy[#%d]: DNS alg %s cannot be loaded", i, name_alg_dns.c_str());
-                        error = true;
-                    }
-                }
+            }
+        }
 
-                if(load_if_exists(cur_object, "script_profile", name_script)) {
-                    auto scr  = lookup_prof_script(name_script.c_str());
-                    if(scr) {
-                        scr->usage_add(std::weak_ptr(rule));
-                        _dia("cfgapi_load_policy[#%d]: script profile %s", i, name_script.c_str());
-                        rule->profile_script = scr;
-                    }
-                    else if(not name_script.empty()){
-                        _err("cfgapi_load_policy[#%d]: script profile %s cannot be loaded", i, name_script.c_str());
-                        error = true;
-                    }
-                }
 
-                if(load_if_exists(cur_object, "routing", name_routing)) {
+    }
+    
+    if(!error){
+        _dia("cfgapi_load_policy[#%d]: ok", i);
+        return rule;
+    }
 
-                    if(name_routing.empty()) name_routing = "none";
+    _err("cfgapi_load_policy[#%d]: not ok (will not process traffic)", i);
+    return nullptr;
+}
 
-                    if(name_routing != "none") {
-                        auto scr = lookup_prof_routing(name_routing.c_str());
-                        if (scr) {
-                            scr->usage_add(std::weak_ptr(rule));
-                            _dia("cfgapi_load_policy[#%d]: routing profile %s", i, name_routing.c_str());
-                            rule->profile_routing = scr;
-                        } else if (not name_routing.empty()) {
-                            _err("cfgapi_load_policy[#%d]: routing profile %s cannot be loaded", i,
-                                 name_routing.c_str());
-                            error = true;
-                        }
-                    }
-                }
+void CfgFactory::publish_snapshot() {
 
+    std::scoped_lock<std::recursive_mutex> l(lock_);
 
-            }
-            
-            if(!error){
-                _dia("cfgapi_load_policy[#%d]: ok", i);
+    auto snap = std::make_shared<CfgSnapshot>();
 
-                db_policy_list.push_back(rule);
-                db_policy[string_format("[%d]", i)] = rule;
-            } else {
-                _err("cfgapi_load_policy[#%d]: not ok (will not process traffic)", i);
-            }
-        }
+    snap->version = ++snapshot_version_;
+    snap->policy_list = db_policy_list;
+    snap->classifier = std::make_shared<PolicyClassifier>(db_policy_list);
+    snap->address = db_address;
+    snap->port = db_port;
+
+    _dia("publish_snapshot: version %lu, %s", snap->version, snap->classifier->to_string(iDIA).c_str());
+
+    std::atomic_store(&snapshot_, shared_CfgSnapshot(std::move(snap)));
+}
+
+
+std::shared_ptr<PolicyRule> CfgSnapshot::policy(int index) const {
+
+    if(index < 0 or index >= static_cast<int>(policy_list.size())) {
+        return nullptr;
     }
-    
-    return num;
+
+    return policy_list[index];
 }
 
-int CfgFactory::policy_match (baseProxy *proxy) {
+std::shared_ptr<ProfileAuth> CfgSnapshot::policy_prof_auth(int index) const {
 
-    auto const& log = log::policy();
+    auto rule = policy(index);
+    return rule ? rule->profile_auth : nullptr;
+}
+
+std::shared_ptr<CfgAddress> CfgSnapshot::lookup_address (std::string const& name) const {
+
+    if(auto it = address.find(name); it != address.end()) {
+        return std::dynamic_pointer_cast<CfgAddress>(it->second);
+    }
+
+    return nullptr;
+}
+
+std::shared_ptr<CfgRange> CfgSnapshot::lookup_port (std::string const& name) const {
+
+    if(auto it = port.find(name); it != port.end()) {
+        return std::dynamic_pointer_cast<CfgRange>(it->second);
+    }
+
+    return std::make_shared<CfgRange>(NULLRANGE);
+}
+
+int CfgSnapshot::policy_match (baseProxy *proxy) const {
+
+    auto const& log = CfgFactory::log::policy();
+
+    if(classifier) {
+        if(auto compiled = classifier->match(proxy); compiled) {
+            if(compiled.value() >= 0) {
+                _dia(" => policy #%d matched!", compiled.value());
+                return compiled.value();
+            }
+
+            _not("policy_match: implicit deny");
+            return -1;
+        }
+    }
 
-    std::scoped_lock<std::recursive_mutex> l(lock_);
-    
     int x = 0;
-    for( auto const& rule: db_policy_list) {
+    for( auto const& rule: policy_list) {
 
         bool r = rule->match(proxy);
         
@@ -1572,11 +1710,19 @@ int CfgFactory::policy_match (baseProxy *proxy) {
     return -1;
 }
 
-int CfgFactory::policy_match (std::vector<baseHostCX *> &left, std::vector<baseHostCX *> &right) {
-    std::scoped_lock<std::recursive_mutex> l(lock_);
-    
+int CfgSnapshot::policy_match (std::vector<baseHostCX *> &left, std::vector<baseHostCX *> &right) const {
+
+    auto const& log = CfgFactory::log::policy();
+
+    if(classifier) {
+        if(auto compiled = classifier->match(left, right); compiled) {
+            _dia("cfgapi_obj_policy_match_lr: compiled match #%d", compiled.value());
+            return compiled.value();
+        }
+    }
+
     int x = 0;
-    for( auto const& rule: db_policy_list) {
+    for( auto const& rule: policy_list) {
 
         bool r = rule->match(left, right);
         
@@ -1602,17 +1748,24 @@ int CfgFactory::policy_match (std::vector<baseHostCX *> &left, std::vector<baseH
 
     _dia("cfgapi_obj_policy_match_lr: implicit deny");
     return -1;
-}    
+}
+
+int CfgFactory::policy_match (baseProxy *proxy) {
+    return snapshot()->policy_match(proxy);
+}
+
+int CfgFactory::policy_match (std::vector<baseHostCX *> &left, std::vector<baseHostCX *> &right) {
+    return snapshot()->policy_match(left, right);
+}
 
 int CfgFactory::policy_action (int index) {
-    std::scoped_lock<std::recursive_mutex> l(lock_);
-    
+
     if(index < 0) {
         return -1;
     }
-    
-    if(index < (signed int)db_policy_list.size()) {
-        return db_policy_list.at(index)->action;
+
+    if(auto rule = snapshot()->policy(index); rule) {
+        return rule->action;
     } else {
         _dia("cfg_obj_policy_action[#%d]: out of bounds, deny", index);
         return PolicyRule::POLICY_ACTION_DENY;
@@ -1620,113 +1773,54 @@ int CfgFactory::policy_action (int index) {
 }
 
 std::shared_ptr<PolicyRule> CfgFactory::policy_rule (int index) {
-    std::scoped_lock<std::recursive_mutex> l(lock_);
-
-    if(index < 0) {
-        return nullptr;
-    }
 
-    if(index < (signed int)db_policy_list.size()) {
-        return db_policy_list.at(index);
-    } else {
+    auto rule = snapshot()->policy(index);
+    if(index >= 0 and not rule) {
         _dia("cfg_obj_policy_rule[#%d]: out of bounds, nullptr", index);
-        return nullptr;
     }
+
+    return rule;
 }
 
 
 std::shared_ptr<ProfileContent> CfgFactory::policy_prof_content (int index) {
-    std::scoped_lock<std::recursive_mutex> l(lock_);
-    
-    if(index < 0) {
-        return nullptr;
-    }
-    
-    if(index < (signed int)db_policy_list.size()) {
-        return db_policy_list.at(index)->profile_content;
-    } else {
-        _dia("policy_prof_content[#%d]: out of bounds, nullptr", index);
-        return nullptr;
-    }
+
+    auto rule = policy_rule(index);
+    return rule ? rule->profile_content : nullptr;
 }
 
 std::shared_ptr<ProfileDetection> CfgFactory::policy_prof_detection (int index) {
-    std::scoped_lock<std::recursive_mutex> l(lock_);
-    
-    if(index < 0) {
-        return nullptr;
-    }
-    
-    if(index < (signed int)db_policy_list.size()) {
-        return db_policy_list.at(index)->profile_detection;
-    } else {
-        _dia("policy_prof_detection[#%d]: out of bounds, nullptr", index);
-        return nullptr;
-    }
+
+    auto rule = policy_rule(index);
+    return rule ? rule->profile_detection : nullptr;
 }
 
 std::shared_ptr<ProfileTls> CfgFactory::policy_prof_tls (int index) {
-    std::scoped_lock<std::recursive_mutex> l(lock_);
-    
-    if(index < 0) {
-        return nullptr;
-    }
-    
-    if(index < (signed int)db_policy_list.size()) {
-        return db_policy_list.at(index)->profile_tls;
-    } else {
-        _dia("policy_prof_tls[#%d]: out of bounds, nullptr", index);
-        return nullptr;
-    }
+
+    auto rule = policy_rule(index);
+    return rule ? rule->profile_tls : nullptr;
 }
 
 
 std::shared_ptr<ProfileAlgDns> CfgFactory::policy_prof_alg_dns (int index) {
-    std::scoped_lock<std::recursive_mutex> l(lock_);
-    
-    if(index < 0) {
-        return nullptr;
-    }
-    
-    if(index < (signed int)db_policy_list.size()) {
-        return db_policy_list.at(index)->profile_alg_dns;
-    } else {
-        _dia("policy_prof_alg_dns[#%d]: out of bounds, nullptr", index);
-        return nullptr;
-    }
+
+    auto rule = policy_rule(index);
+    return rule ? rule->profile_alg_dns : nullptr;
 }
 
 [[maybe_unused]]
 std::shared_ptr<ProfileScript> CfgFactory::policy_prof_script(int index) {
-    std::scoped_lock<std::recursive_mutex> l(lock_);
-
-    if(index < 0) {
-        return nullptr;
-    }
 
-    if(index < (signed int)db_policy_list.size()) {
-        return db_policy_list.at(index)->profile_script;
-    } else {
-        _dia("policy_prof_alg_dns[#%d]: out of bounds, nullptr", index);
-        return nullptr;
-    }
+    auto rule = policy_rule(index);
+    return rule ? rule->profile_script : nullptr;
 }
 
 
 
 std::shared_ptr<ProfileAuth> CfgFactory::policy_prof_auth (int index) {
-    std::scoped_lock<std::recursive_mutex> l(lock_);
-    
-    if(index < 0) {
-        return nullptr;
-    }
-    
-    if(index < (signed int)db_policy_list.size()) {
-        return db_policy_list.at(index)->profile_auth;
-    } else {
-        _dia("policy_prof_auth[#%d]: out of bounds, nullptr", index);
-        return nullptr;
-    }
+
+    auto rule = policy_rule(index);
+    return rule ? rule->profile_auth : nullptr;
 }
 
 
@@ -1820,6 +1914,16 @@ int CfgFactory::load_db_prof_content_subrules(Setting& cur_object, ProfileConten
         }
     }
 
+    if(not new_profile->content_rules.empty()) {
+        new_profile->compile_rules();
+
+        for(auto const& err: new_profile->content_ruleset->errors()) {
+            _err("replace rules in profile '%s': rule %s", new_profile->element_name().c_str(), err.c_str());
+        }
+        _dia("replace rules in profile '%s': %d DFA groups, %d std::regex fallback rules", new_profile->element_name().c_str(),
+             new_profile->content_ruleset->dfa_count(), new_profile->content_ruleset->fallback_count());
+    }
+
     return jnum;
 };
 
@@ -1959,12 +2063,14 @@ int CfgFactory::load_db_prof_tls () {
                         int sni_filter_len = sni_filter.getLength();
                         if(sni_filter_len > 0) {
                                 new_profile->sni_filter_bypass = std::make_shared<std::vector<std::string>>();
-                                new_profile->sni_filter_bypass_addrobj = std::make_shared<std::vector<FqdnAddress>>();
+                                new_profile->sni_filter_bypass_trie = std::make_shared<DomainTrie>();
 
                                 for(int j = 0; j < sni_filter_len; ++j) {
                                     const char* elem = sni_filter[j];
                                     new_profile->sni_filter_bypass->push_back(elem);
-                                    new_profile->sni_filter_bypass_addrobj->emplace_back(elem);
+                                    if(not new_profile->sni_filter_bypass_trie->insert(elem)) {
+                                        _war("load_db_prof_tls: sni_filter_bypass entry '%s' is not a valid name", elem);
+                                    }
                                 }
                         }
                 }
@@ -2153,6 +2259,7 @@ int CfgFactory::load_db_prof_auth () {
                     }
 
                     n_subpol->element_name() = sub_name;
+                    n_subpol->group_set.set(sx::auth::GroupDict::get().intern(sub_name));
 
                     std::string name_content;
                     std::string name_detection;
@@ -2206,6 +2313,7 @@ int CfgFactory::load_db_prof_auth () {
                     }                    
 
                     
+                    a->sub_groups.merge(n_subpol->group_set);
                     a->sub_policies.push_back(n_subpol);
                     _dia("load_db_prof_auth: profiles: %d:%s", j, n_subpol->element_name().c_str());
                 }
@@ -2339,10 +2447,9 @@ bool CfgFactory::prof_content_apply (baseHostCX *originator, baseProxy *new_prox
 
             mitm_proxy->writer_opts()->write_payload = pc->write_payload;
 
-            if( ! pc->content_rules.empty() ) {
+            if(pc->content_ruleset and not pc->content_ruleset->empty()) {
                 _dia("policy_apply: policy content profile[%s]: applying content rules, size %d", pc_name, pc->content_rules.size());
-                mitm_proxy->init_content_replace();
-                mitm_proxy->content_replace(pc->content_rules);
+                mitm_proxy->content_rewrite(pc->content_ruleset);
             }
         }
         else if(load_if_exists(cfgapi.getRoot()["settings"], "default_write_payload", cfg_wrt)) {
@@ -2392,39 +2499,6 @@ bool CfgFactory::prof_detect_apply (baseHostCX *originator, baseProxy *new_proxy
 }
 
 
-std::optional<std::vector<std::string>> CfgFactory::find_bypass_domain_hosts(std::string const& filter_element, bool wildcards_only)  {
-    std::vector<std::string> to_match;
-    {
-        auto dd_ = std::scoped_lock(DNS::get_domain_lock());
-
-        auto wildcard_element = filter_element;
-        bool wildcard_planted = false;
-        if(auto wlc_i = filter_element.find("*."); wlc_i == 0) {
-            _dia("found wildcard SNI bypass element");
-            wildcard_element.replace(0, 2, "");
-            wildcard_planted = true;
-        }
-
-        // do not try to find subdomains based on filter-element string
-        if(not wildcard_planted and wildcards_only) return std::nullopt;
-
-        auto subdomain_cache = DNS::get_domain_cache().get(wildcard_element);
-        if (subdomain_cache != nullptr) {
-            for (auto const &subdomain: subdomain_cache->cache()) {
-
-                std::vector<std::string> prefix_n_domainname = string_split(subdomain.first,
-                                                                            ':');
-                if (prefix_n_domainname.size() < 2)
-                    continue; // continue if we can't strip A: or AAAA:
-
-                to_match.emplace_back(prefix_n_domainname.at(1) + "." + wildcard_element);
-            }
-        }
-    }
-
-    return to_match.empty() ? std::nullopt : std::make_optional(to_match);
-};
-
 bool CfgFactory::prof_tls_apply (baseHostCX *originator, baseProxy *new_proxy, const std::shared_ptr<ProfileTls> &ps) {
 
     auto const& log = log::policy();
@@ -2450,6 +2524,15 @@ bool CfgFactory::prof_tls_apply (baseHostCX *originator, baseProxy *new_proxy, c
 
     _dia("CfgFactory::prof_tls_apply[%s]: profile %s, originator %s", new_proxy->to_string(iINF).c_str(), ps->element_name().c_str(), originator->full_name('L').c_str());
 
+    // ClientHello parsed already by acceptor: bypass is decided before target is connected,
+    // no handshake is started and no certificate is generated for bypassed session
+    std::string_view early_sni;
+    if(auto const* mh = dynamic_cast<MitmHostCX const*>(originator); mh and mh->client_hello and ps->sni_filter_bypass_trie) {
+        if(ps->sni_filter_bypass_trie->match(mh->client_hello->sni, true)) {
+            early_sni = mh->client_hello->sni;
+        }
+    }
+
     for( auto* cx: new_proxy->rs()) {
         baseCom* xcom = cx->com();
         _dia("CfgFactory::prof_tls_apply[%s]: profile %s, target %s", new_proxy->to_string(iINF).c_str(), ps->element_name().c_str(), cx->full_name('R').c_str());
@@ -2461,53 +2544,41 @@ bool CfgFactory::prof_tls_apply (baseHostCX *originator, baseProxy *new_proxy, c
             break;
         }
 
+        auto* sslcom = dynamic_cast<SSLCom*>(xcom);
+        if(sslcom and not early_sni.empty()) {
+            if(sslcom->bypass_me_and_peer()) {
+                _inf("Connection %s bypassed: SNI %s matching TLS bypass list.", originator->full_name('L').c_str(), std::string(early_sni).c_str());
+                break;
+            } else {
+                _war("Connection %s: cannot be bypassed.", originator->full_name('L').c_str());
+            }
+        }
+
         //applying bypass based on DNS cache
 
-        auto* sslcom = dynamic_cast<SSLCom*>(xcom);
-        if(sslcom && ps->sni_filter_bypass) {
-            if( ( ! ps->sni_filter_bypass->empty() ) && ps->sni_filter_use_dns_cache) {
+        if(sslcom && ps->sni_filter_bypass_trie && ps->sni_filter_use_dns_cache) {
 
-                bool interrupt = false;
-                for(FqdnAddress& sni_fqdn: *ps->sni_filter_bypass_addrobj) {
+            auto target = DNS_ReverseIndex::Key::from_str(xcom->owner_cx()->host());
+            if(not target) continue;
 
-                    auto target = CidrAddress(xcom->owner_cx()->host());
+            // names resolving to target IP are matched against compiled filter; wildcard entries
+            // are matched only if domain tree lookup is enabled
+            std::string matched;
+            bool wildcards = ps->sni_filter_use_dns_domain_tree;
+            auto const& trie = *ps->sni_filter_bypass_trie;
 
-                    if(sni_fqdn.match(target.cidr())) {
-                        if(sslcom->bypass_me_and_peer()) {
-                            _inf("Connection %s bypassed: IP in DNS cache matching TLS bypass list (%s).", originator->full_name('L').c_str(), sni_fqdn.fqdn().c_str());
-                            interrupt = true;
-                            break;
-                        } else {
-                            _war("Connection %s: cannot be bypassed.", originator->full_name('L').c_str());
-                        }
-                    }
-                    else if (ps->sni_filter_use_dns_domain_tree) {
-
-                        // don't look for subdomains of current fqdn
-                        auto to_match = find_bypass_domain_hosts(sni_fqdn.fqdn(), true);
-                        if(not to_match) continue;
-
-                        for(auto const& to_match_entry: to_match.value()) {
-                            FqdnAddress ff(to_match_entry);
-                            _deb("Connection %s: subdomain check: test if %s matches %s", originator->full_name('L').c_str(), ff.str().c_str(), xcom->owner_cx()->host().c_str());
-
-                            // ff.match locks DNS cache
-                            if(ff.match(target.cidr())) {
-                                if(sslcom->bypass_me_and_peer()) {
-                                    _inf("Connection %s bypassed: IP in DNS sub-domain cache matching TLS bypass list (%s).", originator->full_name('L').c_str(), sni_fqdn.fqdn().c_str());
-                                } else {
-                                    _war("Connection %s: cannot be bypassed.", originator->full_name('L').c_str());
-                                }
-                                interrupt = true; //exit also from main loop
-                                break;
-                            }
-                        }
-                    }
-                }
+            if(DNS::get_reverse_index().any_name(target.value(), [&](std::string_view name) {
+                                                    if(not trie.match(name, wildcards)) return false;
+                                                    matched = name;
+                                                    return true;
+                                                })) {
 
-                if(interrupt)
+                if(sslcom->bypass_me_and_peer()) {
+                    _inf("Connection %s bypassed: IP in DNS cache matching TLS bypass list (%s).", originator->full_name('L').c_str(), matched.c_str());
                     break;
-
+                } else {
+                    _war("Connection %s: cannot be bypassed.", originator->full_name('L').c_str());
+                }
             }
         }
 
@@ -2612,20 +2683,27 @@ int CfgFactory::policy_apply (baseHostCX *originator, baseProxy *proxy, int matc
 
     auto const& log = log::policy();
 
-    auto lc_ = std::scoped_lock(lock_);
-    
+    // sessions stick with the snapshot they were created with
+    shared_CfgSnapshot snap;
+    if(auto const* mp = dynamic_cast<MitmProxy*>(proxy); mp and mp->config_snapshot()) {
+        snap = mp->config_snapshot();
+    } else {
+        snap = snapshot();
+    }
+
     int policy_num = matched_policy;
-    if(policy_num < 1) {
-        policy_num = policy_match(proxy);
+    if(policy_num < 0) {
+        policy_num = snap->policy_match(proxy);
     }
-    if(auto verdict = policy_action(policy_num); verdict == PolicyRule::POLICY_ACTION_PASS) {
-        auto rule = policy_rule(policy_num);
 
-        auto pc = policy_prof_content(policy_num);
-        auto pd = policy_prof_detection(policy_num);
-        auto pt = policy_prof_tls(policy_num);
-        auto pa = policy_prof_auth(policy_num);
-        auto p_alg_dns = policy_prof_alg_dns(policy_num);
+    auto rule = snap->policy(policy_num);
+    if(rule and rule->action == PolicyRule::POLICY_ACTION_PASS) {
+
+        auto pc = rule->profile_content;
+        auto pd = rule->profile_detection;
+        auto pt = rule->profile_tls;
+        auto pa = rule->profile_auth;
+        auto p_alg_dns = rule->profile_alg_dns;
 
 
         const char *pc_name = "none";
@@ -2804,9 +2882,161 @@ int CfgFactory::load_signatures(libconfig::Config &cfg, const char *name, Signat
 
 
 
+std::string CfgApplyReport::to_string(int verbosity) const {
+
+    std::stringstream ss;
+
+    ss << "apply '" << path << "': " << (incremental ? "incremental" : "full");
+    if(incremental) {
+        ss << ", " << changed_elements << " changed element(s)";
+    }
+    ss << ", rebuilt " << rules_rebuilt << "/" << rules_total << " rules";
+    ss << ", took " << total_time.count() << "us";
+
+    if(verbosity > iINF) {
+        ss << " (objects " << objects_time.count() << "us"
+           << ", policy " << policy_time.count() << "us"
+           << ", snapshot " << snapshot_time.count() << "us)";
+    }
+
+    return ss.str();
+}
+
+std::vector<std::shared_ptr<CfgElement>> CfgFactory::reload_db_entry(db_map_t& db, std::string const& section, std::string const& element,
+                                                                     std::function<bool(Setting&)> const& load_entry) {
+    std::scoped_lock<std::recursive_mutex> l(lock_);
+
+    std::vector<std::shared_ptr<CfgElement>> changed;
+
+    if(element.empty()) {
+        for(auto const& [ name, elem ]: db) {
+            changed.push_back(elem);
+        }
+        db.clear();
+
+        if(cfgapi.exists(section)) {
+            Setting& curr_set = cfgapi.lookup(section);
+            for(int i = 0; i < curr_set.getLength(); i++) {
+                load_entry(curr_set[i]);
+            }
+        }
+
+        return changed;
+    }
+
+    if(auto it = db.find(element); it != db.end()) {
+        changed.push_back(it->second);
+        db.erase(it);
+    }
+
+    if(auto path = section + "." + element; cfgapi.exists(path)) {
+        load_entry(cfgapi.lookup(path));
+    }
+
+    return changed;
+}
+
+std::vector<std::shared_ptr<CfgElement>> CfgFactory::reload_db_section(db_map_t& db, std::string const& element,
+                                                                       std::function<void()> const& load_all) {
+    std::scoped_lock<std::recursive_mutex> l(lock_);
+
+    auto old_db = db;
+    db.clear();
+    load_all();
+
+    std::vector<std::shared_ptr<CfgElement>> changed;
+
+    for(auto const& [ name, old_elem ]: old_db) {
+        auto it = db.find(name);
+        if(not element.empty() and name != element and it != db.end()) {
+            // untouched element: keep instance policies already refer to
+            it->second = old_elem;
+        } else {
+            changed.push_back(old_elem);
+        }
+    }
+
+    return changed;
+}
+
+size_t CfgFactory::rebuild_policy_refs(std::vector<std::shared_ptr<CfgElement>> const& changed) {
+
+    std::scoped_lock<std::recursive_mutex> l(lock_);
+
+    if(not cfgapi.getRoot().exists("policy")) return 0;
+
+    Setting& curr_set = cfgapi.getRoot()["policy"];
+    int num = curr_set.getLength();
+
+    auto [ rebuilt, gone ] = PolicyRule::rebuild_affected(db_policy, num, changed,
+                                                          [&](int i) { return load_db_policy_entry(curr_set[i], i); });
+
+    // replaced policies may still live in snapshots held by sessions - don't keep them as usage references
+    if(not gone.empty()) {
+        for(auto* db: { &db_address, &db_port, &db_proto, &db_features, &db_routing,
+                        &db_prof_detection, &db_prof_content, &db_prof_tls, &db_prof_auth,
+                        &db_prof_alg_dns, &db_prof_script }) {
+            for(auto const& [ name, elem ]: *db) {
+                if(elem) elem->usage_remove(gone);
+            }
+        }
+    }
+
+    db_policy_list.clear();
+    for(int i = 0; i < num; i++) {
+        if(auto it = db_policy.find(string_format("[%d]", i)); it != db_policy.end()) {
+            db_policy_list.push_back(std::dynamic_pointer_cast<PolicyRule>(it->second));
+        }
+    }
+
+    _dia("rebuild_policy_refs: %d changed elements, %d/%d policies rebuilt", changed.size(), rebuilt, num);
+
+    return rebuilt;
+}
+
 bool CfgFactory::apply_config_change(std::string_view section) {
     bool ret = false;
 
+    std::scoped_lock<std::recursive_mutex> l(lock_);
+
+    using clock = std::chrono::steady_clock;
+    auto const started = clock::now();
+    auto since = [](auto from) { return std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - from); };
+
+    apply_report_ = CfgApplyReport();
+    apply_report_.path = section;
+
+    // config path is <section>.<element>[.<sub-settings>]
+    std::string element;
+    if(auto dot = section.find('.'); dot != std::string_view::npos) {
+        element = section.substr(dot + 1, section.find('.', dot + 1) - dot - 1);
+    }
+
+    // objects are reloaded, rebuild policies refering to them
+    auto apply_incremental = [&](std::vector<std::shared_ptr<CfgElement>> const& changed) {
+        apply_report_.incremental = true;
+        apply_report_.objects_time = since(started);
+        apply_report_.changed_elements = changed.size();
+
+        auto policy_started = clock::now();
+        apply_report_.rules_rebuilt = rebuild_policy_refs(changed);
+        apply_report_.policy_time = since(policy_started);
+
+        auto snapshot_started = clock::now();
+        publish_snapshot();
+        apply_report_.snapshot_time = since(snapshot_started);
+    };
+
+    auto apply_full = [&]() {
+        apply_report_.objects_time = since(started);
+
+        auto policy_started = clock::now();
+        cleanup_db_policy();
+        ret = load_db_policy();
+        apply_report_.rules_rebuilt = db_policy_list.size();
+        apply_report_.policy_time = since(policy_started);
+    };
+
     if( 0 == section.find("settings") ) {
         ret = CfgFactory::get()->load_settings();
     } else
@@ -2822,100 +3052,56 @@ bool CfgFactory::apply_config_change(std::string_view section) {
         ret = CfgFactory::get()->load_debug();
     } else
     if( 0 == section.find("policy") ) {
-
-        CfgFactory::get()->cleanup_db_policy();
-        ret = CfgFactory::get()->load_db_policy();
+        apply_full();
     } else
     if( 0 == section.find("port_objects") ) {
 
-        CfgFactory::get()->cleanup_db_port();
-        ret = CfgFactory::get()->load_db_port();
-
-        if(ret) {
-            CfgFactory::get()->cleanup_db_policy();
-            ret = CfgFactory::get()->load_db_policy();
-        }
+        auto changed = reload_db_entry(db_port, "port_objects", element, [this](Setting& s) { return load_db_port_entry(s); });
+        ret = true;
+        apply_incremental(changed);
     } else
     if( 0 == section.find("proto_objects") ) {
 
-        CfgFactory::get()->cleanup_db_proto();
-        ret = CfgFactory::get()->load_db_proto();
-
-        if(ret) {
-            CfgFactory::get()->cleanup_db_policy();
-            ret = CfgFactory::get()->load_db_policy();
-        }
+        auto changed = reload_db_entry(db_proto, "proto_objects", element, [this](Setting& s) { return load_db_proto_entry(s); });
+        ret = true;
+        apply_incremental(changed);
     } else
     if( 0 == section.find("address_objects") ) {
 
-        CfgFactory::get()->cleanup_db_address();
-        ret = CfgFactory::get()->load_db_address();
-
-        if(ret) {
-            CfgFactory::get()->cleanup_db_policy();
-            ret = CfgFactory::get()->load_db_policy();
-        }
+        auto changed = reload_db_entry(db_address, "address_objects", element, [this](Setting& s) { return load_db_address_entry(s); });
+        ret = true;
+        apply_incremental(changed);
     } else
     if( 0 == section.find("detection_profiles") ) {
 
-        CfgFactory::get()->cleanup_db_prof_detection();
-        ret = CfgFactory::get()->load_db_prof_detection();
-
-        if(ret) {
-            CfgFactory::get()->cleanup_db_policy();
-            ret = CfgFactory::get()->load_db_policy();
-        }
+        auto changed = reload_db_section(db_prof_detection, element, [&]() { ret = load_db_prof_detection(); });
+        if(ret) apply_incremental(changed);
     } else
     if( 0 == section.find("content_profiles") ) {
 
-        CfgFactory::get()->cleanup_db_prof_content();
-        ret = CfgFactory::get()->load_db_prof_content();
-
-        if(ret) {
-            CfgFactory::get()->cleanup_db_policy();
-            ret = CfgFactory::get()->load_db_policy();
-        }
+        auto changed = reload_db_section(db_prof_content, element, [&]() { ret = load_db_prof_content(); });
+        if(ret) apply_incremental(changed);
     } else
     if( 0 == section.find("tls_profiles") ) {
 
-        CfgFactory::get()->cleanup_db_prof_tls();
-        ret = CfgFactory::get()->load_db_prof_tls();
-
-        if(ret) {
-            CfgFactory::get()->cleanup_db_policy();
-            ret = CfgFactory::get()->load_db_policy();
-        }
+        auto changed = reload_db_section(db_prof_tls, element, [&]() { ret = load_db_prof_tls(); });
+        if(ret) apply_incremental(changed);
     } else
     if( 0 == section.find("alg_dns_profiles") ) {
 
-        CfgFactory::get()->cleanup_db_prof_alg_dns();
-        ret = CfgFactory::get()->load_db_prof_alg_dns();
-
-        if(ret) {
-            CfgFactory::get()->cleanup_db_policy();
-            ret = CfgFactory::get()->load_db_policy();
-        }
+        auto changed = reload_db_section(db_prof_alg_dns, element, [&]() { ret = load_db_prof_alg_dns(); });
+        if(ret) apply_incremental(changed);
     } else
     if( 0 == section.find("auth_profiles") ) {
 
-        CfgFactory::get()->cleanup_db_prof_auth();
-        ret = CfgFactory::get()->load_db_prof_auth();
-
-        if(ret) {
-            CfgFactory::get()->cleanup_db_policy();
-            ret = CfgFactory::get()->load_db_policy();
-        }
+        auto changed = reload_db_section(db_prof_auth, element, [&]() { ret = load_db_prof_auth(); });
+        if(ret) apply_incremental(changed);
     }
     else
     if( 0 == section.find("routing") ) {
 
-        CfgFactory::get()->cleanup_db_routing();
-        ret = CfgFactory::get()->load_db_routing();
-
-        if(ret) {
-            CfgFactory::get()->cleanup_db_policy();
-            ret = CfgFactory::get()->load_db_policy();
-        }
+        auto changed = reload_db_section(db_routing, element, [&]() { ret = load_db_routing(); });
+        if(ret) apply_incremental(changed);
     }
     else
     if( 0 == section.find("starttls_signatures") or
@@ -2924,10 +3110,14 @@ bool CfgFactory::apply_config_change(std::string_view section) {
         CfgFactory::get()->load_signatures(CfgFactory::cfg_obj(), "starttls_signatures", SigFactory::get().signature_tree(),0);
         CfgFactory::get()->load_signatures(CfgFactory::cfg_obj(), "detection_signatures", SigFactory::get().signature_tree());
 
-        CfgFactory::get()->cleanup_db_policy();
-        ret = CfgFactory::get()->load_db_policy();
+        apply_full();
     }
 
+    apply_report_.rules_total = db_policy_list.size();
+    apply_report_.total_time = since(started);
+
+    _inf("apply_config_change: %s", apply_report_.to_string(iDIA).c_str());
+
     return ret;
 }
 
@@ -3198,6 +3388,15 @@ int CfgFactory::save_address_objects(Config& ex) const {
 
             n_saved++;
         }
+        else if(auto plist = std::dynamic_pointer_cast<PrefixListAddress>(obj->value()); plist) {
+            Setting &s_type = item.add("type", Setting::TypeString);
+            Setting &s_file = item.add("value", Setting::TypeString);
+
+            s_type = "file";
+            s_file = plist->path();
+
+            n_saved++;
+        }
 
     }
 
@@ -3283,11 +3482,102 @@ int CfgFactory::load_db_routing () {
                 else if(lb_meth == "sticky-l4") {
                     new_profile->dnat_lb_method = ProfileRouting::lb_method::LB_L4;
                 }
+                else if(lb_meth == "maglev-l3") {
+                    new_profile->dnat_lb_method = ProfileRouting::lb_method::LB_MAGLEV_L3;
+                }
+                else if(lb_meth == "maglev-l4") {
+                    new_profile->dnat_lb_method = ProfileRouting::lb_method::LB_MAGLEV_L4;
+                }
+                else if(lb_meth == "least-conn") {
+                    new_profile->dnat_lb_method = ProfileRouting::lb_method::LB_LEAST_CONN;
+                }
+                else if(lb_meth == "peak-ewma") {
+                    new_profile->dnat_lb_method = ProfileRouting::lb_method::LB_PEAK_EWMA;
+                }
                 else {
                     new_profile->dnat_lb_method = ProfileRouting::lb_method::LB_RR;
                 }
             }
 
+            if(new_profile->dnat_lb_method == ProfileRouting::lb_method::LB_MAGLEV_L3 or
+               new_profile->dnat_lb_method == ProfileRouting::lb_method::LB_MAGLEV_L4) {
+
+                auto n4 = expand_to_cidr(new_profile->dnat_addresses, AF_INET).size();
+                auto n6 = expand_to_cidr(new_profile->dnat_addresses, AF_INET6).size();
+                if(n4 > MaglevTable::max_backends or n6 > MaglevTable::max_backends) {
+                    _err("load_db_routing[%d]: %s: %d IPv4 / %d IPv6 dnat targets, consistent hashing supports at most %d",
+                         i, name.c_str(), n4, n6, MaglevTable::max_backends);
+                    continue;
+                }
+
+                new_profile->lb_state.use_maglev = true;
+            }
+
+            new_profile->lb_state.make_pools(new_profile->dnat_lb_method, name);
+
+            std::string hc_mode;
+            if(load_if_exists(cur_object, "health_check", hc_mode)) {
+                new_profile->health_check = BackendHealth::mode_from_str(hc_mode);
+            }
+            int hc_port = 0;
+            if(load_if_exists(cur_object, "health_check_port", hc_port)) {
+                if(hc_port < 0 or hc_port > 65535) {
+                    _err("load_db_routing[%d]: %s: invalid health_check_port %d", i, name.c_str(), hc_port);
+                    continue;
+                }
+                new_profile->health_check_port = static_cast<uint16_t>(hc_port);
+            }
+
+            new_profile->health_port = new_profile->health_check_port;
+            if(new_profile->health_port == 0 and not new_profile->dnat_ports.empty()) {
+                if(auto prt = lookup_port(new_profile->dnat_ports[0].c_str()); prt) {
+                    new_profile->health_port = static_cast<uint16_t>(prt->value().first);
+                }
+            }
+
+            if(cur_object.exists("snat_address")) {
+                auto& sa = cur_object["snat_address"];
+                auto sa_l = sa.getLength();
+                for (int j = 0; j < sa_l; ++j) {
+                    const char* address = sa[j];
+                    if(db_address.find(address) == db_address.end()) {
+                        _dia("load_db_routing[%d]: unknown snat address: '%s'", i, address);
+                        continue;
+                    }
+                    new_profile->snat_addresses.emplace_back(address);
+                }
+            }
+
+            if(cur_object.exists("snat_port")) {
+                auto& sp = cur_object["snat_port"];
+                auto sp_l = sp.getLength();
+                for (int j = 0; j < sp_l; ++j) {
+                    const char* port = sp[j];
+                    if(db_port.find(port) == db_port.end()) {
+                        _dia("load_db_routing[%d]: unknown snat port: '%s'", i, port);
+                        continue;
+                    }
+                    new_profile->snat_ports.emplace_back(port);
+                }
+            }
+
+            if(not new_profile->snat_addresses.empty()) {
+                std::vector<std::string> pool_ips;
+                for(auto const& ca: expand_to_cidr(new_profile->snat_addresses, CIDR_NOPROTO)) {
+                    pool_ips.emplace_back(ca->ip(CIDR_ONLYADDR));
+                }
+
+                std::vector<std::pair<int,int>> pool_ports;
+                for(auto const& pn: new_profile->snat_ports) {
+                    if(auto r = lookup_port(pn.c_str()); r) pool_ports.emplace_back(r->value());
+                }
+                // unprivileged ports by default
+                if(pool_ports.empty()) pool_ports.emplace_back(1024, 65535);
+
+                new_profile->snat_pool = NatPool::make(pool_ips, pool_ports);
+                _dia("load_db_routing[%d]: %s", i, new_profile->snat_pool->to_string(iDIA).c_str());
+            }
+
             db_routing[name] = new_profile;
             loaded++;
         }
@@ -3325,9 +3615,30 @@ int CfgFactory::save_routing(Config& ex) const {
             lbm = "sticky-l3";
         else if(obj->dnat_lb_method == ProfileRouting::lb_method::LB_L4)
             lbm = "sticky-l4";
+        else if(obj->dnat_lb_method == ProfileRouting::lb_method::LB_MAGLEV_L3)
+            lbm = "maglev-l3";
+        else if(obj->dnat_lb_method == ProfileRouting::lb_method::LB_MAGLEV_L4)
+            lbm = "maglev-l4";
+        else if(obj->dnat_lb_method == ProfileRouting::lb_method::LB_LEAST_CONN)
+            lbm = "least-conn";
+        else if(obj->dnat_lb_method == ProfileRouting::lb_method::LB_PEAK_EWMA)
+            lbm = "peak-ewma";
         else
             lbm = "round-robin";
 
+        routing_item.add("health_check", Setting::TypeString) = BackendHealth::mode_str(obj->health_check);
+        routing_item.add("health_check_port", Setting::TypeInt) = obj->health_check_port;
+
+        if(not obj->snat_addresses.empty()) {
+            auto& snat_address = routing_item.add("snat_address", Setting::TypeArray);
+            for(auto const& snat_it: obj->snat_addresses)
+                snat_address.add(Setting::TypeString) = snat_it;
+
+            auto& snat_port = routing_item.add("snat_port", Setting::TypeArray);
+            for(auto const& snat_it: obj->snat_ports)
+                snat_port.add(Setting::TypeString) = snat_it;
+        }
+
         n_saved++;
     }
 
@@ -3340,14 +3651,16 @@ bool CfgFactory::new_routing(Setting& ex, std::string const& name) const {
     try {
         Setting &item = ex.add(name, Setting::TypeGroup);
 
-        // to be added later
-        // item.add("snat_address", Setting::TypeArray);
-        // item.add("snat_port", Setting::TypeArray) ;
-
         item.add("dnat_address", Setting::TypeArray);
         item.add("dnat_port", Setting::TypeArray);
 
         item.add("dnat_lb_method", Setting::TypeString) = "round-robin";
+
+        item.add("snat_address", Setting::TypeArray);
+        item.add("snat_port", Setting::TypeArray) ;
+
+        item.add("health_check", Setting::TypeString) = "none";
+        item.add("health_check_port", Setting::TypeInt) = 0;
     }
     catch(libconfig::SettingNameException const& e) {
         _war("cannot add new section %s.%s: %s", ex.c_str(), name.c_str(), e.what());
@@ -3986,31 +4299,31 @@ bool CfgFactory::_apply_new_entry(std::string const& section, std::string const&
     if(section == "proto_objects") {
         if (CfgFactory::get()->new_proto_object(s, entry_name)) {
             added = true;
-            CfgFactory::get()->load_db_proto();
+            CfgFactory::get()->apply_config_change(section + "." + entry_name);
         }
     }
     else if(section == "port_objects") {
         if (CfgFactory::get()->new_port_object(s, entry_name)) {
             added = true;
-            CfgFactory::get()->load_db_port();
+            CfgFactory::get()->apply_config_change(section + "." + entry_name);
         }
     }
     else if(section == "address_objects") {
         if (CfgFactory::get()->new_address_object(s, entry_name)) {
             added = true;
-            CfgFactory::get()->load_db_address();
+            CfgFactory::get()->apply_config_change(section + "." + entry_name);
         }
     }
     else if(section == "detection_profiles") {
         if (CfgFactory::get()->new_detection_profile(s, entry_name)) {
             added = true;
-            CfgFactory::get()->load_db_prof_detection();
+            CfgFactory::get()->apply_config_change(section + "." + entry_name);
         }
     }
     else if(section == "content_profiles") {
         if (CfgFactory::get()->new_content_profile(s, entry_name)) {
             added = true;
-            CfgFactory::get()->load_db_prof_content();
+            CfgFactory::get()->apply_config_change(section + "." + entry_name);
         }
     }
     else if(section == "tls_ca") {
@@ -4022,19 +4335,19 @@ bool CfgFactory::_apply_new_entry(std::string const& section, std::string const&
     else if(section == "tls_profiles") {
         if (CfgFactory::get()->new_tls_profile(s, entry_name)) {
             added = true;
-            CfgFactory::get()->load_db_prof_tls();
+            CfgFactory::get()->apply_config_change(section + "." + entry_name);
         }
     }
     else if(section == "alg_dns_profiles") {
         if (CfgFactory::get()->new_alg_dns_profile(s, entry_name)) {
             added = true;
-            CfgFactory::get()->load_db_prof_alg_dns();
+            CfgFactory::get()->apply_config_change(section + "." + entry_name);
         }
     }
     else if(section == "auth_profiles") {
         if (CfgFactory::get()->new_auth_profile(s, entry_name)) {
             added = true;
-            CfgFactory::get()->load_db_prof_auth();
+            CfgFactory::get()->apply_config_change(section + "." + entry_name);
         }
     }
     else if(section == "policy") {
@@ -4050,8 +4363,7 @@ bool CfgFactory::_apply_new_entry(std::string const& section, std::string const&
     else if(section == "routing") {
         if (CfgFactory::get()->new_routing(s, entry_name)) {
             added = true;
-            // policy is a list - it must be cleared before loaded again
-            CfgFactory::get()->load_db_routing();
+            CfgFactory::get()->apply_config_change(section + "." + entry_name);
         }
     }
 
@@ -4672,6 +4984,8 @@ int save_settings(Config& ex) {
     objects.add("accept_tproxy", Setting::TypeBoolean) = CfgFactory::get()->accept_tproxy;
     objects.add("accept_redirect", Setting::TypeBoolean) = CfgFactory::get()->accept_redirect;
     objects.add("accept_socks", Setting::TypeBoolean) = CfgFactory::get()->accept_socks;
+    objects.add("accept_reuseport", Setting::TypeBoolean) = CfgFactory::get()->accept_reuseport;
+    objects.add("accept_reuseport_cpu_steering", Setting::TypeBoolean) = CfgFactory::get()->accept_reuseport_cpu_steering;
 
     // nameservers
     Setting& it_ns  = objects.add("nameservers", Setting::TypeArray);
@@ -4692,9 +5006,16 @@ int save_settings(Config& ex) {
     objects.add("ssl_workers", Setting::TypeInt) = CfgFactory::get()->num_workers_tls;
     objects.add("ssl_autodetect", Setting::TypeBoolean) = MitmMasterProxy::ssl_autodetect;
     objects.add("ssl_autodetect_harder", Setting::TypeBoolean) = MitmMasterProxy::ssl_autodetect_harder;
+    objects.add("ssl_early_hello", Setting::TypeBoolean) = MitmMasterProxy::tls_early_hello;
     objects.add("ssl_ocsp_status_ttl", Setting::TypeInt) = SSLFactory::options::ocsp_status_ttl;
     objects.add("ssl_crl_status_ttl", Setting::TypeInt) = SSLFactory::options::crl_status_ttl;
     objects.add("ssl_use_ktls", Setting::TypeBoolean) = SSLFactory::options::ktls;
+    objects.add("splice_fastlane", Setting::TypeBoolean) = MitmProxy::opt_splice;
+    objects.add("sg_write", Setting::TypeBoolean) = MitmProxy::opt_sg_write;
+    objects.add("write_high_mark", Setting::TypeInt) = static_cast<int>(MitmProxy::opt_write_marks.high);
+    objects.add("write_low_mark", Setting::TypeInt) = static_cast<int>(MitmProxy::opt_write_marks.low);
+    objects.add("write_budget_mb", Setting::TypeInt) = static_cast<int>(WriteBudget::get().limit.load() / (1024 * 1024));
+    objects.add("relay_proxy", Setting::TypeBoolean) = RelayProxy::enabled;
 
     objects.add("udp_port", Setting::TypeString) = CfgFactory::get()->listen_udp_port_base;
     objects.add("udp_workers", Setting::TypeInt) = CfgFactory::get()->num_workers_udp;
@@ -43,12 +43,15 @@
 #include <vector>
 #include <map>
 #include <mutex>
+#include <atomic>
 #include <chrono>
+#include <functional>
  
 #include <libconfig.h++>
 #include <ext/libcidr/cidr.hpp>
 #include <ranges.hpp>
 #include <policy/policy.hpp>
+#include <policy/classifier.hpp>
 #include <sslcom.hpp>
 #include <traflog/pcaplog.hpp>
 
@@ -153,7 +156,8 @@ struct UpdateBoard {
     uint64_t version_current() const noexcept { return current_version_; }
     uint64_t version_saved() const noexcept { return saved_version_; }
 
-    uint64_t current_version_ = starting_num;
+    // current version is read also by workers (ie. to validate cached policy verdicts)
+    std::atomic<uint64_t> current_version_ { starting_num };
     uint64_t saved_version_ = starting_num;
     subscriber_map_t board_;
     std::string updater_;
@@ -179,6 +183,56 @@ struct UpdateBoardSubscriber {
 };
 
 
+// Immutable view of configuration needed to set up new sessions. It's published by CfgFactory
+// each time policies are (re)loaded and swapped atomically, so workers read it without touching
+// CfgFactory::lock(). Sessions hold the snapshot they were created with - objects they refer to
+// stay valid and consistent even if config is reloaded meanwhile.
+//
+// Snapshot doesn't deep-copy: PolicyRule and profile objects are shared with CfgFactory and
+// with older snapshots still held by sessions. Configuration fields of those objects must not
+// be modified once published - a change builds new objects and publishes a new snapshot.
+// The only state mutated in place is runtime bookkeeping, which is thread-safe on its own:
+//   - PolicyRule::cnt_matches (atomic, relaxed increments)
+//   - ProfileRouting::lb_state (guarded by LbState::lock_, counters atomic)
+// Everything else reachable from a snapshot is read-only.
+struct CfgSnapshot {
+    uint64_t version = 0;
+
+    std::vector<std::shared_ptr<PolicyRule>> policy_list;
+    std::shared_ptr<PolicyClassifier> classifier;
+
+    std::map<std::string, std::shared_ptr<CfgElement>> address;
+    std::map<std::string, std::shared_ptr<CfgElement>> port;
+
+    std::shared_ptr<PolicyRule> policy(int index) const;
+    std::shared_ptr<ProfileAuth> policy_prof_auth(int index) const;
+    int policy_match (baseProxy *proxy) const;
+    int policy_match (std::vector<baseHostCX *> &left, std::vector<baseHostCX *> &right) const;
+
+    std::shared_ptr<CfgAddress> lookup_address (std::string const& name) const;
+    std::shared_ptr<CfgRange> lookup_port (std::string const& name) const;
+};
+using shared_CfgSnapshot = std::shared_ptr<CfgSnapshot const>;
+
+
+// Timing report of a single CfgFactory::apply_config_change() call
+struct CfgApplyReport {
+    std::string path;
+    bool incremental = false;
+
+    size_t changed_elements = 0;
+    size_t rules_rebuilt = 0;
+    size_t rules_total = 0;
+
+    std::chrono::microseconds objects_time {0};
+    std::chrono::microseconds policy_time {0};
+    std::chrono::microseconds snapshot_time {0};
+    std::chrono::microseconds total_time {0};
+
+    std::string to_string(int verbosity=iINF) const;
+};
+
+
 struct SignatureTree;
 
 struct DNS_Setup {
@@ -199,6 +253,12 @@ class CfgFactory : public CfgFactoryBase {
     static inline std::shared_ptr<CfgFactory> self;
     static inline std::shared_ptr<UpdateBoard> update_board;
 
+    // access only via std::atomic_load/atomic_store
+    shared_CfgSnapshot snapshot_ = std::make_shared<CfgSnapshot>();
+    uint64_t snapshot_version_ = 0;
+
+    CfgApplyReport apply_report_;
+
 public:
 //    static inline bool config_changed_flag = false;
 
@@ -225,6 +285,11 @@ public:
 
 
     static std::recursive_mutex& lock() { return get()->lock_; }
+
+    // current configuration snapshot - lock-free for readers
+    shared_CfgSnapshot snapshot() const { return std::atomic_load(&snapshot_); }
+    // build new snapshot from current DBs and make it current
+    void publish_snapshot();
     static libconfig::Setting& cfg_root() { return get()->cfgapi.getRoot(); }
     static libconfig::Config&  cfg_obj() { return get()->cfgapi; }
 
@@ -254,6 +319,11 @@ public:
     bool accept_socks = true;
     bool accept_api = true;
 
+    // TCP acceptors: one SO_REUSEPORT socket per listener thread, pinned to a CPU
+    bool accept_reuseport = false;
+    // attach BPF program steering connections to the listener of the CPU which received them
+    bool accept_reuseport_cpu_steering = false;
+
     std::string admin_group;
 
     int num_workers_tcp = 0;
@@ -394,10 +464,14 @@ public:
     bool load_captures();
     int  load_debug();
     int  load_db_address ();
+        bool load_db_address_entry(libconfig::Setting& cur_object);
     int  load_db_port ();
+        bool load_db_port_entry(libconfig::Setting& cur_object);
     int  load_db_proto ();
+        bool load_db_proto_entry(libconfig::Setting& cur_object);
     int  load_db_features ();
     int  load_db_policy ();
+        std::shared_ptr<PolicyRule> load_db_policy_entry(libconfig::Setting& cur_object, int i);
     int  load_db_prof_content ();
         int load_db_prof_content_subrules(libconfig::Setting& cur_object, ProfileContent* new_profile);
         bool load_db_prof_content_write_format(libconfig::Setting& cur_object, ProfileContent* new_profile);
@@ -485,9 +559,20 @@ public:
 
 
     bool apply_config_change(std::string_view section);
+    CfgApplyReport const& apply_report() const { return apply_report_; }
+
+    using db_map_t = std::map<std::string, std::shared_ptr<CfgElement>>;
+    // reload single @element of @section (all of them if empty), return replaced/removed instances
+    std::vector<std::shared_ptr<CfgElement>> reload_db_entry(db_map_t& db, std::string const& section, std::string const& element,
+                                                             std::function<bool(libconfig::Setting&)> const& load_entry);
+    // reload whole @db, but keep original instances of all elements except @element (all replaced if empty)
+    std::vector<std::shared_ptr<CfgElement>> reload_db_section(db_map_t& db, std::string const& element,
+                                                               std::function<void()> const& load_all);
+    // reparse only policies referring to @changed elements (and those which previously failed to load)
+    size_t rebuild_policy_refs(std::vector<std::shared_ptr<CfgElement>> const& changed);
     int policy_apply (baseHostCX *originator, baseProxy *proxy, int matched_policy=-1);
     void policy_apply_features(std::shared_ptr<PolicyRule> const& policy_rule, MitmProxy *mitm_proxy);
-    std::shared_ptr<PolicyRule> lookup_policy(std::size_t i) { if(i < db_policy_list.size()) return db_policy_list.at(i); else return nullptr; }
+    std::shared_ptr<PolicyRule> lookup_policy(std::size_t i) const { return snapshot()->policy(static_cast<int>(i)); }
 
     bool policy_apply_tls (int policy_num, baseCom *xcom);
     bool policy_apply_tls (const std::shared_ptr<ProfileTls> &pt, baseCom *xcom);
@@ -495,7 +580,6 @@ public:
     bool prof_content_apply (baseHostCX *originator, baseProxy *new_proxy, const std::shared_ptr<ProfileContent> &pc);
     bool prof_detect_apply (baseHostCX *originator, baseProxy *new_proxy, const std::shared_ptr<ProfileDetection> &pd);
 
-    std::optional<std::vector<std::string>> find_bypass_domain_hosts(std::string const& filter_element, bool wildcards_only);
     bool prof_tls_apply (baseHostCX *originator, baseProxy *new_proxy, const std::shared_ptr<ProfileTls> &ps);
     bool prof_alg_dns_apply (baseHostCX *originator, baseProxy *new_proxy, const std::shared_ptr<ProfileAlgDns>& p_alg_dns);
     [[maybe_unused]]
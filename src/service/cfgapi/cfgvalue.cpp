@@ -186,6 +186,16 @@ void CfgValueHelp::init() {
             .may_be_empty(false)
             .value_filter(CfgValue::VALUE_BOOL);
 
+    add("settings.accept_reuseport", "whether each TCP listener thread owns its own SO_REUSEPORT socket")
+            .help_quick("<bool>: set to 'true' to shard accepts per CPU-pinned listener (default: false, requires restart)")
+            .may_be_empty(false)
+            .value_filter(CfgValue::VALUE_BOOL);
+
+    add("settings.accept_reuseport_cpu_steering", "whether to steer new connections to the listener of the receiving CPU")
+            .help_quick("<bool>: set to 'true' to attach BPF CPU steering program, one listener per CPU (default: false, requires restart)")
+            .may_be_empty(false)
+            .value_filter(CfgValue::VALUE_BOOL);
+
     //
 
 
@@ -231,7 +241,42 @@ void CfgValueHelp::init() {
             .value_filter(CfgValue::VALUE_BOOL);
 
     add("settings.ssl_autodetect_harder", "Detect TSL ClientHello on unusual ports - wait a bit longer")
-            .help_quick("<bool> set true to wait a bit longer for TLS ClientHello on plaintext ports")
+            .help_quick("<bool> set true to wait up to 0.5ms for TLS ClientHello on plaintext ports")
+            .may_be_empty(false)
+            .value_filter(CfgValue::VALUE_BOOL);
+
+    add("settings.ssl_early_hello", "Parse TLS ClientHello before handshake starts")
+            .help_quick("<bool> set true to decide SNI bypass from ClientHello (waits up to 50ms) before connecting target (default: true)")
+            .may_be_empty(false)
+            .value_filter(CfgValue::VALUE_BOOL);
+
+    add("settings.splice_fastlane", "Relay not inspected sessions with splice()")
+            .help_quick("<bool> set true to pass payload of not inspected TCP sessions in kernel (default: false)")
+            .may_be_empty(false)
+            .value_filter(CfgValue::VALUE_BOOL);
+
+    add("settings.sg_write", "Write payload of plain TCP sessions with sendmsg() from segment chains")
+            .help_quick("<bool> set true to queue proxied payload in shared segments, written once per round (default: false)")
+            .may_be_empty(false)
+            .value_filter(CfgValue::VALUE_BOOL);
+
+    add("settings.write_high_mark", "Session write queue size when reading from the other side pauses")
+            .help_quick("<number> bytes queued for one side, reading the other side stops above it (default: 4194304)")
+            .may_be_empty(false)
+            .value_filter(CfgValue::VALUE_UINT_NZ);
+
+    add("settings.write_low_mark", "Session write queue size when paused reading resumes")
+            .help_quick("<number> bytes, must be lower than write_high_mark (default: 1048576)")
+            .may_be_empty(false)
+            .value_filter(CfgValue::VALUE_UINT_NZ);
+
+    add("settings.write_budget_mb", "Memory for write queues of all sessions")
+            .help_quick("<number> megabytes, sessions pause reading already at low mark when exceeded, 0 is unlimited (default: 0)")
+            .may_be_empty(false)
+            .value_filter(CfgValue::VALUE_UINT);
+
+    add("settings.relay_proxy", "Use slim L4 proxy for not inspected sessions")
+            .help_quick("<bool> set true to handle sessions of pass-through policies by lightweight relay, spliced if splice_fastlane is set (default: true)")
             .may_be_empty(false)
             .value_filter(CfgValue::VALUE_BOOL);
 
@@ -452,10 +497,10 @@ void CfgValueHelp::init() {
         .value_filter(VALUE_UINT_RANGE<0,65535>);
 
     add("address_objects", "adresses and fqdn names");
-    add("address_objects.[x].type", "'cidr' or 'fqdn'")
+    add("address_objects.[x].type", "'cidr', 'fqdn' or 'file'")
         .may_be_empty(false)
-        .value_filter(is_in_vector([]() -> std::vector<std::string> { return { "cidr", "fqdn" }; },"only allowed options"))
-        .suggestion_generator([](std::string const& section, std::string const& variable) -> std::vector<std::string> { return { "cidr", "fqdn" }; });
+        .value_filter(is_in_vector([]() -> std::vector<std::string> { return { "cidr", "fqdn", "file" }; },"only allowed options"))
+        .suggestion_generator([](std::string const& section, std::string const& variable) -> std::vector<std::string> { return { "cidr", "fqdn", "file" }; });
 
     add("address_objects.[x].value", "value depends on 'type'")
         .may_be_empty(false);
@@ -512,9 +557,9 @@ void CfgValueHelp::init() {
 
     add("policy.[x].nat", "nat options")
             .may_be_empty(false)
-            .value_filter(is_in_vector([]() -> std::vector<std::string> { return {"auto", "none"}; },"auto, or none"))
+            .value_filter(is_in_vector([]() -> std::vector<std::string> { return {"auto", "none", "pool"}; },"auto, none, or pool (needs routing with snat_address)"))
             .suggestion_generator([](std::string const& section, std::string const& variable) -> std::vector<std::string> {
-                return {"auto", "none"};
+                return {"auto", "none", "pool"};
             });
 
     add("policy.[x].tls_profile", "tls options")
@@ -624,9 +669,34 @@ void CfgValueHelp::init_routing() {
             });
     add("routing.[x].dnat_lb_method", "how to distribute connections if more targets")
             .may_be_empty(true)
-            .value_filter(is_in_vector([]() { std::vector<std::string> r {"round-robin", "sticky-l3", "sticky-l4" }; return r; }, "must be in port_objects"))
+            .value_filter(is_in_vector([]() { std::vector<std::string> r {"round-robin", "sticky-l3", "sticky-l4", "maglev-l3", "maglev-l4", "least-conn", "peak-ewma" }; return r; }, "must be in port_objects"))
+            .suggestion_generator([](std::string const& section, std::string const& variable) {
+                std::vector<std::string> r {"round-robin", "sticky-l3", "sticky-l4", "maglev-l3", "maglev-l4", "least-conn", "peak-ewma" }; return r;
+            });
+
+    add("routing.[x].health_check", "active backend checks: connect (tcp), or TLS handshake (tls)")
+            .may_be_empty(true)
+            .value_filter(is_in_vector([]() { std::vector<std::string> r {"none", "tcp", "tls" }; return r; }, "none, tcp, or tls"))
+            .suggestion_generator([](std::string const& section, std::string const& variable) {
+                std::vector<std::string> r {"none", "tcp", "tls" }; return r;
+            });
+
+    add("routing.[x].health_check_port", "port to check (0: first dnat_port)")
+            .may_be_empty(true)
+            .value_filter(VALUE_UINT_RANGE<0, 65535>);
+
+    add("routing.[x].snat_address", "source NAT pool addresses (used with policy nat = pool)")
+            .may_be_empty(true)
+            .value_filter(is_in_vector([]() { return CfgFactory::get()->keys_of_db_address(); },"must be in address_objects"))
             .suggestion_generator([](std::string const& section, std::string const& variable) {
-                std::vector<std::string> r {"round-robin", "sticky-l3", "sticky-l4" }; return r;
+                return CfgFactory::get()->keys_of_db_address();
+            });
+
+    add("routing.[x].snat_port", "source NAT pool ports (1024-65535 if empty)")
+            .may_be_empty(true)
+            .value_filter(is_in_vector([]() { return CfgFactory::get()->keys_of_db_port(); },"must be in port_objects"))
+            .suggestion_generator([](std::string const& section, std::string const& variable) {
+                return CfgFactory::get()->keys_of_db_port();
             });
 }
 
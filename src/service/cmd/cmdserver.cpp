@@ -72,6 +72,7 @@
 
 #include <service/core/smithproxy.hpp>
 #include <proxy/mitmproxy.hpp>
+#include <proxy/relayproxy.hpp>
 #include <proxy/socks5/socksproxy.hpp>
 #include <policy/inspectors.hpp>
 #include <policy/authfactory.hpp>
@@ -305,6 +306,14 @@ std::stringstream features;
     const unsigned long t = MitmProxy::total_mtr_up().total() + MitmProxy::total_mtr_down().total();
     cli_print(cli,"Transferred: %s bytes", number_suffixed(t).c_str());
     cli_print(cli,"Total sessions: %lu", static_cast<unsigned long>(MitmProxy::total_sessions().load()));
+    cli_print(cli,"Spliced sessions: %lu", static_cast<unsigned long>(MitmProxy::spliced_sessions().load()));
+    cli_print(cli,"Scatter-gather writes: %lu syscalls, %s bytes", static_cast<unsigned long>(MitmProxy::sg_syscalls().load()),
+                                                              number_suffixed(MitmProxy::sg_bytes().load()).c_str());
+    auto const& budget = WriteBudget::get();
+    cli_print(cli,"Write queues: %s bytes, throttled directions: %lu now, %lu total", number_suffixed(budget.used.load()).c_str(),
+                                                              static_cast<unsigned long>(budget.throttled.load()),
+                                                              static_cast<unsigned long>(budget.throttled_total.load()));
+    cli_print(cli,"Relay sessions: %lu", static_cast<unsigned long>(RelayProxy::current_sessions().load()));
 
     if(CfgFactory::board()->version_saved() < CfgFactory::board()->version_current()) {
         cli_print(cli, "\n*** Configuration changes NOT saved ***");
@@ -1190,6 +1199,7 @@ bool apply_setting(std::string const& section, std::string const& varname, struc
         apply_hostname(cli);
         cli_print(cli, " ");
         cli_print(cli, "Running config applied (not saved to file).");
+        cli_print(cli, " %s", CfgFactory::get()->apply_report().to_string().c_str());
     }
 
     return ret;
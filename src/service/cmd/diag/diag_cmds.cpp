@@ -60,9 +60,11 @@
 
 #include <sobject.hpp>
 #include <proxy/mitmproxy.hpp>
+#include <proxy/relayproxy.hpp>
 #include <proxy/filters/filterproxy.hpp>
 #include <policy/inspectors.hpp>
 #include <policy/authfactory.hpp>
+#include <policy/verdictcache.hpp>
 
 #include <inspect/sigfactory.hpp>
 #include <inspect/sxsignature.hpp>
@@ -764,6 +766,7 @@ int cli_diag_dns_cache_stats(struct cli_def *cli, const char *command, char *arg
     std::stringstream out;
     std::size_t cache_size = 0;
     int max_size = 0;
+    std::size_t index_size = 0;
 
     {
         auto lc_ = std::scoped_lock(DNS::get_dns_lock());
@@ -771,10 +774,12 @@ int cli_diag_dns_cache_stats(struct cli_def *cli, const char *command, char *arg
         out << "\nDNS cache statistics: \n";
         cache_size = DNS::get_dns_cache().cache().size();
         max_size = DNS::get_dns_cache().max_size();
+        index_size = DNS::get_reverse_index().size();
     }
 
     out << string_format("  Current size: %5d\n", cache_size);
     out << string_format("  Maximum size: %5d\n", max_size);
+    out << string_format("  Indexed IPs:  %5d\n", index_size);
 
     cli_print(cli, "%s", out.str().c_str());
     return CLI_OK;
@@ -787,6 +792,7 @@ int cli_diag_dns_cache_clear(struct cli_def *cli, const char *command, char *arg
     {
         auto lc_ = std::scoped_lock(DNS::get_dns_lock());
         DNS::get_dns_cache().clear();
+        DNS::get_reverse_index().clear();
     }
 
     cli_print(cli,"\nDNS cache cleared.");
@@ -794,6 +800,53 @@ int cli_diag_dns_cache_clear(struct cli_def *cli, const char *command, char *arg
     return CLI_OK;
 }
 
+namespace {
+    std::vector<std::shared_ptr<PrefixListAddress>> prefix_list_objects() {
+        std::vector<std::shared_ptr<PrefixListAddress>> ret;
+
+        auto lc_ = std::scoped_lock(CfgFactory::lock());
+        for (auto const& [ _, a ]: CfgFactory::get()->db_address) {
+            if(auto ca = std::dynamic_pointer_cast<CfgAddress>(a); ca) {
+                if(auto pl = std::dynamic_pointer_cast<PrefixListAddress>(ca->value()); pl) {
+                    ret.push_back(pl);
+                }
+            }
+        }
+
+        return ret;
+    }
+}
+
+int cli_diag_address_lists(struct cli_def *cli, const char *command, char *argv[], int argc) {
+
+    debug_cli_params(cli, command, argv, argc);
+
+    std::stringstream out;
+    std::size_t total_bytes = 0;
+
+    out << "\nPrefix list address objects:\n";
+    for(auto const& pl: prefix_list_objects()) {
+        out << "  " << pl->element_name() << ": " << pl->to_string(iDEB) << "\n";
+        if(auto t = pl->table(); t) total_bytes += t->stats().bytes;
+    }
+    out << string_format("\n  Total memory: %dkB\n", total_bytes / 1024);
+
+    cli_print(cli, "%s", out.str().c_str());
+    return CLI_OK;
+}
+
+int cli_diag_address_lists_reload(struct cli_def *cli, const char *command, char *argv[], int argc) {
+
+    debug_cli_params(cli, command, argv, argc);
+
+    for(auto const& pl: prefix_list_objects()) {
+        bool ok = pl->reload();
+        cli_print(cli, "  %s: %s", pl->element_name().c_str(), ok ? "reloaded" : "reload failed, keeping previous content");
+    }
+
+    return CLI_OK;
+}
+
 int cli_diag_dns_domain_cache_list(struct cli_def *cli, const char *command, char *argv[], int argc) {
 
     debug_cli_params(cli, command, argv, argc);
@@ -845,19 +898,17 @@ int cli_diag_identity_ip_list(struct cli_def *cli, const char *command, char *ar
     std::stringstream ss4;
 
     {
-        auto lc_ = std::scoped_lock(AuthFactory::get_ip4_lock());
-
-        for (auto const& [ ip_address, identity]: AuthFactory::get_ip4_map()) {
+        AuthFactory::get_ip4_map().for_each([&ss4](in_addr const&, IdentityInfo const& identity) {
 
             ss4 << "\n";
-            ss4 << "    ipv4: " << ip_address << ", user: " << identity.username << ", groups: " << identity.groups << ", rx/tx: ";
+            ss4 << "    ipv4: " << identity.ip << ", user: " << identity.username << ", groups: " << identity.groups << ", rx/tx: ";
             ss4 << number_suffixed(identity.tx_bytes) << "/" << number_suffixed(identity.rx_bytes);
 
             ss4 << "\n          uptime: " << std::to_string(identity.uptime()) << ", idle: " << std::to_string(identity.i_time());
             ss4 << "\n          status: " << std::to_string(!identity.i_timeout()) << ", last policy: ";
             ss4 <<   std::to_string(identity.last_seen_policy);
             ss4 << "\n";
-        }
+        });
 
     }
     cli_print(cli, "%s", ss4.str().c_str());
@@ -866,19 +917,17 @@ int cli_diag_identity_ip_list(struct cli_def *cli, const char *command, char *ar
     cli_print(cli, "\nIPv6 identities:");
     std::stringstream ss6;
     {
-        auto lc_ = std::scoped_lock(AuthFactory::get_ip6_lock());
-
-        for (auto const& [ ip_address, identity]: AuthFactory::get_ip6_map()) {
+        AuthFactory::get_ip6_map().for_each([&ss6](in6_addr const&, IdentityInfo6 const& identity) {
 
             ss6 << "\n";
-            ss6 << "    ipv6: " << ip_address << ", user: " << identity.username << ", groups: " << identity.groups << ", rx/tx: ";
+            ss6 << "    ipv6: " << identity.ip << ", user: " << identity.username << ", groups: " << identity.groups << ", rx/tx: ";
             ss6 << number_suffixed(identity.tx_bytes) << "/" << number_suffixed(identity.rx_bytes);
             ss6 << "\n          uptime: " << std::to_string(identity.uptime()) << ", idle: " << std::to_string(identity.i_time());
             ss6 << "\n          status: " << std::to_string(!identity.i_timeout()) << ", last policy: ";
             ss6 <<   std::to_string(identity.last_seen_policy);
             ss6 << "\n";
 
-        }
+        });
     }
     cli_print(cli, "%s", ss6.str().c_str());
 
@@ -895,6 +944,7 @@ int cli_diag_identity_ip_clear(struct cli_def *cli, const char *command, char *a
         auto lc_ = std::scoped_lock(AuthFactory::get_ip4_lock());
 
         AuthFactory::get_ip4_map().clear();
+        if(AuthFactory::get().snap_ip4_seen_ > 0) AuthFactory::get().snap_ip4_.publish({});
         AuthFactory::get().shm_ip4_map.acquire();
         AuthFactory::get().shm_ip4_map.map_entries().clear();
         AuthFactory::get().shm_ip4_map.entries().clear();
@@ -909,6 +959,7 @@ int cli_diag_identity_ip_clear(struct cli_def *cli, const char *command, char *a
         auto lc_ = std::scoped_lock(AuthFactory::get_ip6_lock());
 
         AuthFactory::get_ip6_map().clear();
+        if(AuthFactory::get().snap_ip6_seen_ > 0) AuthFactory::get().snap_ip6_.publish({});
         AuthFactory::get().shm_ip6_map.acquire();
         AuthFactory::get().shm_ip6_map.map_entries().clear();
         AuthFactory::get().shm_ip6_map.entries().clear();
@@ -918,6 +969,7 @@ int cli_diag_identity_ip_clear(struct cli_def *cli, const char *command, char *a
         AuthFactory::get().shm_ip6_map.seen_version(0);
         AuthFactory::get().shm_ip6_map.release();
     }
+    AuthFactory::get().identity_changed();
 
     return CLI_OK;
 }
@@ -1909,6 +1961,17 @@ int cli_diag_proxy_session_list_extra (struct cli_def *cli, const char *command,
 
                 out << cur_obj_ss.str() << "\n";
             }
+            else if (what == "RelayProxy") {
+
+                auto* relay = dynamic_cast<RelayProxy *>(so_ptr);
+                if(not relay) continue;
+
+                if (flag_check<int>(sl_flags, SL_ACTIVE) and relay->stats().mtr_down.get() + relay->stats().mtr_up.get() == 0) {
+                    continue;
+                }
+
+                out << relay->to_string(verbosity) << "\n";
+            }
         }
     }
 
@@ -1963,6 +2026,96 @@ int cli_diag_proxy_policy_list(struct cli_def *cli, const char *command, char *a
             out << it->to_string(verbosity);
             out << "\n\n";
         }
+
+    }
+
+    if(auto snap = CfgFactory::get()->snapshot(); snap) {
+        out << "Config snapshot version: " << snap->version << ", policies: " << snap->policy_list.size() << "\n";
+        if(snap->classifier) {
+            out << snap->classifier->to_string(verbosity) << "\n";
+        }
+    }
+
+    cli_print(cli, "%s", out.str().c_str());
+    return CLI_OK;
+}
+
+
+int cli_diag_proxy_policy_cache(struct cli_def *cli, const char *command, char *argv[], int argc) {
+
+    debug_cli_params(cli, command, argv, argc);
+
+    int verbosity = iINF;
+    if(argc > 0) {
+        verbosity = safe_val(argv[0], iINF);
+    }
+
+    cli_print(cli, "%s", VerdictCache::get().to_string(verbosity).c_str());
+    return CLI_OK;
+}
+
+int cli_diag_proxy_policy_cache_clear(struct cli_def *cli, const char *command, char *argv[], int argc) {
+
+    debug_cli_params(cli, command, argv, argc);
+
+    VerdictCache::get().clear();
+    cli_print(cli, "policy verdict cache cleared");
+
+    return CLI_OK;
+}
+
+int cli_diag_proxy_backend_list(struct cli_def *cli, const char *command, char *argv[], int argc) {
+
+    debug_cli_params(cli, command, argv, argc);
+
+    auto args = args_to_vec(argv, argc);
+    int verbosity = iINF;
+    if(not args.empty()) verbosity = safe_val(args[0], iINF);
+
+    std::stringstream out;
+    out << "\nRouting backend health (interval " << BackendHealth::interval << "s, timeout " << BackendHealth::timeout
+        << "s, rise " << BackendHealth::rise << ", fall " << BackendHealth::fall << "):\n";
+    out << BackendHealth::get().to_string(verbosity);
+
+    auto const now = HostInfo::now_ns();
+    out << "\nRouting backend sessions:\n";
+    {
+        auto lc_ = std::scoped_lock(CfgFactory::lock());
+        for (auto const& [ name, r ]: CfgFactory::get()->db_routing) {
+            auto rp = std::dynamic_pointer_cast<ProfileRouting>(r);
+            if(not rp) continue;
+
+            auto ll_ = std::scoped_lock(rp->lb_state.lock_);
+            for(auto const& pool: { rp->lb_state.pool_v4, rp->lb_state.pool_v6 }) {
+                if(not pool) continue;
+
+                for(auto const& h: pool->candidates()) {
+                    out << "  routing " << name << ": " << h->host << " active=" << h->active_sessions
+                        << " hits=" << h->hits << " latency=" << h->latency_ns(now) / 1000000.0 << "ms\n";
+                }
+            }
+        }
+    }
+
+    cli_print(cli, "%s", out.str().c_str());
+    return CLI_OK;
+}
+
+int cli_diag_proxy_nat_pool(struct cli_def *cli, const char *command, char *argv[], int argc) {
+
+    debug_cli_params(cli, command, argv, argc);
+
+    std::stringstream out;
+    out << "\nSource NAT pools:\n";
+
+    {
+        auto lc_ = std::scoped_lock(CfgFactory::lock());
+        for (auto const& [ name, r ]: CfgFactory::get()->db_routing) {
+            auto rp = std::dynamic_pointer_cast<ProfileRouting>(r);
+            if(not rp or not rp->snat_pool) continue;
+
+            out << "  routing " << name << ": " << rp->snat_pool->to_string(iDEB) << "\n";
+        }
     }
 
     cli_print(cli, "%s", out.str().c_str());
@@ -2013,6 +2166,13 @@ int cli_diag_sig_list(struct cli_def *cli, const char *command, char *argv[], in
 }
 
 
+// workers which count accepted connections (TCP acceptors)
+template <typename T, typename = void>
+struct has_accept_stats : std::false_type {};
+
+template <typename T>
+struct has_accept_stats<T, std::void_t<decltype(std::declval<T const&>().accept_stats())>> : std::true_type {};
+
 int cli_diag_worker_list(struct cli_def *cli, [[maybe_unused]] const char *command, [[maybe_unused]] char *argv[], [[maybe_unused]] int argc) {
 
     int verbosity = iINF;
@@ -2023,7 +2183,17 @@ int cli_diag_worker_list(struct cli_def *cli, [[maybe_unused]] const char *comma
 
     auto& sx = SmithProxy::instance();
 
-    auto list_worker = [&cli] (auto const& wrk, std::size_t index, int verbosity) {
+    auto accept_str = [](auto const& worker) -> std::string {
+        using worker_t = std::decay_t<decltype(*worker)>;
+
+        if constexpr (has_accept_stats<worker_t>::value) {
+            auto const& acc = worker->accept_stats();
+            return string_format(", accepts: %lu/s (%lu)", acc.rate(), acc.accepted());
+        }
+        return {};
+    };
+
+    auto list_worker = [&cli, &accept_str] (auto const& wrk, std::size_t index, int verbosity) {
 
         std::stringstream out;
 
@@ -2039,9 +2209,9 @@ int cli_diag_worker_list(struct cli_def *cli, [[maybe_unused]] const char *comma
 
         if (proxies.empty()) {
             if(verbosity > iINF)
-                out << "\n          `- idle";
+                out << "\n          `- idle" << accept_str(wrk.second);
             else
-                out << " [> idle";
+                out << " [> idle" << accept_str(wrk.second);
 
             auto sss = out.str();
             cli_print(cli, "%s", sss.c_str());
@@ -2073,7 +2243,7 @@ int cli_diag_worker_list(struct cli_def *cli, [[maybe_unused]] const char *comma
                     auto const& proxy = proxies.at(p_i).first;
                     out << string_format("\n          `- proxy[%d]: %s", p_i, proxy->str().c_str());
                 }
-                out << "\n          `- " << speed_str;
+                out << "\n          `- " << speed_str << accept_str(wrk.second);
             }
         } else {
             auto num_proxies = proxies.size();
@@ -2081,7 +2251,7 @@ int cli_diag_worker_list(struct cli_def *cli, [[maybe_unused]] const char *comma
             for (std::size_t prin = 0; prin < num_proxies; ++prin) out << "=";
             out << ">";
 
-            out << string_format(" : %d proxies, %s", num_proxies, speed_str.c_str());
+            out << string_format(" : %d proxies, %s", num_proxies, speed_str.c_str()) << accept_str(wrk.second);
         }
 
         auto sss = out.str();
@@ -2123,9 +2293,20 @@ int cli_diag_worker_list(struct cli_def *cli, [[maybe_unused]] const char *comma
                 thread_id = get_thread_id_str(threads.at(idx));
             }
 
-            cli_print(cli, "    %s%s%s", acceptor->hr().c_str(),
+            std::string reuseport_str;
+            if(auto rp = NetworkServiceFactory::reuseport_listener(acceptor.get()); rp) {
+                reuseport_str = string_format(", reuseport cpu %d", rp->cpu);
+
+                if(auto q = NetworkServiceFactory::accept_queue(rp->socket); q) {
+                    reuseport_str += string_format(", accept queue %u/%u%s", q->length, q->backlog,
+                                                   q->length >= q->backlog ? " *full*" : "");
+                }
+            }
+
+            cli_print(cli, "    %s%s%s%s", acceptor->hr().c_str(),
                                 (verbosity > iINF ? string_format(", type %s", acceptor->proxy_type().str().c_str()).c_str() : ""),
-                                ( (verbosity > iINF and not thread_id.empty() ) ? string_format(", thread %s", thread_id.c_str()).c_str() : ""));
+                                ( (verbosity > iINF and not thread_id.empty() ) ? string_format(", thread %s", thread_id.c_str()).c_str() : ""),
+                                reuseport_str.c_str());
 
 
 
@@ -2155,6 +2336,10 @@ int cli_diag_worker_list(struct cli_def *cli, [[maybe_unused]] const char *comma
 
     cli_print(cli, "\nThreading load: %d total busy workers, %.2f per CPU", stats.workers_busy, stats.workers_busy/(float)std::thread::hardware_concurrency());
 
+    if(auto ovf = NetworkServiceFactory::listen_overflows(); ovf) {
+        cli_print(cli, "Accept queue overflows (system): %lu, listen drops: %lu", ovf->first, ovf->second);
+    }
+
     return CLI_OK;
 }
 int cli_diag_api_list(struct cli_def *cli, const char *command, char *argv[], int argc) {
@@ -2256,9 +2441,21 @@ bool register_diags(cli_def* cli, cli_command* diag) {
     cli_register_command(cli, diag_dns_domains, "list", cli_diag_dns_domain_cache_list, PRIVILEGE_PRIVILEGED, MODE_EXEC, "DNS sub-domain list");
     cli_register_command(cli, diag_dns_domains, "clear", cli_diag_dns_domain_cache_clear, PRIVILEGE_PRIVILEGED, MODE_EXEC, "clear DNS sub-domain cache");
 
+    auto diag_address = cli_register_command(cli, diag, "address", nullptr, PRIVILEGE_UNPRIVILEGED, MODE_EXEC, "address objects troubleshooting commands");
+    auto diag_address_lists = cli_register_command(cli, diag_address, "lists", cli_diag_address_lists, PRIVILEGE_PRIVILEGED, MODE_EXEC, "prefix list objects and their memory footprint");
+    cli_register_command(cli, diag_address_lists, "reload", cli_diag_address_lists_reload, PRIVILEGE_PRIVILEGED, MODE_EXEC, "reload all prefix list files");
+
     auto diag_proxy = cli_register_command(cli, diag, "proxy",nullptr, PRIVILEGE_PRIVILEGED, MODE_EXEC, "proxy related troubleshooting commands");
     auto diag_proxy_policy = cli_register_command(cli,diag_proxy,"policy",nullptr,PRIVILEGE_PRIVILEGED, MODE_EXEC,"proxy policy commands");
     cli_register_command(cli, diag_proxy_policy,"list",cli_diag_proxy_policy_list, PRIVILEGE_PRIVILEGED, MODE_EXEC,"proxy policy list");
+    auto diag_proxy_policy_cache = cli_register_command(cli, diag_proxy_policy,"cache",cli_diag_proxy_policy_cache, PRIVILEGE_PRIVILEGED, MODE_EXEC,"policy verdict cache statistics");
+    cli_register_command(cli, diag_proxy_policy_cache,"clear",cli_diag_proxy_policy_cache_clear, PRIVILEGE_PRIVILEGED, MODE_EXEC,"clear policy verdict cache");
+
+    auto diag_proxy_backend = cli_register_command(cli,diag_proxy,"backend",nullptr,PRIVILEGE_PRIVILEGED, MODE_EXEC,"routing backend commands");
+    cli_register_command(cli, diag_proxy_backend,"list",cli_diag_proxy_backend_list, PRIVILEGE_PRIVILEGED, MODE_EXEC,"routing backends health state and probe latency");
+
+    auto diag_proxy_nat = cli_register_command(cli,diag_proxy,"nat",nullptr,PRIVILEGE_PRIVILEGED, MODE_EXEC,"proxy NAT commands");
+    cli_register_command(cli, diag_proxy_nat,"pool",cli_diag_proxy_nat_pool, PRIVILEGE_PRIVILEGED, MODE_EXEC,"source NAT pool usage");
 
     auto diag_proxy_session = cli_register_command(cli,diag_proxy,"session",nullptr,PRIVILEGE_PRIVILEGED, MODE_EXEC,"proxy session commands");
     cli_register_command(cli, diag_proxy_session,"list", cli_diag_proxy_session_list, PRIVILEGE_PRIVILEGED, MODE_EXEC,"proxy session list");
@@ -74,6 +74,8 @@ int cli_diag_ssl_ca_reload(struct cli_def *cli, const char *command, char *argv[
 int cli_diag_dns_cache_list(struct cli_def *cli, const char *command, char *argv[], int argc);
 int cli_diag_dns_cache_stats(struct cli_def *cli, const char *command, char *argv[], int argc);
 int cli_diag_dns_cache_clear(struct cli_def *cli, const char *command, char *argv[], int argc);
+int cli_diag_address_lists(struct cli_def *cli, const char *command, char *argv[], int argc);
+int cli_diag_address_lists_reload(struct cli_def *cli, const char *command, char *argv[], int argc);
 
 int cli_diag_dns_domain_cache_list(struct cli_def *cli, const char *command, char *argv[], int argc);
 int cli_diag_dns_domain_cache_clear(struct cli_def *cli, const char *command, char *argv[], int argc);
@@ -114,6 +116,10 @@ int cli_diag_proxy_session_io_list(struct cli_def *cli, const char *command, cha
 int cli_diag_proxy_session_clear(struct cli_def *cli, const char *command, char *argv[], int argc);
 
 int cli_diag_proxy_policy_list(struct cli_def *cli, const char *command, char *argv[], int argc);
+int cli_diag_proxy_policy_cache(struct cli_def *cli, const char *command, char *argv[], int argc);
+int cli_diag_proxy_policy_cache_clear(struct cli_def *cli, const char *command, char *argv[], int argc);
+int cli_diag_proxy_nat_pool(struct cli_def *cli, const char *command, char *argv[], int argc);
+int cli_diag_proxy_backend_list(struct cli_def *cli, const char *command, char *argv[], int argc);
 int cli_diag_proxy_tls_list(struct cli_def *cli, const char *command, char *argv[], int argc);
 int cli_diag_proxy_list_active(struct cli_def *cli, const char *command, char *argv[], int argc);
 
@@ -84,25 +84,47 @@ std::thread* SmithProxy::create_identity_refresh_thread() {
             return;
         }
 
-        for (unsigned i = 0; ; i++) {
+        auto& af = AuthFactory::get();
+        af.shm_changes_attach();
 
-            if(abort_sleep(20)) {
-                _dia("id_thread: terminating");
-                break;
+        time_t last_reload = 0;
+        time_t last_check = 0;
+
+        while (not Service::self()->terminate_flag) {
+
+            auto const now = time(nullptr);
+
+            // full reload catches writers which don't use change log, and recovers from log overruns
+            if(now - last_reload >= static_cast<time_t>(af.shm_full_refresh_interval())) {
+                _deb("id_thread: refreshing identities");
+
+                af.shm_ip4_table_refresh();
+                af.shm_ip6_table_refresh();
+                af.shm_token_table_refresh();
+                last_reload = now;
             }
 
-            _deb("id_thread: refreshing identities");
+            if(now - last_check >= static_cast<time_t>(af.options.shm_full_refresh)) {
+                af.ip4_timeout_check();
+                af.ip6_timeout_check();
+                last_check = now;
 
-            AuthFactory::get().shm_ip4_table_refresh();
-            AuthFactory::get().shm_ip6_table_refresh();
-            AuthFactory::get().shm_token_table_refresh();
-            AuthFactory::get().ip4_timeout_check();
-            AuthFactory::get().ip6_timeout_check();
+                _dum("id_thread: finished");
+            }
 
-            _dum("id_thread: finished");
+            // woken up by writers as soon as they append to change log
+            if(af.shm_changes_wait(1000)) {
+                af.shm_changes_apply();
+            }
 
+            // lock-free, just compares generation numbers if nothing was published
+            af.shm_ip4_snapshot_refresh();
+            af.shm_ip6_snapshot_refresh();
 
+            // removals made by workers and timeout checks
+            af.shm_snapshot_removals_flush();
         }
+        _dia("id_thread: terminating");
     });
 
     return id_thread;
@@ -179,7 +201,9 @@ bool SmithProxy::create_listeners() {
                     std::stoi(CfgFactory::get()->listen_tcp_port),
                     tcp_frm,
                     CfgFactory::get()->num_workers_tcp,
-                    proxyType::transparent());
+                    proxyType::transparent(),
+                    CfgFactory::get()->accept_reuseport,
+                    CfgFactory::get()->accept_reuseport_cpu_steering);
 
             log_listener(tcp_frm, plain_proxies);
 
@@ -187,7 +211,9 @@ bool SmithProxy::create_listeners() {
                     std::stoi(CfgFactory::get()->listen_tls_port),
                     tls_frm,
                     CfgFactory::get()->num_workers_tls,
-                    proxyType::transparent());
+                    proxyType::transparent(),
+                    CfgFactory::get()->accept_reuseport,
+                    CfgFactory::get()->accept_reuseport_cpu_steering);
 
             log_listener(tls_frm, ssl_proxies);
 
@@ -226,7 +252,9 @@ bool SmithProxy::create_listeners() {
                     std::stoi(CfgFactory::get()->listen_socks_port),
                     socks_frm,
                     CfgFactory::get()->num_workers_socks,
-                    proxyType::proxy());
+                    proxyType::proxy(),
+                    CfgFactory::get()->accept_reuseport,
+                    CfgFactory::get()->accept_reuseport_cpu_steering);
 
             log_listener(socks_frm, socks_proxies);
 
@@ -254,7 +282,9 @@ bool SmithProxy::create_listeners() {
                     std::stoi(CfgFactory::get()->listen_tcp_port) + 1000,
                     retcp_frm,
                     CfgFactory::get()->num_workers_tcp,
-                    proxyType::redirect());
+                    proxyType::redirect(),
+                    CfgFactory::get()->accept_reuseport,
+                    CfgFactory::get()->accept_reuseport_cpu_steering);
 
             log_listener(retcp_frm, redir_plain_proxies);
 
@@ -262,7 +292,9 @@ bool SmithProxy::create_listeners() {
                     std::stoi(CfgFactory::get()->listen_tls_port) + 1000,
                     "ssl-rdr",
                     CfgFactory::get()->num_workers_tls,
-                    proxyType::redirect());
+                    proxyType::redirect(),
+                    CfgFactory::get()->accept_reuseport,
+                    CfgFactory::get()->accept_reuseport_cpu_steering);
 
             log_listener(retls_frm, redir_ssl_proxies);
 
@@ -660,7 +692,8 @@ bool SmithProxy::load_config(std::string& config_f, bool reload) {
     CfgFactory::get()->config_file = config_f;
 
     // Add another level of lock. File is already loaded. We need to apply its content.
-    // lock is needed here to not try to match against potentially empty/partial policy list
+    // Lock serializes writers only: sessions match against last published snapshot, which is
+    // replaced at the end of load_db_policy(), so they never see empty/partial policy list.
     std::lock_guard<std::recursive_mutex> l_(CfgFactory::lock());
     try {
 
@@ -69,6 +69,7 @@ unsigned int dns_cache_cleanup() {
         auto ttl = it->second->ptr()->current_ttl().value_or(-1);
         if(ttl < 0) {
             _deb("dns_cache_cleanup:     ttl %d -- removing", ttl);
+            DNS::get_reverse_index().remove(it->first);
             it = cache.erase(it);
             removed++;
         } else {
@@ -195,6 +196,31 @@ struct DNS_Resolver : DNS_Setup {
     }
 };
 
+// file-backed address objects are maintained by this thread too, alongside FQDN objects
+void prefix_lists_refresh() {
+
+    logan_lite log = logan_lite("com.dns.updater");
+
+    std::vector<std::shared_ptr<PrefixListAddress>> lists;
+    {
+        auto lc_ = std::scoped_lock(CfgFactory::lock());
+        for (auto const &a: CfgFactory::get()->db_address) {
+            if(auto fa = std::dynamic_pointer_cast<CfgAddress>(a.second); fa) {
+                if(auto pl = std::dynamic_pointer_cast<PrefixListAddress>(fa->value()); pl) {
+                    lists.push_back(pl);
+                }
+            }
+        }
+    }
+
+    // reload outside of config lock, matching continues with old table until swapped
+    for(auto const& pl: lists) {
+        if(pl->reload_if_changed()) {
+            _inf("prefix list %s reloaded: %s", pl->element_name().c_str(), pl->to_string(iINF).c_str());
+        }
+    }
+}
+
 void dns_updater_thread_fn() {
 
     auto const& log = DNS_Resolver::log;
@@ -218,6 +244,8 @@ void dns_updater_thread_fn() {
         const auto to_refresh = DNS_Resolver::check_cache_expiry(request_candidates);
         DNS_Resolver::requery_records(to_refresh);
 
+        prefix_lists_refresh();
+
         dns_cache_laundry_delta += sleep_time;
         if(dns_cache_laundry_delta > dns_cache_laundry_ttl) {
             dns_cache_laundry_delta = 0;
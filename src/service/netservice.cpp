@@ -39,6 +39,18 @@
 
 
 #include <stdexcept>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/filter.h>
+#include <sys/socket.h>
 
 #include <service/netservice.hpp>
 
@@ -51,4 +63,140 @@
 namespace sx {
     netservice_error::netservice_error (const char *string) : runtime_error(string) {}
     netservice_cannot_bind::netservice_cannot_bind (const char *string) : netservice_error(string) {}
-}
\ No newline at end of file
+}
+
+std::optional<NetworkServiceFactory::ReuseportListener> NetworkServiceFactory::reuseport_listener(void const* listener) {
+    auto lc_ = std::scoped_lock(reuseport_lock());
+
+    auto it = reuseport_listeners().find(listener);
+    if(it == reuseport_listeners().end()) return std::nullopt;
+
+    return it->second;
+}
+
+int NetworkServiceFactory::reuseport_socket(unsigned short port) {
+
+    auto const& log = NetworkServiceFactory::log();
+
+    int sock = ::socket(AF_INET6, SOCK_STREAM, 0);
+    if(sock < 0) {
+        _err("reuseport_socket: cannot create socket: %s", string_error().c_str());
+        return -1;
+    }
+
+    auto set_opt = [sock, &log](int level, int opt, const char* name) {
+        int one = 1;
+        if(::setsockopt(sock, level, opt, &one, sizeof(one)) != 0) {
+            _err("reuseport_socket: cannot set %s: %s", name, string_error().c_str());
+            return false;
+        }
+        return true;
+    };
+
+    int zero = 0;
+    ::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+
+    if(not set_opt(SOL_SOCKET, SO_REUSEADDR, "SO_REUSEADDR") or
+       not set_opt(SOL_SOCKET, SO_REUSEPORT, "SO_REUSEPORT") or
+       not set_opt(SOL_IP, IP_TRANSPARENT, "IP_TRANSPARENT") or
+       not set_opt(SOL_IPV6, IPV6_TRANSPARENT, "IPV6_TRANSPARENT")) {
+
+        ::close(sock);
+        return -1;
+    }
+
+    sockaddr_in6 sa {};
+    sa.sin6_family = AF_INET6;
+    sa.sin6_addr = in6addr_any;
+    sa.sin6_port = htons(port);
+
+    if(::bind(sock, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0) {
+        _err("reuseport_socket: cannot bind port %d: %s", port, string_error().c_str());
+        ::close(sock);
+        return -1;
+    }
+
+    if(::listen(sock, SOMAXCONN) != 0) {
+        _err("reuseport_socket: cannot listen on port %d: %s", port, string_error().c_str());
+        ::close(sock);
+        return -1;
+    }
+
+    ::fcntl(sock, F_SETFL, ::fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+    return sock;
+}
+
+bool NetworkServiceFactory::reuseport_cpu_steering(int sock) {
+
+    // A = current cpu; return A  -- socket index in the reuseport group
+    sock_filter code[] = {
+            { BPF_LD  | BPF_W | BPF_ABS, 0, 0, static_cast<__u32>(SKF_AD_OFF + SKF_AD_CPU) },
+            { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    sock_fprog prog { sizeof(code) / sizeof(code[0]), code };
+
+    return ::setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == 0;
+}
+
+std::optional<NetworkServiceFactory::AcceptQueue> NetworkServiceFactory::accept_queue(int sock) {
+
+    // on listening sockets kernel reports current accept queue length in tcpi_unacked and its size in tcpi_sacked
+    tcp_info info {};
+    socklen_t len = sizeof(info);
+
+    if(::getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len) != 0 or info.tcpi_state != TCP_LISTEN) {
+        return std::nullopt;
+    }
+
+    return AcceptQueue { info.tcpi_unacked, info.tcpi_sacked };
+}
+
+std::optional<std::pair<unsigned long, unsigned long>> NetworkServiceFactory::listen_overflows() {
+
+    std::ifstream netstat("/proc/net/netstat");
+    std::string names;
+    std::string values;
+
+    while(std::getline(netstat, names) and std::getline(netstat, values)) {
+        if(names.rfind("TcpExt:", 0) != 0) continue;
+
+        std::stringstream ns(names);
+        std::stringstream vs(values);
+        std::string name;
+        std::string value;
+
+        std::optional<unsigned long> overflows;
+        std::optional<unsigned long> drops;
+
+        while(ns >> name and vs >> value) {
+            if(name == "ListenOverflows") overflows = std::strtoul(value.c_str(), nullptr, 10);
+            else if(name == "ListenDrops") drops = std::strtoul(value.c_str(), nullptr, 10);
+        }
+
+        if(overflows and drops) return std::make_pair(overflows.value(), drops.value());
+        break;
+    }
+
+    return std::nullopt;
+}
+
+bool NetworkServiceFactory::pin_thread(pthread_t thread, int cpu) {
+
+    if(cpu < 0) return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+void NetworkServiceFactory::pin_acceptor(void const* listener) {
+
+    auto const& log = NetworkServiceFactory::log();
+
+    if(auto rp = reuseport_listener(listener); rp and not pin_thread(pthread_self(), rp->cpu)) {
+        _war("reuseport listener: cannot pin acceptor to cpu %d", rp->cpu);
+    }
+}
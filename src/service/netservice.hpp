@@ -41,6 +41,12 @@
 #define SRVUTILS_HPP_
 
 #include <algorithm>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+#include <unistd.h>
 
 #include <threadedacceptor.hpp>
 #include <threadedreceiver.hpp>
@@ -68,15 +74,55 @@ public:
         return l;
     }
 
+    // listener which owns its own SO_REUSEPORT socket (and accept queue); its acceptor thread runs on the CPU
+    struct ReuseportListener {
+        int socket = -1;
+        int cpu = -1;
+    };
+
+    struct AcceptQueue {
+        unsigned int length = 0;
+        unsigned int backlog = 0;
+    };
+
+    static std::mutex& reuseport_lock() { static std::mutex m; return m; }
+    static std::unordered_map<void const*, ReuseportListener>& reuseport_listeners() {
+        static std::unordered_map<void const*, ReuseportListener> m;
+        return m;
+    }
+    static std::optional<ReuseportListener> reuseport_listener(void const* listener);
+
+    // create bound and listening TCP socket with SO_REUSEPORT set
+    static int reuseport_socket(unsigned short port);
+    // attach classic BPF program steering new connections to the socket with index of receiving CPU
+    static bool reuseport_cpu_steering(int sock);
+
+    // current accept queue of the listening socket
+    static std::optional<AcceptQueue> accept_queue(int sock);
+    // system-wide TcpExt ListenOverflows and ListenDrops counters
+    static std::optional<std::pair<unsigned long, unsigned long>> listen_overflows();
+
+    // pin calling thread to the cpu
+    static bool pin_thread(pthread_t thread, int cpu);
+    // pin calling thread to the cpu of reuseport @listener, if it is one. Call it from acceptor thread once
+    // its sub-workers are running (ie. on first accept), so they don't inherit the affinity.
+    static void pin_acceptor(void const* listener);
+
     template <class Listener, class Com,
             typename port_type = unsigned short>
     static std::vector<std::unique_ptr<Listener>> prepare_listener (port_type port, std::string const &friendly_name, int sub_workers,
-                                                                    proxyType type);
+                                                                    proxyType type, bool reuseport = false, bool cpu_steering = false);
+
+private:
+    template <class Listener>
+    static void prepare_reuseport (std::vector<std::unique_ptr<Listener>>& vec_toret, unsigned short port, std::string const &friendly_name,
+                                   int sub_workers, bool cpu_steering, std::function<Listener*(std::shared_ptr<FdQueue>)> const& create_listener,
+                                   std::function<void(Listener*, int)> const& attach_listener);
 };
 
 template <class Listener, class Com, typename port_type>
 std::vector<std::unique_ptr<Listener>> NetworkServiceFactory::prepare_listener (port_type port, std::string const &friendly_name, int sub_workers,
-                                                    proxyType type) {
+                                                    proxyType type, bool reuseport, bool cpu_steering) {
 
     auto const& log = NetworkServiceFactory::log();
 
@@ -94,11 +140,9 @@ std::vector<std::unique_ptr<Listener>> NetworkServiceFactory::prepare_listener (
     _not(sss.c_str());
 
 
-    auto fdhints = std::make_shared<FdQueue>();
-
-    auto create_listener = [&]() -> Listener* {
+    auto create_listener = [&](std::shared_ptr<FdQueue> fdhints) -> Listener* {
         auto* nc =  new Com();
-        auto* r = new Listener(fdhints, nc, type);
+        auto* r = new Listener(std::move(fdhints), nc, type);
 
         r->com()->nonlocal_dst(true);
         r->worker_count_preference(std::max(sub_workers, 2));
@@ -115,7 +159,18 @@ std::vector<std::unique_ptr<Listener>> NetworkServiceFactory::prepare_listener (
 
     };
 
-    std::unique_ptr<Listener> listener(create_listener());
+    if constexpr (std::is_integral_v<port_type>) {
+        if (reuseport) {
+            prepare_reuseport<Listener>(vec_toret, port, friendly_name, sub_workers, cpu_steering,
+                                        create_listener, attach_listener);
+            return vec_toret;
+        }
+    }
+
+    // all listeners accept from one socket and share hints which of them should take new connection
+    auto fdhints = std::make_shared<FdQueue>();
+
+    std::unique_ptr<Listener> listener(create_listener(fdhints));
 
     // bind with master proxy (.. and create child proxies for new connections)
     int sock = listener->bind(port, 'L');
@@ -151,7 +206,7 @@ std::vector<std::unique_ptr<Listener>> NetworkServiceFactory::prepare_listener (
         }
 
         for(unsigned int i = 0; i < nthreads - 1 ; i++) {
-            std::unique_ptr<Listener> additional_listener(create_listener());
+            std::unique_ptr<Listener> additional_listener(create_listener(fdhints));
 
             if(additional_listener) {
                 auto cx = additional_listener->listen(sock, 'L');
@@ -172,4 +227,70 @@ std::vector<std::unique_ptr<Listener>> NetworkServiceFactory::prepare_listener (
 }
 
 
+template <class Listener>
+void NetworkServiceFactory::prepare_reuseport (std::vector<std::unique_ptr<Listener>>& vec_toret, unsigned short port,
+                                               std::string const &friendly_name, int sub_workers, bool cpu_steering,
+                                               std::function<Listener*(std::shared_ptr<FdQueue>)> const& create_listener,
+                                               std::function<void(Listener*, int)> const& attach_listener) {
+
+    auto const& log = NetworkServiceFactory::log();
+
+    auto const ncpus = std::max(std::thread::hardware_concurrency(), 1U);
+
+    // each listener owns its socket; kernel spreads connections among them, no userspace hand-off between acceptors
+    unsigned int nthreads = sub_workers > 0 ? sub_workers : ncpus;
+
+    if(cpu_steering and nthreads != ncpus) {
+        // steering program returns CPU number as socket index, group must contain exactly one socket per CPU
+        _war("%s: cpu steering requires one listener per CPU, using %d listeners", friendly_name.c_str(), ncpus);
+        nthreads = ncpus;
+    }
+
+    for(unsigned int i = 0; i < nthreads; i++) {
+
+        int sock = reuseport_socket(port);
+        if(sock < 0) {
+            std::stringstream ss;
+            ss << "error binding " << friendly_name << " (reuseport) on port: " << port;
+            auto err = ss.str();
+
+            _fat(err.c_str());
+            std::cerr << err.c_str() << std::endl;
+
+            throw sx::netservice_cannot_bind(err.c_str());
+        }
+
+        // own queue: connections accepted by this listener are handled only by its own sub-workers
+        std::unique_ptr<Listener> listener(create_listener(std::make_shared<FdQueue>()));
+        if(not listener) {
+            ::close(sock);
+            throw sx::netservice_error("cannot create reuseport acceptor");
+        }
+
+        locks::fd().insert(sock);
+        auto l_ = std::scoped_lock(*locks::fd().lock(sock));
+
+        if(not listener->listen(sock, 'L')) {
+            throw sx::netservice_error("cannot create reuseport acceptor context");
+        }
+        attach_listener(listener.get(), sock);
+
+        {
+            auto lc_ = std::scoped_lock(reuseport_lock());
+            reuseport_listeners()[listener.get()] = { sock, static_cast<int>(i % ncpus) };
+        }
+
+        _dia("%s: reuseport listener[%d] socket %d, acceptor cpu %d", friendly_name.c_str(), i, sock, i % ncpus);
+
+        vec_toret.emplace_back(std::move(listener));
+    }
+
+    if(cpu_steering and not vec_toret.empty()) {
+        auto first = reuseport_listener(vec_toret.front().get());
+        if(not first or not reuseport_cpu_steering(first->socket)) {
+            _war("%s: cannot attach cpu steering program, kernel will hash connections", friendly_name.c_str());
+        }
+    }
+}
+
 #endif
\ No newline at end of file
@@ -45,6 +45,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <cstdlib>
@@ -54,6 +55,8 @@
 #include <buffer.hpp>
 #include <shmtable.hpp>
 
+#include <policy/groupset.hpp>
+
 
 constexpr const char* AUTH_IP_MEM_NAME = "/smithproxy_auth_ok_%s";
 constexpr const std::size_t AUTH_IP_MEM_SIZE = 64*1024*1024;
@@ -68,6 +71,13 @@ constexpr const char* AUTH_TOKEN_MEM_NAME = "/smithproxy_auth_token_%s";
 constexpr const std::size_t AUTH_TOKEN_MEM_SIZE = AUTH_IP_MEM_SIZE;
 constexpr const char* AUTH_TOKEN_SEM_NAME = "/smithproxy_auth_token_%s.sem";
 
+// change log of all tables above, see shm/shmlog.hpp
+constexpr const char* AUTH_LOG_MEM_NAME = "/smithproxy_auth_log_%s";
+
+// lock-free generations of ip tables, see shm/shmsnapshot.hpp
+constexpr const char* AUTH_IP_SNAP_NAME = "/smithproxy_auth_snap_%s";
+constexpr const char* AUTH_IP6_SNAP_NAME = "/smithproxy_auth6_snap_%s";
+
 constexpr const std::size_t LOGON_INFO_IP_SZ = 4;
 constexpr const std::size_t LOGON_INFO_USERNAME_SZ = 64;
 constexpr const std::size_t LOGON_INFO_GROUPS_SZ = 128;
@@ -163,6 +173,22 @@ struct shm_logon_info_ : public shm_logon_info_base {
 using shm_logon_info = shm_logon_info_<4>;
 using shm_logon_info6 = shm_logon_info_<16>;
 
+// logon info which doesn't fit fixed shm_logon_info record (long username or groups)
+struct logon_info_ext : public shm_logon_info_base {
+    std::string ip_;
+    std::string username_;
+    std::string groups_;
+
+    logon_info_ext(std::string i, std::string u, std::string g) : ip_(std::move(i)), username_(std::move(u)), groups_(std::move(g)) {}
+    ~logon_info_ext() override = default;
+
+    std::string ip() override { return ip_; }
+    std::string username() override { return username_; }
+    std::string groups() override { return groups_; }
+
+    shm_logon_info_base* clone() const override { return new logon_info_ext(*this); }
+};
+
 // structure exchanged with backend daemon
 struct shm_logon_token {
     
@@ -230,6 +256,11 @@ struct IdentityInfoBase {
     std::string  groups;
     
     std::vector<std::string> groups_vec;
+    sx::auth::GroupSet group_set;   // groups_vec interned by AuthFactory
+    bool from_snapshot = false;     // last written from snapshot generation, which may also remove it
+
+    // full logon info, if it didn't fit into last_logon_info
+    std::shared_ptr<logon_info_ext> ext_logon_info;
     
     unsigned int rx_bytes = 0;
     unsigned int tx_bytes = 0;
@@ -253,8 +284,13 @@ struct IdentityInfoType : public IdentityInfoBase {
     
     IdentityInfoType() : IdentityInfoBase() {}
 
+    shm_logon_info_base const& logon_info() const {
+        if(ext_logon_info) return *ext_logon_info;
+        return last_logon_info;
+    }
+
     void update() override {
-        groups = last_logon_info.groups();
+        groups = ext_logon_info ? ext_logon_info->groups() : last_logon_info.groups();
         groups_vec.clear();
         
         int pos = 0;
@@ -0,0 +1,199 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <shm/shmlog.hpp>
+
+#include <chrono>
+#include <climits>
+#include <ctime>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    long futex(std::atomic<uint32_t>* addr, int op, uint32_t val, timespec const* ts) {
+        // not FUTEX_PRIVATE_FLAG: waiters and wakers are in different processes
+        return ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), op, val, ts, nullptr, 0);
+    }
+}
+
+ShmChangeLog::~ShmChangeLog() {
+    detach();
+}
+
+uint64_t ShmChangeLog::now_ns() {
+    timespec ts {};
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+bool ShmChangeLog::attach(std::string const& name, std::size_t capacity) {
+    if(attached()) return true;
+    if(capacity == 0) return false;
+
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+    if(fd < 0) return false;
+
+    auto const size = mapping_size(capacity);
+
+    struct stat st {};
+    if(::fstat(fd, &st) != 0 or (static_cast<std::size_t>(st.st_size) < size and ::ftruncate(fd, static_cast<off_t>(size)) != 0)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mem == MAP_FAILED) return false;
+
+    auto* h = static_cast<header_t*>(mem);
+
+    // zero-filled object is an empty log, first attaching process writes the layout
+    uint32_t expected = 0;
+    if(h->magic.compare_exchange_strong(expected, ~magic)) {
+        h->layout_version = layout_version;
+        h->capacity = static_cast<uint32_t>(capacity);
+        h->slot_size = sizeof(slot_t);
+        h->magic.store(magic, std::memory_order_release);
+    }
+    else {
+        for(int i = 0; i < 1000 and h->magic.load(std::memory_order_acquire) != magic; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // created by a different build, or with a bigger capacity than we mapped
+    if(h->magic.load(std::memory_order_acquire) != magic or h->layout_version != layout_version
+       or h->slot_size != sizeof(slot_t) or h->capacity == 0 or h->capacity > capacity) {
+        ::munmap(mem, size);
+        return false;
+    }
+
+    name_ = name;
+    mapped_ = size;
+    header_.store(h, std::memory_order_release);
+    return true;
+}
+
+void ShmChangeLog::detach() {
+    if(auto* h = header_.exchange(nullptr)) {
+        ::munmap(h, mapped_);
+        mapped_ = 0;
+    }
+}
+
+int64_t ShmChangeLog::append(kind_t kind, op_t op, void const* data, std::size_t len) {
+    auto* h = hdr();
+    if(not h or len > payload_max) return -1;
+
+    auto const seq = h->head.fetch_add(1, std::memory_order_acq_rel);
+    auto& slot = slots(h)[seq % h->capacity];
+
+    slot.stamp.store(2 * seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.kind = kind;
+    slot.op = op;
+    slot.len = static_cast<uint16_t>(len);
+    slot.stamp_ns = now_ns();
+    std::memcpy(slot.data, data, len);
+
+    slot.stamp.store(2 * seq + 2, std::memory_order_release);
+
+    h->notify.fetch_add(1, std::memory_order_seq_cst);
+    if(h->waiters.load(std::memory_order_seq_cst) > 0) {
+        futex(&h->notify, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+
+    return static_cast<int64_t>(seq);
+}
+
+bool ShmChangeLog::commit_overdue(uint64_t seq) const {
+    auto const now = now_ns();
+
+    if(uncommitted_seq_ != seq) {
+        uncommitted_seq_ = seq;
+        uncommitted_since_ns_ = now;
+        return false;
+    }
+
+    return now - uncommitted_since_ns_ >= commit_timeout_ns_;
+}
+
+bool ShmChangeLog::readable(header_t* h, uint64_t seen) const {
+    auto const head = h->head.load(std::memory_order_acquire);
+    if(head <= seen) return false;
+    if(head - seen > h->capacity) return true;
+
+    // committed, or already reused for a newer record
+    if(slots(h)[seen % h->capacity].stamp.load(std::memory_order_acquire) >= 2 * seen + 2) return true;
+
+    return commit_overdue(seen);
+}
+
+bool ShmChangeLog::wait(uint64_t seen, unsigned int timeout_ms) const {
+    auto* h = hdr();
+    if(not h) return false;
+
+    auto const n = h->notify.load(std::memory_order_seq_cst);
+    if(readable(h, seen)) return true;
+
+    // don't oversleep the commit timeout of a record we are already waiting for
+    uint64_t timeout_ns = timeout_ms * 1000000ULL;
+    if(uncommitted_seq_ == seen and seen < h->head.load(std::memory_order_acquire)) {
+        auto const waited = now_ns() - uncommitted_since_ns_;
+        timeout_ns = std::min(timeout_ns, commit_timeout_ns_ > waited ? commit_timeout_ns_ - waited : 0);
+    }
+
+    timespec ts {};
+    ts.tv_sec = static_cast<time_t>(timeout_ns / 1000000000ULL);
+    ts.tv_nsec = static_cast<long>(timeout_ns % 1000000000ULL);
+
+    // writer bumps notify before checking waiters: either it sees us, or futex sees changed value
+    h->waiters.fetch_add(1, std::memory_order_seq_cst);
+    futex(&h->notify, FUTEX_WAIT, n, &ts);
+    h->waiters.fetch_sub(1, std::memory_order_seq_cst);
+
+    return readable(h, seen);
+}
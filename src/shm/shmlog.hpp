@@ -0,0 +1,225 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef SHMLOG_HPP
+#define SHMLOG_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Append-only change log of identity tables, living in its own shared memory object next to them.
+// Writers update the table first, then append a record describing the change and wake readers blocked
+// in wait() through a futex placed in the shared memory (works across unrelated processes, unlike eventfd
+// which would need descriptor passing). Readers apply records in sequence order; when they fall behind more
+// than the log capacity, they do a full table reload and continue from the current head.
+// A writer may die between reserving a record and committing it. Readers wait for such a record at most
+// commit_timeout(), then handle it as an overrun and skip it.
+
+class ShmChangeLog {
+public:
+    // IP4, IP6 and TOKEN carry fixed table records, IDENTITY carries encoded ShmIdentityRecord
+    enum class kind_t : uint8_t { NONE = 0, IP4 = 1, IP6 = 2, TOKEN = 3, IDENTITY = 4 };
+    enum class op_t : uint8_t { UPSERT = 1, REMOVE = 2 };
+
+    static constexpr uint32_t magic = 0x5358434cU;       // "SXCL"
+    static constexpr uint32_t layout_version = 1;
+    static constexpr std::size_t payload_max = 576;      // largest table record (token)
+    static constexpr std::size_t default_capacity = 16384;
+    static constexpr unsigned int default_commit_timeout_ms = 2000;
+
+    struct entry {
+        uint64_t seq;
+        kind_t kind;
+        op_t op;
+        uint64_t stamp_ns;      // CLOCK_MONOTONIC of append()
+        std::string_view data;
+    };
+
+    struct read_result {
+        uint64_t next = 0;      // first sequence not read yet
+        std::size_t applied = 0;
+        bool overrun = false;   // records were lost, reload the full table and continue from @next
+        bool abandoned = false; // overrun caused by record @next-1, which was never committed
+    };
+
+    ShmChangeLog() = default;
+    ~ShmChangeLog();
+
+    ShmChangeLog(ShmChangeLog const&) = delete;
+    ShmChangeLog& operator=(ShmChangeLog const&) = delete;
+
+    // map (and create, if missing) shared memory object @name
+    bool attach(std::string const& name, std::size_t capacity = default_capacity);
+    void detach();
+    bool attached() const { return hdr() != nullptr; }
+    std::string const& name() const { return name_; }
+
+    // returns sequence number of the record, or -1 if not attached or @len is too long
+    int64_t append(kind_t kind, op_t op, void const* data, std::size_t len);
+
+    // call @fn(entry const&) for committed records starting with @from
+    template<typename F>
+    read_result read(uint64_t from, F&& fn) const;
+
+    // block up to @timeout_ms until record @seen is readable (committed, lost, or abandoned by its writer),
+    // true if it is
+    bool wait(uint64_t seen, unsigned int timeout_ms) const;
+
+    // how long readers wait for a reserved record to be committed
+    void commit_timeout(unsigned int ms) { commit_timeout_ns_ = ms * 1000000ULL; }
+
+    uint64_t head() const { auto* h = hdr(); return h ? h->head.load(std::memory_order_acquire) : 0; }
+    std::size_t capacity() const { auto* h = hdr(); return h ? h->capacity : 0; }
+
+    static uint64_t now_ns();
+
+protected:
+    struct header_t {
+        std::atomic<uint32_t> magic;
+        uint32_t layout_version;
+        uint32_t capacity;
+        uint32_t slot_size;
+
+        alignas(64) std::atomic<uint64_t> head;         // next sequence to reserve
+        alignas(64) std::atomic<uint32_t> notify;       // futex word, bumped after each commit
+        std::atomic<uint32_t> waiters;
+    };
+
+    // per-slot seqlock: stamp is 2*seq+1 while being written, 2*seq+2 once committed
+    struct alignas(64) slot_t {
+        std::atomic<uint64_t> stamp;
+        kind_t kind;
+        op_t op;
+        uint16_t len;
+        uint32_t reserved;
+        uint64_t stamp_ns;
+        unsigned char data[payload_max];
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory atomics must be lock free");
+
+    static std::size_t mapping_size(std::size_t capacity) { return sizeof(header_t) + capacity * sizeof(slot_t); }
+    static slot_t* slots(header_t* h) { return reinterpret_cast<slot_t*>(reinterpret_cast<unsigned char*>(h) + sizeof(header_t)); }
+
+    // attach may race with readers and writers in other threads
+    header_t* hdr() const { return header_.load(std::memory_order_acquire); }
+
+private:
+    // record @seq is reserved, but not committed: true once it stays so for longer than commit timeout
+    bool commit_overdue(uint64_t seq) const;
+    bool readable(header_t* h, uint64_t seen) const;
+
+    // reader side, one reading thread per instance
+    mutable uint64_t uncommitted_seq_ = UINT64_MAX;
+    mutable uint64_t uncommitted_since_ns_ = 0;
+    uint64_t commit_timeout_ns_ = default_commit_timeout_ms * 1000000ULL;
+
+    std::string name_;
+    std::atomic<header_t*> header_ {nullptr};
+    std::size_t mapped_ = 0;
+};
+
+
+template<typename F>
+ShmChangeLog::read_result ShmChangeLog::read(uint64_t from, F&& fn) const {
+    read_result ret;
+    ret.next = from;
+
+    auto* h = hdr();
+    if(not h) return ret;
+
+    auto const head = h->head.load(std::memory_order_acquire);
+    auto const cap = h->capacity;
+
+    if(head < from or head - from > cap) {
+        ret.next = head;
+        ret.overrun = true;
+        return ret;
+    }
+
+    unsigned char copy[payload_max];
+
+    for(auto seq = from; seq < head; ++seq) {
+        auto const& slot = slots(h)[seq % cap];
+        auto const committed = 2 * seq + 2;
+
+        auto const st = slot.stamp.load(std::memory_order_acquire);
+        if(st < committed) {                // reserved, but not committed yet
+            if(not commit_overdue(seq)) break;
+
+            // its writer is gone, the change it made to the table is picked up by reload
+            ret.next = seq + 1;
+            ret.overrun = true;
+            ret.abandoned = true;
+            return ret;
+        }
+        if(st > committed) {                // already reused for a newer record
+            ret.next = h->head.load(std::memory_order_acquire);
+            ret.overrun = true;
+            return ret;
+        }
+
+        auto const kind = slot.kind;
+        auto const op = slot.op;
+        auto const stamp_ns = slot.stamp_ns;
+        std::size_t const len = std::min<std::size_t>(slot.len, payload_max);
+        std::memcpy(copy, slot.data, len);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(slot.stamp.load(std::memory_order_relaxed) != st) {
+            ret.next = h->head.load(std::memory_order_acquire);
+            ret.overrun = true;
+            return ret;
+        }
+
+        fn(entry { seq, kind, op, stamp_ns, std::string_view(reinterpret_cast<char const*>(copy), len) });
+        ret.next = seq + 1;
+        ++ret.applied;
+    }
+
+    return ret;
+}
+
+#endif //SHMLOG_HPP
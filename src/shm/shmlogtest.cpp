@@ -0,0 +1,183 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+/*
+ *  Identity change log stress test: forked writers append logon records, this process applies them
+ *  and reports propagation latency (append -> applied by reader).
+ *
+ *  Compile and link:
+ *  g++ -I.. shmlogtest.cpp shmlog.cpp -std=c++17 -O2 -o shmlogtest -pthread -lrt
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <shm/shmlog.hpp>
+
+// same layout as shm_logon_info: address, username, groups
+constexpr std::size_t RECORD_SZ = 4 + 64 + 128;
+
+
+void writer(std::string const& name, int id, int records, int interval_us) {
+    ShmChangeLog log;
+    if(not log.attach(name)) {
+        printf("writer %d: cannot attach %s\n", id, name.c_str());
+        _exit(1);
+    }
+
+    unsigned char rec[RECORD_SZ];
+    for(int i = 0; i < records; ++i) {
+        memset(rec, 0, sizeof(rec));
+
+        in_addr a {};
+        a.s_addr = htonl(0x0a000000U + static_cast<uint32_t>(id) * 0x10000U + static_cast<uint32_t>(i % 0x10000));
+        memcpy(rec, &a, sizeof(a));
+        snprintf(reinterpret_cast<char*>(&rec[4]), 63, "stress_%d_%d", id, i);
+        snprintf(reinterpret_cast<char*>(&rec[4 + 64]), 127, "users+group%d", i % 50);
+
+        log.append(ShmChangeLog::kind_t::IP4, i % 10 == 9 ? ShmChangeLog::op_t::REMOVE : ShmChangeLog::op_t::UPSERT,
+                   rec, sizeof(rec));
+
+        if(interval_us > 0) usleep(interval_us);
+    }
+    _exit(0);
+}
+
+
+void help() {
+    printf("Usage: shmlogtest [writers] [records per writer] [interval between records in us]\n");
+}
+
+
+int main(int argc, char** argv) {
+
+    int const writers = argc > 1 ? atoi(argv[1]) : 4;
+    int const records = argc > 2 ? atoi(argv[2]) : 50000;
+    int const interval_us = argc > 3 ? atoi(argv[3]) : 20;
+
+    if(writers <= 0 or records <= 0 or interval_us < 0) {
+        help();
+        return 1;
+    }
+
+    std::string const name = "/smithproxy_auth_log_stress_" + std::to_string(getpid());
+
+    ShmChangeLog log;
+    if(not log.attach(name)) {
+        printf("cannot attach %s\n", name.c_str());
+        return 1;
+    }
+
+    printf("smithproxy identity change log stress test: %d writers, %d records each, %d us interval, capacity %zu\n",
+           writers, records, interval_us, log.capacity());
+
+    std::vector<pid_t> pids;
+    for(int i = 0; i < writers; ++i) {
+        pid_t p = fork();
+        if(p == 0) writer(name, i, records, interval_us);
+        if(p > 0) pids.push_back(p);
+    }
+
+    std::vector<uint64_t> latency;
+    latency.reserve(static_cast<std::size_t>(writers) * records);
+
+    uint64_t const total = static_cast<uint64_t>(writers) * records;
+    uint64_t seen = 0;
+    uint64_t received = 0;
+    uint64_t overruns = 0;
+    uint64_t wakeups = 0;
+
+    auto const t0 = ShmChangeLog::now_ns();
+    while(received < total) {
+        if(not log.wait(seen, 1000)) {
+            if(ShmChangeLog::now_ns() - t0 > 60ULL * 1000000000ULL) break;
+            continue;
+        }
+        ++wakeups;
+
+        auto r = log.read(seen, [&](ShmChangeLog::entry const& e) {
+            latency.push_back(ShmChangeLog::now_ns() - e.stamp_ns);
+        });
+        if(r.overrun) {
+            // lost records would be recovered by full table reload in smithproxy
+            ++overruns;
+            received += r.next - seen;
+        }
+        else if(r.applied == 0) {
+            // head moved, but the writer didn't commit its record yet
+            sched_yield();
+        }
+        received += r.applied;
+        seen = r.next;
+    }
+    auto const secs = static_cast<double>(ShmChangeLog::now_ns() - t0) / 1e9;
+
+    for(auto p: pids) waitpid(p, nullptr, 0);
+    shm_unlink(name.c_str());
+
+    if(latency.empty()) {
+        printf("no records received\n");
+        return 1;
+    }
+
+    std::sort(latency.begin(), latency.end());
+    auto pct = [&latency](double p) {
+        return static_cast<double>(latency[std::min(latency.size() - 1, static_cast<std::size_t>(p * latency.size()))]) / 1000.0;
+    };
+
+    printf("records: %zu applied / %lu appended in %.2f s (%.0f records/s), reader wakeups: %lu, overruns: %lu\n",
+           latency.size(), static_cast<unsigned long>(total), secs, static_cast<double>(latency.size()) / secs,
+           static_cast<unsigned long>(wakeups), static_cast<unsigned long>(overruns));
+    printf("propagation latency: p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+           pct(0.5), pct(0.99), pct(0.999), static_cast<double>(latency.back()) / 1000.0);
+
+    return 0;
+}
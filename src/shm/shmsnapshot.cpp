@@ -0,0 +1,379 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#include <shm/shmsnapshot.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    // serialized record: family, 3 bytes padding, username length, groups length, address, username, groups
+    constexpr std::size_t record_header_sz = 12;
+
+    struct writer_lock {
+        int fd;
+        bool locked;
+        explicit writer_lock(int f, bool wait = true) : fd(f), locked(::flock(f, wait ? LOCK_EX : LOCK_EX | LOCK_NB) == 0) {}
+        ~writer_lock() { if(locked) ::flock(fd, LOCK_UN); }
+    };
+}
+
+bool ShmIdentityRecord::make(ShmIdentityRecord& rec, std::string const& ip, std::string username, std::string groups) {
+    if(::inet_pton(AF_INET, ip.c_str(), rec.addr.data()) == 1) {
+        rec.family = AF_INET;
+    }
+    else if(::inet_pton(AF_INET6, ip.c_str(), rec.addr.data()) == 1) {
+        rec.family = AF_INET6;
+    }
+    else {
+        return false;
+    }
+
+    rec.username = std::move(username);
+    rec.groups = std::move(groups);
+    return true;
+}
+
+std::string ShmIdentityRecord::ip() const {
+    char b[INET6_ADDRSTRLEN] {};
+    ::inet_ntop(family == AF_INET6 ? AF_INET6 : AF_INET, addr.data(), b, sizeof(b));
+    return b;
+}
+
+void ShmIdentityRecord::encode(std::string& out) const {
+    unsigned char hdr[record_header_sz] {};
+    hdr[0] = static_cast<unsigned char>(family == AF_INET6 ? 6 : 4);
+
+    auto const ulen = static_cast<uint32_t>(username.size());
+    auto const glen = static_cast<uint32_t>(groups.size());
+    std::memcpy(&hdr[4], &ulen, sizeof(ulen));
+    std::memcpy(&hdr[8], &glen, sizeof(glen));
+
+    out.append(reinterpret_cast<char const*>(hdr), sizeof(hdr));
+    out.append(reinterpret_cast<char const*>(addr.data()), addr_len());
+    out.append(username);
+    out.append(groups);
+}
+
+std::size_t ShmIdentityRecord::decode(char const* data, std::size_t len) {
+    if(len < record_header_sz) return 0;
+
+    if(data[0] == 4) family = AF_INET;
+    else if(data[0] == 6) family = AF_INET6;
+    else return 0;
+
+    uint32_t ulen = 0;
+    uint32_t glen = 0;
+    std::memcpy(&ulen, &data[4], sizeof(ulen));
+    std::memcpy(&glen, &data[8], sizeof(glen));
+
+    std::size_t const total = record_header_sz + addr_len() + ulen + glen;
+    if(total > len) return 0;
+
+    auto const* p = data + record_header_sz;
+    addr.fill(0);
+    std::memcpy(addr.data(), p, addr_len());
+    p += addr_len();
+    username.assign(p, ulen);
+    p += ulen;
+    groups.assign(p, glen);
+
+    return total;
+}
+
+
+ShmSnapshotTable::~ShmSnapshotTable() {
+    detach();
+}
+
+bool ShmSnapshotTable::attach(std::string const& name) {
+    if(attached()) return true;
+
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+    if(fd < 0) return false;
+
+    struct stat st {};
+    if(::fstat(fd, &st) != 0 or (static_cast<std::size_t>(st.st_size) < sizeof(control_t) and ::ftruncate(fd, sizeof(control_t)) != 0)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mem = ::mmap(nullptr, sizeof(control_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(mem == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+
+    auto* c = static_cast<control_t*>(mem);
+
+    uint32_t expected = 0;
+    if(c->magic.compare_exchange_strong(expected, ~magic)) {
+        c->layout_version = layout_version;
+        c->magic.store(magic, std::memory_order_release);
+    }
+    else {
+        for(int i = 0; i < 1000 and c->magic.load(std::memory_order_acquire) != magic; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    if(c->magic.load(std::memory_order_acquire) != magic or c->layout_version != layout_version) {
+        ::munmap(mem, sizeof(control_t));
+        ::close(fd);
+        return false;
+    }
+
+    name_ = name;
+    fd_ = fd;
+    ctl_.store(c, std::memory_order_release);
+    return true;
+}
+
+void ShmSnapshotTable::detach() {
+    if(auto* c = ctl_.exchange(nullptr)) {
+        ::munmap(c, sizeof(control_t));
+    }
+    if(fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+std::string ShmSnapshotTable::data_name(uint64_t generation) const {
+    return name_ + "." + std::to_string(generation);
+}
+
+uint64_t ShmSnapshotTable::generation() const {
+    uint64_t gen = 0;
+    uint64_t size = 0;
+    return read_current(gen, size) ? gen : 0;
+}
+
+bool ShmSnapshotTable::read_current(uint64_t& generation, uint64_t& size) const {
+    auto* c = ctl_.load(std::memory_order_acquire);
+    if(not c) return false;
+
+    for(int i = 0; i < 64; ++i) {
+        auto const s1 = c->seq.load(std::memory_order_acquire);
+        if(s1 & 1) {
+            sched_yield();
+            continue;
+        }
+
+        generation = c->generation.load(std::memory_order_relaxed);
+        size = c->size.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(c->seq.load(std::memory_order_relaxed) == s1) return true;
+    }
+
+    return false;
+}
+
+ShmSnapshotTable::load_t ShmSnapshotTable::load(uint64_t& seen, std::vector<ShmIdentityRecord>& out) const {
+
+    // generation object can be unlinked between reading control and opening it: retry with newer one
+    for(int attempt = 0; attempt < 8; ++attempt) {
+        uint64_t gen = 0;
+        uint64_t size = 0;
+
+        if(not read_current(gen, size)) return load_t::BUSY;
+        if(gen == 0) return load_t::EMPTY;
+        if(gen == seen) return load_t::UNCHANGED;
+
+        if(load_generation(gen, size, out) == load_t::LOADED) {
+            seen = gen;
+            return load_t::LOADED;
+        }
+    }
+
+    return load_t::BUSY;
+}
+
+ShmSnapshotTable::load_t ShmSnapshotTable::load_generation(uint64_t generation, uint64_t size, std::vector<ShmIdentityRecord>& out) const {
+
+    if(size < sizeof(data_header_t) or size > max_size) return load_t::BUSY;
+
+    int fd = ::shm_open(data_name(generation).c_str(), O_RDONLY, 0);
+    if(fd < 0) return load_t::BUSY;
+
+    struct stat st {};
+    if(::fstat(fd, &st) != 0 or static_cast<uint64_t>(st.st_size) < size) {
+        ::close(fd);
+        return load_t::BUSY;
+    }
+
+    void* mem = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mem == MAP_FAILED) return load_t::BUSY;
+
+    auto const* base = static_cast<char const*>(mem);
+    data_header_t hdr {};
+    std::memcpy(&hdr, base, sizeof(hdr));
+
+    auto ret = load_t::BUSY;
+    if(hdr.magic == magic and hdr.layout_version == layout_version and hdr.generation == generation
+       and hdr.bytes <= size - sizeof(hdr)) {
+
+        std::vector<ShmIdentityRecord> records;
+        records.reserve(std::min<uint64_t>(hdr.count, hdr.bytes / record_header_sz));
+
+        auto const* p = base + sizeof(hdr);
+        auto left = hdr.bytes;
+        for(uint64_t i = 0; i < hdr.count; ++i) {
+            ShmIdentityRecord rec;
+            auto const n = rec.decode(p, left);
+            if(n == 0) break;
+
+            records.emplace_back(std::move(rec));
+            p += n;
+            left -= n;
+        }
+
+        if(records.size() == hdr.count) {
+            out = std::move(records);
+            ret = load_t::LOADED;
+        }
+    }
+
+    ::munmap(mem, size);
+    return ret;
+}
+
+uint64_t ShmSnapshotTable::publish(std::vector<ShmIdentityRecord> const& records) {
+    if(not attached()) return 0;
+
+    writer_lock l(fd_);
+    if(not l.locked) return 0;
+
+    return publish_locked(records);
+}
+
+uint64_t ShmSnapshotTable::update(std::function<bool(std::vector<ShmIdentityRecord>&)> const& fn) {
+    if(not attached()) return 0;
+
+    writer_lock l(fd_);
+    if(not l.locked) return 0;
+
+    return update_locked(fn);
+}
+
+uint64_t ShmSnapshotTable::try_update(std::function<bool(std::vector<ShmIdentityRecord>&)> const& fn) {
+    if(not attached()) return 0;
+
+    writer_lock l(fd_, false);
+    if(not l.locked) return 0;
+
+    return update_locked(fn);
+}
+
+uint64_t ShmSnapshotTable::update_locked(std::function<bool(std::vector<ShmIdentityRecord>&)> const& fn) {
+    std::vector<ShmIdentityRecord> records;
+    uint64_t seen = 0;
+    if(load(seen, records) == load_t::BUSY) return 0;
+
+    if(not fn(records)) return seen;
+
+    return publish_locked(records);
+}
+
+uint64_t ShmSnapshotTable::publish_locked(std::vector<ShmIdentityRecord> const& records) {
+    auto* c = ctl_.load(std::memory_order_acquire);
+
+    std::string blob(sizeof(data_header_t), '\0');
+    for(auto const& rec: records) rec.encode(blob);
+    if(blob.size() > max_size) return 0;
+
+    // previous writer died in the middle of switch
+    auto seq = c->seq.load(std::memory_order_relaxed);
+    if(seq & 1) c->seq.store(++seq, std::memory_order_release);
+
+    auto const gen = c->generation.load(std::memory_order_relaxed) + 1;
+
+    data_header_t hdr { magic, layout_version, gen, records.size(), blob.size() - sizeof(data_header_t) };
+    std::memcpy(blob.data(), &hdr, sizeof(hdr));
+
+    int fd = ::shm_open(data_name(gen).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if(fd < 0) return 0;
+
+    std::size_t written = 0;
+    while(written < blob.size()) {
+        auto const n = ::write(fd, blob.data() + written, blob.size() - written);
+        if(n <= 0) break;
+        written += static_cast<std::size_t>(n);
+    }
+    ::close(fd);
+
+    if(written != blob.size()) {
+        ::shm_unlink(data_name(gen).c_str());
+        return 0;
+    }
+
+    c->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    c->generation.store(gen, std::memory_order_relaxed);
+    c->size.store(blob.size(), std::memory_order_relaxed);
+    c->seq.store(seq + 2, std::memory_order_release);
+
+    // keep previous generation for readers which already read control, but didn't open it yet
+    if(gen > 2) ::shm_unlink(data_name(gen - 2).c_str());
+
+    return gen;
+}
+
+void ShmSnapshotTable::unlink(std::string const& name) {
+    {
+        ShmSnapshotTable t;
+        if(t.attach(name)) {
+            auto const gen = t.generation();
+            for(uint64_t g = gen > 2 ? gen - 2 : 1; g <= gen; ++g) ::shm_unlink(t.data_name(g).c_str());
+        }
+    }
+    ::shm_unlink(name.c_str());
+}
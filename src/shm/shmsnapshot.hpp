@@ -0,0 +1,145 @@
+/*
+    Smithproxy- transparent proxy with SSL inspection capabilities.
+    Copyright (c) 2014, Ales Stibal <astib@mag0.net>, All rights reserved.
+
+    Smithproxy is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Smithproxy is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Smithproxy.  If not, see <http://www.gnu.org/licenses/>.
+
+    Linking Smithproxy statically or dynamically with other modules is
+    making a combined work based on Smithproxy. Thus, the terms and
+    conditions of the GNU General Public License cover the whole combination.
+
+    In addition, as a special exception, the copyright holders of Smithproxy
+    give you permission to combine Smithproxy with free software programs
+    or libraries that are released under the GNU LGPL and with code
+    included in the standard release of OpenSSL under the OpenSSL's license
+    (or modified versions of such code, with unchanged license).
+    You may copy and distribute such a system following the terms
+    of the GNU GPL for Smithproxy and the licenses of the other code
+    concerned, provided that you include the source code of that other code
+    when and as the GNU GPL requires distribution of source code.
+
+    Note that people who make modified versions of Smithproxy are not
+    obligated to grant this special exception for their modified versions;
+    it is their choice whether to do so. The GNU General Public License
+    gives permission to release a modified version without this exception;
+    this exception also makes it possible to release a modified version
+    which carries forward this exception.
+*/
+
+#ifndef SHMSNAPSHOT_HPP
+#define SHMSNAPSHOT_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+// Identity record without fixed field sizes: username and groups can be of any length.
+struct ShmIdentityRecord {
+    int family = 0;                         // AF_INET or AF_INET6
+    std::array<uint8_t, 16> addr {};        // network order, first 4 bytes for AF_INET
+    std::string username;
+    std::string groups;                     // '+' separated
+
+    static bool make(ShmIdentityRecord& rec, std::string const& ip, std::string username, std::string groups);
+    std::string ip() const;
+    std::size_t addr_len() const { return family == AF_INET6 ? 16 : 4; }
+
+    // append serialized record to @out
+    void encode(std::string& out) const;
+    // parse record from @data, returns consumed bytes or 0 on malformed input
+    std::size_t decode(char const* data, std::size_t len);
+};
+
+
+// Identity table published into shared memory as immutable generations.
+//
+// Control object @name holds generation number and size of current data object "@name.<generation>",
+// both guarded by a seqlock. Writer builds the complete new generation in a fresh object, then switches
+// control fields over: readers never take a lock and always see either the old or the new generation
+// complete. Writers serialize only among themselves (flock on control object), and each generation is sized
+// to its content - there is no fixed segment size, nor fixed record layout.
+class ShmSnapshotTable {
+public:
+    enum class load_t { UNCHANGED, LOADED, EMPTY, BUSY };
+
+    static constexpr uint32_t magic = 0x53585354U;      // "SXST"
+    static constexpr uint32_t layout_version = 1;
+    static constexpr uint64_t max_size = 4ULL * 1024 * 1024 * 1024;
+
+    ShmSnapshotTable() = default;
+    ~ShmSnapshotTable();
+
+    ShmSnapshotTable(ShmSnapshotTable const&) = delete;
+    ShmSnapshotTable& operator=(ShmSnapshotTable const&) = delete;
+
+    bool attach(std::string const& name);
+    void detach();
+    bool attached() const { return ctl_.load(std::memory_order_acquire) != nullptr; }
+    std::string const& name() const { return name_; }
+
+    // 0 if nothing was published yet
+    uint64_t generation() const;
+
+    // readers: load current generation into @out if it differs from @seen, never blocks
+    load_t load(uint64_t& seen, std::vector<ShmIdentityRecord>& out) const;
+
+    // writers: publish @records as new generation, returns it or 0 on error
+    uint64_t publish(std::vector<ShmIdentityRecord> const& records);
+
+    // writers: load current generation, let @fn modify it and publish result (unless @fn returns false)
+    uint64_t update(std::function<bool(std::vector<ShmIdentityRecord>&)> const& fn);
+
+    // writers: as update(), but returns 0 instead of waiting for other writer to finish
+    uint64_t try_update(std::function<bool(std::vector<ShmIdentityRecord>&)> const& fn);
+
+    // remove all generations and control object
+    static void unlink(std::string const& name);
+
+private:
+    struct control_t {
+        std::atomic<uint32_t> magic;
+        uint32_t layout_version;
+        std::atomic<uint64_t> seq;          // odd while generation/size are being switched
+        std::atomic<uint64_t> generation;
+        std::atomic<uint64_t> size;
+    };
+
+    struct data_header_t {
+        uint32_t magic;
+        uint32_t layout_version;
+        uint64_t generation;
+        uint64_t count;
+        uint64_t bytes;                     // of records following the header
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+
+    std::string data_name(uint64_t generation) const;
+    bool read_current(uint64_t& generation, uint64_t& size) const;
+    load_t load_generation(uint64_t generation, uint64_t size, std::vector<ShmIdentityRecord>& out) const;
+    uint64_t publish_locked(std::vector<ShmIdentityRecord> const& records);
+    uint64_t update_locked(std::function<bool(std::vector<ShmIdentityRecord>&)> const& fn);
+
+    std::string name_;
+    int fd_ = -1;
+    std::atomic<control_t*> ctl_ {nullptr};
+};
+
+#endif //SHMSNAPSHOT_HPP
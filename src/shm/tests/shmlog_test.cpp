@@ -0,0 +1,131 @@
+#include <shm/shmlog.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+    std::string test_name(char const* what) {
+        return "/sx_shmlog_test_" + std::string(what) + "_" + std::to_string(::getpid());
+    }
+
+    struct unlink_guard {
+        std::string name;
+        ~unlink_guard() { ::shm_unlink(name.c_str()); }
+    };
+
+    using kind_t = ShmChangeLog::kind_t;
+    using op_t = ShmChangeLog::op_t;
+
+    // writer which dies right after reserving a record
+    struct DeadWriterLog : public ShmChangeLog {
+        void reserve() { hdr()->head.fetch_add(1, std::memory_order_acq_rel); }
+    };
+}
+
+TEST(ShmChangeLog, AppendRead) {
+    unlink_guard g { test_name("rw") };
+
+    ShmChangeLog writer, reader;
+    ASSERT_TRUE(writer.attach(g.name, 64));
+    ASSERT_TRUE(reader.attach(g.name, 64));
+
+    for(int i = 0; i < 10; ++i) {
+        auto const s = std::to_string(i);
+        EXPECT_EQ(writer.append(kind_t::IP4, i % 2 ? op_t::REMOVE : op_t::UPSERT, s.data(), s.size()), i);
+    }
+    EXPECT_EQ(writer.append(kind_t::IP4, op_t::UPSERT, "x", ShmChangeLog::payload_max + 1), -1);
+
+    std::vector<std::string> seen;
+    auto r = reader.read(3, [&](ShmChangeLog::entry const& e) {
+        EXPECT_EQ(e.kind, kind_t::IP4);
+        EXPECT_EQ(e.op, e.seq % 2 ? op_t::REMOVE : op_t::UPSERT);
+        seen.emplace_back(e.data);
+    });
+
+    EXPECT_FALSE(r.overrun);
+    EXPECT_EQ(r.next, 10U);
+    EXPECT_EQ(r.applied, 7U);
+    ASSERT_EQ(seen.size(), 7U);
+    EXPECT_EQ(seen.front(), "3");
+    EXPECT_EQ(seen.back(), "9");
+}
+
+TEST(ShmChangeLog, Overrun) {
+    unlink_guard g { test_name("overrun") };
+
+    ShmChangeLog log;
+    ASSERT_TRUE(log.attach(g.name, 16));
+    for(int i = 0; i < 40; ++i) log.append(kind_t::IP6, op_t::UPSERT, &i, sizeof(i));
+
+    auto r = log.read(10, [](ShmChangeLog::entry const&) { FAIL(); });
+    EXPECT_TRUE(r.overrun);
+    EXPECT_EQ(r.next, 40U);
+
+    // after resync reader continues from head
+    log.append(kind_t::IP6, op_t::REMOVE, "a", 1);
+    r = log.read(r.next, [](ShmChangeLog::entry const& e) { EXPECT_EQ(e.data, "a"); });
+    EXPECT_FALSE(r.overrun);
+    EXPECT_EQ(r.applied, 1U);
+}
+
+TEST(ShmChangeLog, WaitWakes) {
+    unlink_guard g { test_name("wait") };
+
+    ShmChangeLog writer, reader;
+    ASSERT_TRUE(writer.attach(g.name, 64));
+    ASSERT_TRUE(reader.attach(g.name, 64));
+
+    EXPECT_FALSE(reader.wait(0, 10));
+
+    std::thread t([&writer]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        writer.append(kind_t::TOKEN, op_t::UPSERT, "tok", 3);
+    });
+
+    auto const t0 = std::chrono::steady_clock::now();
+    EXPECT_TRUE(reader.wait(0, 5000));
+    EXPECT_LT(std::chrono::steady_clock::now() - t0, std::chrono::seconds(2));
+    t.join();
+}
+
+TEST(ShmChangeLog, AbandonedRecord) {
+    unlink_guard g { test_name("abandoned") };
+
+    DeadWriterLog writer;
+    ShmChangeLog reader;
+    ASSERT_TRUE(writer.attach(g.name, 64));
+    ASSERT_TRUE(reader.attach(g.name, 64));
+    reader.commit_timeout(200);
+
+    writer.append(kind_t::IP4, op_t::UPSERT, "a", 1);
+    writer.reserve();
+    writer.append(kind_t::IP4, op_t::UPSERT, "c", 1);
+
+    auto r = reader.read(0, [](ShmChangeLog::entry const& e) { EXPECT_EQ(e.data, "a"); });
+    EXPECT_EQ(r.next, 1U);
+    EXPECT_FALSE(r.overrun);
+
+    // committed record behind the uncommitted one doesn't make it readable, but its commit timeout does
+    auto const t0 = std::chrono::steady_clock::now();
+    EXPECT_FALSE(reader.wait(r.next, 50));
+    EXPECT_GE(std::chrono::steady_clock::now() - t0, std::chrono::milliseconds(40));
+    EXPECT_TRUE(reader.wait(r.next, 5000));
+    EXPECT_LT(std::chrono::steady_clock::now() - t0, std::chrono::seconds(2));
+
+    r = reader.read(r.next, [](ShmChangeLog::entry const&) { FAIL(); });
+    EXPECT_TRUE(r.overrun);
+    EXPECT_TRUE(r.abandoned);
+    EXPECT_EQ(r.next, 2U);
+
+    r = reader.read(r.next, [](ShmChangeLog::entry const& e) { EXPECT_EQ(e.data, "c"); });
+    EXPECT_FALSE(r.overrun);
+    EXPECT_EQ(r.applied, 1U);
+    EXPECT_EQ(r.next, 3U);
+}
@@ -0,0 +1,208 @@
+#include <shm/shmsnapshot.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <unistd.h>
+
+namespace {
+    std::string test_name(char const* what) {
+        return "/sx_shmsnap_test_" + std::string(what) + "_" + std::to_string(::getpid());
+    }
+
+    struct unlink_guard {
+        std::string name;
+        ~unlink_guard() { ShmSnapshotTable::unlink(name); }
+    };
+
+    ShmIdentityRecord rec4(uint32_t i, std::string user, std::string groups) {
+        ShmIdentityRecord r;
+        r.family = AF_INET;
+        uint32_t const a = htonl(0x0a000000U + i);
+        std::memcpy(r.addr.data(), &a, sizeof(a));
+        r.username = std::move(user);
+        r.groups = std::move(groups);
+        return r;
+    }
+
+    using load_t = ShmSnapshotTable::load_t;
+}
+
+TEST(ShmSnapshotTable, PublishLoad) {
+    unlink_guard g { test_name("pl") };
+
+    ShmSnapshotTable writer, reader;
+    ASSERT_TRUE(writer.attach(g.name));
+    ASSERT_TRUE(reader.attach(g.name));
+
+    uint64_t seen = 0;
+    std::vector<ShmIdentityRecord> out;
+    EXPECT_EQ(reader.load(seen, out), load_t::EMPTY);
+
+    ShmIdentityRecord v6;
+    ASSERT_TRUE(ShmIdentityRecord::make(v6, "2001:db8::1", "bob", "admins"));
+    EXPECT_FALSE(ShmIdentityRecord::make(v6, "not an address", "", ""));
+
+    // no fixed 64/128 byte limits
+    std::string const long_user(1000, 'u');
+    std::string long_groups;
+    for(int i = 0; i < 500; ++i) long_groups += "group" + std::to_string(i) + "+";
+
+    EXPECT_EQ(writer.publish({ rec4(1, "alice", "users+admins"), v6, rec4(2, long_user, long_groups) }), 1U);
+
+    EXPECT_EQ(reader.load(seen, out), load_t::LOADED);
+    EXPECT_EQ(seen, 1U);
+    ASSERT_EQ(out.size(), 3U);
+    EXPECT_EQ(out[0].ip(), "10.0.0.1");
+    EXPECT_EQ(out[0].groups, "users+admins");
+    EXPECT_EQ(out[1].ip(), "2001:db8::1");
+    EXPECT_EQ(out[1].username, "bob");
+    EXPECT_EQ(out[2].username, long_user);
+    EXPECT_EQ(out[2].groups, long_groups);
+
+    EXPECT_EQ(reader.load(seen, out), load_t::UNCHANGED);
+
+    // update: remove one, keep the rest
+    EXPECT_EQ(writer.update([](std::vector<ShmIdentityRecord>& recs) {
+        recs.erase(recs.begin());
+        return true;
+    }), 2U);
+    EXPECT_EQ(reader.load(seen, out), load_t::LOADED);
+    EXPECT_EQ(out.size(), 2U);
+
+    // older generations are cleaned up
+    for(int i = 0; i < 5; ++i) writer.publish(out);
+    EXPECT_EQ(writer.generation(), 7U);
+    EXPECT_EQ(reader.load(seen, out), load_t::LOADED);
+}
+
+TEST(ShmSnapshotTable, BeyondFixedSegment) {
+    unlink_guard g { test_name("big") };
+
+    ShmSnapshotTable t;
+    ASSERT_TRUE(t.attach(g.name));
+
+    // ~80MB, more than fixed 64MB segment of shared_table
+    std::vector<ShmIdentityRecord> recs;
+    std::string const groups(380, 'g');
+    for(uint32_t i = 0; i < 200000; ++i) recs.emplace_back(rec4(i, "user" + std::to_string(i), groups));
+
+    ASSERT_EQ(t.publish(recs), 1U);
+
+    uint64_t seen = 0;
+    std::vector<ShmIdentityRecord> out;
+    ASSERT_EQ(t.load(seen, out), load_t::LOADED);
+    ASSERT_EQ(out.size(), recs.size());
+    EXPECT_EQ(out.back().username, "user199999");
+}
+
+// Slow writer holds writer lock while readers keep loading: they must not wait for it, and must
+// never see a mix of two generations.
+TEST(ShmSnapshotTable, SlowWriterDoesNotBlockReaders) {
+    unlink_guard g { test_name("slow") };
+
+    ShmSnapshotTable writer;
+    ASSERT_TRUE(writer.attach(g.name));
+
+    auto make_gen = [](uint64_t gen) {
+        std::vector<ShmIdentityRecord> recs;
+        for(uint32_t i = 0; i < 1000; ++i) recs.emplace_back(rec4(i, "user" + std::to_string(i), "gen" + std::to_string(gen)));
+        return recs;
+    };
+    writer.publish(make_gen(1));
+
+    std::atomic_bool stop = false;
+    std::atomic_uint64_t loads = 0;
+    std::atomic_uint64_t torn = 0;
+    std::atomic<int64_t> max_load_us = 0;
+
+    std::vector<std::thread> readers;
+    for(int r = 0; r < 4; ++r) {
+        readers.emplace_back([&]() {
+            ShmSnapshotTable t;
+            if(not t.attach(g.name)) return;
+
+            while(not stop) {
+                uint64_t seen = 0;
+                std::vector<ShmIdentityRecord> out;
+
+                auto const t0 = std::chrono::steady_clock::now();
+                auto const res = t.load(seen, out);
+                auto const us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+
+                if(res != load_t::LOADED) continue;
+                ++loads;
+                if(us > max_load_us) max_load_us = us;
+
+                for(auto const& rec: out) {
+                    if(rec.groups != "gen" + std::to_string(seen)) { ++torn; break; }
+                }
+            }
+        });
+    }
+
+    for(uint64_t gen = 2; gen <= 6; ++gen) {
+        writer.update([&](std::vector<ShmIdentityRecord>& recs) {
+            // writer spends a long time holding its lock
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            recs = make_gen(gen);
+            return true;
+        });
+    }
+
+    stop = true;
+    for(auto& t: readers) t.join();
+
+    EXPECT_EQ(torn.load(), 0U);
+    EXPECT_GT(loads.load(), 5U);
+    EXPECT_LT(max_load_us.load(), 100000);   // shorter than a single writer's critical section
+
+    std::cout << "snapshot readers: " << loads.load() << " loads during 500ms of writer lock held, max load "
+              << max_load_us.load() << " us\n";
+}
+
+TEST(ShmSnapshotTable, TryUpdateDoesNotWait) {
+    unlink_guard g { test_name("try") };
+
+    ShmSnapshotTable slow, other;
+    ASSERT_TRUE(slow.attach(g.name));
+    ASSERT_TRUE(other.attach(g.name));
+    slow.publish({ rec4(1, "a", "g") });
+
+    std::atomic_bool locked = false;
+    std::thread t([&]() {
+        slow.update([&](std::vector<ShmIdentityRecord>& recs) {
+            locked = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            recs.emplace_back(rec4(2, "b", "g"));
+            return true;
+        });
+    });
+    while(not locked) std::this_thread::yield();
+
+    auto remove_first = [](std::vector<ShmIdentityRecord>& recs) {
+        recs.erase(recs.begin());
+        return true;
+    };
+
+    auto const t0 = std::chrono::steady_clock::now();
+    EXPECT_EQ(other.try_update(remove_first), 0U);
+    EXPECT_LT(std::chrono::steady_clock::now() - t0, std::chrono::milliseconds(100));
+    t.join();
+
+    EXPECT_EQ(other.try_update(remove_first), 3U);
+
+    uint64_t seen = 0;
+    std::vector<ShmIdentityRecord> out;
+    ASSERT_EQ(other.load(seen, out), load_t::LOADED);
+    ASSERT_EQ(out.size(), 1U);
+    EXPECT_EQ(out.front().username, "b");
+}